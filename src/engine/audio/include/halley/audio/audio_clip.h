@@ -40,6 +40,7 @@ namespace Halley
 		static std::shared_ptr<AudioClip> loadResource(ResourceLoader& loader);
 		constexpr static AssetType getAssetType() { return AssetType::AudioClip; }
 		void reload(Resource&& resource) override;
+		ResourceMemoryUsage getMemoryUsage() const override;
 
 	private:
 		size_t sampleLength = 0;
@@ -164,6 +164,16 @@ void AudioClip::reload(Resource&& resource)
 	*this = std::move(dynamic_cast<AudioClip&>(resource));
 }
 
+ResourceMemoryUsage AudioClip::getMemoryUsage() const
+{
+	// Samples are decoded on another thread, and streamed clips only keep a small buffer around
+	ResourceMemoryUsage usage;
+	if (isLoaded() && !streaming) {
+		usage.ramUsage = size_t(numChannels) * sampleLength * sizeof(AudioConfig::SampleFormat);
+	}
+	return usage;
+}
+
 StreamingAudioClip::StreamingAudioClip(uint8_t numChannels)
 	: numChannels(numChannels)
 {
@@ -77,6 +77,7 @@ namespace Halley
 
 		void pumpEvents(Time time);
 		void pumpAudio();
+		void pumpMainThreadTasks();
 
 		void setupTimers();
 		const StopwatchRollingAveraging& getTimer(CoreAPITimer timer, TimeLine tl) const;
@@ -70,6 +70,7 @@ namespace Halley
 		Material(const Material& other);
 		Material(Material&& other) noexcept;
 		explicit Material(std::shared_ptr<const MaterialDefinition> materialDefinition, bool forceLocalBlocks = false); // forceLocalBlocks is for engine use only
+		~Material();
 
 		void bind(int pass, Painter& painter);
 		void uploadData(Painter& painter);
@@ -107,6 +108,10 @@ namespace Halley
 
 		uint64_t getHash() const;
 
+		// Orders materials by definition (shader and blend), then textures, then uniform data, so sorting by it groups the costliest state changes
+		// Equal materials always have equal keys; recomputed along with the hash, only when the material changes
+		uint64_t getSortKey() const;
+
 	private:
 		std::shared_ptr<const MaterialDefinition> materialDefinition;
 		
@@ -117,6 +122,7 @@ namespace Halley
 		std::array<bool, 8> passEnabled;
 
 		mutable uint64_t hashValue = 0;
+		mutable uint64_t sortKey = 0;
 		mutable bool needToUpdateHash = true;
 		bool needToUploadData = true;
 
@@ -125,6 +131,8 @@ namespace Halley
 
 		bool setUniform(int blockNumber, size_t offset, ShaderParameterType type, const void* data);
 		uint64_t computeHash() const;
+		uint64_t computeSortKey() const;
+		void updateHash() const;
 
 		const std::shared_ptr<const Texture>& getFallbackTexture() const;
 	};
@@ -143,6 +143,7 @@ namespace Halley
 		int semanticIndex = 0;
 		int location = 0;
 		int offset = 0;
+		bool instanced = false; // Read once per instance, rather than per vertex, when drawing instanced
 
 		MaterialAttribute();
 		MaterialAttribute(String name, ShaderParameterType type, int location, int offset = 0);
@@ -190,6 +191,9 @@ namespace Halley
 		size_t getVertexSize() const;
 		size_t getVertexStride() const;
 		size_t getVertexPosOffset() const;
+
+		// Instanced materials ("instanced: true") can have sprites drawn as a single record each, see Painter::drawSprites
+		bool isInstanced() const;
 		const Vector<MaterialAttribute>& getAttributes() const { return attributes; }
 		const Vector<MaterialUniformBlock>& getUniformBlocks() const { return uniformBlocks; }
 		const Vector<MaterialTexture>& getTextures() const { return textures; }
@@ -216,6 +220,8 @@ namespace Halley
 		int vertexPosOffset = 0;
 		int defaultMask = 1;
 		bool columnMajor = false;
+		bool instanced = false;
+		bool hasVertexPos = false;
 
 		std::shared_ptr<const Texture> fallbackTexture;
 
@@ -4,7 +4,10 @@
 #include "halley/maths/colour.h"
 #include "graphics_enums.h"
 #include <condition_variable>
+#include <functional>
+#include <optional>
 #include <halley/maths/vector4.h>
+#include <halley/data_structures/frame_allocator.h>
 
 namespace Halley
 {
@@ -14,8 +17,33 @@ namespace Halley
 	class MaterialDefinition;
 	class Camera;
 	class RenderContext;
+	class RenderCommandList;
 	class Core;
 
+	struct LineShape
+	{
+		gsl::span<const Vector2f> points;
+		float width = 1.0f;
+		Colour4f colour;
+		bool loop = false;
+	};
+
+	struct CircleShape
+	{
+		Vector2f centre;
+		Vector2f radius; // Different x and y radii make an ellipse
+		float width = 1.0f;
+		Colour4f colour;
+		std::optional<std::pair<Angle1f, Angle1f>> arc; // From and to angles, or a full circle if not set
+	};
+
+	struct RectShape
+	{
+		Rect4f rect;
+		float width = 1.0f;
+		Colour4f colour;
+	};
+
 	class Painter
 	{
 		friend class RenderContext;
@@ -32,9 +60,23 @@ namespace Halley
 		};
 
 	public:
+		// Counters for one frame, kept from startRender to the next
+		struct FrameStats {
+			size_t drawCalls = 0;
+			size_t vertices = 0;
+			size_t triangles = 0;
+			size_t mergedMaterialChanges = 0;
+			size_t scratchBytes = 0;
+			size_t peakScratchBytes = 0; // Highest scratch usage of any frame so far, which the frame allocator keeps capacity for
+		};
+
 		Painter(Resources& resources);
 		virtual ~Painter();
 
+		// Core calls these around each frame; anything driving a painter without Core (e.g. headless tests) calls them itself
+		void startRender();
+		void endRender();
+
 		void flush();
 
 		Rect4i getViewPort() const { return viewPort; }
@@ -57,8 +99,13 @@ namespace Halley
 
 		// Draw sprites takes a single vertex per sprite, duplicates the data across multiple vertices, and draws
 		// vertPosOffset is the offset, in bytes, from the start of each vertex's data, to a Vector2f which will be filled with the vertex's position in 0-1 space.
+		// With instanced materials, on backends that support it, the single vertex is uploaded as is and the backend expands it instead
 		void drawSprites(const std::shared_ptr<Material>& material, size_t numSprites, const void* vertexData);
 
+		// Same as above, but takes a pointer to the vertex data of each sprite
+		// Large spans are expanded on the CPU executors, each thread writing its own slice of the vertex and index buffers
+		void drawSprites(const std::shared_ptr<Material>& material, gsl::span<const void* const> vertexData);
+
 		// Draw one sliced sprite. Slices -> x = left, y = top, z = right, w = bottom, in [0..1] space relative to the texture
 		void drawSlicedSprite(const std::shared_ptr<Material>& material, Vector2f scale, Vector4f slices, const void* vertexData);
 
@@ -73,16 +120,42 @@ namespace Halley
 		// Rect drawing
 		void drawRect(Rect4f rect, float width, Colour4f colour, std::shared_ptr<Material> material = {});
 
+		// Batched versions of the above, which tessellate all shapes straight into as few draws as possible, in parallel for large batches
+		// Circles with the same number of segments share a cached unit circle
+		void drawLines(gsl::span<const LineShape> lines, std::shared_ptr<Material> material = {});
+		void drawCircles(gsl::span<const CircleShape> circles, std::shared_ptr<Material> material = {});
+		void drawRects(gsl::span<const RectShape> rects, std::shared_ptr<Material> material = {});
+
+		// While recording, draw calls are stored in the list instead of being sent to the GPU
+		void startRecording(RenderCommandList& list);
+		void stopRecording();
+		bool isRecording() const { return recording != nullptr; }
+
+		// Replays a recorded list, using its stored vertex and index data as-is
+		void draw(const RenderCommandList& list);
+
 		size_t getNumDrawCalls() const { return nDrawCalls; }
 		size_t getNumVertices() const { return nVertices; }
 		size_t getNumTriangles() const { return nTriangles; }
+		size_t getNumMergedMaterialChanges() const { return nMergedMaterialChanges; } // Material changes that didn't need a new draw call, as the materials were equal
+
+		const FrameStats& getPrevFrameStats() const { return prevStats; }
+		size_t getPrevDrawCalls() const { return prevStats.drawCalls; }
+		size_t getPrevVertices() const { return prevStats.vertices; }
+		size_t getPrevTriangles() const { return prevStats.triangles; }
+		size_t getPrevMergedMaterialChanges() const { return prevStats.mergedMaterialChanges; }
+		size_t getPrevScratchBytes() const { return prevStats.scratchBytes; }
+		size_t getPeakScratchBytes() const { return frameAllocator.getPeakUsed(); }
 
-		size_t getPrevDrawCalls() const { return prevDrawCalls; }
-		size_t getPrevVertices() const { return prevVertices; }
-		size_t getPrevTriangles() const { return prevTriangles; }
+		// Scratch memory for the current frame, reset at the start of each render
+		FrameAllocator& getFrameAllocator() { return frameAllocator; }
 
 		void setLogging(bool logging);
 
+		// Instancing is on by default where the backend supports it; turning it off makes all sprites expand on the CPU
+		void setInstancingEnabled(bool enabled);
+		bool isInstancingEnabled() const;
+
 	protected:
 		virtual void startDrawCall() {}
 		virtual void endDrawCall() {}
@@ -91,6 +164,21 @@ namespace Halley
 		virtual void setVertices(const MaterialDefinition& material, size_t numVertices, void* vertexData, size_t numIndices, IndexType* indices, bool standardQuadsOnly) = 0;
 		virtual void drawTriangles(size_t numIndices) = 0;
 
+		// Backends that can expand instances into quads override these three
+		// Each instance is a vertex of the material, except for its vertPos attribute, which the backend supplies for each corner
+		// The default setInstances and drawInstancedQuads expand the quads on the CPU and draw them through setVertices and drawTriangles
+		virtual bool supportsInstancing() const { return false; }
+		virtual void setInstances(const MaterialDefinition& material, size_t numInstances, void* instanceData);
+		virtual void drawInstancedQuads(size_t numInstances);
+
+		// Backends that can keep a whole RenderCommandList in GPU buffers override these four, so replaying it uploads its geometry once
+		// setListVertices points the material's attributes at a command's vertices, at a byte offset into the list's vertex data
+		// Instanced commands are then drawn with drawInstancedQuads, everything else with drawListTriangles
+		virtual bool supportsListUpload() const { return false; }
+		virtual void setListData(gsl::span<const char> vertexData, gsl::span<const IndexType> indices);
+		virtual void setListVertices(const MaterialDefinition& material, size_t vertexOffset, bool instanced);
+		virtual void drawListTriangles(size_t firstIndex, size_t numIndices);
+
 		virtual void setViewPort(Rect4i rect) = 0;
 		virtual void setClip(Rect4i clip, bool enable) = 0;
 
@@ -112,39 +200,49 @@ namespace Halley
 		size_t bytesPending = 0;
 		size_t indicesPending = 0;
 		bool allIndicesAreQuads = true;
+		bool instancesPending = false;
+		bool instancingEnabled = true;
 		Vector<char> vertexBuffer;
 		Vector<IndexType> indexBuffer;
 		std::shared_ptr<Material> materialPending;
 		std::shared_ptr<Material> solidLineMaterial;
+		RenderCommandList* recording = nullptr;
 
 		size_t nDrawCalls = 0;
 		size_t nVertices = 0;
 		size_t nTriangles = 0;
-		size_t prevDrawCalls = 0;
-		size_t prevVertices = 0;
-		size_t prevTriangles = 0;
+		size_t nMergedMaterialChanges = 0;
+		FrameStats prevStats;
 		bool logging = true;
 
+		FrameAllocator frameAllocator;
+
 		Vector<IndexType> stdQuadIndexCache;
+		Vector<Vector<Vector2f>> unitCircles; // Indexed by number of points
 		std::optional<Rect4i> curClip;
 		std::optional<Rect4i> pendingClip;
 
 		void bind(RenderContext& context);
 		void unbind(RenderContext& context);
-		
-		void startRender();
-		void endRender();
-		
+
 		void resetPending();
 		void startDrawCall(const std::shared_ptr<Material>& material);
 		void flushPending();
-		void executeDrawPrimitives(Material& material, size_t numVertices, void* vertexData, gsl::span<const IndexType> indices, PrimitiveType primitiveType = PrimitiveType::Triangle);
+		void executeDrawPrimitives(Material& material, size_t numVertices, void* vertexData, gsl::span<const IndexType> indices, bool standardQuadsOnly, PrimitiveType primitiveType = PrimitiveType::Triangle);
+		void executeDrawInstances(Material& material, size_t numInstances, void* instanceData);
+		void executeDrawListCommand(Material& material, size_t vertexOffset, size_t numVertices, size_t firstIndex, size_t numIndices, bool instanced);
 
 		void makeSpaceForPendingVertices(size_t numBytes);
 		void makeSpaceForPendingIndices(size_t numIndices);
 		PainterVertexData addDrawData(const std::shared_ptr<Material>& material, size_t numVertices, size_t numIndices, bool standardQuadsOnly);
+		PainterVertexData addInstanceData(const std::shared_ptr<Material>& material, size_t numInstances);
+		bool canDrawInstanced(const Material& material) const;
 
 		IndexType* getStandardQuadIndices(size_t numQuads);
+		gsl::span<const Vector2f> getUnitCircle(size_t nPoints);
+
+		void drawLineBatch(const std::shared_ptr<Material>& material, gsl::span<const LineShape> lines, size_t nSegments);
+		void forEachSlice(size_t numItems, size_t minItemsPerTask, const std::function<void(size_t, size_t)>& f); // Splits the items across the CPU executors, if there are enough of them
 		void generateQuadIndicesOffset(IndexType firstVertex, IndexType lineStride, IndexType* target);
 
 		void updateProjection();
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <memory>
+#include <optional>
+#include <gsl/gsl>
+#include <halley/data_structures/vector.h>
+#include "halley/maths/rect.h"
+#include "graphics_enums.h"
+
+namespace Halley
+{
+	class Material;
+	class Painter;
+
+	// The draw calls issued by a Painter while recording, with their materials, vertices, indices and clip
+	// Replaying it skips all CPU work that went into generating the geometry, so it suits static layers (e.g. tilemaps) that don't change often
+	// Vertices are kept in world space, so replaying follows the active camera; clip rectangles are stored in render target space
+	// Materials are held by reference, so changes to them show up on replay; anything else that changes should call invalidate()
+	class RenderCommandList
+	{
+	public:
+		void clear(); // Drops all commands and marks the list as not recorded
+		void invalidate(); // Same as clear, but keeps the buffers around for re-recording
+
+		bool isRecorded() const;
+		bool empty() const;
+
+		size_t getNumCommands() const;
+		size_t getNumVertices() const;
+		size_t getNumIndices() const;
+
+		void replay(Painter& painter) const;
+
+	private:
+		friend class Painter;
+
+		struct Command {
+			std::shared_ptr<Material> material;
+			std::optional<Rect4i> clip;
+			size_t vertexOffset; // In bytes
+			size_t vertexBytes;
+			size_t numVertices; // Number of instances, if instanced
+			size_t indexOffset;
+			size_t numIndices;
+			bool standardQuadsOnly;
+			bool instanced;
+		};
+
+		Vector<Command> commands;
+		Vector<char> vertexData;
+		Vector<IndexType> indexData;
+		size_t numVertices = 0;
+		bool recorded = false;
+
+		void addCommand(std::shared_ptr<Material> material, std::optional<Rect4i> clip, size_t numVertices, const char* vertices, size_t vertexBytes, gsl::span<const IndexType> indices, bool standardQuadsOnly, bool instanced);
+	};
+}
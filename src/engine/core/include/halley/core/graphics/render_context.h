@@ -5,12 +5,15 @@ namespace Halley
 {
 	class Camera;
 	class RenderTarget;
+	class RenderCommandList;
 
 	class RenderContext
 	{
 		friend class Core;
 
 	public:
+		RenderContext(Painter& painter, Camera& camera, RenderTarget& renderTarget);
+
 		void bind(const std::function<void(Painter&)>& f)
 		{
 			pushContext();
@@ -20,6 +23,12 @@ namespace Halley
 			popContext();
 		}
 
+		// Records everything drawn by f into list, instead of drawing it
+		void record(RenderCommandList& list, const std::function<void(Painter&)>& f);
+
+		// Replays list, recording it with f first if it's not recorded yet or has been invalidated
+		void replay(RenderCommandList& list, const std::function<void(Painter&)>& f);
+
 		RenderContext(RenderContext&& context) noexcept;
 
 		RenderContext with(Camera& camera) const;
@@ -27,6 +36,7 @@ namespace Halley
 		Camera& getCamera() const { return camera; }
 
 		RenderTarget& getDefaultRenderTarget();
+		FrameAllocator& getFrameAllocator() { return painter.getFrameAllocator(); } // Reset at the start of each frame
 
 		void flush();
 
@@ -37,7 +47,6 @@ namespace Halley
 
 		RenderContext* restore = nullptr;
 
-		RenderContext(Painter& painter, Camera& camera, RenderTarget& renderTarget);
 		void setActive();
 		void setInactive();
 		void pushContext();
@@ -4,17 +4,20 @@
 #include <halley/time/halleytime.h>
 
 namespace Halley {
-	class Random;
 	class Animation;
+	class Painter;
 	
 	class Particles {
-		struct Particle {
-			Vector2f pos;
-			Vector2f vel;
-			Angle1f angle;
-			float time = 0;
-			float ttl = 1;
-			bool alive = true;
+		// Small copyable generator, so every emitter has its own stream and emitters can be updated concurrently
+		class RNG {
+		public:
+			void setSeed(uint32_t seed);
+			float getFloat(float min, float max); // [min, max)
+			size_t getSizeT(size_t min, size_t max); // [min, max]
+
+		private:
+			uint32_t state[4] = { 1, 2, 3, 4 };
+			uint32_t getRawInt();
 		};
 		
 	public:
@@ -27,28 +30,46 @@ namespace Halley {
 		bool isEnabled() const;
 		void setSpawnRateMultiplier(float value);
 		float getSpawnRateMultiplier() const;
+		void setSeed(uint32_t seed);
 
 		void setPosition(Vector2f pos);
 		void update(Time t);
 
+		// Updates all emitters, spreading them across the CPU executors if there are enough of them
+		static void update(gsl::span<Particles* const> particles, Time t);
+
 		void setSprites(std::vector<Sprite> sprites);
 		void setAnimation(std::shared_ptr<const Animation> animation);
-		
-		[[nodiscard]] gsl::span<Sprite> getSprites();
+
+		size_t getNumParticles() const;
+
+		// Emits the quads of every live particle that overlaps the view straight into the painter
+		void draw(Painter& painter, const std::optional<Rect4f>& clip = {}) const; // Culls against the painter's camera
+		void draw(Painter& painter, Rect4f view, const std::optional<Rect4f>& clip = {}) const;
+
+		// Builds a Sprite for every live particle, prefer draw() or SpritePainter::add() which avoid that
+		// The sprites are rebuilt on every call, so they're read-only; change the particles through setSprites instead
 		[[nodiscard]] gsl::span<const Sprite> getSprites() const;
 
 	private:
-		Random* rng;
-		std::shared_ptr<Material> material;
+		RNG rng;
 
 		bool enabled = true;
 		float spawnRateMultiplier = 1.0f;
 
-		std::vector<Sprite> sprites;
-		std::vector<Particle> particles;
+		// Structure of arrays, with capacity always a multiple of 4 so the SIMD kernels can run on whole lanes
+		std::vector<float> posX;
+		std::vector<float> posY;
+		std::vector<float> velX;
+		std::vector<float> velY;
+		std::vector<float> angles; // In radians
+		std::vector<float> times;
+		std::vector<float> ttls;
+		std::vector<uint32_t> spriteIndices; // Into baseSprites
 		size_t nParticlesAlive = 0;
-		size_t nParticlesVisible = 0;
 		float pendingSpawn = 0;
+
+		mutable std::vector<Sprite> sprites;
 		
 		float spawnRate = 100;
 		Vector2f spawnArea;
@@ -70,8 +91,15 @@ namespace Halley {
 		void spawn(size_t n);
 		void initializeParticle(size_t index);
 		void updateParticles(float t);
+		void removeDeadParticles();
+		void reserve(size_t n);
+
+		bool isVisible() const;
+		float getAlpha(size_t index) const;
+		float getCullRadius(const Sprite& sprite) const;
+		void generateSprites() const;
 
-		Vector2f getSpawnPosition() const;
+		Vector2f getSpawnPosition();
 	};
 
 	class Resources;
@@ -37,6 +37,8 @@ namespace Halley
 
 	class Sprite
 	{
+		friend class Particles;
+
 	public:
 		Sprite();
 
@@ -52,6 +54,10 @@ namespace Halley
 		static void draw(const Sprite* sprites, size_t n, Painter& painter);
 		static void drawMixedMaterials(const Sprite* sprites, size_t n, Painter& painter);
 
+		// Draws, in order, every sprite that is in view
+		// Long runs of sprites that share a material and aren't sliced or clipped are culled and expanded on the CPU executors
+		static void drawInView(gsl::span<const Sprite> sprites, Painter& painter, Rect4f view, const std::optional<Rect4f>& clip = {});
+
 		Sprite& setMaterial(Resources& resources, String materialName = "");
 		Sprite& setMaterial(std::shared_ptr<Material> m, bool shared = true);
 		Sprite& setMaterial(std::unique_ptr<Material> m);
@@ -11,14 +11,17 @@ namespace Halley
 	class TextRenderer;
 	class String;
 	class Sprite;
+	class Particles;
 	class Painter;
+	class FrameAllocator;
 
 	enum class SpritePainterEntryType
 	{
 		SpriteRef,
 		SpriteCached,
 		TextRef,
-		TextCached
+		TextCached,
+		ParticlesRef
 	};
 
 	class SpritePainterEntry
@@ -26,14 +29,18 @@ namespace Halley
 	public:
 		SpritePainterEntry(gsl::span<const Sprite> sprites, int mask, int layer, float tieBreaker, std::optional<Rect4f> clip);
 		SpritePainterEntry(gsl::span<const TextRenderer> texts, int mask, int layer, float tieBreaker, std::optional<Rect4f> clip);
+		SpritePainterEntry(const Particles& particles, int mask, int layer, float tieBreaker, std::optional<Rect4f> clip);
 		SpritePainterEntry(SpritePainterEntryType type, size_t spriteIdx, size_t count, int mask, int layer, float tieBreaker, std::optional<Rect4f> clip);
 
 		bool operator<(const SpritePainterEntry& o) const;
+		uint64_t getSortKey() const; // Orders by layer, then tie breaker, like operator<
 		SpritePainterEntryType getType() const;
 		gsl::span<const Sprite> getSprites() const;
 		gsl::span<const TextRenderer> getTexts() const;
+		const Particles& getParticles() const;
 		uint32_t getIndex() const;
 		uint32_t getCount() const;
+		int getLayer() const;
 		int getMask() const;
 		const std::optional<Rect4f>& getClip() const;
 
@@ -60,15 +67,31 @@ namespace Halley
 		void addCopy(gsl::span<const Sprite> sprites, int mask, int layer, float tieBreaker, std::optional<Rect4f> clip = {});
 		void add(const TextRenderer& sprite, int mask, int layer, float tieBreaker, std::optional<Rect4f> clip = {});
 		void addCopy(const TextRenderer& text, int mask, int layer, float tieBreaker, std::optional<Rect4f> clip = {});
+		void add(const Particles& particles, int mask, int layer, float tieBreaker, std::optional<Rect4f> clip = {});
 		
 		void draw(int mask, Painter& painter);
 
+		// Entries in unordered layers ignore their tie breaker, and are drawn grouped by material to save draw calls
+		// Only for layers where draw order doesn't matter, e.g. sprites that never overlap
+		void setLayerUnordered(int layer, bool unordered);
+
 	private:
+		struct SortEntry {
+			uint64_t key;
+			uint64_t material; // Entries with equal keys are grouped by material sort key, so they can be batched together
+			uint32_t index;
+		};
+
 		Vector<SpritePainterEntry> sprites;
 		Vector<Sprite> cachedSprites;
 		Vector<TextRenderer> cachedText;
+		Vector<SortEntry> sortEntries;
+		Vector<int> unorderedLayers;
 		bool dirty = false;
 
+		void addEntry(SpritePainterEntry entry, uint64_t material);
+		void sortEntriesByKey(FrameAllocator& scratch);
+
 		void draw(gsl::span<const Sprite> sprite, Painter& painter, Rect4f view, const std::optional<Rect4f>& clip) const;
 		void draw(gsl::span<const TextRenderer> text, Painter& painter, Rect4f view, const std::optional<Rect4f>& clip) const;
 	};
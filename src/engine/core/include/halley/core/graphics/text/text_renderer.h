@@ -15,6 +15,7 @@ namespace Halley
 	class LocalisedString;
 	class Painter;
 	class Material;
+	class TextLayout;
 
 	using ColourOverride = std::pair<size_t, std::optional<Colour4f>>;
 
@@ -96,12 +97,17 @@ namespace Halley
 
 		std::vector<ColourOverride> colourOverrides;
 
+		mutable std::shared_ptr<const TextLayout> layout; // Shared with other renderers laying out the same text, see updateLayout()
 		mutable Vector<Sprite> spritesCache;
 		mutable bool materialDirty = true;
 		mutable bool glyphsDirty = true;
-		mutable bool positionDirty = true;
+
+		void updateLayout() const;
+		std::shared_ptr<TextLayout> generateLayout() const;
+		void drawGlyphs(Painter& painter) const;
 
 		std::shared_ptr<Material> getMaterial(const Font& font) const;
+		std::shared_ptr<Material> getMaterialForGlyphs(const Font& font) const;
 		void updateMaterial(Material& material, const Font& font) const;
 		void updateMaterialForFont(const Font& font) const;
 		void updateMaterials() const;
@@ -25,9 +25,12 @@ namespace Halley
 		Vector2i getSize() const { return size; }
 		const TextureDescriptor& getDescriptor() const { return descriptor; }
 
+		ResourceMemoryUsage getMemoryUsage() const override;
+
 	protected:
 		Vector2i size;
 		TextureDescriptor descriptor;
+		ResourceMemoryUsage loadedMemoryUsage;
 
 		virtual void doLoad(TextureDescriptor& descriptor);
 	};
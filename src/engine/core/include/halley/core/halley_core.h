@@ -15,6 +15,7 @@ namespace Halley {} // Get GitHub to realise this is C++ :3
 #include "graphics/blend.h"
 #include "graphics/painter.h"
 #include "graphics/render_context.h"
+#include "graphics/render_command_list.h"
 #include "graphics/shader.h"
 #include "graphics/texture.h"
 #include "graphics/texture_descriptor.h"
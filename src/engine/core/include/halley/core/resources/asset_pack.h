@@ -4,6 +4,10 @@
 #include <memory>
 #include <gsl/span>
 #include "halley/resources/resource_data.h"
+#include "halley/resources/metadata.h"
+#include "halley/data_structures/vector.h"
+#include "halley/text/string_converter.h"
+#include <mutex>
 
 namespace Halley {
 	enum class AssetType;
@@ -12,22 +16,62 @@ namespace Halley {
 	class AssetDatabase;
 	class ResourceData;
 	class ResourceDataReader;
+	class MemoryMappedFile;
+
+	enum class AssetPackCompression : uint32_t {
+		None,
+		Deflate
+	};
+
+	template <>
+	struct EnumNames<AssetPackCompression> {
+		constexpr std::array<const char*, 2> operator()() const {
+			return{{
+				"none",
+				"deflate"
+			}};
+		}
+	};
 
 	struct AssetPackHeader {
+		constexpr static uint32_t currentVersion = 2;
+		constexpr static size_t legacySize = 40; // Version 1 headers end right after dataStartPos
+
 		std::array<char, 8> identifier;
 		std::array<char, 16> iv;
-		uint64_t assetDbStartPos;
+		uint64_t assetDbStartPos; // From version 2 onwards, this is where the directory starts
 		uint64_t dataStartPos;
+		uint32_t version;
+		uint32_t numEntries;
+		uint64_t stringTableStartPos;
 
-		void init(size_t assetDbSize);
+		void init(size_t numEntries, size_t stringTableSize);
+		uint32_t getVersion() const;
 	};
 
+	// Directory entries are sorted by type and name hash, so they can be binary searched straight out of the file
+	struct AssetPackDirectoryEntry {
+		uint64_t nameHash;
+		uint32_t type;
+		uint32_t compression; // AssetPackCompression
+		uint64_t pos; // Relative to dataStartPos
+		uint64_t size;
+		uint32_t nameOffset; // Name and metadata are in the string table
+		uint32_t nameSize;
+		uint32_t metadataOffset;
+		uint32_t metadataSize;
+
+		static uint64_t hashName(const String& name);
+	};
+	static_assert(sizeof(AssetPackDirectoryEntry) == 48, "AssetPackDirectoryEntry is part of the pack format");
+
     class AssetPack {
     public:
 		AssetPack();
 		AssetPack(const AssetPack& other) = delete;
 		AssetPack(AssetPack&& other) noexcept;
 		AssetPack(std::unique_ptr<ResourceDataReader> reader, const String& encryptionKey = "", bool preLoad = false);
+		explicit AssetPack(std::shared_ptr<MemoryMappedFile> mapping, const String& encryptionKey = ""); // Encrypted packs are decrypted into memory, everything else is served straight from the mapping
 		~AssetPack();
 
 		AssetPack& operator=(const AssetPack& other) = delete;
@@ -39,8 +83,12 @@ namespace Halley {
 		const Bytes& getData() const;
 
 		Bytes writeOut() const;
+		void addAsset(AssetType type, const String& name, gsl::span<const gsl::byte> bytes, const Metadata& meta, AssetPackCompression compression = AssetPackCompression::None, int compressionLevel = -1); // Stored as-is if compressing doesn't make it smaller
 
 		std::unique_ptr<ResourceData> getData(const String& asset, AssetType type, bool stream);
+		const Metadata& getMetaData(const String& asset, AssetType type);
+		std::vector<String> getAssets() const;
+		uint32_t getVersion() const;
 
 		void readToMemory();
 		void encrypt(const String& key);
@@ -50,14 +98,36 @@ namespace Halley {
 
 		std::unique_ptr<ResourceDataReader> extractReader();
 
+		bool isMemoryMapped() const;
+
     private:
-		std::unique_ptr<AssetDatabase> assetDb;
+		mutable std::unique_ptr<AssetDatabase> assetDb; // Only built on request from version 2 packs
+		mutable std::mutex assetDbMutex;
 		std::unique_ptr<ResourceDataReader> reader;
+		std::shared_ptr<MemoryMappedFile> mapping;
+		uint32_t version = AssetPackHeader::currentVersion;
+		bool hasDirectory = false; // Packs built in memory, or read from version 1 files, use the asset database instead
+
+		Bytes directoryData; // Unless it's memory mapped
+		gsl::span<const AssetPackDirectoryEntry> directory;
+		gsl::span<const char> stringTable;
+		Vector<std::unique_ptr<Metadata>> metadata;
+		std::mutex metadataMutex;
 		std::atomic<bool> hasReader;
 		std::mutex readerMutex;
 		size_t dataOffset = 0;
 		Bytes data;
 		std::array<char, 16> iv;
+
+		void readHeader(const AssetPackHeader& header);
+		void readDirectory(const AssetPackHeader& header, gsl::span<const gsl::byte> bytes);
+		bool hasEncryption(const String& encryptionKey) const;
+
+		std::unique_ptr<ResourceData> getInflatedData(const String& path, size_t pos, size_t size, bool stream);
+
+		const AssetPackDirectoryEntry* findEntry(const String& asset, AssetType type) const;
+		String getName(const AssetPackDirectoryEntry& entry) const;
+		AssetDatabase& loadAssetDatabase() const;
     };
 
 
@@ -3,9 +3,14 @@
 #include <utility>
 #include <memory>
 #include <functional>
+#include <mutex>
+#include <atomic>
+#include <optional>
 #include <halley/text/halleystring.h>
+#include <halley/resources/resource.h>
 #include <halley/resources/resource_data.h>
 #include <halley/data_structures/hash_map.h>
+#include <halley/data_structures/vector.h>
 
 namespace Halley
 {
@@ -14,6 +19,15 @@ namespace Halley
 	class Resources;
 	class ResourceLoader;
 
+	struct ResourceCollectionStats
+	{
+		size_t numResources = 0;
+		size_t numEvictable = 0; // Loaded by the collection, only held by it and using some memory, so they can be evicted to stay within budget
+		size_t numEvicted = 0;
+		ResourceMemoryUsage memoryUsage;
+		std::optional<size_t> memoryBudget;
+	};
+
 	class ResourceCollectionBase
 	{
 		class Wrapper
@@ -22,18 +36,51 @@ namespace Halley
 			Wrapper(Wrapper&& other) noexcept
 				: res(std::move(other.res))
 				, depth(other.depth)
+				, memoryUsage(other.memoryUsage)
+				, lastUse(other.lastUse)
+				, evictable(other.evictable)
+				, loading(other.loading)
 			{}
 
-			Wrapper(std::shared_ptr<Resource> resource, int loadDepth)
+			Wrapper(std::shared_ptr<Resource> resource, int loadDepth, bool evictable = false)
 				: res(std::move(resource))
 				, depth(loadDepth)
+				, evictable(evictable)
 			{}
 
 			std::shared_ptr<Resource> res;
 			int depth;
+			ResourceMemoryUsage memoryUsage;
+			uint64_t lastUse = 0;
+			bool evictable; // Resources set from outside can't be loaded back, so they're never evicted
+			bool loading = false; // Still loading when stored, so its memory usage is measured again until it's done
+		};
+
+		// A load in progress, shared by every request for the same asset until it's done
+		// Asynchronous loads read their data on the disk IO executors and build the resource on the main thread, unless a synchronous get claims them first
+		class PendingLoad
+		{
+		public:
+			explicit PendingLoad(ResourceLoadPriority priority)
+				: claimed(false)
+				, priority(priority)
+			{}
+
+			Promise<std::shared_ptr<Resource>> promise; // Set to null if loading fails
+			Future<void> prefetching;
+			std::unique_ptr<ResourceDataStatic> prefetched;
+			std::atomic<bool> claimed;
+			ResourceLoadPriority priority;
 		};
 
 	public:
+		struct EvictionCandidate
+		{
+			uint64_t lastUse;
+			AssetType type;
+			String assetId;
+		};
+
 		using ResourceLoaderFunc = std::function<std::shared_ptr<Resource>(const String&, ResourceLoadPriority)>;
 		using ResourceEnumeratorFunc = std::function<std::vector<String>()>;
 
@@ -53,21 +100,49 @@ namespace Halley
 		void purge(const String& assetId);
 
 		std::shared_ptr<Resource> getUntyped(const String& name, ResourceLoadPriority priority = ResourceLoadPriority::Normal);
+		Future<std::shared_ptr<Resource>> getUntypedAsync(const String& name, ResourceLoadPriority priority = ResourceLoadPriority::Normal);
 
 		std::vector<String> enumerate() const;
 
+		// Budget, in bytes of RAM and VRAM combined, for resources of this type
+		// Going over it evicts the least recently used resources that nothing outside the collection is holding
+		void setMemoryBudget(std::optional<size_t> budget);
+		std::optional<size_t> getMemoryBudget() const;
+		ResourceMemoryUsage getMemoryUsage() const;
+		ResourceCollectionStats getStats();
+
+		void evictToBudget();
+		void getEvictionCandidates(Vector<EvictionCandidate>& dst);
+		size_t evict(const String& assetId); // Returns the number of bytes freed, if it was evicted
+
 	protected:
 		virtual std::shared_ptr<Resource> loadResource(ResourceLoader& loader) = 0;
 
 		std::shared_ptr<Resource> doGet(const String& name, ResourceLoadPriority priority);
-		std::shared_ptr<Resource> loadAsset(const String& assetId, ResourceLoadPriority priority);
+		std::shared_ptr<Resource> loadAsset(const String& assetId, ResourceLoadPriority priority, std::unique_ptr<ResourceDataStatic> prefetched = {});
 
 	private:
 		Resources& parent;
 		HashMap<String, Wrapper> resources;
+		HashMap<String, std::shared_ptr<PendingLoad>> pending;
+		mutable std::mutex mutex;
 		AssetType type;
 		ResourceLoaderFunc resourceLoader;
 		ResourceEnumeratorFunc resourceEnumerator;
+
+		ResourceMemoryUsage memoryUsage;
+		std::optional<size_t> memoryBudget;
+		size_t numEvicted = 0;
+		Vector<String> stillLoading; // Resources whose memory usage can still change
+
+		void prefetch(const String& assetId, PendingLoad& load);
+		std::shared_ptr<Resource> completeLoad(const String& assetId, PendingLoad& load);
+
+		void touch(Wrapper& wrapper);
+		bool isEvictable(const Wrapper& wrapper) const;
+		void addMemoryUsage(const String& assetId, Wrapper& wrapper);
+		void refreshMemoryUsage();
+		void eraseResource(HashMap<String, Wrapper>::iterator iter);
 	};
 
 	template <typename T>
@@ -85,6 +160,14 @@ namespace Halley
 			return std::static_pointer_cast<T>(doGet(assetId, priority));
 		}
 
+		Future<std::shared_ptr<const T>> getAsync(const String& assetId, ResourceLoadPriority priority = ResourceLoadPriority::Normal)
+		{
+			return getUntypedAsync(assetId, priority).then(Executors::getCPU(), [] (std::shared_ptr<Resource> res) -> std::shared_ptr<const T>
+			{
+				return std::static_pointer_cast<T>(res);
+			});
+		}
+
 	protected:
 		std::shared_ptr<Resource> loadResource(ResourceLoader& loader) override {
 			return T::loadResource(loader);
@@ -39,6 +39,8 @@ namespace Halley {
 		virtual ~IResourceLocatorProvider() {}
 		virtual std::unique_ptr<ResourceData> getData(const String& path, AssetType type, bool stream) = 0;
 		virtual const AssetDatabase& getAssetDatabase() = 0;
+		virtual std::vector<String> getAssets();
+		virtual const Metadata& getMetaData(const String& asset, AssetType type);
 		virtual int getPriority() const { return 0; }
 		virtual void purge(SystemAPI& system) = 0;
 	};
@@ -49,6 +51,7 @@ namespace Halley {
 		explicit ResourceLocator(SystemAPI& system);
 		void addFileSystem(const Path& path);
 		void addPack(const Path& path, const String& encryptionKey = "", bool preLoad = false, bool allowFailure = false, std::optional<int> priority = {});
+		void addMappedPack(const Path& path, const String& encryptionKey = "", bool allowFailure = false, std::optional<int> priority = {}); // Falls back to addPack if the platform can't map the file
 		std::vector<String> getAssetsFromPack(const Path& path, const String& encryptionKey = "") const;
 		void removePack(const Path& path);
 
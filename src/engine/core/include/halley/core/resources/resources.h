@@ -23,6 +23,9 @@
 
 #include <ctime>
 #include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <optional>
 #include <halley/support/exception.h>
 #include "halley/resources/resource.h"
 #include "resource_collection.h"
@@ -75,6 +78,12 @@ namespace Halley {
 			return of<T>().get(name, priority);
 		}
 
+		template <typename T>
+		Future<std::shared_ptr<const T>> getAsync(const String& name, ResourceLoadPriority priority = ResourceLoadPriority::Normal) const
+		{
+			return of<T>().getAsync(name, priority);
+		}
+
 		template <typename T>
 		void unload(const String& name) const
 		{
@@ -107,12 +116,35 @@ namespace Halley {
 		void reloadAssets(const std::vector<String>& ids); // ids are in "type:name" format
 		void reloadAssets(const std::map<AssetType, std::vector<String>>& byType);
 
+		// Loads assets in the background, one type at a time, in the same order as reloadAssets, so that their dependencies are loaded first
+		Future<void> preload(const std::vector<String>& ids, ResourceLoadPriority priority = ResourceLoadPriority::Normal); // ids are in "type:name" format
+		Future<void> preload(std::map<AssetType, std::vector<String>> byType, ResourceLoadPriority priority = ResourceLoadPriority::Normal);
+
 		const Options& getOptions() const { return options; }
 
+		// Budget, in bytes of RAM and VRAM combined, for all resources together or for a single type
+		// Loading past a budget evicts the least recently used resources that nothing but the cache is holding
+		void setMemoryBudget(std::optional<size_t> budget);
+		void setMemoryBudget(AssetType type, std::optional<size_t> budget);
+		std::optional<size_t> getMemoryBudget() const;
+		ResourceMemoryUsage getMemoryUsage() const;
+		std::map<AssetType, ResourceCollectionStats> getMemoryStats() const;
+		void enforceMemoryBudgets();
+
 	private:
 		const std::unique_ptr<ResourceLocator> locator;
 		Vector<std::unique_ptr<ResourceCollectionBase>> resources;
 		const HalleyAPI* const api;
 		Options options;
+
+		std::atomic<uint64_t> useCounter;
+		std::optional<size_t> memoryBudget;
+		mutable std::mutex budgetMutex;
+
+		using AssetsByType = std::map<AssetType, std::vector<String>>;
+
+		static AssetsByType groupByType(const std::vector<String>& ids);
+		void preloadType(std::shared_ptr<const AssetsByType> assets, AssetsByType::const_iterator cur, ResourceLoadPriority priority, Promise<void> promise);
+		void evictToBudget();
 	};
 }
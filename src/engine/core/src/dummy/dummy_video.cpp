@@ -116,6 +116,26 @@ void DummyPainter::setVertices(const MaterialDefinition&, size_t, void*, size_t,
 
 void DummyPainter::drawTriangles(size_t) {}
 
+bool DummyPainter::supportsInstancing() const
+{
+	return true;
+}
+
+void DummyPainter::setInstances(const MaterialDefinition&, size_t, void*) {}
+
+void DummyPainter::drawInstancedQuads(size_t) {}
+
+bool DummyPainter::supportsListUpload() const
+{
+	return true;
+}
+
+void DummyPainter::setListData(gsl::span<const char>, gsl::span<const IndexType>) {}
+
+void DummyPainter::setListVertices(const MaterialDefinition&, size_t, bool) {}
+
+void DummyPainter::drawListTriangles(size_t, size_t) {}
+
 void DummyPainter::setViewPort(Rect4i) {}
 
 void DummyPainter::setClip(Rect4i, bool) {}
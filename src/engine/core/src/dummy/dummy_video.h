@@ -60,6 +60,13 @@ namespace Halley {
 		void doEndRender() override;
 		void setVertices(const MaterialDefinition& material, size_t numVertices, void* vertexData, size_t numIndices, unsigned short* indices, bool standardQuadsOnly) override;
 		void drawTriangles(size_t numIndices) override;
+		bool supportsInstancing() const override;
+		void setInstances(const MaterialDefinition& material, size_t numInstances, void* instanceData) override;
+		void drawInstancedQuads(size_t numInstances) override;
+		bool supportsListUpload() const override;
+		void setListData(gsl::span<const char> vertexData, gsl::span<const IndexType> indices) override;
+		void setListVertices(const MaterialDefinition& material, size_t vertexOffset, bool instanced) override;
+		void drawListTriangles(size_t firstIndex, size_t numIndices) override;
 		void setViewPort(Rect4i rect) override;
 		void setClip(Rect4i clip, bool enable) override;
 		void setMaterialData(const Material& material) override;
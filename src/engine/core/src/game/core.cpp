@@ -309,6 +309,14 @@ void Core::pumpAudio()
 	}
 }
 
+void Core::pumpMainThreadTasks()
+{
+	// Continuations that need the main thread, such as building resources that finished loading asynchronously
+	// Capped, so a burst of them is spread over several frames instead of stalling one; anything left over runs next frame
+	constexpr auto maxTime = std::chrono::milliseconds(4);
+	Executors::getMainThread().runPending(maxTime);
+}
+
 void Core::setupTimers()
 {
 	const bool devMode = isDevMode();
@@ -371,6 +379,7 @@ void Core::doVariableUpdate(Time time)
 
 	engineTimer.beginSample();
 	pumpEvents(time);
+	pumpMainThreadTasks();
 	engineTimer.pause();
 	
 	gameTimer.beginSample();
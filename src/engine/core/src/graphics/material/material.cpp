@@ -132,6 +132,14 @@ Material::Material(Material&& other) noexcept
 	}
 }
 
+Material::~Material()
+{
+	// Another material could be allocated at the same address, and mistaken for this one by bind()
+	if (currentMaterial == this) {
+		resetBindCache();
+	}
+}
+
 Material::Material(std::shared_ptr<const MaterialDefinition> definition, bool forceLocalBlocks)
 	: materialDefinition(std::move(definition))
 {
@@ -300,6 +308,26 @@ uint64_t Material::computeHash() const
 	return hasher.digest();
 }
 
+uint64_t Material::computeSortKey() const
+{
+	// 16 bits of definition, 24 of textures and 24 of everything else
+	const auto& name = materialDefinition->getName();
+	const uint64_t definitionBits = Hash::hash(gsl::as_bytes(gsl::span<const char>(name.c_str(), name.size()))) & 0xFFFF;
+
+	// Asset ids rather than addresses, so the order doesn't change from run to run
+	Hash::Hasher hasher;
+	for (const auto& texture: textures) {
+		const auto& id = texture ? texture->getAssetId() : String();
+		hasher.feedBytes(gsl::as_bytes(gsl::span<const char>(id.c_str(), id.size())));
+		hasher.feed(uint8_t(0));
+	}
+	const uint64_t textureBits = hasher.digest() & 0xFFFFFF;
+
+	const uint64_t dataBits = hashValue & 0xFFFFFF;
+
+	return (definitionBits << 48) | (textureBits << 24) | dataBits;
+}
+
 const std::shared_ptr<const Texture>& Material::getFallbackTexture() const
 {
 	return materialDefinition->getFallbackTexture();
@@ -352,6 +380,9 @@ Material& Material::set(const String& name, const std::shared_ptr<const Texture>
 			if (textures[textureUnit] != texture) {
 				textures[textureUnit] = texture;
 				needToUpdateHash = true;
+				if (currentMaterial == this) {
+					resetBindCache();
+				}
 			}
 			return *this;
 		}
@@ -378,12 +409,26 @@ bool Material::hasParameter(const String& name) const
 uint64_t Material::getHash() const
 {
 	if (needToUpdateHash) {
-		hashValue = computeHash();
-		needToUpdateHash = false;
+		updateHash();
 	}
 	return hashValue;
 }
 
+uint64_t Material::getSortKey() const
+{
+	if (needToUpdateHash) {
+		updateHash();
+	}
+	return sortKey;
+}
+
+void Material::updateHash() const
+{
+	hashValue = computeHash();
+	sortKey = computeSortKey();
+	needToUpdateHash = false;
+}
+
 MaterialParameter& Material::getParameter(const String& name)
 {
 	for (auto& u : uniforms) {
@@ -73,6 +73,7 @@ void MaterialAttribute::serialize(Serializer& s) const
 	s << semanticIndex;
 	s << location;
 	s << offset;
+	s << instanced;
 }
 
 void MaterialAttribute::deserialize(Deserializer& s)
@@ -83,6 +84,7 @@ void MaterialAttribute::deserialize(Deserializer& s)
 	s >> semanticIndex;
 	s >> location;
 	s >> offset;
+	s >> instanced;
 }
 
 size_t MaterialAttribute::getAttributeSize(ShaderParameterType type)
@@ -173,6 +175,19 @@ void MaterialDefinition::load(const ConfigNode& root)
 	if (root.hasKey("textures")) {
 		loadTextures(root["textures"]);
 	}
+
+	if (root.hasKey("instanced")) {
+		instanced = root["instanced"].asBool();
+	}
+	if (instanced) {
+		// The vertPos attribute is the only one that changes across the quad, so it's supplied by the backend and everything else comes from the instance
+		if (!hasVertexPos) {
+			throw Exception("Instanced material \"" + name + "\" needs a vertPos attribute", HalleyExceptions::Resources);
+		}
+		for (auto& a: attributes) {
+			a.instanced = a.offset != vertexPosOffset;
+		}
+	}
 }
 
 int MaterialDefinition::getNumPasses() const
@@ -214,6 +229,11 @@ size_t MaterialDefinition::getVertexPosOffset() const
 	return size_t(vertexPosOffset);
 }
 
+bool MaterialDefinition::isInstanced() const
+{
+	return instanced;
+}
+
 const std::shared_ptr<const Texture>& MaterialDefinition::getFallbackTexture() const
 {
 	return fallbackTexture;
@@ -244,6 +264,7 @@ void MaterialDefinition::serialize(Serializer& s) const
 	s << vertexSize;
 	s << vertexPosOffset;
 	s << defaultMask;
+	s << instanced;
 }
 
 void MaterialDefinition::deserialize(Deserializer& s)
@@ -256,6 +277,7 @@ void MaterialDefinition::deserialize(Deserializer& s)
 	s >> vertexSize;
 	s >> vertexPosOffset;
 	s >> defaultMask;
+	s >> instanced;
 }
 
 bool MaterialDefinition::isColumnMajor() const
@@ -338,6 +360,7 @@ void MaterialDefinition::loadAttributes(const ConfigNode& node)
 
 		if (attribEntry["special"].asString("") == "vertPos") {
 			vertexPosOffset = a.offset;
+			hasVertexPos = true;
 		}
 	}
 
@@ -3,6 +3,7 @@
 #include <cassert>
 
 #include "halley/core/graphics/render_context.h"
+#include "halley/core/graphics/render_command_list.h"
 #include "halley/core/graphics/render_target/render_target.h"
 #include "halley/core/graphics/material/material.h"
 #include "halley/core/graphics/material/material_definition.h"
@@ -10,6 +11,8 @@
 #include <cstring> // memmove
 #include <gsl/gsl_assert>
 #include "resources/resources.h"
+#include "halley/concurrency/concurrent.h"
+#include "halley/maths/simd.h"
 
 using namespace Halley;
 
@@ -27,10 +30,14 @@ Painter::~Painter()
 void Painter::startRender()
 {
 	Material::resetBindCache();
-	prevDrawCalls = nDrawCalls;
-	prevTriangles = nTriangles;
-	prevVertices = nVertices;
-	nDrawCalls = nTriangles = nVertices = 0;
+	prevStats.drawCalls = nDrawCalls;
+	prevStats.triangles = nTriangles;
+	prevStats.vertices = nVertices;
+	prevStats.mergedMaterialChanges = nMergedMaterialChanges;
+	prevStats.scratchBytes = frameAllocator.getUsed();
+	prevStats.peakScratchBytes = frameAllocator.getPeakUsed();
+	nDrawCalls = nTriangles = nVertices = nMergedMaterialChanges = 0;
+	frameAllocator.reset();
 
 	resetPending();
 	doStartRender();
@@ -62,6 +69,45 @@ static Vector4f& getVertPos(char* vertexAttrib, size_t vertPosOffset)
 	return *reinterpret_cast<Vector4f*>(vertexAttrib + vertPosOffset);
 }
 
+namespace {
+	// Copies the data of each sprite into its four vertices, and fills their positions in 0-1 space
+	// getSrc(i) returns the vertex data of sprite i
+	template <typename F>
+	void expandSpriteVertices(char* dst, size_t numSprites, size_t vertexSize, size_t vertexStride, size_t vertPosOffset, F getSrc)
+	{
+		// j -> vertPos
+		// 0 -> 0, 0
+		// 1 -> 1, 0
+		// 2 -> 1, 1
+		// 3 -> 0, 1
+		alignas(16) constexpr float vertPos[4][4] = { { 0, 0, 0, 0 }, { 1, 0, 1, 0 }, { 1, 1, 1, 1 }, { 0, 1, 0, 1 } };
+		const SIMDVec4 vertPosSIMD[4] = { SIMDVec4::loadAligned(vertPos[0]), SIMDVec4::loadAligned(vertPos[1]), SIMDVec4::loadAligned(vertPos[2]), SIMDVec4::loadAligned(vertPos[3]) };
+
+		const size_t simdSize = vertexSize & ~size_t(15);
+		for (size_t i = 0; i < numSprites; ++i) {
+			const char* src = static_cast<const char*>(getSrc(i));
+			char* v = dst + i * 4 * vertexStride;
+
+			// Each 16 bytes of the source are loaded once and stored in all four vertices
+			for (size_t offset = 0; offset < simdSize; offset += 16) {
+				const auto value = SIMDVec4::loadUnaligned(reinterpret_cast<const float*>(src + offset));
+				for (size_t j = 0; j < 4; ++j) {
+					value.storeUnaligned(reinterpret_cast<float*>(v + j * vertexStride + offset));
+				}
+			}
+			if (simdSize != vertexSize) {
+				for (size_t j = 0; j < 4; ++j) {
+					memcpy(v + j * vertexStride + simdSize, src + simdSize, vertexSize - simdSize);
+				}
+			}
+
+			for (size_t j = 0; j < 4; ++j) {
+				vertPosSIMD[j].storeUnaligned(reinterpret_cast<float*>(v + j * vertexStride + vertPosOffset));
+			}
+		}
+	}
+}
+
 Painter::PainterVertexData Painter::addDrawData(const std::shared_ptr<Material>& material, size_t numVertices, size_t numIndices, bool standardQuadsOnly)
 {
 	updateClip();
@@ -70,7 +116,7 @@ Painter::PainterVertexData Painter::addDrawData(const std::shared_ptr<Material>&
 	if (numVertices > maxVertices) {
 		throw Exception("Too many vertices in draw call: " + toString(numVertices) + ", maximum is " + toString(maxVertices), HalleyExceptions::Graphics);
 	}
-	if (verticesPending + numVertices > maxVertices) {
+	if (instancesPending || verticesPending + numVertices > maxVertices) {
 		flushPending();
 	}
 
@@ -100,6 +146,45 @@ Painter::PainterVertexData Painter::addDrawData(const std::shared_ptr<Material>&
 	return result;
 }
 
+Painter::PainterVertexData Painter::addInstanceData(const std::shared_ptr<Material>& material, size_t numInstances)
+{
+	updateClip();
+
+	// Instances and vertices can't share a batch
+	constexpr auto maxInstances = size_t(std::numeric_limits<IndexType>::max()) / 4;
+	if (!instancesPending || verticesPending + numInstances > maxInstances) {
+		flushPending();
+	}
+
+	Expects(material != nullptr);
+	Expects(numInstances > 0);
+	Expects(numInstances <= maxInstances);
+
+	startDrawCall(material);
+
+	PainterVertexData result;
+
+	result.vertexSize = material->getDefinition().getVertexSize();
+	result.vertexStride = material->getDefinition().getVertexStride();
+	result.dataSize = numInstances * result.vertexStride;
+	makeSpaceForPendingVertices(result.dataSize);
+
+	result.dstVertex = vertexBuffer.data() + bytesPending;
+	result.dstIndex = nullptr;
+	result.firstIndex = 0;
+
+	verticesPending += numInstances;
+	bytesPending += result.dataSize;
+	instancesPending = true;
+
+	return result;
+}
+
+bool Painter::canDrawInstanced(const Material& material) const
+{
+	return instancingEnabled && material.getDefinition().isInstanced() && supportsInstancing();
+}
+
 void Painter::draw(const std::shared_ptr<Material>& material, size_t numVertices, const void* vertexData, gsl::span<const IndexType> indices, PrimitiveType primitiveType)
 {
 	Expects(primitiveType == PrimitiveType::Triangle);
@@ -129,6 +214,16 @@ void Painter::drawSprites(const std::shared_ptr<Material>& material, size_t numS
 {
 	Expects(vertexData != nullptr);
 
+	if (canDrawInstanced(*material)) {
+		constexpr size_t maxSpritesPerBatch = size_t(std::numeric_limits<IndexType>::max()) / 4;
+		const char* const src = reinterpret_cast<const char*>(vertexData);
+		for (size_t start = 0; start < numSprites; start += maxSpritesPerBatch) {
+			const auto result = addInstanceData(material, std::min(numSprites - start, maxSpritesPerBatch));
+			memcpy(result.dstVertex, src + start * result.vertexStride, result.dataSize);
+		}
+		return;
+	}
+
 	const size_t verticesPerSprite = 4;
 	const size_t numVertices = verticesPerSprite * numSprites;
 	const size_t vertPosOffset = material->getDefinition().getVertexPosOffset();
@@ -136,25 +231,42 @@ void Painter::drawSprites(const std::shared_ptr<Material>& material, size_t numS
 	const auto result = addDrawData(material, numVertices, numSprites * 6, true);
 
 	const char* const src = reinterpret_cast<const char*>(vertexData);
+	expandSpriteVertices(result.dstVertex, numSprites, result.vertexSize, result.vertexStride, vertPosOffset, [&] (size_t i) { return src + i * result.vertexStride; });
+
+	generateQuadIndices(result.firstIndex, numSprites, result.dstIndex);
+}
+
+void Painter::drawSprites(const std::shared_ptr<Material>& material, gsl::span<const void* const> vertexData)
+{
+	constexpr size_t maxSpritesPerBatch = size_t(std::numeric_limits<IndexType>::max()) / 4;
+	constexpr size_t minSpritesPerTask = 512;
 
-	for (size_t i = 0; i < numSprites; i++) {
-		for (size_t j = 0; j < verticesPerSprite; j++) {
-			const size_t srcOffset = i * result.vertexStride;
-			const size_t dstOffset = (i * verticesPerSprite + j) * result.vertexStride;
-			memmove(result.dstVertex + dstOffset, src + srcOffset, result.vertexSize);
-
-			// j -> vertPos
-			// 0 -> 0, 0
-			// 1 -> 1, 0
-			// 2 -> 1, 1
-			// 3 -> 0, 1
-			const float x = ((j & 1) ^ ((j & 2) >> 1)) * 1.0f;
-			const float y = ((j & 2) >> 1) * 1.0f;
-			getVertPos(result.dstVertex + dstOffset, vertPosOffset) = Vector4f(x, y, x, y);
+	const size_t vertPosOffset = material->getDefinition().getVertexPosOffset();
+
+	if (canDrawInstanced(*material)) {
+		for (size_t start = 0; start < size_t(vertexData.size()); start += maxSpritesPerBatch) {
+			const size_t numSprites = std::min(size_t(vertexData.size()) - start, maxSpritesPerBatch);
+			const auto result = addInstanceData(material, numSprites);
+			for (size_t i = 0; i < numSprites; ++i) {
+				memcpy(result.dstVertex + i * result.vertexStride, vertexData[start + i], result.vertexSize);
+			}
 		}
+		return;
 	}
 
-	generateQuadIndices(result.firstIndex, numSprites, result.dstIndex);
+	for (size_t start = 0; start < size_t(vertexData.size()); start += maxSpritesPerBatch) {
+		const size_t numSprites = std::min(size_t(vertexData.size()) - start, maxSpritesPerBatch);
+		const auto result = addDrawData(material, numSprites * 4, numSprites * 6, true);
+		const auto* src = vertexData.data() + start;
+
+		auto expand = [&] (size_t from, size_t to)
+		{
+			expandSpriteVertices(result.dstVertex + from * 4 * result.vertexStride, to - from, result.vertexSize, result.vertexStride, vertPosOffset, [&] (size_t i) { return src[from + i]; });
+			generateQuadIndices(IndexType(result.firstIndex + from * 4), to - from, result.dstIndex + from * 6);
+		};
+
+		forEachSlice(numSprites, minSpritesPerTask, expand);
+	}
 }
 
 void Painter::drawSlicedSprite(const std::shared_ptr<Material>& material, Vector2f scale, Vector4f slices, const void* vertexData)
@@ -208,17 +320,7 @@ void Painter::drawSlicedSprite(const std::shared_ptr<Material>& material, Vector
 	}
 }
 
-void Painter::drawLine(gsl::span<const Vector2f> points, float width, Colour4f colour, bool loop, std::shared_ptr<Material> material)
-{
-	if (!material) {
-		material = getSolidLineMaterial();
-	}
-
-	// Need at least two points to draw a line
-	if (points.size() < 2) {
-		return;
-	}
-
+namespace {
 	struct LineVertex {
 		Vector4f colour;
 		Vector2f position;
@@ -227,109 +329,280 @@ void Painter::drawLine(gsl::span<const Vector2f> points, float width, Colour4f c
 		char _padding[8];
 	};
 
-	const Vector4f col(colour.r, colour.g, colour.b, colour.a);
+	size_t getNumLineSegments(const LineShape& line)
+	{
+		// Need at least two points to draw a line
+		const size_t nPoints = size_t(line.points.size());
+		if (nPoints < 2) {
+			return 0;
+		}
+		return line.loop ? nPoints : nPoints - 1;
+	}
 
-	constexpr float normalPos[] = { -1, 1, 1, -1 };
-	constexpr size_t pointIdxOffset[] = { 0, 0, 1, 1 };
+	// Writes four vertices for each segment of the line
+	void tessellateLine(const LineShape& line, LineVertex* vertices)
+	{
+		const auto& points = line.points;
+		const bool loop = line.loop;
+		const float width = line.width;
+		const Vector4f col(line.colour.r, line.colour.g, line.colour.b, line.colour.a);
+
+		constexpr float normalPos[] = { -1, 1, 1, -1 };
+		constexpr size_t pointIdxOffset[] = { 0, 0, 1, 1 };
+
+		const size_t nPoints = points.size();
+		const size_t nSegments = getNumLineSegments(line);
+
+		auto segmentNormal = [&] (size_t i) -> std::optional<Vector2f>
+		{
+			if (!loop && i >= nSegments) {
+				return {};
+			} else {
+				return (points[(i + 1) % nPoints] - points[i % nPoints]).normalized().orthoLeft();
+			}
+		};
+
+		auto makeNormal = [] (Vector2f a, std::optional<Vector2f> maybeB) -> Vector2f
+		{
+			// Enabling this makes it looks nicer, but also introduces a lot of edge cases with acute angles that are very hard to deal with, so only enable for angles <= 90 degrees
+			if (maybeB && maybeB.value().dot(a) >= -0.001f) {
+				const auto b = maybeB.value();
+				const auto c = (a + b).normalized();
+				const auto cosHalfAlpha = c.dot(a);
+				return c * (1.0f / cosHalfAlpha);
+			} else {
+				return a;
+			}
+		};
 
-	const size_t nPoints = points.size();
-	const size_t nSegments = (loop ? nPoints : (nPoints - 1));
-	std::vector<LineVertex> vertices(nSegments * 4);
+		std::optional<Vector2f> prevNormal = loop ? segmentNormal(nSegments - 1) : std::optional<Vector2f>();
+		Vector2f normal = segmentNormal(0).value();
 
-	auto segmentNormal = [&] (size_t i) -> std::optional<Vector2f>
-	{
-		if (!loop && i >= nSegments) {
-			return {};
-		} else {
-			return (points[(i + 1) % nPoints] - points[i % nPoints]).normalized().orthoLeft();
+		for (size_t i = 0; i < nSegments; ++i) {
+			std::optional<Vector2f> nextNormal = segmentNormal(i + 1);
+
+			const Vector2f v0n = makeNormal(normal, prevNormal);
+			const Vector2f v1n = makeNormal(normal, nextNormal);
+
+			for (size_t j = 0; j < 4; ++j) {
+				auto& v = vertices[i * 4 + j];
+				v.colour = col;
+				v.position = points[(i + pointIdxOffset[j]) % nPoints];
+				v.normal = j <= 1 ? v0n : v1n;
+				v.width.x = width;
+				v.width.y = normalPos[j];
+			}
+
+			prevNormal = normal;
+			if (nextNormal) {
+				normal = nextNormal.value();
+			}
 		}
-	};
+	}
 
-	auto makeNormal = [] (Vector2f a, std::optional<Vector2f> maybeB) -> Vector2f
+	size_t getSegmentsForArc(float radius, float arcLen)
 	{
-		// Enabling this makes it looks nicer, but also introduces a lot of edge cases with acute angles that are very hard to deal with, so only enable for angles <= 90 degrees
-		if (maybeB && maybeB.value().dot(a) >= -0.001f) {
-			const auto b = maybeB.value();
-			const auto c = (a + b).normalized();
-			const auto cosHalfAlpha = c.dot(a);
-			return c * (1.0f / cosHalfAlpha);
-		} else {
-			return a;
-		}
-	};
+		return clamp(size_t(arcLen / float(pi() * 2) * 50.0f), size_t(4), size_t(256));
+	}
 
-	std::optional<Vector2f> prevNormal = loop ? segmentNormal(nSegments - 1) : std::optional<Vector2f>();
-	Vector2f normal = segmentNormal(0).value();
+	float getArcLength(const CircleShape& circle)
+	{
+		const auto from = circle.arc->first;
+		const auto to = circle.arc->second;
+		return (to - from).getRadians() + (from.turnSide(to) > 0 ? 0.0f : 0 * float(pi()));
+	}
 
-	for (size_t i = 0; i < nSegments; ++i) {
-		std::optional<Vector2f> nextNormal = segmentNormal(i + 1);
+	size_t getNumCirclePoints(const CircleShape& circle)
+	{
+		const float radius = std::max(circle.radius.x, circle.radius.y);
+		return getSegmentsForArc(radius, circle.arc ? getArcLength(circle) : 2 * float(pi()));
+	}
+}
 
-		const Vector2f v0n = makeNormal(normal, prevNormal);
-		const Vector2f v1n = makeNormal(normal, nextNormal);
+void Painter::drawLine(gsl::span<const Vector2f> points, float width, Colour4f colour, bool loop, std::shared_ptr<Material> material)
+{
+	const LineShape line{ points, width, colour, loop };
+	drawLines(gsl::span<const LineShape>(&line, 1), std::move(material));
+}
 
-		for (size_t j = 0; j < 4; ++j) {
-			const size_t idx = i * 4 + j;
-			auto& v = vertices[idx];
-			v.colour = col;
-			v.position = points[(i + pointIdxOffset[j]) % nPoints];
-			v.normal = j <= 1 ? v0n : v1n;
-			v.width.x = width;
-			v.width.y = normalPos[j];
+void Painter::drawLines(gsl::span<const LineShape> lines, std::shared_ptr<Material> material)
+{
+	if (!material) {
+		material = getSolidLineMaterial();
+	}
+
+	// Lines are grouped into as few draws as the index type allows
+	constexpr size_t maxSegmentsPerBatch = size_t(std::numeric_limits<IndexType>::max()) / 4;
+	const size_t nLines = size_t(lines.size());
+	size_t start = 0;
+	while (start < nLines) {
+		size_t end = start;
+		size_t nSegments = 0;
+		while (end < nLines) {
+			const size_t n = getNumLineSegments(lines[end]);
+			if (end > start && nSegments + n > maxSegmentsPerBatch) {
+				break;
+			}
+			nSegments += n;
+			++end;
 		}
 
-		prevNormal = normal;
-		if (nextNormal) {
-			normal = nextNormal.value();
+		if (nSegments > 0) {
+			drawLineBatch(material, lines.subspan(start, end - start), nSegments);
 		}
+		start = end;
 	}
-
-	drawQuads(material, vertices.size(), vertices.data());
 }
 
-static size_t getSegmentsForArc(float radius, float arcLen)
+void Painter::drawLineBatch(const std::shared_ptr<Material>& material, gsl::span<const LineShape> lines, size_t nSegments)
 {
-	return clamp(size_t(arcLen / float(pi() * 2) * 50.0f), size_t(4), size_t(256));
+	constexpr size_t minLinesPerTask = 128;
+
+	const auto result = addDrawData(material, nSegments * 4, nSegments * 6, true);
+	Expects(result.vertexStride == sizeof(LineVertex));
+
+	// Each line starts at the sum of the segments of the ones before it
+	const auto firstSegment = frameAllocator.alloc<size_t>(size_t(lines.size()));
+	size_t segment = 0;
+	for (size_t i = 0; i < size_t(lines.size()); ++i) {
+		firstSegment[i] = segment;
+		segment += getNumLineSegments(lines[i]);
+	}
+
+	auto* vertices = reinterpret_cast<LineVertex*>(result.dstVertex);
+	forEachSlice(size_t(lines.size()), minLinesPerTask, [&] (size_t from, size_t to)
+	{
+		for (size_t i = from; i < to; ++i) {
+			if (getNumLineSegments(lines[i]) > 0) {
+				tessellateLine(lines[i], vertices + firstSegment[i] * 4);
+			}
+		}
+	});
+
+	generateQuadIndices(result.firstIndex, nSegments, result.dstIndex);
 }
 
 void Painter::drawCircle(Vector2f centre, float radius, float width, Colour4f colour, std::shared_ptr<Material> material)
 {
-	const size_t n = getSegmentsForArc(radius, 2 * float(pi()));
-	std::vector<Vector2f> points;
-	for (size_t i = 0; i < n; ++i) {
-		points.push_back(centre + Vector2f(radius, 0).rotate(Angle1f::fromRadians(i * 2.0f * float(pi()) / n)));
-	}
-	drawLine(points, width, colour, true, std::move(material));
+	const CircleShape circle{ centre, Vector2f(radius, radius), width, colour, std::nullopt };
+	drawCircles(gsl::span<const CircleShape>(&circle, 1), std::move(material));
 }
 
 void Painter::drawCircleArc(Vector2f centre, float radius, float width, Angle1f from, Angle1f to, Colour4f colour, std::shared_ptr<Material> material)
 {
-	const float arcLen = (to - from).getRadians() + (from.turnSide(to) > 0 ? 0.0f : 0 * float(pi()));
-	const size_t n = getSegmentsForArc(radius, arcLen);
-	std::vector<Vector2f> points;
-	for (size_t i = 0; i < n; ++i) {
-		points.push_back(centre + Vector2f(radius, 0).rotate(from + Angle1f::fromRadians(i * arcLen / (n - 1))));
-	}
-	drawLine(points, width, colour, false, std::move(material));
+	const CircleShape circle{ centre, Vector2f(radius, radius), width, colour, std::pair(from, to) };
+	drawCircles(gsl::span<const CircleShape>(&circle, 1), std::move(material));
 }
 
 void Painter::drawEllipse(Vector2f centre, Vector2f radius, float width, Colour4f colour, std::shared_ptr<Material> material)
 {
-	const size_t n = getSegmentsForArc(std::max(radius.x, radius.y), 2 * float(pi()));
-	std::vector<Vector2f> points;
-	for (size_t i = 0; i < n; ++i) {
-		points.push_back(centre + Vector2f(1.0f, 0).rotate(Angle1f::fromRadians(i * 2.0f * float(pi()) / n)) * radius);
+	const CircleShape circle{ centre, radius, width, colour, std::nullopt };
+	drawCircles(gsl::span<const CircleShape>(&circle, 1), std::move(material));
+}
+
+void Painter::drawCircles(gsl::span<const CircleShape> circles, std::shared_ptr<Material> material)
+{
+	constexpr size_t minCirclesPerTask = 128;
+	const size_t nCircles = size_t(circles.size());
+
+	// Points of all circles go into one buffer, and full circles use the cached unit circle for their point count
+	const auto lines = frameAllocator.alloc<LineShape>(nCircles);
+	const auto firstPoint = frameAllocator.alloc<size_t>(nCircles);
+	size_t nPoints = 0;
+	for (size_t i = 0; i < nCircles; ++i) {
+		const size_t n = getNumCirclePoints(circles[i]);
+		if (!circles[i].arc) {
+			getUnitCircle(n);
+		}
+		firstPoint[i] = nPoints;
+		nPoints += n;
+	}
+	const auto points = frameAllocator.alloc<Vector2f>(nPoints);
+
+	forEachSlice(nCircles, minCirclesPerTask, [&] (size_t from, size_t to)
+	{
+		for (size_t i = from; i < to; ++i) {
+			const auto& circle = circles[i];
+			const size_t n = (i + 1 < nCircles ? firstPoint[i + 1] : nPoints) - firstPoint[i];
+			const auto dst = points.subspan(firstPoint[i], n);
+
+			if (circle.arc) {
+				// Rotate by a fixed step, rather than computing sin and cos for each point
+				const float step = getArcLength(circle) / (n - 1);
+				const Vector2f rotation(std::cos(step), std::sin(step));
+				Vector2f p = Vector2f(1, 0).rotate(circle.arc->first);
+				for (size_t j = 0; j < n; ++j) {
+					dst[j] = circle.centre + p * circle.radius;
+					p = Vector2f(p.x * rotation.x - p.y * rotation.y, p.x * rotation.y + p.y * rotation.x);
+				}
+			} else {
+				const auto& unit = unitCircles[n];
+				for (size_t j = 0; j < n; ++j) {
+					dst[j] = circle.centre + unit[j] * circle.radius;
+				}
+			}
+
+			lines[i] = LineShape{ dst, circle.width, circle.colour, !circle.arc };
+		}
+	});
+
+	drawLines(lines, std::move(material));
+}
+
+gsl::span<const Vector2f> Painter::getUnitCircle(size_t nPoints)
+{
+	if (unitCircles.size() <= nPoints) {
+		unitCircles.resize(nPoints + 1);
 	}
-	drawLine(points, width, colour, true, std::move(material));
+	auto& unit = unitCircles[nPoints];
+	if (unit.empty()) {
+		unit.resize(nPoints);
+		for (size_t i = 0; i < nPoints; ++i) {
+			unit[i] = Vector2f(1.0f, 0).rotate(Angle1f::fromRadians(i * 2.0f * float(pi()) / nPoints));
+		}
+	}
+	return unit;
 }
 
 void Painter::drawRect(Rect4f rect, float width, Colour4f colour, std::shared_ptr<Material> material)
 {
-	std::vector<Vector2f> points;
-	points.push_back(rect.getTopLeft());
-	points.push_back(rect.getTopRight());
-	points.push_back(rect.getBottomRight());
-	points.push_back(rect.getBottomLeft());
-	drawLine(points, width, colour, true, std::move(material));
+	const RectShape shape{ rect, width, colour };
+	drawRects(gsl::span<const RectShape>(&shape, 1), std::move(material));
+}
+
+void Painter::drawRects(gsl::span<const RectShape> rects, std::shared_ptr<Material> material)
+{
+	const size_t nRects = size_t(rects.size());
+	const auto lines = frameAllocator.alloc<LineShape>(nRects);
+	const auto points = frameAllocator.alloc<Vector2f>(nRects * 4);
+	for (size_t i = 0; i < nRects; ++i) {
+		const auto& rect = rects[i].rect;
+		const auto dst = points.subspan(i * 4, 4);
+		dst[0] = rect.getTopLeft();
+		dst[1] = rect.getTopRight();
+		dst[2] = rect.getBottomRight();
+		dst[3] = rect.getBottomLeft();
+		lines[i] = LineShape{ dst, rects[i].width, rects[i].colour, true };
+	}
+	drawLines(lines, std::move(material));
+}
+
+void Painter::forEachSlice(size_t numItems, size_t minItemsPerTask, const std::function<void(size_t, size_t)>& f)
+{
+	const size_t maxTasks = numItems / minItemsPerTask;
+	const size_t nTasks = maxTasks > 1 ? std::min(Executors::getCPU().threadCount() + 1, maxTasks) : 1;
+	if (nTasks <= 1) {
+		f(0, numItems);
+	} else {
+		const auto tasks = frameAllocator.alloc<size_t>(nTasks);
+		for (size_t i = 0; i < nTasks; ++i) {
+			tasks[i] = i;
+		}
+		Concurrent::foreach(Executors::getCPU(), tasks.begin(), tasks.end(), [&] (size_t task)
+		{
+			f(numItems * task / nTasks, numItems * (task + 1) / nTasks);
+		});
+	}
 }
 
 void Painter::setLogging(bool logging)
@@ -379,6 +652,7 @@ void Painter::bind(RenderContext& context)
 void Painter::unbind(RenderContext& context)
 {
 	flush();
+	Material::resetBindCache();
 	activeRenderTarget->onUnbind(*this);
 	activeRenderTarget = nullptr;
 	camera->rendering = false;
@@ -431,8 +705,15 @@ std::shared_ptr<Material> Painter::getSolidLineMaterial()
 void Painter::startDrawCall(const std::shared_ptr<Material>& material)
 {
 	if (material != materialPending) {
-		if (materialPending != std::shared_ptr<Material>() && !(*material == *materialPending)) {
-			flushPending();
+		if (materialPending != std::shared_ptr<Material>()) {
+			// Different sort keys are a cheap way to tell materials apart, see Material::getSortKey
+			if (material->getSortKey() == materialPending->getSortKey() && *material == *materialPending) {
+				if (logging) {
+					nMergedMaterialChanges++;
+				}
+			} else {
+				flushPending();
+			}
 		}
 		materialPending = material;
 	}
@@ -441,7 +722,14 @@ void Painter::startDrawCall(const std::shared_ptr<Material>& material)
 void Painter::flushPending()
 {
 	if (verticesPending > 0) {
-		executeDrawPrimitives(*materialPending, verticesPending, vertexBuffer.data(), gsl::span<const IndexType>(indexBuffer.data(), indicesPending));
+		const auto indices = gsl::span<const IndexType>(indexBuffer.data(), indicesPending);
+		if (recording) {
+			recording->addCommand(materialPending, curClip, verticesPending, vertexBuffer.data(), bytesPending, indices, allIndicesAreQuads, instancesPending);
+		} else if (instancesPending) {
+			executeDrawInstances(*materialPending, verticesPending, vertexBuffer.data());
+		} else {
+			executeDrawPrimitives(*materialPending, verticesPending, vertexBuffer.data(), indices, allIndicesAreQuads);
+		}
 	}
 
 	resetPending();
@@ -453,13 +741,11 @@ void Painter::resetPending()
 	verticesPending = 0;
 	indicesPending = 0;
 	allIndicesAreQuads = true;
-	if (materialPending) {
-		Material::resetBindCache();
-		materialPending.reset();
-	}
+	instancesPending = false;
+	materialPending.reset();
 }
 
-void Painter::executeDrawPrimitives(Material& material, size_t numVertices, void* vertexData, gsl::span<const IndexType> indices, PrimitiveType primitiveType)
+void Painter::executeDrawPrimitives(Material& material, size_t numVertices, void* vertexData, gsl::span<const IndexType> indices, bool standardQuadsOnly, PrimitiveType primitiveType)
 {
 	Expects(primitiveType == PrimitiveType::Triangle);
 
@@ -467,7 +753,7 @@ void Painter::executeDrawPrimitives(Material& material, size_t numVertices, void
 
 	// Load vertices
 	// BAD: This method should take const IndexType*!
-	setVertices(material.getDefinition(), numVertices, vertexData, indices.size(), const_cast<IndexType*>(indices.data()), allIndicesAreQuads);
+	setVertices(material.getDefinition(), numVertices, vertexData, indices.size(), const_cast<IndexType*>(indices.data()), standardQuadsOnly);
 
 	// Load material uniforms
 	material.uploadData(*this);
@@ -494,6 +780,173 @@ void Painter::executeDrawPrimitives(Material& material, size_t numVertices, void
 	endDrawCall();
 }
 
+void Painter::executeDrawInstances(Material& material, size_t numInstances, void* instanceData)
+{
+	startDrawCall();
+
+	setInstances(material.getDefinition(), numInstances, instanceData);
+
+	material.uploadData(*this);
+	setMaterialData(material);
+
+	for (int i = 0; i < material.getDefinition().getNumPasses(); i++) {
+		if (material.isPassEnabled(i)) {
+			material.bind(i, *this);
+			drawInstancedQuads(numInstances);
+
+			if (logging) {
+				nDrawCalls++;
+				nTriangles += numInstances * 2;
+				nVertices += numInstances * 4;
+			}
+		}
+	}
+
+	endDrawCall();
+}
+
+void Painter::executeDrawListCommand(Material& material, size_t vertexOffset, size_t numVertices, size_t firstIndex, size_t numIndices, bool instanced)
+{
+	startDrawCall();
+
+	setListVertices(material.getDefinition(), vertexOffset, instanced);
+
+	material.uploadData(*this);
+	setMaterialData(material);
+
+	for (int i = 0; i < material.getDefinition().getNumPasses(); i++) {
+		if (material.isPassEnabled(i)) {
+			material.bind(i, *this);
+			if (instanced) {
+				drawInstancedQuads(numVertices);
+			} else {
+				drawListTriangles(firstIndex, numIndices);
+			}
+
+			if (logging) {
+				nDrawCalls++;
+				nTriangles += instanced ? numVertices * 2 : numIndices / 3;
+				nVertices += instanced ? numVertices * 4 : numVertices;
+			}
+		}
+	}
+
+	endDrawCall();
+}
+
+void Painter::setInstances(const MaterialDefinition& material, size_t numInstances, void* instanceData)
+{
+	// Backends without instancing get the quads expanded on the CPU, as drawSprites does with instancing off
+	const size_t stride = material.getVertexStride();
+	const auto expanded = static_cast<char*>(frameAllocator.alloc(numInstances * 4 * stride, 16));
+	const auto* src = static_cast<const char*>(instanceData);
+	expandSpriteVertices(expanded, numInstances, material.getVertexSize(), stride, material.getVertexPosOffset(), [&] (size_t i) { return src + i * stride; });
+	setVertices(material, numInstances * 4, expanded, numInstances * 6, getStandardQuadIndices(numInstances), true);
+}
+
+void Painter::drawInstancedQuads(size_t numInstances)
+{
+	drawTriangles(numInstances * 6);
+}
+
+void Painter::setListData(gsl::span<const char>, gsl::span<const IndexType>)
+{
+	throw Exception("Uploading command lists is not supported by this painter.", HalleyExceptions::Graphics);
+}
+
+void Painter::setListVertices(const MaterialDefinition&, size_t, bool)
+{
+	throw Exception("Uploading command lists is not supported by this painter.", HalleyExceptions::Graphics);
+}
+
+void Painter::drawListTriangles(size_t, size_t)
+{
+	throw Exception("Uploading command lists is not supported by this painter.", HalleyExceptions::Graphics);
+}
+
+void Painter::setInstancingEnabled(bool enabled)
+{
+	if (enabled != instancingEnabled) {
+		flushPending();
+		instancingEnabled = enabled;
+	}
+}
+
+bool Painter::isInstancingEnabled() const
+{
+	return instancingEnabled && supportsInstancing();
+}
+
+void Painter::startRecording(RenderCommandList& list)
+{
+	Expects(!recording);
+
+	flushPending();
+	list.invalidate();
+	recording = &list;
+}
+
+void Painter::stopRecording()
+{
+	Expects(recording);
+
+	flushPending();
+	recording->recorded = true;
+	recording = nullptr;
+}
+
+void Painter::draw(const RenderCommandList& list)
+{
+	Expects(recording != &list);
+
+	flushPending();
+
+	// Upload the whole list once, and have each command draw from its range of it
+	const bool uploaded = !recording && !list.commands.empty() && supportsListUpload();
+	if (uploaded) {
+		setListData(list.vertexData, list.indexData);
+	}
+
+	for (const auto& cmd: list.commands) {
+		const auto vertexData = list.vertexData.data() + cmd.vertexOffset;
+		const auto indices = gsl::span<const IndexType>(list.indexData.data() + cmd.indexOffset, cmd.numIndices);
+
+		if (recording) {
+			// Replaying into another recording just appends the commands
+			recording->addCommand(cmd.material, cmd.clip, cmd.numVertices, vertexData, cmd.vertexBytes, indices, cmd.standardQuadsOnly, cmd.instanced);
+			continue;
+		}
+
+		if (curClip != cmd.clip) {
+			curClip = cmd.clip;
+			setClip(cmd.clip.value_or(Rect4i()), cmd.clip.has_value());
+			Material::resetBindCache();
+		}
+
+		if (cmd.instanced) {
+			if (isInstancingEnabled()) {
+				if (uploaded) {
+					executeDrawListCommand(*cmd.material, cmd.vertexOffset, cmd.numVertices, cmd.indexOffset, cmd.numIndices, true);
+				} else {
+					executeDrawInstances(*cmd.material, cmd.numVertices, const_cast<char*>(vertexData));
+				}
+			} else {
+				// Recorded with instancing, but it's been turned off since
+				const auto& def = cmd.material->getDefinition();
+				const size_t stride = def.getVertexStride();
+				const auto expanded = frameAllocator.alloc(cmd.numVertices * 4 * stride, 16);
+				expandSpriteVertices(static_cast<char*>(expanded), cmd.numVertices, def.getVertexSize(), stride, def.getVertexPosOffset(), [&] (size_t i) { return vertexData + i * stride; });
+				const auto quadIndices = gsl::span<const IndexType>(getStandardQuadIndices(cmd.numVertices), cmd.numVertices * 6);
+				executeDrawPrimitives(*cmd.material, cmd.numVertices * 4, expanded, quadIndices, true);
+			}
+		} else if (uploaded) {
+			executeDrawListCommand(*cmd.material, cmd.vertexOffset, cmd.numVertices, cmd.indexOffset, cmd.numIndices, false);
+		} else {
+			executeDrawPrimitives(*cmd.material, cmd.numVertices, const_cast<char*>(vertexData), indices, cmd.standardQuadsOnly);
+		}
+	}
+}
+
 IndexType* Painter::getStandardQuadIndices(size_t numQuads)
 {
 	size_t sz = numQuads * 6;
@@ -588,5 +1041,8 @@ void Painter::updateClip()
 
 		flushPending();
 		setClip(targetClip, enableClip);
+
+		// Some backends fold the scissor state into the pass state, so materials must be bound again
+		Material::resetBindCache();
 	}
 }
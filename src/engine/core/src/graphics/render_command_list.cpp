@@ -0,0 +1,72 @@
+#include "halley/core/graphics/render_command_list.h"
+#include "halley/core/graphics/painter.h"
+#include <cstring>
+
+using namespace Halley;
+
+void RenderCommandList::clear()
+{
+	commands = Vector<Command>();
+	vertexData = Vector<char>();
+	indexData = Vector<IndexType>();
+	numVertices = 0;
+	recorded = false;
+}
+
+void RenderCommandList::invalidate()
+{
+	commands.clear();
+	vertexData.clear();
+	indexData.clear();
+	numVertices = 0;
+	recorded = false;
+}
+
+bool RenderCommandList::isRecorded() const
+{
+	return recorded;
+}
+
+bool RenderCommandList::empty() const
+{
+	return commands.empty();
+}
+
+size_t RenderCommandList::getNumCommands() const
+{
+	return commands.size();
+}
+
+size_t RenderCommandList::getNumVertices() const
+{
+	return numVertices;
+}
+
+size_t RenderCommandList::getNumIndices() const
+{
+	return indexData.size();
+}
+
+void RenderCommandList::replay(Painter& painter) const
+{
+	painter.draw(*this);
+}
+
+void RenderCommandList::addCommand(std::shared_ptr<Material> material, std::optional<Rect4i> clip, size_t nVertices, const char* vertices, size_t vertexBytes, gsl::span<const IndexType> indices, bool standardQuadsOnly, bool instanced)
+{
+	auto& cmd = commands.emplace_back();
+	cmd.material = std::move(material);
+	cmd.clip = clip;
+	cmd.vertexOffset = vertexData.size();
+	cmd.vertexBytes = vertexBytes;
+	cmd.numVertices = nVertices;
+	cmd.indexOffset = indexData.size();
+	cmd.numIndices = size_t(indices.size());
+	cmd.standardQuadsOnly = standardQuadsOnly;
+	cmd.instanced = instanced;
+
+	vertexData.resize(vertexData.size() + vertexBytes);
+	memcpy(vertexData.data() + cmd.vertexOffset, vertices, vertexBytes);
+	indexData.insert(indexData.end(), indices.begin(), indices.end());
+	numVertices += instanced ? nVertices * 4 : nVertices;
+}
@@ -1,5 +1,6 @@
 #include "halley/core/graphics/render_context.h"
 #include "halley/core/graphics/render_target/render_target.h"
+#include "halley/core/graphics/render_command_list.h"
 
 using namespace Halley;
 
@@ -61,6 +62,27 @@ void RenderContext::flush()
 	painter.flush();
 }
 
+void RenderContext::record(RenderCommandList& list, const std::function<void(Painter&)>& f)
+{
+	bind([&] (Painter& painter)
+	{
+		painter.startRecording(list);
+		f(painter);
+		painter.stopRecording();
+	});
+}
+
+void RenderContext::replay(RenderCommandList& list, const std::function<void(Painter&)>& f)
+{
+	if (!list.isRecorded()) {
+		record(list, f);
+	}
+	bind([&] (Painter& painter)
+	{
+		painter.draw(list);
+	});
+}
+
 /*
 RenderContext RenderContext::subArea(Rect4i area) const
 {
@@ -1,17 +1,62 @@
 #include "graphics/sprite/particles.h"
 
+#include <array>
 #include "halley/maths/random.h"
+#include "halley/maths/simd.h"
+#include "halley/core/graphics/painter.h"
+#include "halley/core/graphics/camera.h"
+#include "halley/core/graphics/material/material.h"
+#include "halley/core/graphics/material/material_definition.h"
+#include "halley/concurrency/concurrent.h"
 
 using namespace Halley;
 
+void Particles::RNG::setSeed(uint32_t seed)
+{
+	// Expand the seed with splitmix32, which never yields an all-zero state
+	for (auto& s: state) {
+		seed += 0x9E3779B9u;
+		uint32_t z = seed;
+		z = (z ^ (z >> 16)) * 0x85EBCA6Bu;
+		z = (z ^ (z >> 13)) * 0xC2B2AE35u;
+		s = z ^ (z >> 16);
+	}
+}
+
+uint32_t Particles::RNG::getRawInt()
+{
+	// xoshiro128+
+	const uint32_t result = state[0] + state[3];
+	const uint32_t t = state[1] << 9;
+	state[2] ^= state[0];
+	state[3] ^= state[1];
+	state[1] ^= state[2];
+	state[0] ^= state[3];
+	state[2] ^= t;
+	state[3] = (state[3] << 11) | (state[3] >> 21);
+	return result;
+}
+
+float Particles::RNG::getFloat(float min, float max)
+{
+	// The top 24 bits are the best ones, and exactly representable as a float
+	return min + (max - min) * (static_cast<float>(getRawInt() >> 8) * (1.0f / 16777216.0f));
+}
+
+size_t Particles::RNG::getSizeT(size_t min, size_t max)
+{
+	return min + static_cast<size_t>(getRawInt()) % (max - min + 1);
+}
+
 Particles::Particles()
-	: rng(&Random::getGlobal())
 {
+	rng.setSeed(Random::getGlobal().getRawInt());
 }
 
 Particles::Particles(const ConfigNode& node, Resources& resources)
-	: rng(&Random::getGlobal())
 {
+	rng.setSeed(Random::getGlobal().getRawInt());
+
 	spawnRate = node["spawnRate"].asFloat(100);
 	spawnArea = node["spawnArea"].asVector2f(Vector2f(0, 0));
 	ttl = node["ttl"].asFloat(1.0f);
@@ -53,6 +98,11 @@ float Particles::getSpawnRateMultiplier() const
 	return spawnRateMultiplier;
 }
 
+void Particles::setSeed(uint32_t seed)
+{
+	rng.setSeed(seed);
+}
+
 void Particles::setPosition(Vector2f pos)
 {
 	position = pos;
@@ -71,30 +121,31 @@ void Particles::update(Time t)
 	updateParticles(static_cast<float>(t));
 
 	// Remove dead particles
-	for (size_t i = 0; i < nParticlesAlive; ) {
-		if (!particles[i].alive) {
-			if (i != nParticlesAlive - 1) {
-				// Swap with last particle that's alive
-				std::swap(particles[i], particles[nParticlesAlive - 1]);
-				std::swap(sprites[i], sprites[nParticlesAlive - 1]);
-			}
-			--nParticlesAlive;
-			// Don't increment i here, since i is now a new particle that's still alive
-		} else {
-			++i;
-		}
-	}
+	removeDeadParticles();
+}
 
-	// Update visibility
-	nParticlesVisible = nParticlesAlive;
-	if (nParticlesVisible > 0 && !sprites[0].hasMaterial()) {
-		nParticlesVisible = 0;
+void Particles::update(gsl::span<Particles* const> particles, Time t) // static
+{
+	// Each emitter only touches its own data and random stream, so they can run in any order
+	constexpr size_t minParallelEmitters = 16;
+	if (particles.size() < minParallelEmitters) {
+		for (auto* p: particles) {
+			p->update(t);
+		}
+	} else {
+		Concurrent::foreach(Executors::getCPU(), particles.begin(), particles.end(), [t] (Particles* p)
+		{
+			p->update(t);
+		});
 	}
 }
 
 void Particles::setSprites(std::vector<Sprite> sprites)
 {
 	baseSprites = std::move(sprites);
+	for (size_t i = 0; i < nParticlesAlive; ++i) {
+		spriteIndices[i] = baseSprites.empty() ? 0 : static_cast<uint32_t>(rng.getSizeT(0, baseSprites.size() - 1));
+	}
 }
 
 void Particles::setAnimation(std::shared_ptr<const Animation> animation)
@@ -102,25 +153,149 @@ void Particles::setAnimation(std::shared_ptr<const Animation> animation)
 	baseAnimation = std::move(animation);
 }
 
-gsl::span<Sprite> Particles::getSprites()
+size_t Particles::getNumParticles() const
 {
-	return gsl::span<Sprite>(sprites).subspan(0, nParticlesVisible);
+	return nParticlesAlive;
+}
+
+void Particles::draw(Painter& painter, const std::optional<Rect4f>& clip) const
+{
+	draw(painter, painter.getCurrentCamera().getClippingRectangle(), clip);
+}
+
+void Particles::draw(Painter& painter, Rect4f view, const std::optional<Rect4f>& clip) const
+{
+	if (!isVisible()) {
+		return;
+	}
+
+	const auto cullRect = clip ? view.intersection(clip.value()) : view;
+	if (cullRect.getWidth() <= 0 || cullRect.getHeight() <= 0) {
+		return;
+	}
+
+	// Particles can face any direction, so each base sprite is culled by the circle around its pivot
+	constexpr size_t maxBaseSprites = 64;
+	std::array<float, maxBaseSprites> cullRadii;
+	const size_t nRadii = std::min(baseSprites.size(), maxBaseSprites);
+	for (size_t i = 0; i < nRadii; ++i) {
+		cullRadii[i] = getCullRadius(baseSprites[i]);
+	}
+	auto isInView = [&] (size_t index)
+	{
+		const auto spriteIdx = spriteIndices[index];
+		const float r = spriteIdx < nRadii ? cullRadii[spriteIdx] : getCullRadius(baseSprites[spriteIdx]);
+		return posX[index] + r >= cullRect.getLeft() && posX[index] - r <= cullRect.getRight()
+			&& posY[index] + r >= cullRect.getTop() && posY[index] - r <= cullRect.getBottom();
+	};
+
+	if (clip) {
+		painter.setRelativeClip(clip.value());
+	}
+
+	// Quads go straight into the painter, in batches of consecutive particles sharing a material
+	constexpr size_t batchSize = 64;
+	std::array<SpriteVertexAttrib, batchSize> vertices;
+
+	for (size_t start = 0; start < nParticlesAlive; ) {
+		const auto& material = baseSprites[spriteIndices[start]].material;
+		if (!material) {
+			++start;
+			continue;
+		}
+		Expects(material->getDefinition().getVertexStride() == sizeof(SpriteVertexAttrib));
+
+		size_t count = 0;
+		for (; start < nParticlesAlive && count < batchSize && baseSprites[spriteIndices[start]].material == material; ++start) {
+			if (!isInView(start)) {
+				continue;
+			}
+			auto& v = vertices[count++];
+			v = baseSprites[spriteIndices[start]].vertexAttrib;
+			v.pos = Vector2f(posX[start], posY[start]);
+			v.rotation = angles[start];
+			v.colour.a = getAlpha(start);
+		}
+
+		if (count > 0) {
+			painter.drawSprites(material, count, vertices.data());
+		}
+	}
+
+	if (clip) {
+		painter.setClip();
+	}
 }
 
 gsl::span<const Sprite> Particles::getSprites() const
 {
-	return gsl::span<const Sprite>(sprites).subspan(0, nParticlesVisible);
+	generateSprites();
+	return gsl::span<const Sprite>(sprites);
+}
+
+void Particles::generateSprites() const
+{
+	if (!isVisible()) {
+		sprites.clear();
+		return;
+	}
+
+	sprites.clear();
+	sprites.reserve(nParticlesAlive);
+	for (size_t i = 0; i < nParticlesAlive; ++i) {
+		const auto& base = baseSprites[spriteIndices[i]];
+		if (base.hasMaterial()) {
+			auto& sprite = sprites.emplace_back(base);
+			sprite.vertexAttrib.pos = Vector2f(posX[i], posY[i]);
+			sprite.vertexAttrib.rotation = angles[i];
+			sprite.vertexAttrib.colour.a = getAlpha(i);
+		}
+	}
+}
+
+bool Particles::isVisible() const
+{
+	// Particles whose own sprite has no material are skipped when drawing
+	return nParticlesAlive > 0 && std::any_of(baseSprites.begin(), baseSprites.end(), [] (const Sprite& sprite) { return sprite.hasMaterial(); });
+}
+
+float Particles::getCullRadius(const Sprite& sprite) const
+{
+	const auto pivot = sprite.getPivot();
+	const auto farCorner = Vector2f(std::max(pivot.x, 1.0f - pivot.x), std::max(pivot.y, 1.0f - pivot.y));
+	return (sprite.getScaledSize().abs() * farCorner).length();
+}
+
+float Particles::getAlpha(size_t index) const
+{
+	if (fadeInTime > 0.000001f || fadeOutTime > 0.00001f) {
+		const float time = times[index];
+		return clamp(std::min(time / fadeInTime, (ttls[index] - time) / fadeOutTime), 0.0f, 1.0f);
+	}
+	return baseSprites[spriteIndices[index]].vertexAttrib.colour.a;
+}
+
+void Particles::reserve(size_t n)
+{
+	// Keeps every array padded to whole SIMD lanes
+	const size_t size = std::max(size_t(8), nextPowerOf2(n));
+	if (posX.size() < size) {
+		posX.resize(size);
+		posY.resize(size);
+		velX.resize(size);
+		velY.resize(size);
+		angles.resize(size);
+		times.resize(size);
+		ttls.resize(size);
+		spriteIndices.resize(size);
+	}
 }
 
 void Particles::spawn(size_t n)
 {
 	const size_t start = nParticlesAlive;
 	nParticlesAlive += n;
-	const size_t size = std::max(size_t(8), nextPowerOf2(nParticlesAlive));
-	if (particles.size() < size) {
-		particles.resize(size);
-		sprites.resize(size);
-	}
+	reserve(nParticlesAlive);
 	
 	for (size_t i = start; i < nParticlesAlive; ++i) {
 		initializeParticle(i);
@@ -129,56 +304,75 @@ void Particles::spawn(size_t n)
 
 void Particles::initializeParticle(size_t index)
 {
-	const auto startDirection = Angle1f::fromDegrees(rng->getFloat(angle - angleScatter, angle + angleScatter));
+	const auto startDirection = Angle1f::fromDegrees(rng.getFloat(angle - angleScatter, angle + angleScatter));
 	
-	auto& particle = particles[index];
-	particle.alive = true;
-	particle.time = 0;
-	particle.ttl = rng->getFloat(ttl - ttlScatter, ttl + ttlScatter);
-	particle.pos = getSpawnPosition();
-	particle.angle = rotateTowardsMovement ? startDirection : Angle1f();
-	particle.vel = Vector2f(rng->getFloat(speed - speedScatter, speed + speedScatter), startDirection);
+	times[index] = 0;
+	ttls[index] = rng.getFloat(ttl - ttlScatter, ttl + ttlScatter);
 
-	auto& sprite = sprites[index];
-	if (!baseSprites.empty()) {
-		sprite = rng->getRandomElement(baseSprites);
-	}
+	const auto pos = getSpawnPosition();
+	posX[index] = pos.x;
+	posY[index] = pos.y;
+
+	const auto vel = Vector2f(rng.getFloat(speed - speedScatter, speed + speedScatter), startDirection);
+	velX[index] = vel.x;
+	velY[index] = vel.y;
+	angles[index] = rotateTowardsMovement ? startDirection.getRadians() : 0.0f;
+
+	spriteIndices[index] = baseSprites.empty() ? 0 : static_cast<uint32_t>(rng.getSizeT(0, baseSprites.size() - 1));
 }
 
 void Particles::updateParticles(float time)
 {
-	for (size_t i = 0; i < nParticlesAlive; ++i) {
-		auto& particle = particles[i];
+	if (directionScatter > 0.00001f) {
+		for (size_t i = 0; i < nParticlesAlive; ++i) {
+			const auto vel = Vector2f(velX[i], velY[i]).rotate(Angle1f::fromDegrees(rng.getFloat(-directionScatter * time, directionScatter * time)));
+			velX[i] = vel.x;
+			velY[i] = vel.y;
+		}
+	}
 
-		particle.time += time;
-		if (particle.time >= particle.ttl) {
-			particle.alive = false;
-		} else {
-			if (directionScatter > 0.00001f) {
-				particle.vel = particle.vel.rotate(Angle1f::fromDegrees(rng->getFloat(-directionScatter * time, directionScatter * time)));
-			}
-			
-			particle.pos += particle.vel * time;
+	// Arrays are padded to a multiple of 4, so the lanes past the last live particle are just spare slots
+	const size_t n = (nParticlesAlive + 3) & ~size_t(3);
+	const auto dt = SIMDVec4::loadSingleValue(time);
+	for (size_t i = 0; i < n; i += 4) {
+		(SIMDVec4::loadUnaligned(&times[i]) + dt).storeUnaligned(&times[i]);
+		(SIMDVec4::loadUnaligned(&posX[i]) + SIMDVec4::loadUnaligned(&velX[i]) * dt).storeUnaligned(&posX[i]);
+		(SIMDVec4::loadUnaligned(&posY[i]) + SIMDVec4::loadUnaligned(&velY[i]) * dt).storeUnaligned(&posY[i]);
+	}
 
-			if (rotateTowardsMovement && particle.vel.squaredLength() > 0.001f) {
-				particle.angle = particle.vel.angle();
+	if (rotateTowardsMovement) {
+		for (size_t i = 0; i < nParticlesAlive; ++i) {
+			if (velX[i] * velX[i] + velY[i] * velY[i] > 0.001f) {
+				angles[i] = std::atan2(velY[i], velX[i]);
 			}
+		}
+	}
+}
 
-			if (fadeInTime > 0.000001f || fadeOutTime > 0.00001f) {
-				const float alpha = clamp(std::min(particle.time / fadeInTime, (particle.ttl - particle.time) / fadeOutTime), 0.0f, 1.0f);
-				sprites[i].getColour().a = alpha;
-			}
-			
-			sprites[i]
-				.setPosition(particle.pos)
-				.setRotation(particle.angle);
+void Particles::removeDeadParticles()
+{
+	for (size_t i = 0; i < nParticlesAlive; ) {
+		if (times[i] >= ttls[i]) {
+			// Move the last particle that's alive into this slot, and check it again
+			const size_t last = nParticlesAlive - 1;
+			posX[i] = posX[last];
+			posY[i] = posY[last];
+			velX[i] = velX[last];
+			velY[i] = velY[last];
+			angles[i] = angles[last];
+			times[i] = times[last];
+			ttls[i] = ttls[last];
+			spriteIndices[i] = spriteIndices[last];
+			--nParticlesAlive;
+		} else {
+			++i;
 		}
 	}
 }
 
-Vector2f Particles::getSpawnPosition() const
+Vector2f Particles::getSpawnPosition()
 {
-	return position + Vector2f(rng->getFloat(-spawnArea.x * 0.5f, spawnArea.x * 0.5f), rng->getFloat(-spawnArea.y * 0.5f, spawnArea.y * 0.5f));
+	return position + Vector2f(rng.getFloat(-spawnArea.x * 0.5f, spawnArea.x * 0.5f), rng.getFloat(-spawnArea.y * 0.5f, spawnArea.y * 0.5f));
 }
 
 ConfigNode ConfigNodeSerializer<Particles>::serialize(const Particles& particles, ConfigNodeSerializationContext& context)
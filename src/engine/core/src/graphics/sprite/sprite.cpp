@@ -8,6 +8,7 @@
 #include "halley/core/graphics/texture.h"
 #include "resources/resources.h"
 #include <gsl/gsl_assert>
+#include "halley/concurrency/concurrent.h"
 
 #include "halley/file_formats/config_file.h"
 
@@ -94,16 +95,7 @@ void Sprite::draw(const Sprite* sprites, size_t n, Painter& painter) // static
 	Expects(material->getDefinition().getVertexStride() == sizeof(SpriteVertexAttrib));
 
 	size_t spriteSize = sizeof(SpriteVertexAttrib);
-	char buffer[4096];
-	char* vertexData;
-	std::vector<char> vertices;
-	const size_t vertexDataSize = n * spriteSize;
-	if (vertexDataSize <= 4096) {
-		vertexData = buffer;
-	} else {
-		vertices.resize(vertexDataSize);
-		vertexData = vertices.data();
-	}
+	char* vertexData = static_cast<char*>(painter.getFrameAllocator().alloc(n * spriteSize, alignof(SpriteVertexAttrib)));
 
 	for (size_t i = 0; i < n; i++) {
 		auto& sprite = sprites[i];
@@ -133,6 +125,94 @@ void Sprite::drawMixedMaterials(const Sprite* sprites, size_t n, Painter& painte
 	draw(sprites + start, n - start, painter);
 }
 
+void Sprite::drawInView(gsl::span<const Sprite> sprites, Painter& painter, Rect4f view, const std::optional<Rect4f>& clip) // static
+{
+	constexpr size_t minParallelRun = 1024;
+	constexpr size_t spritesPerCullTask = 1024;
+
+	auto canBatch = [] (const Sprite& sprite)
+	{
+		return sprite.material && !sprite.sliced && !sprite.hasClip;
+	};
+
+	auto isVisible = [&] (const Sprite& sprite)
+	{
+		if (!sprite.isInView(view)) {
+			return false;
+		}
+		if (clip) {
+			const auto onScreen = sprite.getAABB().intersection(*clip);
+			return onScreen.getWidth() >= 0.01f && onScreen.getHeight() >= 0.01f;
+		}
+		return true;
+	};
+
+	const size_t n = sprites.size();
+
+	for (size_t i = 0; i < n; ) {
+		size_t runEnd = i;
+		if (canBatch(sprites[i])) {
+			const auto& material = sprites[i].material;
+			while (runEnd < n && canBatch(sprites[runEnd]) && sprites[runEnd].material == material) {
+				++runEnd;
+			}
+		}
+
+		if (runEnd - i < minParallelRun) {
+			// Not worth it, draw them one by one
+			for (const size_t end = std::max(runEnd, i + 1); i < end; ++i) {
+				if (sprites[i].isInView(view)) {
+					sprites[i].draw(painter, clip);
+				}
+			}
+			continue;
+		}
+
+		// Cull in parallel, each task compacting its visible sprites at the start of its own slice...
+		const size_t runSize = runEnd - i;
+		const size_t nTasks = (runSize + spritesPerCullTask - 1) / spritesPerCullTask;
+		const Sprite* run = sprites.data() + i;
+		const auto visible = painter.getFrameAllocator().alloc<const void*>(runSize);
+		const auto tasks = painter.getFrameAllocator().alloc<size_t>(nTasks);
+		for (size_t t = 0; t < nTasks; ++t) {
+			tasks[t] = t;
+		}
+		Concurrent::foreach(Executors::getCPU(), tasks.begin(), tasks.end(), [&] (size_t& task)
+		{
+			const size_t start = task * spritesPerCullTask;
+			const size_t end = std::min(start + spritesPerCullTask, runSize);
+			size_t count = 0;
+			for (size_t j = start; j < end; ++j) {
+				if (isVisible(run[j])) {
+					visible[start + count++] = &run[j].vertexAttrib;
+				}
+			}
+			task = count;
+		});
+
+		// ...then merge the slices, keeping the submission order
+		size_t nVisible = 0;
+		for (size_t t = 0; t < nTasks; ++t) {
+			const size_t start = t * spritesPerCullTask;
+			if (nVisible != start) {
+				std::copy(visible.begin() + start, visible.begin() + start + tasks[t], visible.begin() + nVisible);
+			}
+			nVisible += tasks[t];
+		}
+
+		if (nVisible > 0) {
+			if (clip) {
+				painter.setRelativeClip(*clip);
+			}
+			painter.drawSprites(run->material, gsl::span<const void* const>(visible.data(), nVisible));
+			if (clip) {
+				painter.setClip();
+			}
+		}
+		i = runEnd;
+	}
+}
+
 Rect4f Sprite::getLocalAABB() const
 {
 	const Vector2f sz = getSize();
@@ -1,11 +1,24 @@
 #include "graphics/sprite/sprite_painter.h"
 #include "graphics/sprite/sprite.h"
 #include "graphics/painter.h"
+#include "graphics/material/material.h"
 #include <gsl/gsl>
+#include <algorithm>
+#include <array>
+#include <cstring>
 #include "graphics/text/text_renderer.h"
+#include "graphics/sprite/particles.h"
 
 using namespace Halley;
 
+namespace {
+	uint64_t getMaterialKey(const Sprite& sprite)
+	{
+		// Sprites with equal materials have equal sort keys, and can share a draw call, see Painter::startDrawCall
+		return sprite.hasMaterial() ? sprite.getMaterial().getSortKey() : 0;
+	}
+}
+
 SpritePainterEntry::SpritePainterEntry(gsl::span<const Sprite> sprites, int mask, int layer, float tieBreaker, std::optional<Rect4f> clip)
 	: ptr(sprites.empty() ? nullptr : &sprites[0])
 	, count(sprites.size())
@@ -27,6 +40,17 @@ SpritePainterEntry::SpritePainterEntry(gsl::span<const TextRenderer> texts, int
 {
 }
 
+SpritePainterEntry::SpritePainterEntry(const Particles& particles, int mask, int layer, float tieBreaker, std::optional<Rect4f> clip)
+	: ptr(&particles)
+	, count(1)
+	, type(SpritePainterEntryType::ParticlesRef)
+	, layer(layer)
+	, mask(mask)
+	, tieBreaker(tieBreaker)
+	, clip(clip)
+{
+}
+
 SpritePainterEntry::SpritePainterEntry(SpritePainterEntryType type, size_t spriteIdx, size_t count, int mask, int layer, float tieBreaker, std::optional<Rect4f> clip)
 	: count(count)
 	, index(static_cast<int>(spriteIdx))
@@ -48,6 +72,16 @@ bool SpritePainterEntry::operator<(const SpritePainterEntry& o) const
 	}
 }
 
+uint64_t SpritePainterEntry::getSortKey() const
+{
+	// Flip the sign bits so that signed values sort correctly as unsigned ones
+	uint32_t tieBreakerBits;
+	memcpy(&tieBreakerBits, &tieBreaker, sizeof(tieBreakerBits));
+	tieBreakerBits = (tieBreakerBits & 0x80000000u) ? ~tieBreakerBits : (tieBreakerBits | 0x80000000u);
+	const uint32_t layerBits = static_cast<uint32_t>(layer) ^ 0x80000000u;
+	return (uint64_t(layerBits) << 32) | tieBreakerBits;
+}
+
 SpritePainterEntryType SpritePainterEntry::getType() const
 {
 	return type;
@@ -67,6 +101,13 @@ gsl::span<const TextRenderer> SpritePainterEntry::getTexts() const
 	return gsl::span<const TextRenderer>(static_cast<const TextRenderer*>(ptr), count);
 }
 
+const Particles& SpritePainterEntry::getParticles() const
+{
+	Expects(ptr != nullptr);
+	Expects(type == SpritePainterEntryType::ParticlesRef);
+	return *static_cast<const Particles*>(ptr);
+}
+
 uint32_t SpritePainterEntry::getIndex() const
 {
 	Expects(ptr == nullptr);
@@ -78,6 +119,11 @@ uint32_t SpritePainterEntry::getCount() const
 	return count;
 }
 
+int SpritePainterEntry::getLayer() const
+{
+	return layer;
+}
+
 int SpritePainterEntry::getMask() const
 {
 	return mask;
@@ -90,9 +136,12 @@ const std::optional<Rect4f>& SpritePainterEntry::getClip() const
 
 void SpritePainter::start()
 {
+	// Clearing keeps the capacity, so steady state frames don't allocate
 	sprites.clear();
 	cachedSprites.clear();
 	cachedText.clear();
+	sortEntries.clear();
+	dirty = false;
 }
 
 void SpritePainter::start(size_t)
@@ -103,24 +152,21 @@ void SpritePainter::start(size_t)
 void SpritePainter::add(const Sprite& sprite, int mask, int layer, float tieBreaker, std::optional<Rect4f> clip)
 {
 	Expects(mask >= 0);
-	sprites.push_back(SpritePainterEntry(gsl::span<const Sprite>(&sprite, 1), mask, layer, tieBreaker, std::move(clip)));
-	dirty = true;
+	addEntry(SpritePainterEntry(gsl::span<const Sprite>(&sprite, 1), mask, layer, tieBreaker, std::move(clip)), getMaterialKey(sprite));
 }
 
 void SpritePainter::addCopy(const Sprite& sprite, int mask, int layer, float tieBreaker, std::optional<Rect4f> clip)
 {
 	Expects(mask >= 0);
-	sprites.push_back(SpritePainterEntry(SpritePainterEntryType::SpriteCached, cachedSprites.size(), 1, mask, layer, tieBreaker, std::move(clip)));
+	addEntry(SpritePainterEntry(SpritePainterEntryType::SpriteCached, cachedSprites.size(), 1, mask, layer, tieBreaker, std::move(clip)), getMaterialKey(sprite));
 	cachedSprites.push_back(sprite);
-	dirty = true;
 }
 
 void SpritePainter::add(gsl::span<const Sprite> sprites, int mask, int layer, float tieBreaker, std::optional<Rect4f> clip)
 {
 	Expects(mask >= 0);
 	if (!sprites.empty()) {
-		this->sprites.push_back(SpritePainterEntry(sprites, mask, layer, tieBreaker, std::move(clip)));
-		dirty = true;
+		addEntry(SpritePainterEntry(sprites, mask, layer, tieBreaker, std::move(clip)), getMaterialKey(sprites[0]));
 	}
 }
 
@@ -128,35 +174,123 @@ void SpritePainter::addCopy(gsl::span<const Sprite> sprites, int mask, int layer
 {
 	Expects(mask >= 0);
 	if (!sprites.empty()) {
-		this->sprites.push_back(SpritePainterEntry(SpritePainterEntryType::SpriteCached, cachedSprites.size(), sprites.size(), mask, layer, tieBreaker, std::move(clip)));
+		addEntry(SpritePainterEntry(SpritePainterEntryType::SpriteCached, cachedSprites.size(), sprites.size(), mask, layer, tieBreaker, std::move(clip)), getMaterialKey(sprites[0]));
 		cachedSprites.insert(cachedSprites.end(), sprites.begin(), sprites.end());
-		dirty = true;
 	}
 }
 
 void SpritePainter::add(const TextRenderer& text, int mask, int layer, float tieBreaker, std::optional<Rect4f> clip)
 {
 	Expects(mask >= 0);
-	sprites.push_back(SpritePainterEntry(gsl::span<const TextRenderer>(&text, 1), mask, layer, tieBreaker, std::move(clip)));
-	dirty = true;
+	addEntry(SpritePainterEntry(gsl::span<const TextRenderer>(&text, 1), mask, layer, tieBreaker, std::move(clip)), 0);
 }
 
 void SpritePainter::addCopy(const TextRenderer& text, int mask, int layer, float tieBreaker, std::optional<Rect4f> clip)
 {
 	Expects(mask >= 0);
-	sprites.push_back(SpritePainterEntry(SpritePainterEntryType::TextCached, cachedText.size(), 1, mask, layer, tieBreaker, std::move(clip)));
+	addEntry(SpritePainterEntry(SpritePainterEntryType::TextCached, cachedText.size(), 1, mask, layer, tieBreaker, std::move(clip)), 0);
 	cachedText.push_back(text);
-	dirty = true;
+}
+
+void SpritePainter::add(const Particles& particles, int mask, int layer, float tieBreaker, std::optional<Rect4f> clip)
+{
+	Expects(mask >= 0);
+	if (particles.getNumParticles() > 0) {
+		addEntry(SpritePainterEntry(particles, mask, layer, tieBreaker, std::move(clip)), 0);
+	}
+}
+
+void SpritePainter::setLayerUnordered(int layer, bool unordered)
+{
+	const auto iter = std::find(unorderedLayers.begin(), unorderedLayers.end(), layer);
+	if (unordered && iter == unorderedLayers.end()) {
+		unorderedLayers.push_back(layer);
+	} else if (!unordered && iter != unorderedLayers.end()) {
+		unorderedLayers.erase(iter);
+	}
+}
+
+void SpritePainter::addEntry(SpritePainterEntry entry, uint64_t material)
+{
+	auto key = entry.getSortKey();
+	if (!unorderedLayers.empty() && std::find(unorderedLayers.begin(), unorderedLayers.end(), entry.getLayer()) != unorderedLayers.end()) {
+		// Drop the tie breaker, so the whole layer is ordered by material alone
+		key &= 0xFFFFFFFF00000000ull;
+	}
+
+	// Entries are often submitted already in order, in which case there's nothing to sort
+	if (!sortEntries.empty()) {
+		const auto& last = sortEntries.back();
+		if (key < last.key || (key == last.key && material < last.material)) {
+			dirty = true;
+		}
+	}
+
+	sortEntries.push_back(SortEntry{ key, material, static_cast<uint32_t>(sprites.size()) });
+	sprites.push_back(std::move(entry));
+}
+
+void SpritePainter::sortEntriesByKey(FrameAllocator& scratch)
+{
+	const size_t n = sortEntries.size();
+	if (n < 64) {
+		std::sort(sortEntries.begin(), sortEntries.end(), [] (const SortEntry& a, const SortEntry& b)
+		{
+			if (a.key != b.key) {
+				return a.key < b.key;
+			} else if (a.material != b.material) {
+				return a.material < b.material;
+			} else {
+				return a.index < b.index;
+			}
+		});
+		return;
+	}
+
+	// LSD radix sort, one byte at a time: 8 passes for the material, then 8 for the key
+	// Scenes usually have only a few layers, so passes where every entry falls in the same bucket are skipped
+	constexpr size_t nPasses = 16;
+	auto getDigit = [] (const SortEntry& e, size_t pass) -> size_t
+	{
+		return pass < 8 ? (e.material >> (pass * 8)) & 0xFF : (e.key >> ((pass - 8) * 8)) & 0xFF;
+	};
+
+	std::array<std::array<uint32_t, 256>, nPasses> histograms = {};
+	for (const auto& e: sortEntries) {
+		for (size_t pass = 0; pass < nPasses; ++pass) {
+			++histograms[pass][getDigit(e, pass)];
+		}
+	}
+
+	SortEntry* src = sortEntries.data();
+	SortEntry* dst = scratch.alloc<SortEntry>(n).data();
+	for (size_t pass = 0; pass < nPasses; ++pass) {
+		auto& histogram = histograms[pass];
+		if (histogram[getDigit(src[0], pass)] == n) {
+			continue;
+		}
+
+		uint32_t offset = 0;
+		for (auto& count: histogram) {
+			const auto c = count;
+			count = offset;
+			offset += c;
+		}
+		for (size_t i = 0; i < n; ++i) {
+			dst[histogram[getDigit(src[i], pass)]++] = src[i];
+		}
+		std::swap(src, dst);
+	}
+
+	if (src != sortEntries.data()) {
+		std::copy(src, src + n, sortEntries.begin());
+	}
 }
 
 void SpritePainter::draw(int mask, Painter& painter)
 {
 	if (dirty) {
-		// TODO: implement hierarchical bucketing.
-		// - one bucket per layer
-		// - for each layer, one bucket per vertical band of the screen (32px or so)
-		// - sort each leaf bucket
-		std::sort(sprites.begin(), sprites.end()); // lol
+		sortEntriesByKey(painter.getFrameAllocator());
 		dirty = false;
 	}
 
@@ -165,7 +299,8 @@ void SpritePainter::draw(int mask, Painter& painter)
 	Rect4f view = cam.getClippingRectangle();
 
 	// Draw!
-	for (auto& s : sprites) {
+	for (auto& e : sortEntries) {
+		const auto& s = sprites[e.index];
 		if ((s.getMask() & mask) != 0) {
 			const auto type = s.getType();
 			
@@ -177,6 +312,8 @@ void SpritePainter::draw(int mask, Painter& painter)
 				draw(s.getTexts(), painter, view, s.getClip());
 			} else if (type == SpritePainterEntryType::TextCached) {
 				draw(gsl::span<const TextRenderer>(cachedText.data() + s.getIndex(), s.getCount()), painter, view, s.getClip());
+			} else if (type == SpritePainterEntryType::ParticlesRef) {
+				s.getParticles().draw(painter, view, s.getClip());
 			}
 		}
 	}
@@ -185,11 +322,7 @@ void SpritePainter::draw(int mask, Painter& painter)
 
 void SpritePainter::draw(gsl::span<const Sprite> sprites, Painter& painter, Rect4f view, const std::optional<Rect4f>& clip) const
 {
-	for (const auto& sprite: sprites) {
-		if (sprite.isInView(view)) {
-			sprite.draw(painter, clip);
-		}
-	}
+	Sprite::drawInView(sprites, painter, view, clip);
 }
 
 void SpritePainter::draw(gsl::span<const TextRenderer> texts, Painter& painter, Rect4f view, const std::optional<Rect4f>& clip) const
@@ -4,12 +4,141 @@
 #include "halley/core/graphics/material/material.h"
 #include "halley/core/graphics/material/material_parameter.h"
 #include <gsl/gsl_assert>
+#include <array>
+#include <list>
+#include <mutex>
 
 #include "halley/support/logger.h"
 #include "halley/text/i18n.h"
+#include "halley/utils/hash.h"
+#include "halley/data_structures/hash_map.h"
 
 using namespace Halley;
 
+namespace Halley {
+	// The glyphs of a piece of text, laid out at the origin
+	// Only depends on the parameters in Key, so renderers that only differ in position, clip or material parameters share it
+	class TextLayout
+	{
+	public:
+		struct Key {
+			std::weak_ptr<const Font> font; // Weak, so cached layouts never keep a font alive, or match a different font allocated in its place
+			int fontVersion = 0;
+			StringUTF32 text;
+			float size = 0;
+			float align = 0;
+			float lineSpacing = 0;
+			Vector2f offset;
+			Vector2f pixelOffset;
+			Colour colour;
+			std::vector<ColourOverride> colourOverrides;
+
+			bool isFont(const std::shared_ptr<const Font>& other) const
+			{
+				return !font.owner_before(other) && !other.owner_before(font);
+			}
+
+			bool operator==(const Key& other) const
+			{
+				return !font.owner_before(other.font) && !other.font.owner_before(font) && fontVersion == other.fontVersion && text == other.text && size == other.size && align == other.align
+					&& lineSpacing == other.lineSpacing && offset == other.offset && pixelOffset == other.pixelOffset && colour == other.colour
+					&& colourOverrides == other.colourOverrides;
+			}
+
+			uint64_t getHash() const
+			{
+				Hash::Hasher hasher;
+				hasher.feed(font.lock().get());
+				hasher.feed(fontVersion);
+				hasher.feedBytes(gsl::as_bytes(gsl::span<const char32_t>(text.data(), text.size())));
+				hasher.feed(size);
+				hasher.feed(align);
+				hasher.feed(lineSpacing);
+				hasher.feed(offset);
+				hasher.feed(pixelOffset);
+				hasher.feed(colour);
+				for (const auto& o: colourOverrides) {
+					hasher.feed(o.first);
+					hasher.feed(o.second.value_or(Colour4f(-1, -1, -1, -1)));
+				}
+				return hasher.digest();
+			}
+		};
+
+		struct Glyph {
+			Vector2f pos;
+			Vector2f size;
+			Vector2f pivot;
+			Rect4f texRect;
+			Colour4f colour;
+			float scale;
+			uint32_t fontIndex; // Into fonts
+		};
+
+		Key key;
+		Vector<int> fontGlyphs; // For each font used by the glyphs, a character the main font resolves to it, or -1 for the main font itself
+		Vector<Glyph> glyphs;
+
+		// Replacement fonts are owned by the main font, so they're looked up through it rather than stored here
+		const Font& getFont(const Font& mainFont, uint32_t fontIndex) const
+		{
+			const int code = fontGlyphs[fontIndex];
+			return code < 0 ? mainFont : mainFont.getFontForGlyph(code);
+		}
+	};
+}
+
+namespace {
+	class TextLayoutCache
+	{
+	public:
+		template <typename F>
+		std::shared_ptr<const TextLayout> get(const TextLayout::Key& key, F generate)
+		{
+			const auto hash = key.getHash();
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				const auto iter = layouts.find(hash);
+				if (iter != layouts.end() && iter->second->second->key == key) {
+					lru.splice(lru.begin(), lru, iter->second);
+					return iter->second->second;
+				}
+			}
+
+			std::shared_ptr<const TextLayout> layout = generate();
+
+			std::unique_lock<std::mutex> lock(mutex);
+			const auto iter = layouts.find(hash);
+			if (iter != layouts.end()) {
+				lru.erase(iter->second);
+				layouts.erase(iter);
+			}
+			while (layouts.size() >= maxLayouts) {
+				// Least recently used first. Layouts of unloaded fonts can't match anymore, so they end up here too
+				layouts.erase(lru.back().first);
+				lru.pop_back();
+			}
+			lru.emplace_front(hash, layout);
+			layouts[hash] = lru.begin();
+			return layout;
+		}
+
+	private:
+		using Entry = std::pair<uint64_t, std::shared_ptr<const TextLayout>>;
+		constexpr static size_t maxLayouts = 4096;
+
+		std::mutex mutex;
+		std::list<Entry> lru; // Most recently used first
+		HashMap<uint64_t, std::list<Entry>::iterator> layouts;
+	};
+
+	TextLayoutCache& getTextLayoutCache()
+	{
+		static TextLayoutCache cache;
+		return cache;
+	}
+}
+
 TextRenderer::TextRenderer()
 {
 }
@@ -26,10 +155,8 @@ TextRenderer::TextRenderer(std::shared_ptr<const Font> font, String text, float
 
 TextRenderer& TextRenderer::setPosition(Vector2f pos)
 {
-	if (position != pos) {
-		position = pos;
-		positionDirty = true;
-	}
+	// Glyphs are laid out at the origin, so moving the text doesn't need to touch them
+	position = pos;
 	return *this;
 }
 
@@ -184,128 +311,189 @@ TextRenderer TextRenderer::clone() const
 
 void TextRenderer::generateSprites(std::vector<Sprite>& sprites) const
 {
-	Expects(font != nullptr);
+	updateLayout();
+
+	const auto& glyphs = layout->glyphs;
+	sprites.resize(glyphs.size());
+	for (size_t i = 0; i < glyphs.size(); ++i) {
+		const auto& glyph = glyphs[i];
+		sprites[i] = Sprite()
+			.setMaterial(getMaterialForGlyphs(layout->getFont(*font, glyph.fontIndex)), true)
+			.setSize(glyph.size)
+			.setTexRect(glyph.texRect)
+			.setColour(glyph.colour)
+			.setPivot(glyph.pivot)
+			.setScale(glyph.scale)
+			.setPos(position + glyph.pos);
+	}
+}
 
-	bool floorEnabled = false;
-	auto floorAlign = [floorEnabled] (Vector2f a) -> Vector2f
-	{
-		if (floorEnabled) {
-			return a.floor();
-		} else {
-			return a;
-		}
-	};
+void TextRenderer::draw(Painter& painter, const std::optional<Rect4f>& extClip) const
+{
+	updateLayout();
+
+	const std::optional<Rect4f> myClip = clip ? clip.value() + position : std::optional<Rect4f>();
+	const auto finalClip = Rect4f::optionalIntersect(myClip, extClip);
+	if (finalClip) {
+		painter.setRelativeClip(finalClip.value());
+	}
 
-	const bool hasMaterialOverride = font->isDistanceField();
-	if (hasMaterialOverride && materialDirty) {
+	if (spriteFilter) {
+		// The filter works on sprites, so those need to be generated
+		generateSprites(spritesCache);
+		spriteFilter(gsl::span<Sprite>(spritesCache.data(), spritesCache.size()));
+		Sprite::drawMixedMaterials(spritesCache.data(), spritesCache.size(), painter);
+	} else {
+		drawGlyphs(painter);
+	}
+
+	if (finalClip) {
+		painter.setClip();
+	}
+}
+
+void TextRenderer::updateLayout() const
+{
+	Expects(font != nullptr);
+
+	if (font->isDistanceField() && materialDirty) {
 		updateMaterials();
 		materialDirty = false;
 	}
 
-	if (glyphsDirty || positionDirty) {
-		float mainScale = getScale(*font);
-		Vector2f p = floorAlign(position + Vector2f(0, font->getAscenderDistance() * mainScale));
-		if (offset != Vector2f(0, 0)) {
-			p -= floorAlign(getExtents() * offset);
-		}
+	if (glyphsDirty || !layout || !layout->key.isFont(font) || layout->key.fontVersion != font->getAssetVersion()) {
+		TextLayout::Key key;
+		key.font = font;
+		key.fontVersion = font->getAssetVersion();
+		key.text = text;
+		key.size = size;
+		key.align = align;
+		key.lineSpacing = lineSpacing;
+		key.offset = offset;
+		key.pixelOffset = pixelOffset;
+		key.colour = colour;
+		key.colourOverrides = colourOverrides;
+
+		layout = getTextLayoutCache().get(key, [&] ()
+		{
+			auto result = generateLayout();
+			result->key = key;
+			return result;
+		});
+		glyphsDirty = false;
+	}
+}
 
-		size_t startPos = 0;
-		size_t spritesInserted = 0;
-		Vector2f lineOffset;
+std::shared_ptr<TextLayout> TextRenderer::generateLayout() const
+{
+	auto result = std::make_shared<TextLayout>();
+	auto& glyphs = result->glyphs;
+	auto& fontGlyphs = result->fontGlyphs;
+	Vector<const Font*> fonts; // Matching fontGlyphs
+	fonts.push_back(font.get());
+	fontGlyphs.push_back(-1);
 
-		auto flush = [&] ()
-		{
-			// Line break, update previous characters!
-			if (align != 0) {
-				Vector2f off = floorAlign(-lineOffset * align);
-				for (size_t j = startPos; j < spritesInserted; j++) {
-					auto& sprite = sprites[j];
-					sprite.setPos(sprite.getPosition() + off);
-				}
+	const float mainScale = getScale(*font);
+	Vector2f p = Vector2f(0, font->getAscenderDistance() * mainScale);
+	if (offset != Vector2f(0, 0)) {
+		p -= getExtents() * offset;
+	}
+
+	size_t startPos = 0;
+	Vector2f lineOffset;
+
+	auto flush = [&] ()
+	{
+		// Line break, update previous characters!
+		if (align != 0) {
+			const Vector2f off = -lineOffset * align;
+			for (size_t j = startPos; j < glyphs.size(); j++) {
+				glyphs[j].pos += off;
 			}
+		}
 
-			// Move pen
-			p.y += getLineHeight();
+		// Move pen
+		p.y += getLineHeight();
 
-			// Reset
-			startPos = spritesInserted;
-			lineOffset.x = 0;
-		};
+		// Reset
+		startPos = glyphs.size();
+		lineOffset.x = 0;
+	};
 
-		auto curCol = colour;
-		size_t curOverride = 0;
+	auto curCol = colour;
+	size_t curOverride = 0;
 
-		const size_t n = text.size();
+	const size_t n = text.size();
+	glyphs.reserve(n);
 
-		size_t nGlyphs = 0;
-		for (size_t i = 0; i < n; i++) {
-			if (text[i] != '\n') {
-				++nGlyphs;
-			}
-		}
-		sprites.resize(nGlyphs);
+	for (size_t i = 0; i < n; i++) {
+		int c = text[i];
 
-		for (size_t i = 0; i < n; i++) {
-			int c = text[i];
+		// Check for colour override
+		while (curOverride < colourOverrides.size() && colourOverrides[curOverride].first == i) {
+			curCol = colourOverrides[curOverride].second ? colourOverrides[curOverride].second.value() : colour;
+			++curOverride;
+		}
 
-			// Check for colour override
-			while (curOverride < colourOverrides.size() && colourOverrides[curOverride].first == i) {
-				curCol = colourOverrides[curOverride].second ? colourOverrides[curOverride].second.value() : colour;
-				++curOverride;
+		if (c == '\n') {
+			flush();
+		} else {
+			const auto& [glyph, fontForGlyph] = font->getGlyph(c);
+			const float scale = getScale(fontForGlyph);
+			const auto fontAdjustment = Vector2f(0, fontForGlyph.getAscenderDistance() - font->getAscenderDistance()) * scale;
+
+			auto fontIter = std::find(fonts.begin(), fonts.end(), &fontForGlyph);
+			if (fontIter == fonts.end()) {
+				fontIter = fonts.insert(fonts.end(), &fontForGlyph);
+				fontGlyphs.push_back(c);
 			}
-			
-			if (c == '\n') {
+
+			auto& g = glyphs.emplace_back();
+			g.pos = p + lineOffset + pixelOffset + fontAdjustment;
+			g.size = glyph.size;
+			g.pivot = glyph.horizontalBearing / glyph.size * Vector2f(-1, 1);
+			g.texRect = glyph.area;
+			g.colour = curCol;
+			g.scale = scale;
+			g.fontIndex = uint32_t(fontIter - fonts.begin());
+
+			lineOffset.x += glyph.advance.x * scale;
+
+			if (i == n - 1) {
 				flush();
-			} else {
-				const auto& [glyph, fontForGlyph] = font->getGlyph(c);
-				const float scale = getScale(fontForGlyph);
-				const auto fontAdjustment = floorAlign(Vector2f(0, fontForGlyph.getAscenderDistance() - font->getAscenderDistance()) * scale);
-
-				std::shared_ptr<Material> materialToUse = hasMaterialOverride ? getMaterial(fontForGlyph) : fontForGlyph.getMaterial();
-
-				sprites[spritesInserted++] = Sprite()
-					.setMaterial(std::move(materialToUse), true)
-					.setSize(glyph.size)
-					.setTexRect(glyph.area)
-					.setColour(curCol)
-					.setPivot(glyph.horizontalBearing / glyph.size * Vector2f(-1, 1))
-					.setScale(scale)
-					.setPos(p + lineOffset + pixelOffset + fontAdjustment);
-
-				lineOffset.x += glyph.advance.x * scale;
-
-				if (i == n - 1) {
-					flush();
-				}
 			}
 		}
-
-		glyphsDirty = false;
-		positionDirty = false;
 	}
-}
-
-void TextRenderer::draw(Painter& painter, const std::optional<Rect4f>& extClip) const
-{
-	generateSprites(spritesCache);
 
-	if (spriteFilter) {
-		// We don't know what the user will do with glyphs, so mark them as dirty
-		spriteFilter(gsl::span<Sprite>(spritesCache.data(), spritesCache.size()));
-		glyphsDirty = true;
-		positionDirty = true;
-	}
+	return result;
+}
 
-	const std::optional<Rect4f> myClip = clip ? clip.value() + position : std::optional<Rect4f>();
-	const auto finalClip = Rect4f::optionalIntersect(myClip, extClip);
-	if (finalClip) {
-		painter.setRelativeClip(finalClip.value());
-	}
-	
-	Sprite::drawMixedMaterials(spritesCache.data(), spritesCache.size(), painter);
+void TextRenderer::drawGlyphs(Painter& painter) const
+{
+	// Glyphs go straight into the painter, in batches of consecutive glyphs sharing a font
+	constexpr size_t batchSize = 32;
+	std::array<SpriteVertexAttrib, batchSize> vertices;
+
+	const auto& glyphs = layout->glyphs;
+	const size_t n = glyphs.size();
+	for (size_t start = 0; start < n; ) {
+		const auto fontIndex = glyphs[start].fontIndex;
+		const auto material = getMaterialForGlyphs(layout->getFont(*font, fontIndex));
+
+		size_t count = 0;
+		for (; start < n && count < batchSize && glyphs[start].fontIndex == fontIndex; ++start, ++count) {
+			const auto& glyph = glyphs[start];
+			auto& v = vertices[count];
+			v = SpriteVertexAttrib();
+			v.pos = position + glyph.pos;
+			v.pivot = glyph.pivot;
+			v.size = glyph.size;
+			v.scale = Vector2f(glyph.scale, glyph.scale);
+			v.colour = glyph.colour;
+			v.texRect = glyph.texRect;
+		}
 
-	if (finalClip) {
-		painter.setClip();
+		painter.drawSprites(material, count, vertices.data());
 	}
 }
 
@@ -541,6 +729,11 @@ float TextRenderer::getScale(const Font& f) const
 	return size / f.getSizePoints() * (usingReplacement ? font->getReplacementScale() : 1.0f);
 }
 
+std::shared_ptr<Material> TextRenderer::getMaterialForGlyphs(const Font& f) const
+{
+	return font->isDistanceField() ? getMaterial(f) : f.getMaterial();
+}
+
 std::shared_ptr<Material> TextRenderer::getMaterial(const Font& font) const
 {
 	const auto iter = materials.find(&font);
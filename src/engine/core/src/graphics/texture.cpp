@@ -8,13 +8,30 @@
 
 using namespace Halley;
 
+static ResourceMemoryUsage computeMemoryUsage(Vector2i size, TextureFormat format, bool useMipMap, const Image* retainedImage)
+{
+	size_t bytes = size_t(std::max(size.x, 0)) * size_t(std::max(size.y, 0)) * size_t(TextureDescriptor::getBitsPerPixel(format));
+	if (useMipMap) {
+		bytes += bytes / 3;
+	}
+
+	ResourceMemoryUsage usage;
+	usage.vramUsage = bytes;
+	usage.ramUsage = retainedImage ? retainedImage->getByteSize() : 0;
+	return usage;
+}
+
 Texture::Texture(Vector2i size)
 	: size(size)
+	, loadedMemoryUsage(computeMemoryUsage(size, TextureFormat::RGBA, false, nullptr))
 {}
 
 void Texture::load(TextureDescriptor desc)
 {
 	descriptor = std::move(desc);
+
+	// Measured before doLoad marks the texture as loaded, as the descriptor is still changed after that
+	loadedMemoryUsage = computeMemoryUsage(size, descriptor.format, descriptor.useMipMap, descriptor.retainPixelData ? descriptor.pixelData.getImage() : nullptr);
 	doLoad(descriptor);
 
 	if (!descriptor.retainPixelData) {
@@ -43,6 +60,15 @@ void Texture::doLoad(TextureDescriptor& descriptor)
 {
 }
 
+ResourceMemoryUsage Texture::getMemoryUsage() const
+{
+	// Written by the thread loading the texture, so only read once it's done; assume RGBA until then
+	if (isLoaded()) {
+		return loadedMemoryUsage;
+	}
+	return computeMemoryUsage(size, TextureFormat::RGBA, false, nullptr);
+}
+
 std::shared_ptr<Texture> Texture::loadResource(ResourceLoader& loader)
 {
 	const auto& meta = loader.getMeta();
@@ -5,15 +5,83 @@
 #include "halley/bytes/compression.h"
 #include "halley/maths/random.h"
 #include "halley/utils/encrypt.h"
+#include "halley/file/memory_mapped_file.h"
+#include "halley/resources/resource.h"
+#include "halley/utils/hash.h"
+#include <string_view>
 
 using namespace Halley;
 
-void AssetPackHeader::init(size_t assetDbSize)
+namespace {
+	class InflatedDataReader final : public ResourceDataReader {
+	public:
+		explicit InflatedDataReader(std::shared_ptr<const Bytes> data)
+			: data(std::move(data))
+		{}
+
+		size_t size() const override
+		{
+			return data->size();
+		}
+
+		int read(gsl::span<gsl::byte> dst) override
+		{
+			const size_t toRead = std::min(data->size() - std::min(curPos, data->size()), size_t(dst.size()));
+			memcpy(dst.data(), data->data() + curPos, toRead);
+			curPos += toRead;
+			return int(toRead);
+		}
+
+		void seek(int64_t pos, int whence) override
+		{
+			switch (whence) {
+			case SEEK_SET:
+				curPos = size_t(pos);
+				break;
+			case SEEK_CUR:
+				curPos = size_t(curPos + pos);
+				break;
+			case SEEK_END:
+				curPos = size_t(data->size() + pos);
+				break;
+			}
+		}
+
+		size_t tell() const override
+		{
+			return curPos;
+		}
+
+		void close() override
+		{
+		}
+
+	private:
+		std::shared_ptr<const Bytes> data;
+		size_t curPos = 0;
+	};
+}
+
+void AssetPackHeader::init(size_t nEntries, size_t stringTableSize)
 {
 	memcpy(identifier.data(), "HALLEYPK", 8);
-	assetDbStartPos = sizeof(AssetPackHeader);
-	dataStartPos = assetDbStartPos + assetDbSize;
 	memset(iv.data(), 0, iv.size());
+	version = currentVersion;
+	numEntries = uint32_t(nEntries);
+	assetDbStartPos = sizeof(AssetPackHeader);
+	stringTableStartPos = assetDbStartPos + nEntries * sizeof(AssetPackDirectoryEntry);
+	dataStartPos = alignUp(stringTableStartPos + stringTableSize, uint64_t(8));
+}
+
+uint32_t AssetPackHeader::getVersion() const
+{
+	// Version 1 packs had no version field, and their asset database started right after the header
+	return assetDbStartPos >= sizeof(AssetPackHeader) ? version : 1;
+}
+
+uint64_t AssetPackDirectoryEntry::hashName(const String& name)
+{
+	return Hash::hash(gsl::as_bytes(gsl::span<const char>(name.c_str(), name.size())));
 }
 
 AssetPack::AssetPack()
@@ -34,36 +102,36 @@ AssetPack::AssetPack(std::unique_ptr<ResourceDataReader> _reader, const String&
 {
 	// Read header
 	size_t totalSize = reader->size();
-	if (totalSize < sizeof(AssetPackHeader)) {
+	if (totalSize < AssetPackHeader::legacySize) {
 		throw Exception("Asset pack is invalid (too small)", HalleyExceptions::Resources);
 	}
 	AssetPackHeader header;
-	int nRead = reader->read(gsl::as_writable_bytes(gsl::span<AssetPackHeader>(&header, 1)));
-	if (nRead != int(sizeof(header))) {
+	memset(&header, 0, sizeof(header));
+	const size_t headerSize = std::min(totalSize, sizeof(header));
+	int nRead = reader->read(gsl::as_writable_bytes(gsl::span<AssetPackHeader>(&header, 1)).subspan(0, headerSize));
+	if (nRead != int(headerSize)) {
 		throw Exception("Unable to read header", HalleyExceptions::Resources);
 	}
-	if (memcmp(header.identifier.data(), "HALLEYPK", 8) != 0) {
-		throw Exception("Asset pack is invalid (invalid identifier)", HalleyExceptions::Resources);
-	}
-	iv = header.iv;
-	dataOffset = size_t(header.dataStartPos);
+	readHeader(header);
 
-	// Read asset database
+	// Read directory, or asset database on older packs
 	{
-		const size_t assetDbSize = size_t(header.dataStartPos - header.assetDbStartPos);
-		auto assetDbBytes = Bytes(assetDbSize);
-		nRead = reader->read(gsl::as_writable_bytes(gsl::span<Byte>(assetDbBytes)));
-		if (nRead != int(assetDbBytes.size())) {
+		if (header.assetDbStartPos > header.dataStartPos || header.dataStartPos > totalSize) {
+			throw Exception("Asset pack is invalid (truncated)", HalleyExceptions::Resources);
+		}
+		directoryData = Bytes(size_t(header.dataStartPos - header.assetDbStartPos));
+		reader->seek(int64_t(header.assetDbStartPos), SEEK_SET);
+		nRead = reader->read(gsl::as_writable_bytes(gsl::span<Byte>(directoryData)));
+		if (nRead != int(directoryData.size())) {
 			throw Exception("Unable to read header", HalleyExceptions::Resources);
 		}
-		assetDb = std::make_unique<AssetDatabase>();
-		Deserializer::fromBytes<AssetDatabase>(*assetDb, Compression::decompress(assetDbBytes));
+		readDirectory(header, gsl::as_bytes(gsl::span<const Byte>(directoryData)));
+		if (!hasDirectory) {
+			directoryData = Bytes();
+		}
 	}
 
-	std::array<char, 16> ivEmpty;
-	memset(ivEmpty.data(), 0, ivEmpty.size());
-	const bool hasCrypt = memcmp(iv.data(), ivEmpty.data(), iv.size()) != 0 && !encryptionKey.isEmpty();
-
+	const bool hasCrypt = hasEncryption(encryptionKey);
 	if (preLoad || hasCrypt) {
 		readToMemory();
 	}
@@ -73,6 +141,30 @@ AssetPack::AssetPack(std::unique_ptr<ResourceDataReader> _reader, const String&
 	}
 }
 
+AssetPack::AssetPack(std::shared_ptr<MemoryMappedFile> _mapping, const String& encryptionKey)
+	: mapping(std::move(_mapping))
+	, hasReader(false)
+{
+	const auto bytes = mapping->getSpan();
+	if (size_t(bytes.size()) < AssetPackHeader::legacySize) {
+		throw Exception("Asset pack is invalid (too small)", HalleyExceptions::Resources);
+	}
+	AssetPackHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(&header, bytes.data(), std::min(size_t(bytes.size()), sizeof(header)));
+	readHeader(header);
+
+	if (header.assetDbStartPos > header.dataStartPos || header.dataStartPos > uint64_t(bytes.size())) {
+		throw Exception("Asset pack is invalid (truncated)", HalleyExceptions::Resources);
+	}
+	readDirectory(header, bytes.subspan(size_t(header.assetDbStartPos), size_t(header.dataStartPos - header.assetDbStartPos)));
+
+	if (hasEncryption(encryptionKey)) {
+		readToMemory();
+		decrypt(encryptionKey);
+	}
+}
+
 AssetPack::~AssetPack()
 {
 }
@@ -84,23 +176,31 @@ AssetPack& AssetPack::operator=(AssetPack&& other) noexcept
 	assetDb = std::move(other.assetDb);
 	dataOffset = other.dataOffset;
 	reader = std::move(other.reader);
+	mapping = std::move(other.mapping);
 	data = std::move(other.data);
 	hasReader = !!reader;
+	version = other.version;
+	hasDirectory = other.hasDirectory;
+	directoryData = std::move(other.directoryData);
+	directory = other.directory;
+	stringTable = other.stringTable;
+	metadata = std::move(other.metadata);
 
 	other.hasReader = false;
 	other.reader.reset();
+	other.hasDirectory = false;
 
 	return *this;
 }
 
 AssetDatabase& AssetPack::getAssetDatabase()
 {
-	return *assetDb;
+	return loadAssetDatabase();
 }
 
 const AssetDatabase& AssetPack::getAssetDatabase() const
 {
-	return *assetDb;
+	return loadAssetDatabase();
 }
 
 Bytes& AssetPack::getData()
@@ -115,31 +215,150 @@ const Bytes& AssetPack::getData() const
 
 Bytes AssetPack::writeOut() const
 {
-	auto assetDbBytes = Compression::compress(Serializer::toBytes(*assetDb));
+	// Build the directory from the asset database, with names and metadata in the string table
+	Vector<AssetPackDirectoryEntry> entries;
+	Bytes strings;
+	auto addString = [&] (gsl::span<const gsl::byte> bytes) -> uint32_t
+	{
+		const size_t pos = strings.size();
+		strings.resize(pos + bytes.size());
+		memcpy(strings.data() + pos, bytes.data(), bytes.size());
+		return uint32_t(pos);
+	};
+
+	const auto& db = loadAssetDatabase();
+	for (auto typeName: EnumNames<AssetType>()()) {
+		const auto type = fromString<AssetType>(typeName);
+		if (!db.hasDatabase(type)) {
+			continue;
+		}
+		for (auto& [name, asset]: db.getDatabase(type).getAssets()) {
+			const auto location = asset.path.split(':');
+			const auto metaBytes = Serializer::toBytes(asset.meta);
+
+			auto& entry = entries.emplace_back();
+			entry.nameHash = AssetPackDirectoryEntry::hashName(name);
+			entry.type = uint32_t(type);
+			entry.compression = uint32_t(location.size() > 2 ? fromString<AssetPackCompression>(location[2]) : AssetPackCompression::None);
+			entry.pos = uint64_t(location.at(0).toInteger64());
+			entry.size = uint64_t(location.at(1).toInteger64());
+			entry.nameSize = uint32_t(name.size());
+			entry.nameOffset = addString(gsl::as_bytes(gsl::span<const char>(name.c_str(), name.size())));
+			entry.metadataSize = uint32_t(metaBytes.size());
+			entry.metadataOffset = addString(gsl::as_bytes(gsl::span<const Byte>(metaBytes)));
+		}
+	}
+	if (strings.size() > std::numeric_limits<uint32_t>::max()) {
+		throw Exception("Asset pack string table is too large.", HalleyExceptions::Resources);
+	}
+
+	std::sort(entries.begin(), entries.end(), [&] (const AssetPackDirectoryEntry& a, const AssetPackDirectoryEntry& b)
+	{
+		if (a.type != b.type) {
+			return a.type < b.type;
+		}
+		if (a.nameHash != b.nameHash) {
+			return a.nameHash < b.nameHash;
+		}
+		const auto nameA = std::string_view(reinterpret_cast<const char*>(strings.data()) + a.nameOffset, a.nameSize);
+		const auto nameB = std::string_view(reinterpret_cast<const char*>(strings.data()) + b.nameOffset, b.nameSize);
+		return nameA < nameB;
+	});
+
 	AssetPackHeader header;
-	header.init(assetDbBytes.size());
+	header.init(entries.size(), strings.size());
 	header.iv = iv;
 
 	auto result = Bytes(size_t(header.dataStartPos + data.size()));
 	memcpy(result.data(), &header, sizeof(AssetPackHeader));
-	memcpy(result.data() + header.assetDbStartPos, assetDbBytes.data(), assetDbBytes.size());
+	if (!entries.empty()) {
+		memcpy(result.data() + header.assetDbStartPos, entries.data(), entries.size() * sizeof(AssetPackDirectoryEntry));
+	}
+	memcpy(result.data() + header.stringTableStartPos, strings.data(), strings.size());
 	memcpy(result.data() + header.dataStartPos, data.data(), data.size());
 	return result;
 }
 
+void AssetPack::addAsset(AssetType type, const String& name, gsl::span<const gsl::byte> bytes, const Metadata& meta, AssetPackCompression compression, int compressionLevel)
+{
+	// Packs read from a file are brought into memory first, so new data can be appended after theirs
+	if (mapping || hasReader) {
+		readToMemory();
+	}
+
+	// The directory can't grow, so from now on the pack is looked up through its asset database, like packs built in memory
+	if (hasDirectory) {
+		loadAssetDatabase();
+		hasDirectory = false;
+		directory = {};
+		stringTable = {};
+		metadata.clear();
+		directoryData = Bytes();
+	}
+
+	Bytes compressed;
+	if (compression == AssetPackCompression::Deflate) {
+		compressed = Compression::compress(bytes, compressionLevel);
+		if (compressed.size() < size_t(bytes.size())) {
+			bytes = gsl::as_bytes(gsl::span<const Byte>(compressed));
+		} else {
+			compression = AssetPackCompression::None;
+		}
+	}
+
+	const size_t pos = data.size();
+	const size_t size = size_t(bytes.size());
+	data.reserve(nextPowerOf2(pos + size));
+	data.resize(pos + size);
+	memcpy(data.data() + pos, bytes.data(), size);
+
+	auto path = toString(pos) + ":" + toString(size);
+	if (compression != AssetPackCompression::None) {
+		path += ":" + toString(compression);
+	}
+	loadAssetDatabase().addAsset(name, type, AssetDatabase::Entry(path, meta));
+}
+
 std::unique_ptr<ResourceData> AssetPack::getData(const String& asset, AssetType type, bool stream)
 {
 	auto path = asset;
-	auto ps = assetDb->getDatabase(type).get(asset).path.split(':');
-	size_t pos = size_t(ps.at(0).toInteger());
-	size_t size = size_t(ps.at(1).toInteger());
+	size_t pos;
+	size_t size;
+	auto compression = AssetPackCompression::None;
+	if (hasDirectory) {
+		const auto* entry = findEntry(asset, type);
+		if (!entry) {
+			throw Exception("Asset not found: " + toString(type) + ":" + asset, HalleyExceptions::Resources);
+		}
+		pos = size_t(entry->pos);
+		size = size_t(entry->size);
+		compression = AssetPackCompression(entry->compression);
+	} else {
+		auto ps = assetDb->getDatabase(type).get(asset).path.split(':');
+		pos = size_t(ps.at(0).toInteger64());
+		size = size_t(ps.at(1).toInteger64());
+		if (ps.size() > 2) {
+			compression = fromString<AssetPackCompression>(ps[2]);
+		}
+	}
+
+	if (compression == AssetPackCompression::Deflate) {
+		return getInflatedData(path, pos, size, stream);
+	}
 
 	if (stream) {
 		return std::make_unique<ResourceDataStream>(path, [=] () -> std::unique_ptr<ResourceDataReader> {
 			return std::make_unique<PackDataReader>(*this, pos, size);
 		});
 	} else {
-		if (hasReader) {
+		if (mapping) {
+			if (dataOffset + pos + size > mapping->getSize()) {
+				throw Exception("Asset \"" + asset + "\" is out of pack bounds.", HalleyExceptions::Resources);
+			}
+
+			// Aliases the mapping, so it stays alive for as long as the data is in use
+			return std::make_unique<ResourceDataStatic>(std::shared_ptr<const char>(mapping, mapping->getData() + dataOffset + pos), size, path);
+		} else if (hasReader) {
 			auto result = new char[size];
 			try {
 				readData(pos, gsl::as_writable_bytes(gsl::span<char>(result, size)));
@@ -159,8 +378,101 @@ std::unique_ptr<ResourceData> AssetPack::getData(const String& asset, AssetType
 	}
 }
 
+std::unique_ptr<ResourceData> AssetPack::getInflatedData(const String& path, size_t pos, size_t size, bool stream)
+{
+	// Inflated on the calling thread, straight out of the mapping or preloaded data if possible
+	Bytes compressed;
+	gsl::span<const gsl::byte> src;
+	if (mapping || !hasReader) {
+		const auto packData = mapping ? mapping->getSpan().subspan(dataOffset) : gsl::as_bytes(gsl::span<const Byte>(data));
+		if (pos + size > size_t(packData.size())) {
+			throw Exception("Asset \"" + path + "\" is out of pack bounds.", HalleyExceptions::Resources);
+		}
+		src = packData.subspan(pos, size);
+	} else {
+		compressed.resize(size);
+		readData(pos, gsl::as_writable_bytes(gsl::span<Byte>(compressed)));
+		src = gsl::as_bytes(gsl::span<const Byte>(compressed));
+	}
+
+	if (stream) {
+		auto inflated = std::make_shared<Bytes>(Compression::decompress(src));
+		return std::make_unique<ResourceDataStream>(path, [=] () -> std::unique_ptr<ResourceDataReader> {
+			return std::make_unique<InflatedDataReader>(inflated);
+		});
+	}
+
+	size_t inflatedSize;
+	auto inflated = Compression::decompressToSharedPtr(src, inflatedSize);
+	return std::make_unique<ResourceDataStatic>(std::move(inflated), inflatedSize, path);
+}
+
+const Metadata& AssetPack::getMetaData(const String& asset, AssetType type)
+{
+	if (!hasDirectory) {
+		return loadAssetDatabase().getDatabase(type).get(asset).meta;
+	}
+
+	const auto* entry = findEntry(asset, type);
+	if (!entry) {
+		throw Exception("Asset not found: " + toString(type) + ":" + asset, HalleyExceptions::Resources);
+	}
+
+	// Metadata is only deserialized the first time it's requested
+	const size_t idx = size_t(entry - directory.data());
+	std::unique_lock<std::mutex> lock(metadataMutex);
+	if (!metadata[idx]) {
+		metadata[idx] = std::make_unique<Metadata>(Deserializer::fromBytes<Metadata>(gsl::as_bytes(stringTable.subspan(entry->metadataOffset, entry->metadataSize))));
+	}
+	return *metadata[idx];
+}
+
+std::vector<String> AssetPack::getAssets() const
+{
+	if (!hasDirectory) {
+		return loadAssetDatabase().getAssets();
+	}
+
+	std::vector<String> result;
+	result.reserve(directory.size());
+	uint32_t lastType = std::numeric_limits<uint32_t>::max();
+	String prefix;
+	for (auto& entry: directory) {
+		if (entry.type != lastType) {
+			lastType = entry.type;
+			prefix = toString(AssetType(entry.type)) + ":";
+		}
+		result.push_back(prefix + getName(entry));
+	}
+	return result;
+}
+
+uint32_t AssetPack::getVersion() const
+{
+	return version;
+}
+
 void AssetPack::readToMemory()
 {
+	if (mapping) {
+		const auto src = mapping->getSpan().subspan(dataOffset);
+		data = Bytes(size_t(src.size()));
+		memcpy(data.data(), src.data(), data.size());
+
+		if (hasDirectory) {
+			// The directory was pointing into the mapping
+			const auto* start = reinterpret_cast<const char*>(directory.data());
+			const size_t stringTableStart = size_t(stringTable.data() - start);
+			directoryData = Bytes(stringTableStart + size_t(stringTable.size()));
+			memcpy(directoryData.data(), start, directoryData.size());
+			directory = gsl::span<const AssetPackDirectoryEntry>(reinterpret_cast<const AssetPackDirectoryEntry*>(directoryData.data()), directory.size());
+			stringTable = gsl::span<const char>(reinterpret_cast<const char*>(directoryData.data()) + stringTableStart, stringTable.size());
+		}
+
+		mapping.reset();
+		return;
+	}
+
 	std::unique_lock<std::mutex> lock(readerMutex);
 	reader->seek(dataOffset, SEEK_SET);
 	data = reader->readAll();
@@ -188,6 +500,15 @@ void AssetPack::decrypt(const String& key)
 
 void AssetPack::readData(size_t pos, gsl::span<gsl::byte> dst)
 {
+	if (mapping) {
+		// No lock needed, the mapping is read-only
+		if (dataOffset + pos + size_t(dst.size()) > mapping->getSize()) {
+			throw Exception("Asset data is out of pack bounds.", HalleyExceptions::Resources);
+		}
+		memcpy(dst.data(), mapping->getData() + dataOffset + pos, dst.size());
+		return;
+	}
+
 	if (hasReader) {
 		std::unique_lock<std::mutex> lock(readerMutex);
 		if (reader) {
@@ -211,6 +532,98 @@ std::unique_ptr<ResourceDataReader> AssetPack::extractReader()
 	return std::move(reader);
 }
 
+bool AssetPack::isMemoryMapped() const
+{
+	return !!mapping;
+}
+
+void AssetPack::readHeader(const AssetPackHeader& header)
+{
+	if (memcmp(header.identifier.data(), "HALLEYPK", 8) != 0) {
+		throw Exception("Asset pack is invalid (invalid identifier)", HalleyExceptions::Resources);
+	}
+	version = header.getVersion();
+	if (version > AssetPackHeader::currentVersion) {
+		throw Exception("Asset pack version " + toString(version) + " is not supported.", HalleyExceptions::Resources);
+	}
+	iv = header.iv;
+	dataOffset = size_t(header.dataStartPos);
+}
+
+void AssetPack::readDirectory(const AssetPackHeader& header, gsl::span<const gsl::byte> bytes)
+{
+	if (version < 2) {
+		assetDb = std::make_unique<AssetDatabase>();
+		Deserializer::fromBytes<AssetDatabase>(*assetDb, Compression::decompress(bytes));
+		return;
+	}
+
+	// Searched in place, bytes must outlive the pack
+	const size_t directorySize = size_t(header.numEntries) * sizeof(AssetPackDirectoryEntry);
+	const size_t stringTableStart = size_t(header.stringTableStartPos - header.assetDbStartPos);
+	if (directorySize > stringTableStart || stringTableStart > size_t(bytes.size())) {
+		throw Exception("Asset pack is invalid (bad directory)", HalleyExceptions::Resources);
+	}
+	directory = gsl::span<const AssetPackDirectoryEntry>(reinterpret_cast<const AssetPackDirectoryEntry*>(bytes.data()), header.numEntries);
+	stringTable = gsl::span<const char>(reinterpret_cast<const char*>(bytes.data()) + stringTableStart, bytes.size() - stringTableStart);
+	for (auto& entry: directory) {
+		if (size_t(entry.nameOffset) + entry.nameSize > size_t(stringTable.size()) || size_t(entry.metadataOffset) + entry.metadataSize > size_t(stringTable.size())) {
+			throw Exception("Asset pack is invalid (bad directory entry)", HalleyExceptions::Resources);
+		}
+		if (entry.compression > uint32_t(AssetPackCompression::Deflate)) {
+			throw Exception("Asset pack uses an unsupported compression (" + toString(entry.compression) + ")", HalleyExceptions::Resources);
+		}
+	}
+	metadata.resize(directory.size());
+	hasDirectory = true;
+}
+
+bool AssetPack::hasEncryption(const String& encryptionKey) const
+{
+	std::array<char, 16> ivEmpty;
+	memset(ivEmpty.data(), 0, ivEmpty.size());
+	return memcmp(iv.data(), ivEmpty.data(), iv.size()) != 0 && !encryptionKey.isEmpty();
+}
+
+const AssetPackDirectoryEntry* AssetPack::findEntry(const String& asset, AssetType type) const
+{
+	const auto key = std::make_pair(uint32_t(type), AssetPackDirectoryEntry::hashName(asset));
+	auto iter = std::lower_bound(directory.begin(), directory.end(), key, [] (const AssetPackDirectoryEntry& entry, const std::pair<uint32_t, uint64_t>& k)
+	{
+		return std::make_pair(entry.type, entry.nameHash) < k;
+	});
+
+	// Names only need comparing on hash collisions
+	for (; iter != directory.end() && iter->type == key.first && iter->nameHash == key.second; ++iter) {
+		if (iter->nameSize == asset.size() && memcmp(stringTable.data() + iter->nameOffset, asset.c_str(), asset.size()) == 0) {
+			return &*iter;
+		}
+	}
+	return nullptr;
+}
+
+String AssetPack::getName(const AssetPackDirectoryEntry& entry) const
+{
+	return String(stringTable.data() + entry.nameOffset, entry.nameSize);
+}
+
+AssetDatabase& AssetPack::loadAssetDatabase() const
+{
+	std::unique_lock<std::mutex> lock(assetDbMutex);
+	if (!assetDb) {
+		assetDb = std::make_unique<AssetDatabase>();
+		for (auto& entry: directory) {
+			auto meta = Deserializer::fromBytes<Metadata>(gsl::as_bytes(stringTable.subspan(entry.metadataOffset, entry.metadataSize)));
+			auto path = toString(entry.pos) + ":" + toString(entry.size);
+			if (entry.compression != uint32_t(AssetPackCompression::None)) {
+				path += ":" + toString(AssetPackCompression(entry.compression));
+			}
+			assetDb->addAsset(getName(entry), AssetType(entry.type), AssetDatabase::Entry(path, meta));
+		}
+	}
+	return *assetDb;
+}
+
 PackDataReader::PackDataReader(AssetPack& pack, size_t startPos, size_t fileSize)
 	: pack(pack)
 	, startPos(startPos)
@@ -2,7 +2,9 @@
 #include "resources/resource_locator.h"
 #include "resources/resources.h"
 #include <halley/resources/resource.h>
+#include <halley/concurrency/concurrent.h>
 #include <utility>
+#include <algorithm>
 
 #include "graphics/sprite/sprite.h"
 #include "halley/support/logger.h"
@@ -18,23 +20,31 @@ ResourceCollectionBase::ResourceCollectionBase(Resources& parent, AssetType type
 
 void ResourceCollectionBase::clear()
 {
+	std::unique_lock<std::mutex> lock(mutex);
 	resources.clear();
+	memoryUsage = {};
+	stillLoading.clear();
 }
 
 void ResourceCollectionBase::unload(const String& assetId)
 {
-	resources.erase(assetId);
+	std::unique_lock<std::mutex> lock(mutex);
+	auto res = resources.find(assetId);
+	if (res != resources.end()) {
+		eraseResource(res);
+	}
 }
 
 void ResourceCollectionBase::unloadAll(int minDepth)
 {
+	std::unique_lock<std::mutex> lock(mutex);
 	for (auto iter = resources.begin(); iter != resources.end(); ) {
 		auto next = iter;
 		++next;
 
 		auto& res = (*iter).second;
 		if (res.depth >= minDepth) {
-			resources.erase(iter);
+			eraseResource(iter);
 		}
 
 		iter = next;
@@ -43,19 +53,33 @@ void ResourceCollectionBase::unloadAll(int minDepth)
 
 void ResourceCollectionBase::reload(const String& assetId)
 {
-	auto res = resources.find(assetId);
-	if (res != resources.end()) {
-		auto& resWrap = res->second;
-		try {
-			std::shared_ptr<Resource> newAsset = loadAsset(assetId, ResourceLoadPriority::High);
-			newAsset->setAssetId(assetId);
-			newAsset->onLoaded(parent);
-			resWrap.res->reloadResource(std::move(*newAsset));
-		} catch (std::exception& e) {
-			Logger::logError("Error while reloading " + assetId + ": " + e.what());
-		} catch (...) {
-			Logger::logError("Unknown error while reloading " + assetId);
+	std::shared_ptr<Resource> resource;
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		auto res = resources.find(assetId);
+		if (res == resources.end()) {
+			return;
 		}
+		resource = res->second.res;
+	}
+
+	try {
+		std::shared_ptr<Resource> newAsset = loadAsset(assetId, ResourceLoadPriority::High);
+		newAsset->setAssetId(assetId);
+		newAsset->onLoaded(parent);
+		resource->reloadResource(std::move(*newAsset));
+
+		// Measured again, as it's holding the new data now
+		std::unique_lock<std::mutex> lock(mutex);
+		auto res = resources.find(assetId);
+		if (res != resources.end() && res->second.res == resource) {
+			memoryUsage -= res->second.memoryUsage;
+			addMemoryUsage(assetId, res->second);
+		}
+	} catch (std::exception& e) {
+		Logger::logError("Error while reloading " + assetId + ": " + e.what());
+	} catch (...) {
+		Logger::logError("Unknown error while reloading " + assetId);
 	}
 }
 
@@ -71,6 +95,49 @@ std::shared_ptr<Resource> ResourceCollectionBase::getUntyped(const String& name,
 	return doGet(name, priority);
 }
 
+Future<std::shared_ptr<Resource>> ResourceCollectionBase::getUntypedAsync(const String& assetId, ResourceLoadPriority priority)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+
+	// Look in cache and return if it's there
+	auto res = resources.find(assetId);
+	if (res != resources.end()) {
+		touch(res->second);
+		Promise<std::shared_ptr<Resource>> promise;
+		promise.setValue(res->second.res);
+		return promise.getFuture();
+	}
+
+	// Join the load if it's already in progress
+	auto iter = pending.find(assetId);
+	if (iter != pending.end()) {
+		return iter->second->promise.getFuture();
+	}
+
+	// Read on the disk IO executors, in order of priority, then build it on the main thread
+	// This is all queued before releasing the lock, so anyone joining the load sees it complete
+	auto load = std::make_shared<PendingLoad>(priority);
+	pending[assetId] = load;
+	load->prefetching = Concurrent::execute(Executors::getDiskIO(), getTaskPriority(priority), [this, assetId, load] ()
+	{
+		prefetch(assetId, *load);
+	});
+	load->prefetching.then(Executors::getMainThread(), [this, assetId, load] ()
+	{
+		if (!load->claimed.exchange(true)) {
+			try {
+				completeLoad(assetId, *load);
+			} catch (std::exception& e) {
+				Logger::logError("Error while loading " + assetId + ": " + e.what());
+			} catch (...) {
+				Logger::logError("Unknown error while loading " + assetId);
+			}
+		}
+	});
+
+	return load->promise.getFuture();
+}
+
 std::vector<String> ResourceCollectionBase::enumerate() const
 {
 	if (resourceEnumerator) {
@@ -80,7 +147,7 @@ std::vector<String> ResourceCollectionBase::enumerate() const
 	}
 }
 
-std::shared_ptr<Resource> ResourceCollectionBase::loadAsset(const String& assetId, ResourceLoadPriority priority) {
+std::shared_ptr<Resource> ResourceCollectionBase::loadAsset(const String& assetId, ResourceLoadPriority priority, std::unique_ptr<ResourceDataStatic> prefetched) {
 	std::shared_ptr<Resource> newRes;
 
 	if (resourceLoader) {
@@ -88,7 +155,8 @@ std::shared_ptr<Resource> ResourceCollectionBase::loadAsset(const String& assetI
 		newRes = resourceLoader(assetId, priority);
 	} else {
 		// Normal loading
-		auto resLoader = ResourceLoader(*(parent.locator), assetId, type, priority, parent.api, parent);		
+		auto resLoader = ResourceLoader(*(parent.locator), assetId, type, priority, parent.api, parent);
+		resLoader.prefetched = std::move(prefetched);
 		newRes = loadResource(resLoader);
 		if (!newRes && resLoader.loaded) {
 			throw Exception("Unable to construct resource from data: " + assetId, HalleyExceptions::Resources);
@@ -104,19 +172,90 @@ std::shared_ptr<Resource> ResourceCollectionBase::loadAsset(const String& assetI
 
 std::shared_ptr<Resource> ResourceCollectionBase::doGet(const String& assetId, ResourceLoadPriority priority)
 {
-	// Look in cache and return if it's there
-	auto res = resources.find(assetId);
-	if (res != resources.end()) {
-		return res->second.res;
+	std::shared_ptr<PendingLoad> load;
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+
+		// Look in cache and return if it's there
+		auto res = resources.find(assetId);
+		if (res != resources.end()) {
+			touch(res->second);
+			return res->second.res;
+		}
+
+		auto iter = pending.find(assetId);
+		if (iter == pending.end()) {
+			// Not loading yet, so load it here, letting anyone else asking for it wait on this
+			load = std::make_shared<PendingLoad>(priority);
+			load->claimed = true;
+			pending[assetId] = load;
+			lock.unlock();
+			return completeLoad(assetId, *load);
+		}
+		load = iter->second;
+	}
+
+	// Being loaded asynchronously, but not built yet, so build it here rather than wait for the main thread
+	if (!load->claimed.exchange(true)) {
+		load->prefetching.wait();
+		return completeLoad(assetId, *load);
+	}
+
+	// Being built elsewhere
+	auto result = load->promise.getFuture().get();
+	if (!result) {
+		throw Exception("Unable to load resource: " + assetId, HalleyExceptions::Resources);
+	}
+	return result;
+}
+
+void ResourceCollectionBase::prefetch(const String& assetId, PendingLoad& load)
+{
+	// Streamed assets are read as they're used, and loaders that are overridden don't read through the locator
+	// Any errors are left for completeLoad to report, as it'll run into them again
+	if (!resourceLoader) {
+		try {
+			const auto& meta = parent.locator->getMetaData(assetId, type);
+			if (!meta.getBool("streaming", false)) {
+				load.prefetched = ResourceLoader::readStatic(*(parent.locator), assetId, type, meta);
+			}
+		} catch (...) {
+			load.prefetched.reset();
+		}
+	}
+}
+
+std::shared_ptr<Resource> ResourceCollectionBase::completeLoad(const String& assetId, PendingLoad& load)
+{
+	std::shared_ptr<Resource> newRes;
+	try {
+		// Load resource from disk
+		newRes = loadAsset(assetId, load.priority, std::move(load.prefetched));
+		newRes->setAssetId(assetId);
+
+		// Store in cache
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			auto result = resources.emplace(assetId, Wrapper(newRes, 0, true));
+			if (result.second) {
+				addMemoryUsage(assetId, result.first->second);
+				touch(result.first->second);
+			}
+			pending.erase(assetId);
+		}
+		newRes->onLoaded(parent);
+	} catch (...) {
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			pending.erase(assetId);
+		}
+		load.promise.setValue({});
+		throw;
 	}
-	
-	// Load resource from disk
-	std::shared_ptr<Resource> newRes = loadAsset(assetId, priority);
 
-	// Store in cache
-	newRes->setAssetId(assetId);
-	resources.emplace(assetId, Wrapper(newRes, 0));
-	newRes->onLoaded(parent);
+	evictToBudget();
+	parent.evictToBudget();
+	load.promise.setValue(newRes);
 
 	return newRes;
 }
@@ -124,16 +263,24 @@ std::shared_ptr<Resource> ResourceCollectionBase::doGet(const String& assetId, R
 bool ResourceCollectionBase::exists(const String& assetId)
 {
 	// Look in cache
-	auto res = resources.find(assetId);
-	if (res != resources.end()) {
-		return true;
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		auto res = resources.find(assetId);
+		if (res != resources.end()) {
+			return true;
+		}
 	}
 
 	return parent.locator->exists(assetId, type);
 }
 
 void ResourceCollectionBase::setResource(int curDepth, const String& name, std::shared_ptr<Resource> resource) {
-	resources.emplace(name, Wrapper(std::move(resource), curDepth));
+	std::unique_lock<std::mutex> lock(mutex);
+	auto result = resources.emplace(name, Wrapper(std::move(resource), curDepth));
+	if (result.second) {
+		addMemoryUsage(name, result.first->second);
+		touch(result.first->second);
+	}
 }
 
 void ResourceCollectionBase::setResourceLoader(ResourceLoaderFunc loader)
@@ -145,3 +292,159 @@ void ResourceCollectionBase::setResourceEnumerator(ResourceEnumeratorFunc enumer
 {
 	resourceEnumerator = std::move(enumerator);
 }
+
+void ResourceCollectionBase::setMemoryBudget(std::optional<size_t> budget)
+{
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		memoryBudget = budget;
+	}
+	evictToBudget();
+}
+
+std::optional<size_t> ResourceCollectionBase::getMemoryBudget() const
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	return memoryBudget;
+}
+
+ResourceMemoryUsage ResourceCollectionBase::getMemoryUsage() const
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	return memoryUsage;
+}
+
+ResourceCollectionStats ResourceCollectionBase::getStats()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	refreshMemoryUsage();
+
+	ResourceCollectionStats stats;
+	stats.numResources = resources.size();
+	for (auto& res: resources) {
+		if (isEvictable(res.second)) {
+			++stats.numEvictable;
+		}
+	}
+	stats.numEvicted = numEvicted;
+	stats.memoryUsage = memoryUsage;
+	stats.memoryBudget = memoryBudget;
+	return stats;
+}
+
+void ResourceCollectionBase::evictToBudget()
+{
+	// Declared before the lock, so evicted resources are only destroyed after it's released
+	Vector<std::shared_ptr<Resource>> evicted;
+
+	std::unique_lock<std::mutex> lock(mutex);
+	if (!memoryBudget) {
+		return;
+	}
+	refreshMemoryUsage();
+	if (memoryUsage.getTotal() <= *memoryBudget) {
+		return;
+	}
+
+	Vector<std::pair<uint64_t, HashMap<String, Wrapper>::iterator>> candidates;
+	for (auto iter = resources.begin(); iter != resources.end(); ++iter) {
+		if (isEvictable(iter->second)) {
+			candidates.emplace_back(iter->second.lastUse, iter);
+		}
+	}
+	std::sort(candidates.begin(), candidates.end(), [] (const auto& a, const auto& b) { return a.first < b.first; });
+
+	for (auto& candidate: candidates) {
+		if (memoryUsage.getTotal() <= *memoryBudget) {
+			break;
+		}
+		evicted.push_back(std::move(candidate.second->second.res));
+		eraseResource(candidate.second);
+		++numEvicted;
+	}
+}
+
+void ResourceCollectionBase::getEvictionCandidates(Vector<EvictionCandidate>& dst)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	refreshMemoryUsage();
+
+	for (auto& res: resources) {
+		if (isEvictable(res.second)) {
+			dst.push_back(EvictionCandidate{ res.second.lastUse, type, res.first });
+		}
+	}
+}
+
+size_t ResourceCollectionBase::evict(const String& assetId)
+{
+	std::shared_ptr<Resource> evicted;
+
+	std::unique_lock<std::mutex> lock(mutex);
+	auto res = resources.find(assetId);
+	if (res == resources.end() || !isEvictable(res->second)) {
+		return 0;
+	}
+
+	const size_t freed = res->second.memoryUsage.getTotal();
+	evicted = std::move(res->second.res);
+	eraseResource(res);
+	++numEvicted;
+	return freed;
+}
+
+void ResourceCollectionBase::touch(Wrapper& wrapper)
+{
+	wrapper.lastUse = ++parent.useCounter;
+}
+
+bool ResourceCollectionBase::isEvictable(const Wrapper& wrapper) const
+{
+	// Evicting something that doesn't use any memory wouldn't help, and it'd have to be loaded again
+	return wrapper.evictable && wrapper.res.use_count() == 1 && wrapper.memoryUsage.getTotal() > 0;
+}
+
+static bool isStillLoading(const Resource& res)
+{
+	const auto* asyncRes = dynamic_cast<const AsyncResource*>(&res);
+	return asyncRes && !asyncRes->isLoaded();
+}
+
+void ResourceCollectionBase::addMemoryUsage(const String& assetId, Wrapper& wrapper)
+{
+	wrapper.memoryUsage = wrapper.res->getMemoryUsage();
+	memoryUsage += wrapper.memoryUsage;
+
+	if (!wrapper.loading && isStillLoading(*wrapper.res)) {
+		wrapper.loading = true;
+		stillLoading.push_back(assetId);
+	}
+}
+
+void ResourceCollectionBase::refreshMemoryUsage()
+{
+	// Only resources that were still loading when stored can have changed since they were measured
+	for (size_t i = 0; i < stillLoading.size(); ) {
+		auto& wrapper = resources.at(stillLoading[i]);
+		memoryUsage -= wrapper.memoryUsage;
+		wrapper.memoryUsage = wrapper.res->getMemoryUsage();
+		memoryUsage += wrapper.memoryUsage;
+
+		if (isStillLoading(*wrapper.res)) {
+			++i;
+		} else {
+			wrapper.loading = false;
+			stillLoading[i] = std::move(stillLoading.back());
+			stillLoading.pop_back();
+		}
+	}
+}
+
+void ResourceCollectionBase::eraseResource(HashMap<String, Wrapper>::iterator iter)
+{
+	if (iter->second.loading) {
+		stillLoading.erase(std::find(stillLoading.begin(), stillLoading.end(), iter->first));
+	}
+	memoryUsage -= iter->second.memoryUsage;
+	resources.erase(iter);
+}
@@ -6,9 +6,20 @@
 #include "api/system_api.h"
 #include "halley/text/string_converter.h"
 #include "halley/resources/resource.h"
+#include "halley/file/memory_mapped_file.h"
 
 using namespace Halley;
 
+std::vector<String> IResourceLocatorProvider::getAssets()
+{
+	return getAssetDatabase().getAssets();
+}
+
+const Metadata& IResourceLocatorProvider::getMetaData(const String& asset, AssetType type)
+{
+	return getAssetDatabase().getDatabase(type).get(asset).meta;
+}
+
 ResourceLocator::ResourceLocator(SystemAPI& system)
 	: system(system)
 {
@@ -23,8 +34,7 @@ void ResourceLocator::add(std::unique_ptr<IResourceLocatorProvider> locator, con
 
 void ResourceLocator::loadLocatorData(IResourceLocatorProvider& locator)
 {
-	auto& db = locator.getAssetDatabase();
-	for (auto& asset: db.getAssets()) {
+	for (auto& asset: locator.getAssets()) {
 		auto result = assetToLocator.find(asset);
 		if (result == assetToLocator.end() || result->second->getPriority() < locator.getPriority()) {
 			assetToLocator[asset] = &locator;
@@ -122,11 +132,20 @@ void ResourceLocator::addPack(const Path& path, const String& encryptionKey, boo
 	}
 }
 
+void ResourceLocator::addMappedPack(const Path& path, const String& encryptionKey, bool allowFailure, std::optional<int> priority)
+{
+	auto mapping = MemoryMappedFile::open(path);
+	if (mapping) {
+		add(std::make_unique<PackResourceLocator>(std::move(mapping), path, encryptionKey, priority), path);
+	} else {
+		addPack(path, encryptionKey, false, allowFailure, priority);
+	}
+}
+
 void ResourceLocator::removePack(const Path& path)
 {
 	auto* locatorToRemove = locatorPaths.find(path.getString())->second;
-	auto& dbToRemove = locatorToRemove->getAssetDatabase();
-	for (auto& asset : dbToRemove.getAssets()) {
+	for (auto& asset : locatorToRemove->getAssets()) {
 		auto result = assetToLocator.find(asset);
 		if (result != assetToLocator.end()) {
 			assetToLocator.erase(asset);
@@ -137,8 +156,7 @@ void ResourceLocator::removePack(const Path& path)
 	
 	for (const auto& locator : locators)
 	{
-		auto& db = locator->getAssetDatabase();
-		for (auto& asset : db.getAssets()) {
+		for (auto& asset : locator->getAssets()) {
 			auto result = assetToLocator.find(asset);
 			if (result == assetToLocator.end() || result->second->getPriority() < locator->getPriority()) {
 				assetToLocator[asset] = locator.get();
@@ -152,8 +170,7 @@ std::vector<String> ResourceLocator::getAssetsFromPack(const Path& path, const S
 	auto dataReader = system.getDataReader(path.string());
 	if (dataReader) {
 		std::unique_ptr<IResourceLocatorProvider> resourceLocator = std::make_unique<PackResourceLocator>(std::move(dataReader), path, "", true);
-		auto& db = resourceLocator->getAssetDatabase();
-		return db.getAssets();
+		return resourceLocator->getAssets();
 	}
 	else {
 		throw Exception("Unable to load resource pack \"" + path.string() + "\"", HalleyExceptions::Resources);
@@ -164,7 +181,7 @@ const Metadata& ResourceLocator::getMetaData(const String& asset, AssetType type
 {
 	auto result = assetToLocator.find(toString(type) + ":" + asset);
 	if (result != assetToLocator.end()) {
-		return result->second->getAssetDatabase().getDatabase(type).get(asset).meta;
+		return result->second->getMetaData(asset, type);
 	} else {
 		throw Exception("Unable to locate resource: " + asset, HalleyExceptions::Resources);
 	}
@@ -2,6 +2,7 @@
 #include <utility>
 #include "resources/asset_pack.h"
 #include "api/system_api.h"
+#include "halley/file/memory_mapped_file.h"
 using namespace Halley;
 
 PackResourceLocator::PackResourceLocator(std::unique_ptr<ResourceDataReader> reader, Path path, String key, bool preLoad, std::optional<int> priority)
@@ -13,6 +14,15 @@ PackResourceLocator::PackResourceLocator(std::unique_ptr<ResourceDataReader> rea
 	assetPack = std::make_unique<AssetPack>(std::move(reader), encryptionKey, preLoad);
 }
 
+PackResourceLocator::PackResourceLocator(std::shared_ptr<MemoryMappedFile> mapping, Path path, String key, std::optional<int> priority)
+	: path(std::move(path))
+	, encryptionKey(std::move(key))
+	, memoryMapped(true)
+	, priority(priority)
+{
+	assetPack = std::make_unique<AssetPack>(std::move(mapping), encryptionKey);
+}
+
 PackResourceLocator::~PackResourceLocator()
 {
 }
@@ -33,6 +43,22 @@ const AssetDatabase& PackResourceLocator::getAssetDatabase()
 	return assetPack->getAssetDatabase();
 }
 
+std::vector<String> PackResourceLocator::getAssets()
+{
+	if (!assetPack) {
+		loadAfterPurge();
+	}
+	return assetPack->getAssets();
+}
+
+const Metadata& PackResourceLocator::getMetaData(const String& asset, AssetType type)
+{
+	if (!assetPack) {
+		loadAfterPurge();
+	}
+	return assetPack->getMetaData(asset, type);
+}
+
 void PackResourceLocator::purge(SystemAPI& sys)
 {
 	assetPack.reset();
@@ -41,6 +67,14 @@ void PackResourceLocator::purge(SystemAPI& sys)
 
 void PackResourceLocator::loadAfterPurge()
 {
+	if (memoryMapped) {
+		auto mapping = MemoryMappedFile::open(path);
+		if (!mapping) {
+			throw Exception("Unable to map resource pack \"" + path.string() + "\"", HalleyExceptions::Resources);
+		}
+		assetPack = std::make_unique<AssetPack>(std::move(mapping), encryptionKey);
+		return;
+	}
 	assetPack = std::make_unique<AssetPack>(system->getDataReader(path.string()), encryptionKey, preLoad);
 }
 
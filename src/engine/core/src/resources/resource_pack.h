@@ -6,15 +6,19 @@
 namespace Halley {
 	class SystemAPI;
 	class AssetPack;
+	class MemoryMappedFile;
 
 	class PackResourceLocator final : public IResourceLocatorProvider {
 	public:
 		explicit PackResourceLocator(std::unique_ptr<ResourceDataReader> reader, Path path, String encryptionKey = "", bool preLoad = false, std::optional<int> priority = {});
+		explicit PackResourceLocator(std::shared_ptr<MemoryMappedFile> mapping, Path path, String encryptionKey = "", std::optional<int> priority = {});
 		~PackResourceLocator();
 
 	protected:
 		std::unique_ptr<ResourceData> getData(const String& asset, AssetType type, bool stream) override;
 		const AssetDatabase& getAssetDatabase() override;
+		std::vector<String> getAssets() override;
+		const Metadata& getMetaData(const String& asset, AssetType type) override;
 		void purge(SystemAPI& system) override;
 		int getPriority() const override;
 		
@@ -25,7 +29,8 @@ namespace Halley {
 
 		Path path;
 		String encryptionKey; // :(
-		bool preLoad;
+		bool preLoad = false;
+		bool memoryMapped = false;
 		std::optional<int> priority;
 		SystemAPI* system = nullptr;
 	};
@@ -2,6 +2,7 @@
 #include "resources/resource_locator.h"
 #include "api/halley_api.h"
 #include "halley/support/logger.h"
+#include <halley/concurrency/concurrent.h>
 
 using namespace Halley;
 
@@ -9,6 +10,7 @@ Resources::Resources(std::unique_ptr<ResourceLocator> locator, const HalleyAPI&
 	: locator(std::move(locator))
 	, api(&api)
 	, options(options)
+	, useCounter(0)
 {
 }
 
@@ -19,18 +21,7 @@ void Resources::reloadAssets(const std::vector<String>& ids)
 		return;
 	}
 
-	// Build this map first, so it gets sorted by AssetType
-	// The order in which asset types are reloaded is important, since they have dependencies
-	std::map<AssetType, std::vector<String>> byType;
-
-	for (auto& id: ids) {
-		auto splitPos = id.find(':');
-		auto type = fromString<AssetType>(id.left(splitPos));
-		String name = id.mid(splitPos + 1);
-		byType[type].emplace_back(std::move(name));
-	}
-
-	reloadAssets(byType);
+	reloadAssets(groupByType(ids));
 
 	locator->purgeAll();
 }
@@ -66,4 +57,131 @@ void Resources::reloadAssets(const std::map<AssetType, std::vector<String>>& byT
 	}
 }
 
+Future<void> Resources::preload(const std::vector<String>& ids, ResourceLoadPriority priority)
+{
+	return preload(groupByType(ids), priority);
+}
+
+Future<void> Resources::preload(std::map<AssetType, std::vector<String>> byType, ResourceLoadPriority priority)
+{
+	auto assets = std::make_shared<const AssetsByType>(std::move(byType));
+	Promise<void> promise;
+	preloadType(assets, assets->begin(), priority, promise);
+	return promise.getFuture();
+}
+
+void Resources::preloadType(std::shared_ptr<const AssetsByType> assets, AssetsByType::const_iterator cur, ResourceLoadPriority priority, Promise<void> promise)
+{
+	if (cur == assets->end()) {
+		promise.set();
+		return;
+	}
+
+	auto& collection = ofType(cur->first);
+	std::vector<Future<std::shared_ptr<Resource>>> futures;
+	futures.reserve(cur->second.size());
+	for (auto& name: cur->second) {
+		futures.push_back(collection.getUntypedAsync(name, priority));
+	}
+
+	// Only move on to the next type once all of these are done, so it finds its dependencies already loaded
+	Concurrent::whenAll(futures.begin(), futures.end()).then(Executors::getCPU(), [this, assets, next = std::next(cur), priority, promise] ()
+	{
+		preloadType(assets, next, priority, promise);
+	});
+}
+
+void Resources::setMemoryBudget(std::optional<size_t> budget)
+{
+	{
+		std::unique_lock<std::mutex> lock(budgetMutex);
+		memoryBudget = budget;
+	}
+	evictToBudget();
+}
+
+void Resources::setMemoryBudget(AssetType type, std::optional<size_t> budget)
+{
+	ofType(type).setMemoryBudget(budget);
+}
+
+std::optional<size_t> Resources::getMemoryBudget() const
+{
+	std::unique_lock<std::mutex> lock(budgetMutex);
+	return memoryBudget;
+}
+
+ResourceMemoryUsage Resources::getMemoryUsage() const
+{
+	ResourceMemoryUsage usage;
+	for (auto& collection: resources) {
+		if (collection) {
+			usage += collection->getMemoryUsage();
+		}
+	}
+	return usage;
+}
+
+std::map<AssetType, ResourceCollectionStats> Resources::getMemoryStats() const
+{
+	std::map<AssetType, ResourceCollectionStats> result;
+	for (size_t i = 0; i < resources.size(); ++i) {
+		if (resources[i]) {
+			result[AssetType(i)] = resources[i]->getStats();
+		}
+	}
+	return result;
+}
+
+void Resources::enforceMemoryBudgets()
+{
+	for (auto& collection: resources) {
+		if (collection) {
+			collection->evictToBudget();
+		}
+	}
+	evictToBudget();
+}
+
+void Resources::evictToBudget()
+{
+	std::unique_lock<std::mutex> lock(budgetMutex);
+	if (!memoryBudget || getMemoryUsage().getTotal() <= *memoryBudget) {
+		return;
+	}
+
+	// Gathering candidates also refreshes each collection's usage, so measure it again afterwards
+	Vector<ResourceCollectionBase::EvictionCandidate> candidates;
+	for (auto& collection: resources) {
+		if (collection) {
+			collection->getEvictionCandidates(candidates);
+		}
+	}
+	std::sort(candidates.begin(), candidates.end(), [] (const auto& a, const auto& b) { return a.lastUse < b.lastUse; });
+
+	size_t usage = getMemoryUsage().getTotal();
+	for (auto& candidate: candidates) {
+		if (usage <= *memoryBudget) {
+			break;
+		}
+		usage -= std::min(usage, ofType(candidate.type).evict(candidate.assetId));
+	}
+}
+
+Resources::AssetsByType Resources::groupByType(const std::vector<String>& ids)
+{
+	// Build this map first, so it gets sorted by AssetType
+	// The order in which asset types are loaded is important, since they have dependencies
+	AssetsByType byType;
+
+	for (auto& id: ids) {
+		auto splitPos = id.find(':');
+		auto type = fromString<AssetType>(id.left(splitPos));
+		String name = id.mid(splitPos + 1);
+		byType[type].emplace_back(std::move(name));
+	}
+
+	return byType;
+}
+
 Resources::~Resources() = default;
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <memory>
+#include <cstddef>
+#include <halley/data_structures/vector.h>
+#include <halley/data_structures/tree_map.h>
+#include "family_mask.h"
+
+namespace Halley {
+	class ComponentDeleterTable;
+
+	// An archetype holds every component of every entity that shares the same mask.
+	// Each component type gets its own column, and an entity occupies the same row across all columns,
+	// so iterating entities of one archetype walks each column linearly.
+	class Archetype {
+	public:
+		Archetype(FamilyMaskType mask, const Vector<int>& componentIds, ComponentDeleterTable& table);
+		~Archetype();
+
+		Archetype(const Archetype& other) = delete;
+		Archetype& operator=(const Archetype& other) = delete;
+
+		FamilyMaskType getMask() const { return mask; }
+		size_t getNumRows() const { return nRows - freeRows.size(); }
+		size_t getCapacity() const { return nRows; }
+
+		uint32_t allocRow();
+		void freeRow(uint32_t row);
+
+		bool hasComponent(int componentId) const;
+		void* getComponent(int componentId, uint32_t row) const;
+		bool owns(int componentId, uint32_t row, const void* ptr) const;
+
+	private:
+		constexpr static size_t rowsPerChunk = 256;
+
+		struct Column {
+			int componentId = -1;
+			size_t stride = 0;
+			Vector<std::unique_ptr<std::max_align_t[]>> chunks;
+		};
+
+		FamilyMaskType mask;
+		Vector<Column> columns;
+		Vector<int> columnIndex;
+		Vector<uint32_t> freeRows;
+		uint32_t nRows = 0;
+	};
+
+	class ArchetypeStorage {
+	public:
+		explicit ArchetypeStorage(ComponentDeleterTable& table);
+		~ArchetypeStorage();
+
+		Archetype& getArchetype(FamilyMaskType mask, const Vector<int>& componentIds);
+		size_t getNumArchetypes() const { return archetypes.size(); }
+
+	private:
+		ComponentDeleterTable& table;
+		TreeMap<FamilyMaskType, std::unique_ptr<Archetype>> archetypes;
+	};
+}
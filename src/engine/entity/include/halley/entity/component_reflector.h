@@ -1,12 +1,62 @@
 #pragma once
 
+#include <memory>
+#include <type_traits>
+#include "entity.h"
+#include "halley/bytes/byte_serializer.h"
+
 namespace Halley {
+	// A fully deserialized component that can be copied into any number of entities
+	class ComponentPrototype {
+	public:
+		virtual ~ComponentPrototype() = default;
+
+		// Returns false if the entity already has this component, in which case nothing is done
+		virtual bool addToEntity(EntityRef& entity) const = 0;
+	};
+
+	template <typename T>
+	class ComponentPrototypeImpl final : public ComponentPrototype {
+	public:
+		ComponentPrototypeImpl(ConfigNodeSerializationContext& context, const ConfigNode& data)
+		{
+			component.deserialize(context, data);
+		}
+
+		bool addToEntity(EntityRef& entity) const override
+		{
+			if (entity.hasComponent<T>()) {
+				return false;
+			}
+			entity.addComponent<T>(T(component));
+			return true;
+		}
+
+	private:
+		T component;
+	};
+
+	// Components can opt into compact binary serialization by implementing serialize(Serializer&) and deserialize(Deserializer&)
+	// Others are converted through ConfigNode when written to a binary stream
+	template <typename T, typename = void>
+	struct HasByteSerialization : std::false_type {};
+
+	template <typename T>
+	struct HasByteSerialization<T, std::void_t<
+		decltype(std::declval<const T&>().serialize(std::declval<Serializer&>())),
+		decltype(std::declval<T&>().deserialize(std::declval<Deserializer&>()))
+	>> : std::true_type {};
+
     class ComponentReflector {
     public:
     	virtual ~ComponentReflector() = default;
 
     	virtual const char* getName() const = 0;
     	virtual ConfigNode serialize(ConfigNodeSerializationContext& context, const Component& component) const = 0;
+    	virtual std::unique_ptr<ComponentPrototype> makePrototype(ConfigNodeSerializationContext& context, const ConfigNode& data) const = 0;
+
+    	virtual void serialize(Serializer& s, ConfigNodeSerializationContext& context, const Component& component) const = 0;
+    	virtual void deserialize(Deserializer& s, ConfigNodeSerializationContext& context, EntityRef& entity) const = 0; // Adds the component if the entity doesn't have it yet
     };
 
 	template <typename T>
@@ -21,5 +71,47 @@ namespace Halley {
 		{
 			return static_cast<const T&>(component).serialize(context);
 		}
+
+		std::unique_ptr<ComponentPrototype> makePrototype(ConfigNodeSerializationContext& context, const ConfigNode& data) const override
+		{
+			if constexpr (std::is_copy_constructible_v<T>) {
+				return std::make_unique<ComponentPrototypeImpl<T>>(context, data);
+			} else {
+				return {};
+			}
+		}
+
+		void serialize(Serializer& s, ConfigNodeSerializationContext& context, const Component& component) const override
+		{
+			if constexpr (HasByteSerialization<T>::value) {
+				s << static_cast<const T&>(component);
+			} else {
+				s << static_cast<const T&>(component).serialize(context);
+			}
+		}
+
+		void deserialize(Deserializer& s, ConfigNodeSerializationContext& context, EntityRef& entity) const override
+		{
+			auto* existing = entity.tryGetComponent<T>();
+			if (existing) {
+				deserializeInto(s, context, *existing);
+			} else {
+				T component;
+				deserializeInto(s, context, component);
+				entity.addComponent<T>(std::move(component));
+			}
+		}
+
+	private:
+		void deserializeInto(Deserializer& s, ConfigNodeSerializationContext& context, T& component) const
+		{
+			if constexpr (HasByteSerialization<T>::value) {
+				s >> component;
+			} else {
+				ConfigNode node;
+				s >> node;
+				component.deserialize(context, node);
+			}
+		}
 	};
 }
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <array>
 #include "halley/maths/vector2.h"
 #include "halley/entity/component.h"
 #include "halley/entity/entity.h"
@@ -10,6 +11,7 @@
 namespace Halley
 {
 	class Sprite;
+	class Transform2DHierarchy;
 }
 
 class Transform2DComponent final : public Transform2DComponentBase {
@@ -33,6 +35,8 @@ public:
 	Halley::Vector2f getGlobalPosition() const;
 	void setGlobalPosition(Halley::Vector2f v);
 
+	// Points are transformed by the full affine transform of the hierarchy. A non-uniform scale above a rotated child shears it,
+	// which a scale and a rotation can't represent: in that case, these return the component-wise product of the scales and sum of the rotations
 	Halley::Vector2f getGlobalScale() const;
 	void setGlobalScale(Halley::Vector2f v);
 
@@ -45,6 +49,7 @@ public:
 	Halley::Vector2f transformPoint(const Halley::Vector2f& p) const;
 	Halley::Vector2f inverseTransformPoint(const Halley::Vector2f& p) const;
 
+	// Bounds of the sprite if drawn with this transform, including the sprite's own scale, rotation and flip as well as the global ones
 	Halley::Rect4f getSpriteAABB(const Halley::Sprite& sprite) const;
 	Halley::Rect4f getSpriteUncroppedAABB(const Halley::Sprite& sprite) const;
 
@@ -57,6 +62,7 @@ public:
 
 private:
 	friend class Halley::EntityRef;
+	friend class Halley::Transform2DHierarchy;
 
 	mutable Halley::EntityRef entity;
 	mutable Transform2DComponent* parentTransform = nullptr;
@@ -65,6 +71,8 @@ private:
 
 	mutable uint32_t cachedValues = 0;
 	mutable Halley::Vector2f cachedGlobalPos;
+	mutable Halley::Vector2f cachedGlobalAxisX; // Columns of the global linear transform
+	mutable Halley::Vector2f cachedGlobalAxisY;
 	mutable Halley::Vector2f cachedGlobalScale;
 	mutable Halley::Angle1f cachedGlobalRotation;
 	mutable int cachedSubWorld = 0;
@@ -83,8 +91,18 @@ private:
 	};
 
 	void updateParentTransform();
+	void updateGlobalTransform() const;
+	void refreshGlobalTransform() const;
+	void getLocalAxes(Halley::Vector2f& x, Halley::Vector2f& y) const;
+	void getGlobalAxes(Halley::Vector2f& x, Halley::Vector2f& y) const;
+	Halley::Rect4f transformRect(const Halley::Rect4f& rect) const;
+	static Halley::Rect4f applySpriteTransform(const Halley::Sprite& sprite, const Halley::Rect4f& rect);
+	static Halley::Rect4f getBounds(std::array<Halley::Vector2f, 4> points);
+	bool isGlobalTransformCached() const;
+	void markGlobalTransformRead() const;
 	void markDirty(DirtyPropagationMode mode = DirtyPropagationMode::Changed, int depth = 0) const;
 	void markDirtyShallow() const;
+	void markDirtyInHierarchy() const;
 	bool isCached(CachedIndices index) const;
 	void setCached(CachedIndices index) const;
 };
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+#include <halley/data_structures/vector.h>
+#include <halley/data_structures/hash_map.h>
+#include <halley/text/halleystring.h>
+#include <halley/time/halleytime.h>
+
+namespace Halley
+{
+	class World;
+	class System;
+	class Family;
+	class Path;
+
+	// Records timings and counters for every frame of a World, keeping the most recent ones in a ring buffer
+	// Meant for headless runs and soak tests, which can dump it as a Chrome trace (load it in chrome://tracing) or as CSV
+	class WorldTelemetry
+	{
+	public:
+		struct SystemSample {
+			int system = 0; // Index into getSystemNames()
+			int64_t startNs = 0; // Relative to when the telemetry was created
+			int64_t durationNs = 0;
+			uint32_t messagesSent = 0;
+		};
+
+		struct FamilySample {
+			uint32_t entities = 0;
+			int64_t updateNs = 0;
+		};
+
+		struct Frame {
+			uint64_t frameNumber = 0;
+			TimeLine timeline = TimeLine::FixedUpdate;
+			int64_t startNs = 0;
+			int64_t durationNs = 0;
+			uint32_t entities = 0;
+			uint32_t entitiesSpawned = 0;
+			uint32_t entitiesDestroyed = 0;
+			uint32_t messagesSent = 0;
+			int64_t familyUpdateNs = 0;
+			Vector<SystemSample> systems;
+			Vector<FamilySample> families; // Indexed like getFamilyNames()
+		};
+
+		explicit WorldTelemetry(size_t capacity);
+
+		void setCapacity(size_t capacity); // Drops all recorded frames
+		size_t getCapacity() const;
+		void clear();
+
+		size_t getNumFrames() const;
+		const Frame& getFrame(size_t index) const; // 0 is the oldest frame still in the buffer
+
+		const Vector<String>& getSystemNames() const;
+		const Vector<String>& getFamilyNames() const;
+
+		String toChromeTrace() const;
+
+		// One row per frame, system, family and counter, with columns frame,timeline,type,name,start_us,duration_us,value
+		// value is the entity count for frames and families, and the number of messages sent for systems
+		String toCSV() const;
+
+		void saveChromeTrace(const Path& path) const;
+		void saveCSV(const Path& path) const;
+
+		static int64_t getTimestamp(); // In nanoseconds, on the clock used by System and World to record samples
+
+	private:
+		friend class World;
+
+		Vector<Frame> frames;
+		size_t firstFrame = 0;
+		size_t numFrames = 0;
+		uint64_t frameNumber = 0;
+		int64_t epoch = 0;
+
+		Frame current;
+		int64_t frameStart = 0;
+
+		Vector<String> systemNames;
+		HashMap<String, int> systemIndices;
+		Vector<String> familyNames;
+
+		void beginFrame();
+		void endFrame(const World& world, TimeLine timeline);
+
+		void onEntitiesSpawned(size_t count);
+		void onEntitiesDestroyed(size_t count);
+		void onFamilyUpdated(size_t familyIndex, int64_t startNs);
+
+		int getSystemIndex(const String& name);
+		void updateFamilyNames(const World& world);
+	};
+}
@@ -9,28 +9,20 @@
 #include "type_deleter.h"
 #include <halley/data_structures/vector.h>
 #include "halley/utils/type_traits.h"
+#include "halley/utils/utils.h"
 #include "halley/maths/uuid.h"
 
 namespace Halley {
 	class World;
 	class System;
 	class EntityRef;
+	class Archetype;
+	class ArchetypeStorage;
 
 	// True if T::onAddedToEntity(EntityRef&) exists
 	template <class, class = void_t<>> struct HasOnAddedToEntityMember : std::false_type {};
 	template <class T> struct HasOnAddedToEntityMember<T, decltype(std::declval<T&>().onAddedToEntity(std::declval<EntityRef&>()))> : std::true_type { };
 	
-	class MessageEntry
-	{
-	public:
-		std::unique_ptr<Message> msg;
-		int type = -1;
-		int age = -1;
-
-		MessageEntry() {}
-		MessageEntry(std::unique_ptr<Message> msg, int type, int age) : msg(std::move(msg)), type(type), age(age) {}
-	};
-
 	class EntityRef;
 	class ConstEntityRef;
 
@@ -48,24 +40,20 @@ namespace Halley {
 		T* tryGetComponent()
 		{
 			constexpr int id = FamilyMask::RetrieveComponentIndex<T>::componentIndex;
-			for (int i = 0; i < liveComponents; i++) {
-				if (components[i].first == id) {
-					return static_cast<T*>(components[i].second);
-				}
+			if (!hasComponentId(id)) {
+				return nullptr;
 			}
-			return nullptr;
+			return static_cast<T*>(components[getComponentSlot(id)].second);
 		}
 
 		template <typename T>
 		const T* tryGetComponent() const
 		{
 			constexpr int id = FamilyMask::RetrieveComponentIndex<T>::componentIndex;
-			for (int i = 0; i < liveComponents; i++) {
-				if (components[i].first == id) {
-					return static_cast<const T*>(components[i].second);
-				}
+			if (!hasComponentId(id)) {
+				return nullptr;
 			}
-			return nullptr;
+			return static_cast<const T*>(components[getComponentSlot(id)].second);
 		}
 
 		template <typename T>
@@ -93,11 +81,7 @@ namespace Halley {
 		template <typename T>
 		bool hasComponent(World& world) const
 		{
-			if (dirty) {
-				return tryGetComponent<T>() != nullptr;
-			} else {
-				return hasBit(world, FamilyMask::RetrieveComponentIndex<T>::componentIndex);
-			}
+			return hasComponentId(FamilyMask::RetrieveComponentIndex<T>::componentIndex);
 		}
 
 		bool needsRefresh() const
@@ -123,31 +107,38 @@ namespace Halley {
 		FamilyMaskType getMask() const;
 		EntityId getEntityId() const;
 
-		void refresh(MaskStorage& storage, ComponentDeleterTable& table);
-		void destroy();
+		bool refresh(MaskStorage& storage, ComponentDeleterTable& table, ArchetypeStorage* archetypes = nullptr); // Returns whether any components moved to archetype storage
+		void destroy(World& world);
 		
 		void sortChildren(const std::vector<UUID>& uuids);
 
 	private:
 		// Start with these for better cache coherence
+		// Live components are kept sorted by id, so the slot of a component is the number of live components with a lower id
 		Vector<std::pair<int, Component*>> components;
+		std::array<uint64_t, 4> liveComponentBits = {};
+		static_assert(sizeof(liveComponentBits) * 8 >= FamilyMask::RealType().size(), "liveComponentBits must have a bit for every component id a FamilyMask can hold");
 		int liveComponents = 0;
 		bool dirty : 1;
 		bool alive : 1;
 		bool serializable : 1;
 		bool reloaded : 1;
 		bool fromPrefab : 1;
+		bool componentsAdded : 1;
 		
 		int8_t hierarchyRevision = 0;
 		Entity* parent = nullptr;
 		Vector<Entity*> children;
 		
-		Vector<MessageEntry> inbox;
 		FamilyMaskType mask;
 		EntityId entityId;
 		String name;
 		UUID uuid;
 
+		Archetype* archetype = nullptr;
+		uint32_t archetypeRow = 0;
+		uint32_t worldIndex = 0;
+
 		Entity();
 		void destroyComponents(ComponentDeleterTable& storage);
 
@@ -165,12 +156,9 @@ namespace Halley {
 		Entity& removeComponent(World& world)
 		{
 			constexpr int id = T::componentIndex;
-			for (int i = 0; i < liveComponents; ++i) {
-				if (components[i].first == id) {
-					removeComponentAt(i);
-					markDirty(world);
-					return *this;
-				}
+			if (hasComponentId(id)) {
+				removeComponentAt(getComponentSlot(id));
+				markDirty(world);
 			}
 
 			return *this;
@@ -181,6 +169,8 @@ namespace Halley {
 		void removeAllComponents(World& world);
 		void deleteComponent(Component* component, int id, ComponentDeleterTable& table);
 		void keepOnlyComponentsWithIds(const std::vector<int>& ids, World& world);
+		bool relocateComponents(ArchetypeStorage& archetypes, ComponentDeleterTable& table);
+		void onComponentsRelocated();
 
 		void onReady();
 
@@ -194,9 +184,28 @@ namespace Halley {
 		void detachChildren();
 		void markHierarchyDirty();
 
-		void doDestroy(bool updateParenting);
+		void doDestroy(World& world, bool updateParenting);
 
-		bool hasBit(World& world, int index) const;
+		bool hasComponentId(int id) const
+		{
+			return (liveComponentBits[id >> 6] >> (id & 63)) & 1;
+		}
+
+		int getComponentSlot(int id) const
+		{
+			const int word = id >> 6;
+			int slot = popCount(liveComponentBits[word] & ((uint64_t(1) << (id & 63)) - 1));
+			for (int i = 0; i < word; ++i) {
+				slot += popCount(liveComponentBits[i]);
+			}
+			return slot;
+		}
+
+		void setComponentBit(int id, bool value)
+		{
+			const uint64_t bit = uint64_t(1) << (id & 63);
+			liveComponentBits[id >> 6] = value ? (liveComponentBits[id >> 6] | bit) : (liveComponentBits[id >> 6] & ~bit);
+		}
 	};
 
 	class EntityRef;
@@ -282,10 +291,14 @@ namespace Halley {
 			static_assert(std::is_default_constructible<T>::value, "Components must have a default constructor");
 
 			auto c = new T(std::move(component));
+			const bool duplicate = entity->hasComponentId(T::componentIndex);
 			entity->addComponent(*world, c);
 
 			if constexpr (HasOnAddedToEntityMember<T>::value) {
-				c->onAddedToEntity(*this);
+				// Duplicates are discarded, so they're never attached to the entity
+				if (!duplicate) {
+					c->onAddedToEntity(*this);
+				}
 			}
 
 			return *this;
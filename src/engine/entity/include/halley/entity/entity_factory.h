@@ -10,6 +10,7 @@ namespace Halley {
 	class World;
 	class Resources;
 	class EntityScene;
+	class ComponentPrototype;
 	
 	class EntityFactory {
 	public:
@@ -27,6 +28,11 @@ namespace Halley {
 		EntityRef createEntity(const ConfigNode& node);
 		EntityRef createPrefab(std::shared_ptr<const Prefab> prefab);
 		EntityScene createScene(std::shared_ptr<const Prefab> scene);
+
+		// Creates count instances of the same prefab, returning the root of each one
+		// Prefabs are compiled into a flat template the first time they're instantiated, which makes spawning them in bulk much cheaper
+		std::vector<EntityRef> createEntities(const String& prefabName, size_t count);
+		std::vector<EntityRef> createEntities(std::shared_ptr<const Prefab> prefab, size_t count);
 		
 		void updateEntityTree(EntityRef& entity, const ConfigNode& node);
 		void updateScene(std::vector<EntityRef>& entities, const ConfigNode& node);
@@ -54,19 +60,45 @@ namespace Halley {
 
 
 	private:
+		struct CompiledComponent {
+			String name;
+			ConfigNode data;
+			std::unique_ptr<ComponentPrototype> prototype;
+			bool compiled = false;
+		};
+
+		struct CompiledEntity {
+			String name;
+			UUID uuid;
+			int parent = -1;
+			std::vector<CompiledComponent> components;
+		};
+
+		struct CompiledPrefab {
+			std::vector<std::pair<std::weak_ptr<const Prefab>, int>> dependencies; // Weak, so the cache doesn't keep unloaded prefabs alive
+			std::vector<CompiledEntity> entities;
+		};
+
 		World& world;
 		Resources& resources;
 		ConfigNodeSerializationContext context;
 
 		ConfigNode dummyPrefab;
+		std::map<const Prefab*, std::unique_ptr<CompiledPrefab>> compiledPrefabs;
 
 		void createEntityTreeForScene(const ConfigNode& node, EntityScene& curScene, std::shared_ptr<const Prefab> prefab, std::optional<int> index = {});
 		EntityRef createEntityTree(const ConfigNode& node, EntityScene* curScene);
 		EntityRef createEntity(std::optional<EntityRef> parent, const ConfigNode& node, bool populate, EntityScene* curScene);
 		
 		void updateEntity(EntityRef& entity, const ConfigNode& node, UpdateMode mode = UpdateMode::UpdateAll);
+		void forEachComponentData(const ConfigNode& treeNode, std::function<void(const String&, const ConfigNode&)> callback) const;
 		void doUpdateEntityTree(EntityRef& entity, const ConfigNode& node, bool refreshing);
 		
+		CompiledPrefab& getCompiledPrefab(const std::shared_ptr<const Prefab>& prefab);
+		void compileEntity(CompiledPrefab& compiled, const ConfigNode& treeNode, int parent) const;
+		EntityRef instantiate(CompiledPrefab& compiled, std::vector<EntityRef>& created);
+		void evictCompiledPrefabs();
+
 		std::shared_ptr<const Prefab> getPrefab(const String& id) const;
 		const ConfigNode& getPrefabNode(const String& id) const;
 
@@ -80,6 +112,12 @@ namespace Halley {
 	public:
 		World& world;
 		std::map<UUID, EntityId> uuids;
+		size_t uuidLookups = 0;
+
+		// Set while taking or restoring a world snapshot. References are then stored as the entity's index in the snapshot, as UUIDs are shared by prefab instances
+		bool snapshot = false;
+		HashMap<EntityId, size_t> snapshotIndices;
+		Vector<EntityId> snapshotEntities;
 
 		EntitySerializationContext(World& world);
 
@@ -6,6 +6,9 @@
 #include "halley/bytes/config_node_serializer.h"
 
 namespace Halley {
+	class Serializer;
+	class Deserializer;
+
 	struct alignas(8) EntityId {
 		int64_t value;
 
@@ -29,6 +32,9 @@ namespace Halley {
 			return Halley::toString(value);
 		}
 
+		void serialize(Serializer& s) const;
+		void deserialize(Deserializer& s);
+
 		static String toUUID(const EntityId& id, ConfigNodeSerializationContext& context);
 		static EntityId fromUUID(const String& uuidStr, ConfigNodeSerializationContext& context);
 	};
@@ -1,10 +1,12 @@
 #pragma once
 
 #include <algorithm>
+#include <optional>
 #include <gsl/gsl_assert>
 #include "family_type.h"
 #include "family_mask.h"
 #include "entity_id.h"
+#include "halley/data_structures/hash_map.h"
 #include "halley/data_structures/nullable_reference.h"
 #include "halley/support/exception.h"
 #include "halley/support/debug.h"
@@ -31,6 +33,15 @@ namespace Halley {
 			return static_cast<char*>(elems) + (n * elemSize);
 		}
 
+		std::optional<size_t> getIndexOf(EntityId id) const
+		{
+			const auto iter = entityIndex.find(id);
+			if (iter == entityIndex.end()) {
+				return {};
+			}
+			return iter->second;
+		}
+
 		void addOnEntitiesAdded(FamilyBindingBase* bind);
 		void removeOnEntityAdded(FamilyBindingBase* bind);
 		void addOnEntitiesRemoved(FamilyBindingBase* bind);
@@ -46,6 +57,7 @@ namespace Halley {
 		virtual void addEntity(Entity& entity) = 0;
 		void removeEntity(Entity& entity);
 		void reloadEntity(Entity& entity);
+		void refreshEntity(Entity& entity);
 		virtual void updateEntities() = 0;
 		virtual void clearEntities() = 0;
 		
@@ -54,6 +66,10 @@ namespace Halley {
 		size_t elemSize = 0;
 		Vector<EntityId> toRemove;
 		Vector<EntityId> toReload;
+		Vector<Entity*> toRefresh;
+		HashMap<EntityId, size_t> entityIndex;
+		bool storageOrdered = false; // Keep entities in the order their components are laid out in archetype storage
+		bool orderDirty = false;
 
 		Vector<FamilyBindingBase*> addEntityCallbacks;
 		Vector<FamilyBindingBase*> removeEntityCallbacks;
@@ -114,15 +130,19 @@ namespace Halley {
 	protected:
 		void addEntity(Entity& entity) override
 		{
+			entityIndex[entity.getEntityId()] = entities.size();
 			auto& e = entities.emplace_back();
 			e.entityId = entity.getEntityId();
 			T::Type::loadComponents(entity, &e.data[0]);
 
 			dirty = true;
+			orderDirty = true;
 		}
 
 		void updateEntities() override
 		{
+			refreshEntities();
+
 			if (dirty) {
 				// Notify additions
 				HALLEY_DEBUG_TRACE();
@@ -141,9 +161,11 @@ namespace Halley {
 				// Notify reloads
 				HALLEY_DEBUG_TRACE();
 				std::vector<StorageType*> reloadedEntities;
-				for (auto& entity : entities) {
-					if (std::find(toReload.begin(), toReload.end(), entity.entityId) != toReload.end()) {
-						reloadedEntities.push_back(&entity);
+				reloadedEntities.reserve(toReload.size());
+				for (auto& id : toReload) {
+					const auto iter = entityIndex.find(id);
+					if (iter != entityIndex.end()) {
+						reloadedEntities.push_back(&entities[iter->second]);
 					}
 				}
 				notifyReload(reloadedEntities.data(), reloadedEntities.size());
@@ -152,12 +174,18 @@ namespace Halley {
 
 			// Remove
 			removeDeadEntities();
+
+			if (storageOrdered && orderDirty) {
+				sortByStorage();
+			}
+			orderDirty = false;
 		}
 
 		void clearEntities() override
 		{
 			notifyRemove(entities.data(), entities.size());
 			entities.clear();
+			entityIndex.clear();
 			updateElems();
 		}
 
@@ -172,56 +200,75 @@ namespace Halley {
 			elemSize = sizeof(StorageType);
 		}
 
+		void refreshEntities()
+		{
+			// Entities whose components were relocated by archetype storage need their pointers reloaded
+			if (!toRefresh.empty()) {
+				HALLEY_DEBUG_TRACE();
+				for (auto& entity: toRefresh) {
+					const auto iter = entityIndex.find(entity->getEntityId());
+					if (iter != entityIndex.end()) {
+						T::Type::loadComponents(*entity, &entities[iter->second].data[0]);
+					}
+				}
+				toRefresh.clear();
+				orderDirty = true;
+			}
+		}
+
 		void removeDeadEntities()
 		{
 			// Performance-critical code
-			// Benchmarks suggest that using a Vector is faster than std::set and std::unordered_set
+			// Each removed entity is swapped with the last living one, so this only touches the entities being removed
 			if (!toRemove.empty()) {
 				HALLEY_DEBUG_TRACE();
-				size_t removeCount = toRemove.size();
-				Expects(removeCount > 0);
+				const size_t removeCount = toRemove.size();
 				Expects(removeCount <= entities.size());
-				std::sort(toRemove.begin(), toRemove.end());
-
-				for (size_t i = 1; i < toRemove.size(); ++i) {
-					Expects(toRemove[i - 1] != toRemove[i]);
-				}
 
 				// Move all entities to be removed to the back of the vector
-				{
-					int n = int(entities.size());
-					// Note: it's important to scan it forward. Scanning backwards would improve performance for short-lived entities,
-					// but it causes an issue where an entity is removed and added to the same family in one frame.
-					for (int i = 0; i < n; i++) {
-						EntityId id = entities[i].entityId;
-						auto iter = std::lower_bound(toRemove.begin(), toRemove.end(), id);
-						if (iter != toRemove.end() && id == *iter) {
-							toRemove.erase(iter);
-							if (i != n - 1) {
-								std::swap(entities[i], entities[n - 1]);
-								i--;
-							}
-							n--;
-							if (toRemove.empty()) {
-								break;
-							}
-						}
+				size_t n = entities.size();
+				for (auto& id: toRemove) {
+					const auto iter = entityIndex.find(id);
+					Expects(iter != entityIndex.end());
+					const size_t idx = iter->second;
+					entityIndex.erase(iter);
+
+					--n;
+					if (idx != n) {
+						std::swap(entities[idx], entities[n]);
+						entityIndex[entities[idx].entityId] = idx;
 					}
-					Ensures(size_t(n) + removeCount == entities.size());
 				}
-
-				Expects(toRemove.empty());
+				toRemove.clear();
 
 				// Notify removal
-				size_t newSize = entities.size() - removeCount;
-				Ensures(newSize < entities.size());
-				notifyRemove(entities.data() + newSize, removeCount);
+				Ensures(n + removeCount == entities.size());
+				notifyRemove(entities.data() + n, removeCount);
 
 				// Remove them
-				entities.resize(newSize);
+				entities.resize(n);
 				updateElems();
+				orderDirty = true;
+			}
+		}
+
+		void sortByStorage()
+		{
+			// Sorting by the address of the first component puts entities of the same archetype chunk together, in row order
+			// Iterating the family then walks each component column linearly, rather than jumping around
+			if constexpr (T::Type::getNumComponents() > 0) {
+				const auto byAddress = [] (const StorageType& a, const StorageType& b)
+				{
+					return std::less<const void*>()(*reinterpret_cast<const void* const*>(a.data.data()), *reinterpret_cast<const void* const*>(b.data.data()));
+				};
+				if (!std::is_sorted(entities.begin(), entities.end(), byAddress)) {
+					HALLEY_DEBUG_TRACE();
+					std::sort(entities.begin(), entities.end(), byAddress);
+					for (size_t i = 0; i < entities.size(); ++i) {
+						entityIndex[entities[i].entityId] = i;
+					}
+				}
 			}
-			Ensures(toRemove.empty());
 		}
 	};
 }
@@ -22,6 +22,7 @@ namespace Halley {
 		void doInit(FamilyMaskType readMask, FamilyMaskType writeMask) noexcept;
 		
 		void* getElement(size_t index) const noexcept { return family->getElement(index); }
+		std::optional<size_t> getIndexOf(EntityId id) const { return family->getIndexOf(id); }
 		void setFamily(Family* family) noexcept;
 
 		void setOnEntitiesAdded(std::function<void(void*, size_t)> callback);
@@ -36,6 +37,8 @@ namespace Halley {
 
 	private:
 		friend class System;
+		friend class SystemScheduler;
+		friend class WorldTelemetry;
 		friend class Family;
 
 		Family* family = nullptr;
@@ -6,7 +6,7 @@ namespace Halley {
 	{
 		template <typename T>
 		struct StripMaybeRef {
-			using type = T;
+			using type = std::remove_const_t<T>;
 		};
 
 		template <typename T>
@@ -14,6 +14,11 @@ namespace Halley {
 			using type = T;
 		};
 
+		template <typename T>
+		struct StripMaybeRef<const MaybeRef<T>> {
+			using type = T;
+		};
+
 
 		template <typename... Ts>
 		struct Evaluator;
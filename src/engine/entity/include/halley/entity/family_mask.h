@@ -58,6 +58,11 @@ namespace Halley {
 			static constexpr int componentIndex = T::componentIndex;
 		};
 
+		template <typename T>
+		struct RetrieveComponentIndex<const MaybeRef<T>> {
+			static constexpr int componentIndex = T::componentIndex;
+		};
+
 
 
 
@@ -100,10 +105,11 @@ namespace Halley {
 		template <typename T, typename... Ts>
 		struct MutableEvaluator <T, Ts...> {
 			constexpr static void makeMask(RealType& mask) {
-				if constexpr (std::is_const<T>::value) {
+				// Components are declared const in the family type when the family only reads them
+				if constexpr (!std::is_const<T>::value) {
 					FamilyMask::setBit(mask, RetrieveComponentIndex<T>::componentIndex);
 				}
-				Evaluator<Ts...>::makeMask(mask);
+				MutableEvaluator<Ts...>::makeMask(mask);
 			}
 
 			constexpr static HandleType getMask(MaskStorage& storage) {
@@ -120,6 +126,9 @@ namespace Halley {
 		template <typename T>
 		struct IsMaybeRef<MaybeRef<T>> : std::true_type {};
 
+		template <typename T>
+		struct IsMaybeRef<const MaybeRef<T>> : std::true_type {};
+
 
 		template <typename... Ts>
 		struct InclusionEvaluator;
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <memory>
+#include <cstddef>
+#include <halley/data_structures/vector.h>
+#include "message.h"
+
+namespace Halley
+{
+	// Allocates the entity messages sent by a system in contiguous chunks
+	// Messages are all destroyed together when the arena is reset, which keeps the chunks for reuse
+	class MessageArena
+	{
+	public:
+		MessageArena() = default;
+		MessageArena(const MessageArena& other) = delete;
+		MessageArena(MessageArena&& other) = default;
+		MessageArena& operator=(const MessageArena& other) = delete;
+		MessageArena& operator=(MessageArena&& other) = default;
+		~MessageArena();
+
+		template <typename T>
+		T* create(T msg)
+		{
+			static_assert(std::is_base_of_v<Message, T>, "T must be a Message");
+			auto* result = ::new (allocate(sizeof(T), alignof(T))) T(std::move(msg));
+			messages.push_back(result);
+			return result;
+		}
+
+		void reset();
+
+	private:
+		constexpr static size_t chunkSize = 16 * 1024;
+
+		struct Chunk {
+			std::unique_ptr<std::max_align_t[]> data;
+			size_t size = 0;
+		};
+
+		Vector<Chunk> chunks;
+		Vector<Message*> messages;
+		size_t curChunk = 0;
+		size_t curPos = 0;
+
+		void* allocate(size_t size, size_t alignment);
+	};
+}
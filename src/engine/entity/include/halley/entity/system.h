@@ -9,6 +9,7 @@
 #include "family_type.h"
 #include "entity.h"
 #include "halley/utils/type_traits.h"
+#include "message_arena.h"
 #include "system_message.h"
 
 namespace Halley {
@@ -69,6 +70,10 @@ namespace Halley {
 		virtual void onMessagesReceived(int, Message**, size_t*, size_t) {}
 		virtual void onSystemMessageReceived(int messageId, SystemMessage& msg, const std::function<void(std::byte*)>& callback) {}
 
+		// Called by generated code, so the scheduler knows which systems can safely run concurrently
+		// Systems that never declare their access are always run on their own
+		void declareAccess(bool exclusive, Vector<String> services, Vector<int> messageTypesSent);
+
 		template <typename F, typename V>
 		static void invokeIndividual(F&& f, V& fam)
 		{
@@ -88,9 +93,7 @@ namespace Halley {
 		template <typename T>
 		void sendMessageGeneric(EntityId entityId, T msg)
 		{
-			auto toSend = std::make_unique<T>();
-			*toSend = std::move(msg);
-			doSendMessage(entityId, std::move(toSend), T::messageIndex);
+			doSendMessage(entityId, outgoingMessages.create(std::move(msg)), T::messageIndex);
 		}
 
 		template <typename T, typename R, typename F>
@@ -176,11 +179,30 @@ namespace Halley {
 
 	private:
 		friend class World;
+		friend class SystemScheduler;
+		friend class WorldTelemetry;
+
+		struct MessageEntry {
+			EntityId target;
+			Message* msg = nullptr;
+			int type = -1;
+			System* sender = nullptr;
+		};
 
 		Vector<FamilyBindingBase*> families;
 		Vector<int> messageTypesReceived;
-		Vector<EntityId> messagesSentTo;
-		Vector<std::pair<EntityId, MessageEntry>> outbox;
+
+		// Messages are sent into outgoingMessages, and move to deliveredMessages once dispatched
+		// Delivered messages are freed when this system next updates, as every other system has had a chance to see them by then
+		MessageArena outgoingMessages;
+		MessageArena deliveredMessages;
+		Vector<MessageEntry> outbox;
+		Vector<System*> messageReceivers;
+
+		// One inbox per type in messageTypesReceived
+		Vector<Vector<MessageEntry>> inbox;
+		Vector<Message*> inboxMessages;
+		Vector<size_t> inboxIndices;
 		Vector<const SystemMessageContext*> systemMessageInbox;
 		Vector<const SystemMessageContext*> systemMessages;
 
@@ -191,16 +213,27 @@ namespace Halley {
 		int systemId = -1;
 		bool initialised = false;
 		bool collectSamples = false;
+		bool exclusiveAccess = true;
+		Vector<String> servicesUsed;
+		Vector<int> messageTypesSent;
 
 		StopwatchRollingAveraging timer;
+		int64_t sampleStart = 0; // When the last sample began, see WorldTelemetry::getTimestamp()
+		uint32_t messagesSent = 0; // Since the last update or render began
 
 		void doUpdate(Time time);
+		void preUpdate();
+		void runUpdate(Time time);
+		void postUpdate();
 		void doRender(RenderContext& rc);
 		void onAddedToWorld(World& world, int id);
 
 		void purgeMessages();
 		void processMessages();
-		void doSendMessage(EntityId target, std::unique_ptr<Message> msg, int msgId);
+		void doSendMessage(EntityId target, Message* msg, int msgId);
+		void receiveMessage(const MessageEntry& entry);
+		void removeMessagesFrom(const System& sender);
+		void removeMessageReceiver(const System& receiver);
 		size_t doSendSystemMessage(SystemMessageContext context, const String& targetSystem);
 		void dispatchMessages();
 	};
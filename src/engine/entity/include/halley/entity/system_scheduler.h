@@ -0,0 +1,38 @@
+#pragma once
+
+#include <memory>
+#include <halley/data_structures/vector.h>
+#include <halley/time/halleytime.h>
+
+class MaskStorage;
+
+namespace Halley {
+	class System;
+	class World;
+
+	enum class SystemSchedulingMode {
+		Sequential,
+		Parallel
+	};
+
+	// Groups the systems of a timeline into batches of systems that don't conflict with each other, and runs each batch concurrently
+	// Two systems conflict if one writes a component that the other accesses, if they share a service, if one sends a message that
+	// the other receives, or if either of them didn't declare its access (or declared world/API/resources access)
+	// Systems only move ahead of earlier systems they don't conflict with, so results match running them in order
+	// Transform2DComponent caches its global transform when read, so the world's Transform2DHierarchy is updated before each batch,
+	// leaving nothing for concurrent readers to compute
+	class SystemScheduler {
+	public:
+		void invalidate();
+		void update(World& world, const Vector<std::unique_ptr<System>>& systems, Time time);
+
+		const Vector<Vector<System*>>& getBatches() const { return batches; }
+
+	private:
+		Vector<Vector<System*>> batches;
+		bool dirty = true;
+
+		void buildBatches(const Vector<std::unique_ptr<System>>& systems, MaskStorage& storage);
+		void runBatch(const Vector<System*>& batch, Time time);
+	};
+}
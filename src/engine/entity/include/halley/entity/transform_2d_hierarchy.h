@@ -0,0 +1,46 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <halley/data_structures/vector.h>
+#include "entity_id.h"
+
+class Transform2DComponent;
+
+namespace Halley {
+	class World;
+	class Family;
+
+	// Brings the global transforms of every Transform2DComponent in a world up to date, so reading them doesn't compute anything
+	// Transforms report themselves when they're changed, added or lose their parent, and only the subtrees below those are walked,
+	// parents before children, so each transform only needs to read its parent's cached values
+	class Transform2DHierarchy {
+	public:
+		explicit Transform2DHierarchy(World& world);
+		~Transform2DHierarchy();
+
+		void update();
+
+		// The subtree under this entity needs updating. Can be called from any thread
+		void markDirty(EntityId id);
+
+	private:
+		class Binding;
+
+		Family& family;
+		std::unique_ptr<Binding> binding;
+
+		std::mutex mutex;
+		Vector<EntityId> dirtyRoots;
+
+		// Kept between updates to reuse their memory
+		Vector<EntityId> pending;
+		Vector<const Transform2DComponent*> roots; // Sorted by address
+		Vector<const Transform2DComponent*> stack;
+
+		void onAdded(void* elements, size_t count);
+		bool hasDirtyAncestor(const Transform2DComponent& transform) const;
+		void updateSubtree(const Transform2DComponent& root);
+		const Transform2DComponent* getTransform(EntityId id) const;
+	};
+}
@@ -1,6 +1,10 @@
 #pragma once
 
 #include <halley/data_structures/vector.h>
+#include <halley/support/exception.h>
+#include <new>
+#include <type_traits>
+#include <typeinfo>
 
 namespace Halley {
 	class TypeDeleterBase
@@ -8,7 +12,10 @@ namespace Halley {
 	public:
 		virtual ~TypeDeleterBase() {}
 		virtual size_t getSize() = 0;
+		virtual size_t getAlignment() = 0;
 		virtual void callDestructor(void* ptr) = 0;
+		virtual void callMoveConstructor(void* dst, void* src) = 0;
+		virtual bool isRelocatable() = 0; // Whether it can be moved into archetype storage
 	};
 
 	class ComponentDeleterTable
@@ -52,6 +59,11 @@ namespace Halley {
 			return sizeof(T);
 		}
 
+		size_t getAlignment() override
+		{
+			return alignof(T);
+		}
+
 		void callDestructor(void* ptr) override
 		{
 #ifdef _MSC_VER
@@ -59,5 +71,20 @@ namespace Halley {
 #endif
 			static_cast<T*>(ptr)->~T();
 		}
+
+		bool isRelocatable() override
+		{
+			return std::is_move_constructible_v<T>;
+		}
+
+		void callMoveConstructor(void* dst, void* src) override
+		{
+			if constexpr (std::is_move_constructible_v<T>) {
+				// Component overrides operator new, so make sure we get the global placement new
+				::new (dst) T(std::move(*static_cast<T*>(src)));
+			} else {
+				throw Exception("Component " + String(typeid(T).name()) + " cannot be relocated, as it's not move constructible.", HalleyExceptions::Entity);
+			}
+		}
 	};
 }
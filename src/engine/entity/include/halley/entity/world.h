@@ -14,6 +14,7 @@
 #include <halley/data_structures/tree_map.h>
 #include "service.h"
 #include "create_functions.h"
+#include "system_scheduler.h"
 #include "halley/utils/attributes.h"
 
 namespace Halley {
@@ -25,9 +26,17 @@ namespace Halley {
 	class System;
 	class Painter;
 	class HalleyAPI;
+	class ArchetypeStorage;
+	class Transform2DHierarchy;
+	class WorldSnapshot;
+	class WorldTelemetry;
+	class ConfigNodeSerializationContext;
 
 	class World
 	{
+		friend class System;
+		friend class WorldTelemetry;
+
 	public:
 		World(const HalleyAPI& api, Resources& resources, bool collectMetrics, CreateComponentFunction createComponent);
 		~World();
@@ -76,6 +85,8 @@ namespace Halley {
 		EntityRef createEntity(UUID uuid, String name = "", std::optional<EntityRef> parent = {}, bool fromPrefab = false);
 		EntityRef createEntity(UUID uuid, String name, EntityId parentId);
 
+		void reserveEntities(size_t count); // Reserves space for count more entities to be created this frame
+
 		void destroyEntity(EntityId id);
 		void destroyEntity(EntityRef entity);
 
@@ -91,9 +102,19 @@ namespace Halley {
 
 		void spawnPending(); // Warning: use with care, will invalidate entities
 
-		void onEntityDirty();
+		void onEntityDirty(Entity& entity);
+
+		void setEntityReloaded(Entity& entity);
 
-		void setEntityReloaded();
+		// Captures all entities, with their hierarchy and components, into a binary snapshot
+		// Given a base, the result is a delta that only stores the entities that changed since it
+		WorldSnapshot snapshot();
+		WorldSnapshot snapshot(const WorldSnapshot& base);
+
+		// Makes the world match the snapshot: other entities are destroyed, and the ones in it are updated in place or recreated
+		// Recreated entities get new ids, and EntityIds in the restored components are remapped to them
+		void restore(const WorldSnapshot& snapshot);
+		void restore(const WorldSnapshot& delta, const WorldSnapshot& base);
 
 		template <typename T>
 		Family& getFamily() noexcept
@@ -119,17 +140,41 @@ namespace Halley {
 
 		bool isDevMode() const;
 
+		// When enabled, entities sharing the same mask keep their components in contiguous per-type arrays
+		// Components may be moved whenever an entity's mask changes, so don't hold on to component pointers across frames
+		// Must be set before any entities are created
+		// Can also be set with "archetypeStorage: true" in the systems config
+		void setArchetypeStorageEnabled(bool enabled);
+		bool isArchetypeStorageEnabled() const;
+
+		// In parallel mode, update timelines run systems that don't conflict with each other concurrently on the CPU executors
+		// Sequential mode (the default) runs every system in order on the calling thread
+		// Can also be set with "parallelSystems: true" in the systems config
+		void setSystemSchedulingMode(SystemSchedulingMode mode);
+		SystemSchedulingMode getSystemSchedulingMode() const;
+
+		// Records per-frame timings and counters of every system and family, keeping the last capacity frames
+		// Can also be set with "telemetry: <capacity>" in the systems config
+		void setTelemetryEnabled(bool enabled, size_t capacity = 600);
+		WorldTelemetry* getTelemetry() const; // Null if disabled
+
+		// Null while the world is being destroyed
+		Transform2DHierarchy* getTransformHierarchy() const;
+
 	private:
 		const HalleyAPI& api;
 		Resources& resources;
 		std::array<Vector<std::unique_ptr<System>>, static_cast<int>(TimeLine::NUMBER_OF_TIMELINES)> systems;
+		std::array<SystemScheduler, static_cast<int>(TimeLine::NUMBER_OF_TIMELINES)> schedulers;
 		CreateComponentFunction createComponent;
 		bool collectMetrics = false;
-		bool entityDirty = false;
-		bool entityReloaded = false;
+		SystemSchedulingMode schedulingMode = SystemSchedulingMode::Sequential;
 		
 		Vector<Entity*> entities;
 		Vector<Entity*> entitiesPendingCreation;
+		Vector<Entity*> entitiesDirty;
+		Vector<Entity*> entitiesReloaded;
+		Vector<Entity*> entitiesRemoved;
 		MappedPool<Entity*> entityMap;
 
 		//TreeMap<FamilyMaskType, std::unique_ptr<Family>> families;
@@ -137,9 +182,14 @@ namespace Halley {
 		TreeMap<String, std::shared_ptr<Service>> services;
 
 		TreeMap<FamilyMaskType, std::vector<Family*>> familyCache;
+		Vector<Vector<System*>> messageReceivers;
+		bool messageReceiversDirty = true;
 
 		std::shared_ptr<MaskStorage> maskStorage;
 		std::shared_ptr<ComponentDeleterTable> componentDeleterTable;
+		std::unique_ptr<ArchetypeStorage> archetypeStorage;
+		std::unique_ptr<Transform2DHierarchy> transformHierarchy;
+		std::unique_ptr<WorldTelemetry> telemetry;
 
 		mutable std::array<StopwatchRollingAveraging, 3> timer;
 
@@ -163,6 +213,9 @@ namespace Halley {
 
 		const std::vector<Family*>& getFamiliesFor(const FamilyMaskType& mask);
 
+		ConfigNodeSerializationContext makeSerializationContext();
+
 		void processSystemMessages(TimeLine timeline);
+		const Vector<System*>& getMessageReceivers(int messageType);
 	};
 }
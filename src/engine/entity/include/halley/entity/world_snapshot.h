@@ -0,0 +1,53 @@
+#pragma once
+
+#include <halley/data_structures/vector.h>
+#include <halley/data_structures/hash_map.h>
+#include <halley/bytes/byte_serializer.h>
+#include "entity_id.h"
+
+namespace Halley
+{
+	// The state of every entity in a World, with its hierarchy and components, as produced by World::snapshot()
+	// Each entity is stored as a separate binary record, so snapshots can be diffed against each other cheaply
+	class WorldSnapshot
+	{
+	public:
+		struct Entry {
+			EntityId id;
+			Bytes data; // Empty if the entity didn't change, in delta snapshots
+
+			void serialize(Serializer& s) const;
+			void deserialize(Deserializer& s);
+		};
+
+		WorldSnapshot() = default;
+		explicit WorldSnapshot(gsl::span<const gsl::byte> bytes);
+
+		Bytes toBytes() const;
+
+		void serialize(Serializer& s) const;
+		void deserialize(Deserializer& s);
+
+		bool isDelta() const;
+		size_t getNumEntities() const;
+		const Vector<Entry>& getEntries() const;
+
+		// Returns a delta snapshot which only holds the entities that changed since base
+		WorldSnapshot makeDelta(const WorldSnapshot& base) const;
+
+		// Rebuilds the full snapshot from a delta and the snapshot it was made against
+		WorldSnapshot applyDelta(const WorldSnapshot& base) const;
+
+	private:
+		friend class World;
+
+		Vector<Entry> entries;
+		bool delta = false;
+	};
+
+	// Set on the Deserializer while components are restored, so EntityIds saved in the snapshot map to the restored entities
+	class WorldSnapshotState : public SerializerState {
+	public:
+		HashMap<EntityId, EntityId> entityIds;
+	};
+}
@@ -12,6 +12,7 @@ namespace Halley {} // Get GitHub to realise this is C++ :3
 #include "entity/system_message.h"
 #include "entity/world.h"
 #include "entity/world_scene_data.h"
+#include "entity/world_snapshot.h"
 #include "entity/family_binding.h"
 #include "entity/family.h"
 #include "entity/entity_scene.h"
@@ -20,5 +21,6 @@ namespace Halley {} // Get GitHub to realise this is C++ :3
 
 #include "entity/diagnostics/performance_stats.h"
 #include "entity/diagnostics/world_stats.h"
+#include "entity/diagnostics/world_telemetry.h"
 
 #include "entity/scene_editor/scene_editor.h"
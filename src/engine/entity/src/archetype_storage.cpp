@@ -0,0 +1,98 @@
+#include "archetype_storage.h"
+#include "type_deleter.h"
+#include <algorithm>
+#include <functional>
+#include <gsl/gsl_assert>
+
+using namespace Halley;
+
+Archetype::Archetype(FamilyMaskType mask, const Vector<int>& componentIds, ComponentDeleterTable& table)
+	: mask(mask)
+{
+	int maxId = 0;
+	for (auto id: componentIds) {
+		maxId = std::max(maxId, id);
+	}
+	columnIndex.resize(size_t(maxId) + 1, -1);
+
+	columns.reserve(componentIds.size());
+	for (auto id: componentIds) {
+		auto* deleter = table.get(id);
+		const size_t align = deleter->getAlignment();
+		Expects(align <= alignof(std::max_align_t));
+
+		columnIndex[id] = int(columns.size());
+		auto& column = columns.emplace_back();
+		column.componentId = id;
+		column.stride = (deleter->getSize() + align - 1) / align * align;
+	}
+}
+
+Archetype::~Archetype() = default;
+
+uint32_t Archetype::allocRow()
+{
+	if (!freeRows.empty()) {
+		// Always reuse the lowest free row, so the archetype stays as packed as possible
+		std::pop_heap(freeRows.begin(), freeRows.end(), std::greater<>());
+		const auto row = freeRows.back();
+		freeRows.pop_back();
+		return row;
+	}
+
+	const auto row = nRows++;
+	if (row % rowsPerChunk == 0) {
+		for (auto& column: columns) {
+			const size_t nElems = (column.stride * rowsPerChunk + sizeof(std::max_align_t) - 1) / sizeof(std::max_align_t);
+			column.chunks.emplace_back(new std::max_align_t[nElems]);
+		}
+	}
+	return row;
+}
+
+void Archetype::freeRow(uint32_t row)
+{
+	Expects(row < nRows);
+	freeRows.push_back(row);
+	std::push_heap(freeRows.begin(), freeRows.end(), std::greater<>());
+}
+
+bool Archetype::hasComponent(int componentId) const
+{
+	return componentId < int(columnIndex.size()) && columnIndex[componentId] != -1;
+}
+
+void* Archetype::getComponent(int componentId, uint32_t row) const
+{
+	if (!hasComponent(componentId)) {
+		return nullptr;
+	}
+
+	const auto& column = columns[columnIndex[componentId]];
+	auto* chunk = reinterpret_cast<char*>(column.chunks[row / rowsPerChunk].get());
+	return chunk + column.stride * (row % rowsPerChunk);
+}
+
+bool Archetype::owns(int componentId, uint32_t row, const void* ptr) const
+{
+	return getComponent(componentId, row) == ptr;
+}
+
+ArchetypeStorage::ArchetypeStorage(ComponentDeleterTable& table)
+	: table(table)
+{
+}
+
+ArchetypeStorage::~ArchetypeStorage() = default;
+
+Archetype& ArchetypeStorage::getArchetype(FamilyMaskType mask, const Vector<int>& componentIds)
+{
+	auto iter = archetypes.find(mask);
+	if (iter != archetypes.end()) {
+		return *iter->second;
+	}
+
+	auto& result = archetypes[mask];
+	result = std::make_unique<Archetype>(mask, componentIds, table);
+	return *result;
+}
@@ -1,6 +1,8 @@
 #include "halley/support/logger.h"
 #include "components/transform_2d_component.h"
 #include "halley/core/graphics/sprite/sprite.h"
+#include "halley/entity/transform_2d_hierarchy.h"
+#include "halley/entity/world.h"
 
 using namespace Halley;
 
@@ -30,6 +32,7 @@ void Transform2DComponent::onHierarchyChanged()
 {
 	updateParentTransform();	
 	markDirtyShallow();
+	markDirtyInHierarchy();
 }
 
 void Transform2DComponent::updateParentTransform()
@@ -65,8 +68,7 @@ Vector2f Transform2DComponent::getGlobalPosition() const
 {
 	if (parentTransform) {
 		if (!isCached(CachedIndices::Position)) {
-			setCached(CachedIndices::Position);
-			cachedGlobalPos = parentTransform->transformPoint(position);
+			updateGlobalTransform();
 		}
 		return cachedGlobalPos;
 	} else {
@@ -81,26 +83,42 @@ void Transform2DComponent::setGlobalPosition(Vector2f v)
 
 Vector2f Transform2DComponent::getGlobalScale() const
 {
-	// TODO
-	return scale;
+	if (parentTransform) {
+		if (!isCached(CachedIndices::Scale)) {
+			updateGlobalTransform();
+		}
+		return cachedGlobalScale;
+	} else {
+		return scale;
+	}
 }
 
 void Transform2DComponent::setGlobalScale(Vector2f v)
 {
-	// TODO
-	setLocalScale(v);
+	if (parentTransform) {
+		// Any local scale gives the same global scale along an axis the parent collapses, so keep the current one
+		const auto parentScale = parentTransform->getGlobalScale();
+		setLocalScale(Vector2f(parentScale.x != 0 ? v.x / parentScale.x : scale.x, parentScale.y != 0 ? v.y / parentScale.y : scale.y));
+	} else {
+		setLocalScale(v);
+	}
 }
 
 Angle1f Transform2DComponent::getGlobalRotation() const
 {
-	// TODO
-	return rotation;
+	if (parentTransform) {
+		if (!isCached(CachedIndices::Rotation)) {
+			updateGlobalTransform();
+		}
+		return cachedGlobalRotation;
+	} else {
+		return rotation;
+	}
 }
 
 void Transform2DComponent::setGlobalRotation(Angle1f v)
 {
-	// TODO
-	setLocalRotation(v);
+	setLocalRotation(parentTransform ? v - parentTransform->getGlobalRotation() : v);
 }
 
 int Transform2DComponent::getSubWorld() const
@@ -131,30 +149,68 @@ void Transform2DComponent::setSubWorld(int world)
 
 Vector2f Transform2DComponent::transformPoint(const Vector2f& p) const
 {
-	// TODO, do this properly
-	
-	auto pos = getGlobalPosition() + p;
-	setCached(CachedIndices::Position); // Important: getGlobalPosition() won't cache if it's the root, but this is important for markDirty
+	Vector2f axisX;
+	Vector2f axisY;
+	getGlobalAxes(axisX, axisY);
+	const auto pos = getGlobalPosition() + axisX * p.x + axisY * p.y;
+	markGlobalTransformRead();
 	return pos;
 }
 
 Vector2f Transform2DComponent::inverseTransformPoint(const Vector2f& p) const
 {
-	// TODO, do this properly
+	Vector2f axisX;
+	Vector2f axisY;
+	getGlobalAxes(axisX, axisY);
+	const auto d = p - getGlobalPosition();
+	markGlobalTransformRead();
 
-	auto pos = p - getGlobalPosition();
-	setCached(CachedIndices::Position); // Important: getGlobalPosition() won't cache if it's the root, but this is important for markDirty
-	return pos;
+	// A transform with a zero scale collapses the plane, so there's no point to map back to
+	const float det = axisX.x * axisY.y - axisY.x * axisX.y;
+	if (det == 0) {
+		return Vector2f();
+	}
+	return Vector2f(d.x * axisY.y - d.y * axisY.x, d.y * axisX.x - d.x * axisX.y) / det;
 }
 
 Rect4f Transform2DComponent::getSpriteAABB(const Sprite& sprite) const
 {
-	return sprite.getAABB() - sprite.getPosition() + getGlobalPosition();
+	auto rect = sprite.getLocalAABB();
+	if (sprite.isFlipped()) {
+		rect = Rect4f(Vector2f(-rect.getRight(), rect.getTop()), Vector2f(-rect.getLeft(), rect.getBottom()));
+	}
+	return transformRect(applySpriteTransform(sprite, rect));
 }
 
 Halley::Rect4f Transform2DComponent::getSpriteUncroppedAABB(const Halley::Sprite& sprite) const
 {
-	return sprite.getUncroppedAABB() - sprite.getPosition() + getGlobalPosition();
+	const auto pivot = sprite.getUncroppedAbsolutePivot();
+	return transformRect(applySpriteTransform(sprite, Rect4f(-pivot, sprite.getUncroppedSize() - pivot)));
+}
+
+Rect4f Transform2DComponent::transformRect(const Rect4f& rect) const
+{
+	return getBounds({ transformPoint(rect.getTopLeft()), transformPoint(rect.getTopRight()), transformPoint(rect.getBottomLeft()), transformPoint(rect.getBottomRight()) });
+}
+
+Rect4f Transform2DComponent::applySpriteTransform(const Sprite& sprite, const Rect4f& rect)
+{
+	// The sprite's own scale and rotation apply around its pivot, before this transform
+	const auto scale = sprite.getScale();
+	const auto rotation = sprite.getRotation();
+	const auto apply = [&] (Vector2f p) { return (p * scale).rotate(rotation); };
+	return getBounds({ apply(rect.getTopLeft()), apply(rect.getTopRight()), apply(rect.getBottomLeft()), apply(rect.getBottomRight()) });
+}
+
+Rect4f Transform2DComponent::getBounds(std::array<Vector2f, 4> points)
+{
+	Vector2f tl = points[0];
+	Vector2f br = points[0];
+	for (const auto& p: points) {
+		tl = Vector2f(std::min(tl.x, p.x), std::min(tl.y, p.y));
+		br = Vector2f(std::max(br.x, p.x), std::max(br.y, p.y));
+	}
+	return Rect4f(tl, br);
 }
 
 void Transform2DComponent::deserialize(ConfigNodeSerializationContext& context, const ConfigNode& node)
@@ -172,6 +228,12 @@ void Transform2DComponent::markDirty(DirtyPropagationMode mode, int depth) const
 	if (cachedValues != 0 || mode != DirtyPropagationMode::Changed) {
 		markDirtyShallow();
 
+		// The hierarchy walks the whole subtree from here, so only the top needs to be reported
+		// Children of a removed transform become the top of their own subtrees
+		if (depth == 0 || (depth == 1 && mode == DirtyPropagationMode::Removed)) {
+			markDirtyInHierarchy();
+		}
+
 		// Propagate to all children
 		for (auto& c: entity.getRawChildren()) {
 			const auto childTransform = c->tryGetComponent<Transform2DComponent>();
@@ -191,12 +253,84 @@ void Transform2DComponent::markDirty(DirtyPropagationMode mode, int depth) const
 	}
 }
 
+void Transform2DComponent::updateGlobalTransform() const
+{
+	// All global values are computed together, from the parent's global values
+	Vector2f parentX;
+	Vector2f parentY;
+	parentTransform->getGlobalAxes(parentX, parentY);
+	Vector2f localX;
+	Vector2f localY;
+	getLocalAxes(localX, localY);
+	cachedGlobalAxisX = parentX * localX.x + parentY * localX.y;
+	cachedGlobalAxisY = parentX * localY.x + parentY * localY.y;
+
+	cachedGlobalPos = parentTransform->transformPoint(position);
+	cachedGlobalScale = parentTransform->getGlobalScale() * scale;
+	cachedGlobalRotation = parentTransform->getGlobalRotation() + rotation;
+	markGlobalTransformRead();
+}
+
+void Transform2DComponent::refreshGlobalTransform() const
+{
+	// Everything the getters would otherwise compute and cache on first read
+	if (parentTransform) {
+		if (!isGlobalTransformCached()) {
+			updateGlobalTransform();
+		}
+	} else {
+		markGlobalTransformRead();
+	}
+	getSubWorld();
+}
+
+void Transform2DComponent::getLocalAxes(Vector2f& x, Vector2f& y) const
+{
+	x = Vector2f(scale.x, 0).rotate(rotation);
+	y = Vector2f(0, scale.y).rotate(rotation);
+}
+
+void Transform2DComponent::getGlobalAxes(Vector2f& x, Vector2f& y) const
+{
+	if (parentTransform) {
+		if (!isCached(CachedIndices::Position)) {
+			updateGlobalTransform();
+		}
+		x = cachedGlobalAxisX;
+		y = cachedGlobalAxisY;
+	} else {
+		getLocalAxes(x, y);
+	}
+}
+
+bool Transform2DComponent::isGlobalTransformCached() const
+{
+	return isCached(CachedIndices::Position) && isCached(CachedIndices::Scale) && isCached(CachedIndices::Rotation);
+}
+
+void Transform2DComponent::markGlobalTransformRead() const
+{
+	// Important: the getters won't cache if this is the root, but children depend on these values, so markDirty needs to know they were read
+	setCached(CachedIndices::Position);
+	setCached(CachedIndices::Scale);
+	setCached(CachedIndices::Rotation);
+}
+
 void Transform2DComponent::markDirtyShallow() const
 {
 	++revision;
 	cachedValues = 0;
 }
 
+void Transform2DComponent::markDirtyInHierarchy() const
+{
+	if (entity.isValid()) {
+		if (auto* hierarchy = entity.getWorld().getTransformHierarchy()) {
+			hierarchy->markDirty(entity.getEntityId());
+		}
+	}
+}
+
 bool Transform2DComponent::isCached(CachedIndices index) const
 {
 	return cachedValues & (1 << int(index));
@@ -204,5 +338,8 @@ bool Transform2DComponent::isCached(CachedIndices index) const
 
 void Transform2DComponent::setCached(CachedIndices index) const
 {
-	cachedValues |= (1 << int(index));
+	// Transforms are read concurrently once they're up to date, so only write if it changes anything
+	if (!isCached(index)) {
+		cachedValues |= (1 << int(index));
+	}
 }
@@ -135,7 +135,8 @@ void PerformanceStatsView::drawHeader(Painter& painter)
 
 	
 	String str = "Capped: " + formatTime(totalFrameTime + vsyncTime) + " ms [" + toString(curFPS) + " FPS] | Uncapped: " + formatTime(totalFrameTime) + " ms [" + toString(maxFPS) + " FPS].\n"
-		+ toString(painter.getPrevDrawCalls()) + " draw calls, " + toString(painter.getPrevTriangles()) + " triangles, " + toString(painter.getPrevVertices()) + " vertices.";
+		+ toString(painter.getPrevDrawCalls()) + " draw calls, " + toString(painter.getPrevTriangles()) + " triangles, " + toString(painter.getPrevVertices()) + " vertices, "
+		+ toString(painter.getPrevScratchBytes() / 1024) + " KiB scratch [" + toString(painter.getPeakScratchBytes() / 1024) + " KiB peak].";
 
 	const auto audioSpec = api.audio->getAudioSpec();
 	if (audioSpec) {
@@ -0,0 +1,317 @@
+#include "diagnostics/world_telemetry.h"
+#include <chrono>
+#include <cstring>
+#include <sstream>
+#include <iomanip>
+#include "world.h"
+#include "system.h"
+#include "family.h"
+#include "family_binding.h"
+#include "halley/file/path.h"
+#include "halley/support/exception.h"
+
+using namespace Halley;
+
+namespace {
+	const char* getTimeLineName(TimeLine timeline)
+	{
+		switch (timeline) {
+		case TimeLine::FixedUpdate:
+			return "fixedUpdate";
+		case TimeLine::VariableUpdate:
+			return "variableUpdate";
+		case TimeLine::Render:
+			return "render";
+		default:
+			return "unknown";
+		}
+	}
+
+	void writeMicroseconds(std::ostream& out, int64_t ns)
+	{
+		if (ns < 0) {
+			out << '-';
+			ns = -ns;
+		}
+		out << (ns / 1000) << '.' << std::setw(3) << std::setfill('0') << (ns % 1000) << std::setfill(' ');
+	}
+
+	void writeJSONString(std::ostream& out, const String& str)
+	{
+		out << '"';
+		for (char c: str.cppStr()) {
+			if (c == '"' || c == '\\') {
+				out << '\\';
+			}
+			out << c;
+		}
+		out << '"';
+	}
+
+	Bytes toBytes(const String& str)
+	{
+		Bytes result(str.size());
+		memcpy(result.data(), str.c_str(), str.size());
+		return result;
+	}
+}
+
+WorldTelemetry::WorldTelemetry(size_t capacity)
+	: epoch(getTimestamp())
+{
+	setCapacity(capacity);
+}
+
+void WorldTelemetry::setCapacity(size_t capacity)
+{
+	if (capacity == 0) {
+		throw Exception("WorldTelemetry needs room for at least one frame.", HalleyExceptions::Entity);
+	}
+	frames.clear();
+	frames.resize(capacity);
+	firstFrame = 0;
+	numFrames = 0;
+}
+
+size_t WorldTelemetry::getCapacity() const
+{
+	return frames.size();
+}
+
+void WorldTelemetry::clear()
+{
+	firstFrame = 0;
+	numFrames = 0;
+}
+
+size_t WorldTelemetry::getNumFrames() const
+{
+	return numFrames;
+}
+
+const WorldTelemetry::Frame& WorldTelemetry::getFrame(size_t index) const
+{
+	Expects(index < numFrames);
+	return frames[(firstFrame + index) % frames.size()];
+}
+
+const Vector<String>& WorldTelemetry::getSystemNames() const
+{
+	return systemNames;
+}
+
+const Vector<String>& WorldTelemetry::getFamilyNames() const
+{
+	return familyNames;
+}
+
+int64_t WorldTelemetry::getTimestamp()
+{
+	using namespace std::chrono;
+	return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+void WorldTelemetry::beginFrame()
+{
+	frameStart = getTimestamp();
+}
+
+void WorldTelemetry::endFrame(const World& world, TimeLine timeline)
+{
+	const int64_t now = getTimestamp();
+
+	current.frameNumber = frameNumber++;
+	current.timeline = timeline;
+	current.startNs = frameStart - epoch;
+	current.durationNs = now - frameStart;
+	current.entities = uint32_t(world.numEntities());
+
+	current.messagesSent = 0;
+	for (auto& system: world.getSystems(timeline)) {
+		auto& sample = current.systems.emplace_back();
+		sample.system = getSystemIndex(system->getName());
+		sample.startNs = system->sampleStart - epoch;
+		sample.durationNs = system->timer.lastElapsedNanoSeconds();
+		sample.messagesSent = system->messagesSent;
+		current.messagesSent += system->messagesSent;
+	}
+
+	if (familyNames.size() != world.families.size()) {
+		updateFamilyNames(world);
+	}
+	current.families.resize(world.families.size());
+	for (size_t i = 0; i < world.families.size(); ++i) {
+		current.families[i].entities = uint32_t(world.families[i]->count());
+	}
+
+	// Swap into the ring buffer, so the evicted frame's vectors are reused for the next one
+	size_t slot;
+	if (numFrames < frames.size()) {
+		slot = (firstFrame + numFrames) % frames.size();
+		++numFrames;
+	} else {
+		slot = firstFrame;
+		firstFrame = (firstFrame + 1) % frames.size();
+	}
+	std::swap(frames[slot], current);
+
+	current.entitiesSpawned = 0;
+	current.entitiesDestroyed = 0;
+	current.familyUpdateNs = 0;
+	current.systems.clear();
+	for (auto& f: current.families) {
+		f = FamilySample();
+	}
+}
+
+void WorldTelemetry::onEntitiesSpawned(size_t count)
+{
+	current.entitiesSpawned += uint32_t(count);
+}
+
+void WorldTelemetry::onEntitiesDestroyed(size_t count)
+{
+	current.entitiesDestroyed += uint32_t(count);
+}
+
+void WorldTelemetry::onFamilyUpdated(size_t familyIndex, int64_t startNs)
+{
+	const int64_t elapsed = getTimestamp() - startNs;
+	if (familyIndex >= current.families.size()) {
+		current.families.resize(familyIndex + 1);
+	}
+	current.families[familyIndex].updateNs += elapsed;
+	current.familyUpdateNs += elapsed;
+}
+
+int WorldTelemetry::getSystemIndex(const String& name)
+{
+	const auto iter = systemIndices.find(name);
+	if (iter != systemIndices.end()) {
+		return iter->second;
+	}
+	const int idx = int(systemNames.size());
+	systemNames.push_back(name);
+	systemIndices[name] = idx;
+	return idx;
+}
+
+void WorldTelemetry::updateFamilyNames(const World& world)
+{
+	// Families are named after the first system that binds them, e.g. "Sprite/1" is the second family of SpriteSystem
+	familyNames.resize(world.families.size());
+	for (size_t i = 0; i < familyNames.size(); ++i) {
+		familyNames[i] = String("family") + toString(i);
+	}
+
+	Vector<char> named(familyNames.size(), 0);
+	for (auto& tl: world.systems) {
+		for (auto& system: tl) {
+			for (size_t j = 0; j < system->families.size(); ++j) {
+				const auto iter = std::find_if(world.families.begin(), world.families.end(), [&] (const std::unique_ptr<Family>& f) { return f.get() == system->families[j]->family; });
+				if (iter != world.families.end()) {
+					const size_t idx = iter - world.families.begin();
+					if (!named[idx]) {
+						familyNames[idx] = system->getName() + "/" + toString(j);
+						named[idx] = 1;
+					}
+				}
+			}
+		}
+	}
+}
+
+String WorldTelemetry::toChromeTrace() const
+{
+	// See the "Trace Event Format" document for the format, timestamps are in microseconds
+	std::stringstream out;
+	out << "{\"traceEvents\":[\n";
+	out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":0,\"args\":{\"name\":\"fixedUpdate\"}},\n";
+	out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":1,\"args\":{\"name\":\"variableUpdate\"}},\n";
+	out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":2,\"args\":{\"name\":\"render\"}}";
+
+	for (size_t i = 0; i < numFrames; ++i) {
+		const auto& frame = getFrame(i);
+		const int tid = int(frame.timeline);
+
+		out << ",\n{\"name\":\"frame\",\"cat\":\"world\",\"ph\":\"X\",\"pid\":0,\"tid\":" << tid << ",\"ts\":";
+		writeMicroseconds(out, frame.startNs);
+		out << ",\"dur\":";
+		writeMicroseconds(out, frame.durationNs);
+		out << ",\"args\":{\"frame\":" << frame.frameNumber << ",\"familyUpdateNs\":" << frame.familyUpdateNs << "}}";
+
+		for (auto& sample: frame.systems) {
+			out << ",\n{\"name\":";
+			writeJSONString(out, systemNames[sample.system]);
+			out << ",\"cat\":\"system\",\"ph\":\"X\",\"pid\":0,\"tid\":" << tid << ",\"ts\":";
+			writeMicroseconds(out, sample.startNs);
+			out << ",\"dur\":";
+			writeMicroseconds(out, sample.durationNs);
+			out << ",\"args\":{\"messagesSent\":" << sample.messagesSent << "}}";
+		}
+
+		out << ",\n{\"name\":\"entities\",\"ph\":\"C\",\"pid\":0,\"tid\":" << tid << ",\"ts\":";
+		writeMicroseconds(out, frame.startNs);
+		out << ",\"args\":{\"alive\":" << frame.entities << ",\"spawned\":" << frame.entitiesSpawned << ",\"destroyed\":" << frame.entitiesDestroyed << ",\"messagesSent\":" << frame.messagesSent << "}}";
+
+		if (!frame.families.empty()) {
+			out << ",\n{\"name\":\"families\",\"ph\":\"C\",\"pid\":0,\"tid\":" << tid << ",\"ts\":";
+			writeMicroseconds(out, frame.startNs);
+			out << ",\"args\":{";
+			for (size_t j = 0; j < frame.families.size(); ++j) {
+				if (j > 0) {
+					out << ',';
+				}
+				writeJSONString(out, j < familyNames.size() ? familyNames[j] : String("family") + toString(j));
+				out << ':' << frame.families[j].entities;
+			}
+			out << "}}";
+		}
+	}
+
+	out << "\n]}\n";
+	return out.str();
+}
+
+String WorldTelemetry::toCSV() const
+{
+	std::stringstream out;
+	out << "frame,timeline,type,name,start_us,duration_us,value\n";
+
+	for (size_t i = 0; i < numFrames; ++i) {
+		const auto& frame = getFrame(i);
+		const char* timeline = getTimeLineName(frame.timeline);
+		auto writeRow = [&] (const char* type, const String& name, int64_t startNs, int64_t durationNs, uint64_t value)
+		{
+			out << frame.frameNumber << ',' << timeline << ',' << type << ',' << name << ',';
+			writeMicroseconds(out, startNs);
+			out << ',';
+			writeMicroseconds(out, durationNs);
+			out << ',' << value << '\n';
+		};
+
+		writeRow("frame", "", frame.startNs, frame.durationNs, frame.entities);
+		for (auto& sample: frame.systems) {
+			writeRow("system", systemNames[sample.system], sample.startNs, sample.durationNs, sample.messagesSent);
+		}
+		for (size_t j = 0; j < frame.families.size(); ++j) {
+			writeRow("family", j < familyNames.size() ? familyNames[j] : String("family") + toString(j), frame.startNs, frame.families[j].updateNs, frame.families[j].entities);
+		}
+		writeRow("counter", "entitiesSpawned", frame.startNs, 0, frame.entitiesSpawned);
+		writeRow("counter", "entitiesDestroyed", frame.startNs, 0, frame.entitiesDestroyed);
+		writeRow("counter", "messagesSent", frame.startNs, 0, frame.messagesSent);
+		writeRow("counter", "familyUpdate", frame.startNs, frame.familyUpdateNs, 0);
+	}
+
+	return out.str();
+}
+
+void WorldTelemetry::saveChromeTrace(const Path& path) const
+{
+	Path::writeFile(path, toBytes(toChromeTrace()));
+}
+
+void WorldTelemetry::saveCSV(const Path& path) const
+{
+	Path::writeFile(path, toBytes(toCSV()));
+}
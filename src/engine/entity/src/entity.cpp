@@ -1,6 +1,8 @@
+#include <algorithm>
 #include <halley/data_structures/memory_pool.h>
 #include "entity.h"
 #include "world.h"
+#include "archetype_storage.h"
 #include "components/transform_2d_component.h"
 
 
@@ -12,6 +14,7 @@ Entity::Entity()
 	, serializable(true)
 	, reloaded(false)
 	, fromPrefab(false)
+	, componentsAdded(false)
 {
 	
 }
@@ -24,34 +27,47 @@ void Entity::destroyComponents(ComponentDeleterTable& table)
 		deleteComponent(component.second, component.first, table);
 	}
 	components.clear();
+	liveComponentBits = {};
 	liveComponents = 0;
+
+	if (archetype) {
+		archetype->freeRow(archetypeRow);
+		archetype = nullptr;
+	}
 }
 
 void Entity::addComponent(Component* component, int id)
 {
-	// Put it at the back of the list...
-	components.push_back(std::pair<int, Component*>(id, component));
+	Expects(id >= 0 && id < int(FamilyMask::RealType().size()));
 
-	// ...if there's dead components, swap with the first dead component...
-	if (liveComponents < int(components.size())) {
-		std::swap(components[liveComponents], components.back());
+	// Adding a component that already exists keeps the existing one, as before
+	// The new one is never visible, and is deleted with the other dead components on refresh
+	if (hasComponentId(id)) {
+		components.push_back(std::pair<int, Component*>(id, component));
+		return;
 	}
 
-	// ...and increase the list, therefore putting it in living component territory
+	// Insert it in its sorted place in living component territory, pushing the dead components along
+	components.insert(components.begin() + getComponentSlot(id), std::pair<int, Component*>(id, component));
+	setComponentBit(id, true);
 	++liveComponents;
+	componentsAdded = true;
 }
 
 void Entity::removeComponentAt(int i)
 {
-	// Put it at the end of the list of living components... (guaranteed to swap with living component)
-	std::swap(components[i], components[size_t(liveComponents) - 1]);
+	// Move it to the end of the list of living components, keeping the others sorted...
+	const int id = components[i].first;
+	std::rotate(components.begin() + i, components.begin() + i + 1, components.begin() + liveComponents);
 
 	// ...then shrink that list, therefore moving it into dead component territory
+	setComponentBit(id, false);
 	--liveComponents;
 }
 
 void Entity::removeAllComponents(World& world)
 {
+	liveComponentBits = {};
 	liveComponents = 0;
 	markDirty(world);
 }
@@ -60,22 +76,92 @@ void Entity::deleteComponent(Component* component, int id, ComponentDeleterTable
 {
 	TypeDeleterBase* deleter = table.get(id);
 	deleter->callDestructor(component);
-	PoolPool::getPool(deleter->getSize())->free(component);
+
+	// Components living in the archetype are freed along with their row
+	if (!archetype || !archetype->owns(id, archetypeRow, component)) {
+		PoolPool::getPool(deleter->getSize())->free(component);
+	}
 }
 
 void Entity::keepOnlyComponentsWithIds(const std::vector<int>& ids, World& world)
 {
-	for (int i = 0; i < liveComponents; ++i) {
-		if (std::find(ids.begin(), ids.end(), components[i].first) == ids.end()) {
-			std::swap(components[i], components[liveComponents - 1]);
-			--liveComponents;
-			--i;
-		}
+	// Stable, so the components that are kept stay sorted
+	const auto liveEnd = components.begin() + liveComponents;
+	const auto keptEnd = std::stable_partition(components.begin(), liveEnd, [&] (const std::pair<int, Component*>& c)
+	{
+		return std::find(ids.begin(), ids.end(), c.first) != ids.end();
+	});
+	for (auto iter = keptEnd; iter != liveEnd; ++iter) {
+		setComponentBit(iter->first, false);
 	}
+	liveComponents = int(keptEnd - components.begin());
 	
 	markDirty(world);
 }
 
+bool Entity::relocateComponents(ArchetypeStorage& archetypes, ComponentDeleterTable& table)
+{
+	if (components.empty()) {
+		if (archetype) {
+			archetype->freeRow(archetypeRow);
+			archetype = nullptr;
+		}
+		return false;
+	}
+
+	// Find the archetype that matches the current mask
+	// Components that can't be moved aren't part of it, and stay in their own allocation
+	Archetype* target = archetype;
+	if (!target || target->getMask() != mask) {
+		Vector<int> ids;
+		ids.reserve(components.size());
+		for (auto& c: components) {
+			if (table.get(c.first)->isRelocatable()) {
+				ids.push_back(c.first);
+			}
+		}
+		target = &archetypes.getArchetype(mask, ids);
+	}
+
+	// Move every component that isn't yet in its slot. If the archetype didn't change, that's only components added since the last refresh
+	const bool changedRow = target != archetype;
+	const uint32_t row = changedRow ? target->allocRow() : archetypeRow;
+	bool relocated = false;
+	for (auto& c: components) {
+		if (target->hasComponent(c.first) && (changedRow || !target->owns(c.first, row, c.second))) {
+			auto* dst = target->getComponent(c.first, row);
+			table.get(c.first)->callMoveConstructor(dst, c.second);
+			deleteComponent(c.second, c.first, table);
+			c.second = static_cast<Component*>(dst);
+			relocated = true;
+		}
+	}
+
+	if (changedRow) {
+		if (archetype) {
+			archetype->freeRow(archetypeRow);
+		}
+		archetype = target;
+		archetypeRow = row;
+	}
+
+	if (relocated) {
+		onComponentsRelocated();
+	}
+	return relocated;
+}
+
+void Entity::onComponentsRelocated()
+{
+	// Children cache a pointer to our transform, so they need to fetch it again
+	for (auto& child: children) {
+		auto transform = child->tryGetComponent<Transform2DComponent>();
+		if (transform) {
+			transform->onHierarchyChanged();
+		}
+	}
+}
+
 void Entity::onReady()
 {
 }
@@ -84,7 +170,7 @@ void Entity::markDirty(World& world)
 {
 	if (!dirty) {
 		dirty = true;
-		world.onEntityDirty();
+		world.onEntityDirty(*this);
 	}
 }
 
@@ -149,8 +235,9 @@ FamilyMaskType Entity::getMask() const
 	return mask;
 }
 
-void Entity::refresh(MaskStorage& storage, ComponentDeleterTable& table)
+bool Entity::refresh(MaskStorage& storage, ComponentDeleterTable& table, ArchetypeStorage* archetypes)
 {
+	bool relocated = false;
 	if (dirty) {
 		dirty = false;
 
@@ -165,8 +252,16 @@ void Entity::refresh(MaskStorage& storage, ComponentDeleterTable& table)
 		for (auto i : components) {
 			FamilyMask::setBit(m, i.first);
 		}
+		const auto oldMask = mask;
 		mask = FamilyMaskType(m, storage);
+
+		// Only a change to the set of components can move them
+		if (archetypes && (componentsAdded || mask != oldMask)) {
+			relocated = relocateComponents(*archetypes, table);
+		}
+		componentsAdded = false;
 	}
+	return relocated;
 }
 
 EntityId Entity::getEntityId() const
@@ -177,9 +272,9 @@ EntityId Entity::getEntityId() const
 	return entityId;
 }
 
-void Entity::destroy()
+void Entity::destroy(World& world)
 {
-	doDestroy(true);
+	doDestroy(world, true);
 }
 
 void Entity::sortChildren(const std::vector<UUID>& uuids)
@@ -221,30 +316,26 @@ void Entity::sortChildren(const std::vector<UUID>& uuids)
 	}
 }
 
-void Entity::doDestroy(bool updateParenting)
+void Entity::doDestroy(World& world, bool updateParenting)
 {
 	if (updateParenting) {
 		setParent(nullptr, false);
 	}
 
 	for (auto& c: children) {
-		c->doDestroy(false);
+		c->doDestroy(world, false);
 	}
 	children.clear();
 	
 	alive = false;
-	dirty = true;
-}
-
-bool Entity::hasBit(World& world, int index) const
-{
-	return FamilyMask::hasBit(mask, index, world.getMaskStorage());
+	markDirty(world);
 }
 
 void EntityRef::setReloaded()
 {
 	Expects(entity);
-	entity->reloaded = true;
-
-	world->setEntityReloaded();
+	if (!entity->reloaded) {
+		entity->reloaded = true;
+		world->setEntityReloaded(*entity);
+	}
 }
@@ -1,4 +1,5 @@
 #include "entity_factory.h"
+#include <algorithm>
 
 
 #include "component_reflector.h"
@@ -47,14 +48,34 @@ EntityRef EntityFactory::createPrefab(std::shared_ptr<const Prefab> prefab)
 		Logger::logWarning("Missing prefab");
 		return EntityRef();
 	} else {
-		const auto& node = prefab->getRoot();
-		if (node.getType() == ConfigNodeType::Sequence) {
-			throw Exception("Prefab seems to have more than one root; use EntityFactory::createScene() instead", HalleyExceptions::Entity);
-		}
-		
-		startContext();
-		return createEntityTree(node, nullptr);
+		std::vector<EntityRef> created;
+		return instantiate(getCompiledPrefab(prefab), created);
+	}
+}
+
+std::vector<EntityRef> EntityFactory::createEntities(const String& prefabName, size_t count)
+{
+	return createEntities(getPrefab(prefabName), count);
+}
+
+std::vector<EntityRef> EntityFactory::createEntities(std::shared_ptr<const Prefab> prefab, size_t count)
+{
+	std::vector<EntityRef> result;
+	if (!prefab) {
+		Logger::logWarning("Missing prefab");
+		return result;
 	}
+
+	auto& compiled = getCompiledPrefab(prefab);
+	world.reserveEntities(count * compiled.entities.size());
+	result.reserve(count);
+
+	std::vector<EntityRef> created;
+	created.reserve(compiled.entities.size());
+	for (size_t i = 0; i < count; ++i) {
+		result.push_back(instantiate(compiled, created));
+	}
+	return result;
 }
 
 EntityScene EntityFactory::createScene(std::shared_ptr<const Prefab> prefab)
@@ -117,13 +138,39 @@ EntityRef EntityFactory::createEntity(std::optional<EntityRef> parent, const Con
 }
 
 void EntityFactory::updateEntity(EntityRef& entity, const ConfigNode& treeNode, UpdateMode mode)
+{
+	std::vector<int> idsUpdated;
+
+	// Load components
+	const auto& func = world.getCreateComponentFunction();
+	forEachComponentData(treeNode, [&] (const String& componentName, const ConfigNode& componentData)
+	{
+		auto result = func(*this, componentName, entity, componentData);
+		
+		if (mode == UpdateMode::UpdateAllDeleteOld) {
+			idsUpdated.push_back(result.componentId);
+		}
+	});
+
+	if (mode == UpdateMode::UpdateAllDeleteOld) {
+		entity.keepOnlyComponentsWithIds(idsUpdated);
+	}
+
+	const bool isPrefab = treeNode.hasKey("prefab");
+	const auto& node = isPrefab ? getPrefabNode(treeNode["prefab"].asString()) : treeNode;
+	entity.setName(node["name"].asString(""));
+
+	if (mode == UpdateMode::UpdateAllDeleteOld) {
+		entity.setReloaded();
+	}
+}
+
+void EntityFactory::forEachComponentData(const ConfigNode& treeNode, std::function<void(const String&, const ConfigNode&)> callback) const
 {
 	const bool isPrefab = treeNode.hasKey("prefab");
 	const auto& node = isPrefab ? getPrefabNode(treeNode["prefab"].asString()) : treeNode;
 	auto* overrideNodes = isPrefab ? &treeNode : nullptr;
 	
-	std::vector<int> idsUpdated;
-
 	// Prepare component overrides
 	std::map<String, const ConfigNode*> overrides;
 	if (overrideNodes) {
@@ -159,47 +206,19 @@ void EntityFactory::updateEntity(EntityRef& entity, const ConfigNode& treeNode,
 		}
 	};
 
-	// Load components
-	auto loadComponents = [&] (const ConfigNode::MapType map)
+	auto visitComponents = [&] (const ConfigNode::MapType& map)
 	{
-		const auto func = world.getCreateComponentFunction();
 		for (const auto& [componentName, componentData]: map) {
-			auto result = func(*this, componentName, entity, getComponentData(componentName, componentData));
-			
-			if (mode == UpdateMode::UpdateAllDeleteOld) {
-				idsUpdated.push_back(result.componentId);
-			}
+			callback(componentName, getComponentData(componentName, componentData));
 		}
 	};
 	
 	if (node["components"].getType() == ConfigNodeType::Sequence) {
-		const auto& sequence = node["components"].asSequence();
-
-		if (mode == UpdateMode::UpdateAllDeleteOld) {
-			idsUpdated.reserve(sequence.size());
-		}
-		
-		for (const auto& componentNode: sequence) {
-			loadComponents(componentNode.asMap());
+		for (const auto& componentNode: node["components"].asSequence()) {
+			visitComponents(componentNode.asMap());
 		}
 	} else if (node["components"].getType() == ConfigNodeType::Map) {
-		const auto& map = node["components"].asMap();
-		
-		if (mode == UpdateMode::UpdateAllDeleteOld) {
-			idsUpdated.reserve(map.size());
-		}
-
-		loadComponents(map);
-	}
-
-	if (mode == UpdateMode::UpdateAllDeleteOld) {
-		entity.keepOnlyComponentsWithIds(idsUpdated);
-	}
-
-	entity.setName(node["name"].asString(""));
-
-	if (mode == UpdateMode::UpdateAllDeleteOld) {
-		entity.setReloaded();
+		visitComponents(node["components"].asMap());
 	}
 }
 
@@ -312,6 +331,113 @@ void EntityFactory::doUpdateEntityTree(EntityRef& entity, const ConfigNode& tree
 	entity.sortChildren(nodeUUIDs);
 }
 
+EntityFactory::CompiledPrefab& EntityFactory::getCompiledPrefab(const std::shared_ptr<const Prefab>& prefab)
+{
+	if (compiledPrefabs.find(prefab.get()) == compiledPrefabs.end()) {
+		evictCompiledPrefabs();
+	}
+	auto& compiled = compiledPrefabs[prefab.get()];
+
+	// Recompile if the prefab or any of the prefabs nested in it were reloaded or unloaded
+	const bool upToDate = compiled && std::all_of(compiled->dependencies.begin(), compiled->dependencies.end(), [] (const auto& dep)
+	{
+		const auto depPrefab = dep.first.lock();
+		return depPrefab && depPrefab->getAssetVersion() == dep.second;
+	});
+
+	if (!upToDate) {
+		const auto& node = prefab->getRoot();
+		if (node.getType() == ConfigNodeType::Sequence) {
+			throw Exception("Prefab seems to have more than one root; use EntityFactory::createScene() instead", HalleyExceptions::Entity);
+		}
+
+		compiled = std::make_unique<CompiledPrefab>();
+		compiled->dependencies.emplace_back(prefab, prefab->getAssetVersion());
+		compileEntity(*compiled, node, -1);
+	}
+
+	return *compiled;
+}
+
+void EntityFactory::evictCompiledPrefabs()
+{
+	// Drop templates of prefabs that are no longer loaded. The first dependency is always the prefab itself
+	for (auto iter = compiledPrefabs.begin(); iter != compiledPrefabs.end(); ) {
+		if (!iter->second || iter->second->dependencies.empty() || iter->second->dependencies.front().first.expired()) {
+			iter = compiledPrefabs.erase(iter);
+		} else {
+			++iter;
+		}
+	}
+}
+
+void EntityFactory::compileEntity(CompiledPrefab& compiled, const ConfigNode& treeNode, int parent) const
+{
+	const bool isPrefab = treeNode.hasKey("prefab");
+	const auto prefab = isPrefab ? getPrefab(treeNode["prefab"].asString()) : std::shared_ptr<const Prefab>();
+	const auto& node = isPrefab ? (prefab ? prefab->getRoot() : dummyPrefab) : treeNode;
+	if (prefab) {
+		compiled.dependencies.emplace_back(prefab, prefab->getAssetVersion());
+	}
+
+	const int index = int(compiled.entities.size());
+	auto& entity = compiled.entities.emplace_back();
+	entity.name = node["name"].asString("");
+	entity.uuid = getUUID(treeNode["uuid"]); // Use UUID in parent, not in prefab
+	entity.parent = parent;
+
+	forEachComponentData(treeNode, [&] (const String& componentName, const ConfigNode& componentData)
+	{
+		auto& component = entity.components.emplace_back();
+		component.name = componentName;
+		component.data = ConfigNode(componentData);
+	});
+
+	// Note that entity might be invalidated from here on
+	if (node["children"].getType() == ConfigNodeType::Sequence) {
+		for (auto& childNode: node["children"].asSequence()) {
+			compileEntity(compiled, childNode, index);
+		}
+	}
+}
+
+EntityRef EntityFactory::instantiate(CompiledPrefab& compiled, std::vector<EntityRef>& created)
+{
+	startContext();
+	created.clear();
+
+	// Create the whole tree first, so components can refer to any entity in it
+	for (const auto& e: compiled.entities) {
+		auto entity = world.createEntity(e.uuid, e.name, e.parent >= 0 ? std::optional<EntityRef>(created[e.parent]) : std::optional<EntityRef>(), true);
+		context.entityContext->uuids[e.uuid] = entity.getEntityId();
+		created.push_back(entity);
+	}
+
+	const auto& func = world.getCreateComponentFunction();
+	for (size_t i = 0; i < created.size(); ++i) {
+		auto& entity = created[i];
+		for (auto& component: compiled.entities[i].components) {
+			if (component.prototype && component.prototype->addToEntity(entity)) {
+				continue;
+			}
+
+			const auto result = func(*this, component.name, entity, component.data);
+
+			// Components that don't refer to other entities are the same in every instance, so further instances just copy them
+			if (!component.compiled) {
+				component.compiled = true;
+				const auto lookups = context.entityContext->uuidLookups;
+				auto prototype = getComponentReflector(result.componentId).makePrototype(context, component.data);
+				if (context.entityContext->uuidLookups == lookups) {
+					component.prototype = std::move(prototype);
+				}
+			}
+		}
+	}
+
+	return created.at(0);
+}
+
 std::shared_ptr<const Prefab> EntityFactory::getPrefab(const String& id) const
 {
 	return resources.exists<Prefab>(id) ? resources.get<Prefab>(id) : std::shared_ptr<const Prefab>();
@@ -354,4 +480,6 @@ EntitySerializationContext::EntitySerializationContext(World& world)
 void EntitySerializationContext::clear()
 {
 	uuids.clear();
+	snapshotIndices.clear();
+	snapshotEntities.clear();
 }
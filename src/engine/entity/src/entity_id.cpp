@@ -3,17 +3,51 @@
 #include "world.h"
 #include "halley/maths/uuid.h"
 #include "halley/entity/entity_factory.h"
+#include "halley/entity/world_snapshot.h"
+#include "halley/bytes/byte_serializer.h"
 
 using namespace Halley;
 
+void EntityId::serialize(Serializer& s) const
+{
+	s << value;
+}
+
+void EntityId::deserialize(Deserializer& s)
+{
+	s >> value;
+
+	// When restoring a world snapshot, the entity might have been recreated with a different id
+	const auto state = s.getState<WorldSnapshotState>();
+	if (state && isValid()) {
+		const auto iter = state->entityIds.find(*this);
+		*this = iter != state->entityIds.end() ? iter->second : EntityId();
+	}
+}
+
 String EntityId::toUUID(const EntityId& id, ConfigNodeSerializationContext& context)
 {
+	if (context.entityContext->snapshot) {
+		const auto iter = context.entityContext->snapshotIndices.find(id);
+		return iter != context.entityContext->snapshotIndices.end() ? "#" + Halley::toString(iter->second) : "";
+	}
+
 	auto& world = context.entityContext->world;
-	return world.getEntity(id).getUUID().toString();
+	const auto entity = world.tryGetRawEntity(id);
+	return entity ? entity->getUUID().toString() : "";
 }
 
 EntityId EntityId::fromUUID(const String& uuidStr, ConfigNodeSerializationContext& context)
 {
+	++context.entityContext->uuidLookups;
+	if (uuidStr.isEmpty()) {
+		return EntityId();
+	}
+	if (context.entityContext->snapshot) {
+		const auto& entities = context.entityContext->snapshotEntities;
+		const size_t index = uuidStr.startsWith("#") ? size_t(uuidStr.mid(1).toInteger64()) : entities.size();
+		return index < entities.size() ? entities[index] : EntityId();
+	}
 	const auto iter = context.entityContext->uuids.find(UUID(uuidStr));
 	if (iter != context.entityContext->uuids.end()) {
 		return iter->second;
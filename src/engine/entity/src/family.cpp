@@ -69,3 +69,8 @@ void Family::reloadEntity(Entity& entity)
 {
 	toReload.push_back(entity.getEntityId());
 }
+
+void Family::refreshEntity(Entity& entity)
+{
+	toRefresh.push_back(&entity);
+}
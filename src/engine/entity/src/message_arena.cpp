@@ -0,0 +1,44 @@
+#include "message_arena.h"
+#include <halley/utils/utils.h>
+#include <gsl/gsl_assert>
+#include <algorithm>
+
+using namespace Halley;
+
+MessageArena::~MessageArena()
+{
+	reset();
+}
+
+void MessageArena::reset()
+{
+	for (auto& msg: messages) {
+		msg->~Message();
+	}
+	messages.clear();
+	curChunk = 0;
+	curPos = 0;
+}
+
+void* MessageArena::allocate(size_t size, size_t alignment)
+{
+	Expects(alignment <= alignof(std::max_align_t));
+
+	for (; curChunk < chunks.size(); ++curChunk, curPos = 0) {
+		auto& chunk = chunks[curChunk];
+		const size_t pos = alignUp(curPos, alignment);
+		if (pos + size <= chunk.size) {
+			curPos = pos + size;
+			return reinterpret_cast<char*>(chunk.data.get()) + pos;
+		}
+	}
+
+	// Out of space, add a new chunk (large enough for this message, in case it's huge)
+	const size_t nElems = (std::max(chunkSize, size) + sizeof(std::max_align_t) - 1) / sizeof(std::max_align_t);
+	auto& chunk = chunks.emplace_back();
+	chunk.data.reset(new std::max_align_t[nElems]);
+	chunk.size = nElems * sizeof(std::max_align_t);
+	curChunk = chunks.size() - 1;
+	curPos = size;
+	return chunk.data.get();
+}
@@ -1,5 +1,5 @@
 #include "system.h"
-#include <halley/data_structures/flat_map.h>
+#include "diagnostics/world_telemetry.h"
 #include "halley/support/debug.h"
 
 using namespace Halley;
@@ -9,6 +9,8 @@ System::System(Vector<FamilyBindingBase*> uninitializedFamilies, Vector<int> mes
 	, messageTypesReceived(std::move(messageTypesReceived))
 	, timer(0)
 {
+	std::sort(this->messageTypesReceived.begin(), this->messageTypesReceived.end());
+	inbox.resize(this->messageTypesReceived.size());
 }
 
 size_t System::getEntityCount() const
@@ -46,75 +48,95 @@ void System::onAddedToWorld(World& w, int id) {
 
 void System::purgeMessages()
 {
-	if (!messagesSentTo.empty()) {
-		for (auto& target: messagesSentTo) {
-			// Purge all messages of this age
-			Entity* entity = world->tryGetRawEntity(target);
-
-			if (entity) {
-				auto& inbox = entity->inbox;
-				inbox.erase(std::remove_if(inbox.begin(), inbox.end(), [&] (const MessageEntry& e) { return e.age == systemId; }), inbox.end());
-			}
+	// Everyone has seen the messages dispatched on the last update, so take them back out of the inboxes they're still in
+	if (!messageReceivers.empty()) {
+		for (auto& receiver: messageReceivers) {
+			receiver->removeMessagesFrom(*this);
 		}
-		messagesSentTo.clear();
+		messageReceivers.clear();
 	}
+	deliveredMessages.reset();
 }
 
 void System::processMessages()
 {
-	// This whole method is probably very inefficient.
-	struct MessageBox
-	{
-		Vector<Message*> msg;
-		Vector<size_t> elemIdx;
-	};
-	FlatMap<int, MessageBox> inboxes;
-
-	if (!families.empty()) {
-		auto& fam = *families[0];
-		size_t sz = fam.count();
-		for (size_t i = 0; i < sz; i++) {
-			FamilyBase* elem = reinterpret_cast<FamilyBase*>(fam.getElement(i));
-			Entity* entity = world->tryGetRawEntity(elem->entityId);
-			if (entity) {
-				for (const auto& msg: entity->inbox) {
-					if (std::find(messageTypesReceived.begin(), messageTypesReceived.end(), msg.type) != messageTypesReceived.end()) {
-						auto& inbox = inboxes[msg.type];
-						inbox.msg.emplace_back(msg.msg.get());
-						inbox.elemIdx.emplace_back(i);
-					}
-				}
+	if (families.empty()) {
+		for (auto& messages: inbox) {
+			messages.clear();
+		}
+		return;
+	}
+
+	// Messages are delivered to the entities of the main family, grouped by type
+	auto& fam = *families[0];
+	for (size_t i = 0; i < inbox.size(); ++i) {
+		auto& messages = inbox[i];
+		if (messages.empty()) {
+			continue;
+		}
+
+		inboxMessages.clear();
+		inboxIndices.clear();
+		for (auto& entry: messages) {
+			if (auto idx = fam.getIndexOf(entry.target)) {
+				inboxMessages.push_back(entry.msg);
+				inboxIndices.push_back(*idx);
 			}
 		}
-		for (auto& iter : inboxes) {
-			int id = iter.first;
-			auto& inbox = iter.second;
-			onMessagesReceived(id, inbox.msg.data(), inbox.elemIdx.data(), inbox.msg.size());
+		messages.clear();
+
+		if (!inboxMessages.empty()) {
+			onMessagesReceived(messageTypesReceived[i], inboxMessages.data(), inboxIndices.data(), inboxMessages.size());
 		}
 	}
 }
 
-void System::doSendMessage(EntityId entityId, std::unique_ptr<Message> msg, int id)
+void System::doSendMessage(EntityId entityId, Message* msg, int id)
 {
-	outbox.emplace_back(std::make_pair(entityId, MessageEntry(std::move(msg), id, systemId)));
+	outbox.push_back(MessageEntry{ entityId, msg, id, this });
 }
 
 void System::dispatchMessages()
 {
 	if (!outbox.empty()) {
-		for (auto& o: outbox) {
-			Entity* entity = world->tryGetRawEntity(o.first);
-			if (entity) {
-				entity->inbox.emplace_back(std::move(o.second));
-				messagesSentTo.push_back(o.first);
+		messagesSent += uint32_t(outbox.size());
+		for (auto& entry: outbox) {
+			for (auto& receiver: world->getMessageReceivers(entry.type)) {
+				receiver->receiveMessage(entry);
+				if (std::find(messageReceivers.begin(), messageReceivers.end(), receiver) == messageReceivers.end()) {
+					messageReceivers.push_back(receiver);
+				}
 			}
 		}
 		outbox.clear();
+
+		// Anything sent from now on goes into the other arena, which was emptied by purgeMessages()
+		std::swap(outgoingMessages, deliveredMessages);
 	}
 }
 
+void System::receiveMessage(const MessageEntry& entry)
+{
+	const auto iter = std::lower_bound(messageTypesReceived.begin(), messageTypesReceived.end(), entry.type);
+	Expects(iter != messageTypesReceived.end() && *iter == entry.type);
+	inbox[iter - messageTypesReceived.begin()].push_back(entry);
+}
+
+void System::removeMessagesFrom(const System& sender)
+{
+	for (auto& messages: inbox) {
+		messages.erase(std::remove_if(messages.begin(), messages.end(), [&] (const MessageEntry& e) { return e.sender == &sender; }), messages.end());
+	}
+}
+
+void System::removeMessageReceiver(const System& receiver)
+{
+	messageReceivers.erase(std::remove(messageReceivers.begin(), messageReceivers.end(), &receiver), messageReceivers.end());
+}
+
 size_t System::doSendSystemMessage(SystemMessageContext context, const String& targetSystem)
 {
+	++messagesSent;
 	return world->sendSystemMessage(std::move(context), targetSystem);
 }
 
@@ -142,18 +164,58 @@ size_t System::getSystemMessagesInInbox() const
 	return systemMessageInbox.size();
 }
 
+void System::declareAccess(bool exclusive, Vector<String> services, Vector<int> messagesSent)
+{
+	exclusiveAccess = exclusive;
+	servicesUsed = std::move(services);
+	messageTypesSent = std::move(messagesSent);
+}
+
 void System::doUpdate(Time time) {
+	preUpdate();
+	runUpdate(time);
+	postUpdate();
+}
+
+void System::preUpdate()
+{
 	HALLEY_DEBUG_TRACE_COMMENT(name.c_str());
 	if (collectSamples) {
+		sampleStart = WorldTelemetry::getTimestamp();
 		timer.beginSample();
 	}
+	messagesSent = 0;
 
 	purgeMessages();
 	if (!messageTypesReceived.empty()) {
 		processMessages();
 	}
-	
+
+	if (collectSamples) {
+		timer.pause();
+	}
+}
+
+void System::runUpdate(Time time)
+{
+	// Might run on a worker thread, see SystemScheduler
+	if (collectSamples) {
+		timer.resume();
+	}
+
 	updateBase(time);
+
+	if (collectSamples) {
+		timer.pause();
+	}
+}
+
+void System::postUpdate()
+{
+	if (collectSamples) {
+		timer.resume();
+	}
+
 	dispatchMessages();
 
 	if (collectSamples) {
@@ -169,8 +231,10 @@ void System::doRender(RenderContext& rc) {
 	
 	HALLEY_DEBUG_TRACE_COMMENT(name.c_str());
 	if (collectSamples) {
+		sampleStart = WorldTelemetry::getTimestamp();
 		timer.beginSample();
 	}
+	messagesSent = 0;
 
 	renderBase(rc);
 
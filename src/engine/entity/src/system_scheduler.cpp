@@ -0,0 +1,151 @@
+#include "system_scheduler.h"
+#include "system.h"
+#include "world.h"
+#include "transform_2d_hierarchy.h"
+#include <halley/concurrency/concurrent.h>
+#include <exception>
+
+using namespace Halley;
+
+namespace {
+	struct SystemMasks {
+		FamilyMask::RealType read;
+		FamilyMask::RealType write;
+	};
+
+	bool intersects(const Vector<int>& a, const Vector<int>& b)
+	{
+		for (auto& v: a) {
+			if (std::find(b.begin(), b.end(), v) != b.end()) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool intersects(const Vector<String>& a, const Vector<String>& b)
+	{
+		for (auto& v: a) {
+			if (std::find(b.begin(), b.end(), v) != b.end()) {
+				return true;
+			}
+		}
+		return false;
+	}
+}
+
+void SystemScheduler::invalidate()
+{
+	dirty = true;
+}
+
+void SystemScheduler::update(World& world, const Vector<std::unique_ptr<System>>& systems, Time time)
+{
+	if (dirty) {
+		buildBatches(systems, world.getMaskStorage());
+		dirty = false;
+	}
+
+	for (auto& batch: batches) {
+		// Systems in a batch can read the same transforms, which must not compute and cache anything while they do
+		world.getTransformHierarchy()->update();
+		runBatch(batch, time);
+		world.spawnPending();
+	}
+}
+
+void SystemScheduler::buildBatches(const Vector<std::unique_ptr<System>>& systems, MaskStorage& storage)
+{
+	const size_t n = systems.size();
+
+	Vector<SystemMasks> access(n);
+	for (size_t i = 0; i < n; ++i) {
+		for (auto& f: systems[i]->families) {
+			access[i].read |= f->readMask.getRealValue(storage);
+			access[i].write |= f->writeMask.getRealValue(storage);
+		}
+	}
+
+	auto conflicts = [&] (size_t i, size_t j) -> bool
+	{
+		const auto& a = *systems[i];
+		const auto& b = *systems[j];
+		if (a.exclusiveAccess || b.exclusiveAccess) {
+			return true;
+		}
+		if ((access[i].write & access[j].read).any() || (access[j].write & access[i].read).any()) {
+			return true;
+		}
+		return intersects(a.servicesUsed, b.servicesUsed)
+			|| intersects(a.messageTypesSent, b.messageTypesReceived)
+			|| intersects(b.messageTypesSent, a.messageTypesReceived);
+	};
+
+	// Each system runs one batch after the latest system it depends on
+	// This is the longest path to it in the dependency graph, so every edge of the graph points to a later batch
+	Vector<size_t> level(n, 0);
+	size_t nLevels = 0;
+	for (size_t i = 0; i < n; ++i) {
+		for (size_t j = 0; j < i; ++j) {
+			if (level[j] + 1 > level[i] && conflicts(j, i)) {
+				level[i] = level[j] + 1;
+			}
+		}
+		nLevels = std::max(nLevels, level[i] + 1);
+	}
+
+	batches.clear();
+	batches.resize(nLevels);
+	for (size_t i = 0; i < n; ++i) {
+		batches[level[i]].push_back(systems[i].get());
+	}
+}
+
+void SystemScheduler::runBatch(const Vector<System*>& batch, Time time)
+{
+	// The calling thread runs one of the tasks as well
+	auto& queue = Executors::getCPU();
+	const size_t nTasks = std::min(batch.size(), queue.threadCount() + 1);
+
+	if (nTasks <= 1) {
+		for (auto& system: batch) {
+			system->doUpdate(time);
+		}
+		return;
+	}
+
+	// Messages touch the inboxes of other systems, so those are always processed on this thread
+	for (auto& system: batch) {
+		system->preUpdate();
+	}
+
+	Vector<std::exception_ptr> errors(nTasks);
+	auto runTask = [&batch, &errors, nTasks, time] (size_t task)
+	{
+		try {
+			for (size_t i = task; i < batch.size(); i += nTasks) {
+				batch[i]->runUpdate(time);
+			}
+		} catch (...) {
+			errors[task] = std::current_exception();
+		}
+	};
+
+	Vector<Future<void>> futures;
+	futures.reserve(nTasks - 1);
+	for (size_t i = 1; i < nTasks; ++i) {
+		futures.push_back(Concurrent::execute(queue, [&runTask, i] () { runTask(i); }));
+	}
+	runTask(0);
+	Concurrent::whenAll(futures.begin(), futures.end()).wait(queue);
+
+	for (auto& e: errors) {
+		if (e) {
+			std::rethrow_exception(e);
+		}
+	}
+
+	for (auto& system: batch) {
+		system->postUpdate();
+	}
+}
@@ -0,0 +1,120 @@
+#include "transform_2d_hierarchy.h"
+#include "world.h"
+#include "family.h"
+#include "family_type.h"
+#include "family_binding.h"
+#include "components/transform_2d_component.h"
+#include <algorithm>
+
+using namespace Halley;
+
+namespace {
+	class Transform2DFamily : public FamilyBaseOf<Transform2DFamily> {
+	public:
+		const Transform2DComponent& transform;
+
+		using Type = FamilyType<const Transform2DComponent>;
+
+	protected:
+		Transform2DFamily(const Transform2DComponent& transform)
+			: transform(transform)
+		{}
+	};
+}
+
+class Transform2DHierarchy::Binding : public FamilyBindingBase {
+public:
+	Binding(Family& family, Transform2DHierarchy& hierarchy)
+	{
+		setFamily(&family);
+		setOnEntitiesAdded([&hierarchy] (void* elements, size_t count) { hierarchy.onAdded(elements, count); });
+	}
+};
+
+Transform2DHierarchy::Transform2DHierarchy(World& world)
+	: family(world.getFamily<Transform2DFamily>())
+{
+	binding = std::make_unique<Binding>(family, *this);
+}
+
+Transform2DHierarchy::~Transform2DHierarchy() = default;
+
+void Transform2DHierarchy::markDirty(EntityId id)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	dirtyRoots.push_back(id);
+}
+
+void Transform2DHierarchy::update()
+{
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		std::swap(pending, dirtyRoots);
+	}
+	if (pending.empty()) {
+		return;
+	}
+
+	// Entities that were removed since they were marked aren't in the family anymore
+	roots.clear();
+	for (const auto id: pending) {
+		if (const auto* transform = getTransform(id)) {
+			roots.push_back(transform);
+		}
+	}
+	pending.clear();
+	std::sort(roots.begin(), roots.end());
+	roots.erase(std::unique(roots.begin(), roots.end()), roots.end());
+
+	// Subtrees under another dirty root are walked as part of that one
+	for (const auto* root: roots) {
+		if (!hasDirtyAncestor(*root)) {
+			updateSubtree(*root);
+		}
+	}
+}
+
+void Transform2DHierarchy::onAdded(void* elements, size_t count)
+{
+	const auto* entries = static_cast<const Transform2DFamily*>(elements);
+	std::unique_lock<std::mutex> lock(mutex);
+	for (size_t i = 0; i < count; ++i) {
+		dirtyRoots.push_back(entries[i].entityId);
+	}
+}
+
+bool Transform2DHierarchy::hasDirtyAncestor(const Transform2DComponent& transform) const
+{
+	for (const auto* t = transform.parentTransform; t; t = t->parentTransform) {
+		if (std::binary_search(roots.begin(), roots.end(), t)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void Transform2DHierarchy::updateSubtree(const Transform2DComponent& root)
+{
+	// Depth first, so each transform is updated before any of its children
+	stack.clear();
+	stack.push_back(&root);
+	while (!stack.empty()) {
+		const auto* transform = stack.back();
+		stack.pop_back();
+		transform->refreshGlobalTransform();
+
+		for (auto* child: transform->entity.getRawChildren()) {
+			if (const auto* childTransform = child->tryGetComponent<Transform2DComponent>()) {
+				stack.push_back(childTransform);
+			}
+		}
+	}
+}
+
+const Transform2DComponent* Transform2DHierarchy::getTransform(EntityId id) const
+{
+	if (const auto index = family.getIndexOf(id)) {
+		return &static_cast<const Transform2DFamily*>(family.getElement(*index))->transform;
+	}
+	return nullptr;
+}
@@ -6,6 +6,9 @@
 #include "world.h"
 #include "system.h"
 #include "family.h"
+#include "archetype_storage.h"
+#include "transform_2d_hierarchy.h"
+#include "diagnostics/world_telemetry.h"
 #include "halley/text/string_converter.h"
 #include "halley/support/debug.h"
 #include "halley/file_formats/config_file.h"
@@ -27,10 +30,14 @@ World::World(const HalleyAPI& api, Resources& resources, bool collectMetrics, Cr
 	for (auto& t: timer) {
 		t.setNumSamples(isDevMode() ? 300 : 30);
 	}
+
+	transformHierarchy = std::make_unique<Transform2DHierarchy>(*this);
 }
 
 World::~World()
 {
+	transformHierarchy.reset();
+
 	for (auto& tl: systems) {
 		for (auto& s: tl) {
 			s->deInit();
@@ -58,10 +65,12 @@ System& World::addSystem(std::unique_ptr<System> system, TimeLine timelineType)
 {
 	system->api = &api;
 	system->resources = &resources;
-	system->setCollectSamples(collectMetrics);
+	system->setCollectSamples(collectMetrics || telemetry);
 	auto& ref = *system.get();
 	auto& timeline = getSystems(timelineType);
 	timeline.emplace_back(std::move(system));
+	schedulers[static_cast<int>(timelineType)].invalidate();
+	messageReceiversDirty = true;
 	ref.onAddedToWorld(*this, int(timeline.size()));
 	return ref;
 }
@@ -71,7 +80,19 @@ void World::removeSystem(System& system)
 	for (auto& sys : systems) {
 		for (size_t i = 0; i < sys.size(); i++) {
 			if (sys[i].get() == &system) {
+				// Make sure no other system is holding on to its messages, or is about to send it any
+				system.purgeMessages();
+				for (auto& tl: systems) {
+					for (auto& other: tl) {
+						other->removeMessageReceiver(system);
+					}
+				}
+
 				sys.erase(sys.begin() + i);
+				for (auto& scheduler: schedulers) {
+					scheduler.invalidate();
+				}
+				messageReceiversDirty = true;
 				return;
 			}
 		}
@@ -129,6 +150,17 @@ Service& World::addService(std::shared_ptr<Service> service)
 
 void World::loadSystems(const ConfigNode& root, std::function<std::unique_ptr<System>(String)> createFunction)
 {
+	if (root.hasKey("archetypeStorage")) {
+		setArchetypeStorageEnabled(root["archetypeStorage"].asBool());
+	}
+	if (root.hasKey("parallelSystems")) {
+		setSystemSchedulingMode(root["parallelSystems"].asBool() ? SystemSchedulingMode::Parallel : SystemSchedulingMode::Sequential);
+	}
+	if (root.hasKey("telemetry")) {
+		const int capacity = root["telemetry"].asInt(0);
+		setTelemetryEnabled(capacity > 0, size_t(std::max(capacity, 1)));
+	}
+
 	auto timelines = root["timelines"].asMap();
 	for (auto iter = timelines.begin(); iter != timelines.end(); ++iter) {
 		String timelineName = iter->first;
@@ -200,6 +232,12 @@ EntityRef World::createEntity(UUID uuid, String name, EntityId parentId)
 	return createEntity(uuid, name, getEntity(parentId));
 }
 
+void World::reserveEntities(size_t count)
+{
+	entitiesPendingCreation.reserve(entitiesPendingCreation.size() + count);
+	entitiesDirty.reserve(entitiesDirty.size() + count);
+}
+
 void World::destroyEntity(EntityId id)
 {
 	doDestroyEntity(id);
@@ -221,8 +259,7 @@ void World::doDestroyEntity(EntityId id)
 
 void World::doDestroyEntity(Entity* e)
 {
-	e->destroy();
-	entityDirty = true;
+	e->destroy(*this);
 }
 
 EntityRef World::getEntity(EntityId id)
@@ -302,14 +339,14 @@ std::vector<ConstEntityRef> World::getTopLevelEntities() const
 	return result;
 }
 
-void World::onEntityDirty()
+void World::onEntityDirty(Entity& entity)
 {
-	entityDirty = true;
+	entitiesDirty.push_back(&entity);
 }
 
-void World::setEntityReloaded()
+void World::setEntityReloaded(Entity& entity)
 {
-	entityReloaded = true;
+	entitiesReloaded.push_back(&entity);
 }
 
 const CreateComponentFunction& World::getCreateComponentFunction() const
@@ -349,6 +386,64 @@ bool World::isDevMode() const
 	return api.core->isDevMode();
 }
 
+void World::setArchetypeStorageEnabled(bool enabled)
+{
+	if (enabled == isArchetypeStorageEnabled()) {
+		return;
+	}
+	if (!entities.empty() || !entitiesPendingCreation.empty()) {
+		throw Exception("Archetype storage can only be changed before any entities are created.", HalleyExceptions::Entity);
+	}
+	archetypeStorage = enabled ? std::make_unique<ArchetypeStorage>(*componentDeleterTable) : std::unique_ptr<ArchetypeStorage>();
+	for (auto& family: families) {
+		family->storageOrdered = enabled;
+	}
+}
+
+bool World::isArchetypeStorageEnabled() const
+{
+	return static_cast<bool>(archetypeStorage);
+}
+
+void World::setSystemSchedulingMode(SystemSchedulingMode mode)
+{
+	schedulingMode = mode;
+}
+
+SystemSchedulingMode World::getSystemSchedulingMode() const
+{
+	return schedulingMode;
+}
+
+void World::setTelemetryEnabled(bool enabled, size_t capacity)
+{
+	if (enabled) {
+		if (telemetry) {
+			telemetry->setCapacity(capacity);
+		} else {
+			telemetry = std::make_unique<WorldTelemetry>(capacity);
+		}
+	} else {
+		telemetry.reset();
+	}
+
+	for (auto& tl: systems) {
+		for (auto& system: tl) {
+			system->setCollectSamples(collectMetrics || enabled);
+		}
+	}
+}
+
+WorldTelemetry* World::getTelemetry() const
+{
+	return telemetry.get();
+}
+
+Transform2DHierarchy* World::getTransformHierarchy() const
+{
+	return transformHierarchy.get();
+}
+
 void World::deleteEntity(Entity* entity)
 {
 	Expects (entity);
@@ -373,8 +468,12 @@ void World::step(TimeLine timeline, Time elapsed)
 	if (collectMetrics) {
 		t.beginSample();
 	}
+	if (telemetry) {
+		telemetry->beginFrame();
+	}
 
 	spawnPending();
+	transformHierarchy->update();
 
 	initSystems();
 	updateSystems(timeline, elapsed);
@@ -383,6 +482,9 @@ void World::step(TimeLine timeline, Time elapsed)
 	if (collectMetrics) {
 		t.endSample();
 	}
+	if (telemetry) {
+		telemetry->endFrame(*this, timeline);
+	}
 }
 
 void World::render(RenderContext& rc) const
@@ -391,6 +493,9 @@ void World::render(RenderContext& rc) const
 	if (collectMetrics) {
 		t.beginSample();
 	}
+	if (telemetry) {
+		telemetry->beginFrame();
+	}
 
 	renderSystems(rc);
 	rc.flush();
@@ -398,6 +503,9 @@ void World::render(RenderContext& rc) const
 	if (collectMetrics) {
 		t.endSample();
 	}
+	if (telemetry) {
+		telemetry->endFrame(*this, TimeLine::Render);
+	}
 }
 
 void World::allocateEntity(Entity* entity) {
@@ -410,12 +518,15 @@ void World::spawnPending()
 {
 	if (!entitiesPendingCreation.empty()) {
 		HALLEY_DEBUG_TRACE();
+		if (telemetry) {
+			telemetry->onEntitiesSpawned(entitiesPendingCreation.size());
+		}
 		for (auto& e : entitiesPendingCreation) {
 			e->onReady();
+			e->worldIndex = uint32_t(entities.size());
+			entities.push_back(e);
 		}
-		std::move(entitiesPendingCreation.begin(), entitiesPendingCreation.end(), std::insert_iterator<decltype(entities)>(entities, entities.end()));
 		entitiesPendingCreation.clear();
-		entityDirty = true;
 		HALLEY_DEBUG_TRACE();
 	}
 
@@ -424,116 +535,102 @@ void World::spawnPending()
 
 void World::updateEntities()
 {
-	if (!entityDirty) {
+	if (entitiesDirty.empty() && entitiesReloaded.empty()) {
 		return;
 	}
 
-	entityDirty = false;
-
 	HALLEY_DEBUG_TRACE();
-	size_t nEntities = entities.size();
 
-	std::vector<size_t> entitiesRemoved;
-
-	struct FamilyTodo {
-		std::vector<std::pair<FamilyMaskType, Entity*>> toAdd;
-		std::vector<std::pair<FamilyMaskType, Entity*>> toRemove;
-		std::vector<std::pair<FamilyMaskType, Entity*>> toReload;
-	};
-	std::map<FamilyMaskType, FamilyTodo> pending;
-
-	// Update all entities
+	// Only entities that were marked dirty since the last update need to be visited
 	// This loop should be as fast as reasonably possible
-	for (size_t i = 0; i < nEntities; i++) {
-		auto& entity = *entities[i];
-		if (i + 20 < nEntities) { // Watch out for sign! Don't subtract!
-			prefetchL2(entities[i + 20]);
+	const size_t nDirty = entitiesDirty.size();
+	for (size_t i = 0; i < nDirty; i++) {
+		auto& entity = *entitiesDirty[i];
+		if (i + 20 < nDirty) { // Watch out for sign! Don't subtract!
+			prefetchL2(entitiesDirty[i + 20]);
 		}
 
-		// Check if it needs any sort of updating
-		if (entity.needsRefresh()) {
-			// First of all, let's check if it's dead
-			if (!entity.isAlive()) {
-				// Remove from systems
-				pending[entity.getMask()].toRemove.emplace_back(FamilyMaskType(), &entity);
-				entitiesRemoved.push_back(i);
-			} else {
-				// It's alive, so check old and new system inclusions
-				FamilyMaskType oldMask = entity.getMask();
-				entity.refresh(*maskStorage, *componentDeleterTable);
-				FamilyMaskType newMask = entity.getMask();
-
-				// Did it change?
-				if (oldMask != newMask) {
-					pending[oldMask].toRemove.emplace_back(newMask, &entity);
-					pending[newMask].toAdd.emplace_back(oldMask, &entity);
-				}
+		// First of all, let's check if it's dead
+		if (!entity.isAlive()) {
+			// Remove from systems
+			for (auto& fam: getFamiliesFor(entity.getMask())) {
+				fam->removeEntity(entity);
 			}
-		}
-	}
-
-	if (entityReloaded) {
-		for (size_t i = 0; i < nEntities; i++) {
-			auto& entity = *entities[i];
-			if (entity.reloaded && entity.isAlive()) {
-				pending[entity.getMask()].toReload.emplace_back(entity.getMask(), &entity);
-				entity.reloaded = false;
-			}
-		}
-	}
-
-	entityReloaded = false;
-
-	HALLEY_DEBUG_TRACE();
-	// Go through every family adding/removing entities as needed
-	for (auto& todo: pending) {
-		for (auto& fam: getFamiliesFor(todo.first)) {
-			const auto& famMask = fam->inclusionMask;
-			
-			for (auto& e: todo.second.toRemove) {
-				// Only remove if the entity is not about to be re-added
-				const auto& newMask = e.first;
-				if (!newMask.contains(famMask, *maskStorage)) {
-					fam->removeEntity(*e.second);
+			entitiesRemoved.push_back(&entity);
+		} else {
+			// It's alive, so check old and new system inclusions
+			const FamilyMaskType oldMask = entity.getMask();
+			const bool relocated = entity.refresh(*maskStorage, *componentDeleterTable, archetypeStorage.get());
+			const FamilyMaskType newMask = entity.getMask();
+
+			// Did it change?
+			if (oldMask != newMask) {
+				for (auto& fam: getFamiliesFor(oldMask)) {
+					// Only remove if the entity is not about to be re-added
+					if (!newMask.contains(fam->inclusionMask, *maskStorage)) {
+						fam->removeEntity(entity);
+					} else if (relocated) {
+						// Staying in this family, but its components have moved to a new archetype
+						fam->refreshEntity(entity);
+					}
 				}
-			}
-			for (auto& e: todo.second.toAdd) {
-				// Only add if the entity was not already in this
-				const auto& oldMask = e.first;
-				if (!oldMask.contains(famMask, *maskStorage)) {
-					fam->addEntity(*e.second);
+				for (auto& fam: getFamiliesFor(newMask)) {
+					// Only add if the entity was not already in this
+					if (!oldMask.contains(fam->inclusionMask, *maskStorage)) {
+						fam->addEntity(entity);
+					}
+				}
+			} else if (relocated) {
+				// Same components, but some of them were replaced
+				for (auto& fam: getFamiliesFor(newMask)) {
+					fam->refreshEntity(entity);
 				}
 			}
+		}
+	}
+	entitiesDirty.clear();
 
-			for (auto& e : todo.second.toReload) {
-				fam->reloadEntity(*e.second);
+	for (auto& entity: entitiesReloaded) {
+		if (entity->isAlive()) {
+			for (auto& fam: getFamiliesFor(entity->getMask())) {
+				fam->reloadEntity(*entity);
 			}
 		}
+		entity->reloaded = false;
 	}
+	entitiesReloaded.clear();
 
 	HALLEY_DEBUG_TRACE();
 	// Update families
-	for (auto& iter : families) {
-		iter->updateEntities();
+	if (telemetry) {
+		for (size_t i = 0; i < families.size(); ++i) {
+			const auto start = WorldTelemetry::getTimestamp();
+			families[i]->updateEntities();
+			telemetry->onFamilyUpdated(i, start);
+		}
+	} else {
+		for (auto& iter : families) {
+			iter->updateEntities();
+		}
 	}
 	
 	HALLEY_DEBUG_TRACE();
 	// Actually remove dead entities
-	if (!entitiesRemoved.empty()) {
-		size_t livingEntityCount = entities.size();
-		for (int i = int(entitiesRemoved.size()); --i >= 0; ) {
-			size_t idx = entitiesRemoved[i];
-			auto& entity = *entities[idx];
-
-			// Remove
-			entityMap.freeId(entity.getEntityId().value);
-			deleteEntity(&entity);
-
-			// Put it at the back of the array, so it's removed when the array gets resized
-			std::swap(entities[idx], entities[--livingEntityCount]);
-		}
-		entities.resize(livingEntityCount);
+	if (telemetry) {
+		telemetry->onEntitiesDestroyed(entitiesRemoved.size());
+	}
+	for (auto& entity: entitiesRemoved) {
+		// Swap the last entity into its slot
+		const auto idx = entity->worldIndex;
+		entities[idx] = entities.back();
+		entities[idx]->worldIndex = idx;
+		entities.pop_back();
+
+		// Remove
+		entityMap.freeId(entity->getEntityId().value);
+		deleteEntity(entity);
 	}
+	entitiesRemoved.clear();
 
 	HALLEY_DEBUG_TRACE();
 }
@@ -552,6 +649,11 @@ void World::initSystems()
 
 void World::updateSystems(TimeLine timeline, Time elapsed)
 {
+	if (schedulingMode == SystemSchedulingMode::Parallel) {
+		schedulers[static_cast<int>(timeline)].update(*this, getSystems(timeline), elapsed);
+		return;
+	}
+
 	for (auto& system : getSystems(timeline)) {
 		system->doUpdate(elapsed);
 		spawnPending();
@@ -583,6 +685,7 @@ void World::onAddFamily(Family& family) noexcept
 			family.addEntity(entity);
 		}
 	}
+	family.storageOrdered = isArchetypeStorageEnabled();
 	familyCache.clear();
 }
 
@@ -605,6 +708,32 @@ const std::vector<Family*>& World::getFamiliesFor(const FamilyMaskType& mask)
 	}
 }
 
+const Vector<System*>& World::getMessageReceivers(int messageType)
+{
+	if (messageReceiversDirty) {
+		messageReceiversDirty = false;
+		messageReceivers.clear();
+
+		// Render systems never process messages
+		for (auto timeline: { TimeLine::FixedUpdate, TimeLine::VariableUpdate }) {
+			for (auto& system: getSystems(timeline)) {
+				for (auto type: system->messageTypesReceived) {
+					if (type >= int(messageReceivers.size())) {
+						messageReceivers.resize(size_t(type) + 1);
+					}
+					messageReceivers[type].push_back(system.get());
+				}
+			}
+		}
+	}
+
+	if (messageType < 0 || messageType >= int(messageReceivers.size())) {
+		static const Vector<System*> empty;
+		return empty;
+	}
+	return messageReceivers[messageType];
+}
+
 void World::processSystemMessages(TimeLine timeline)
 {
 	bool keepRunning = true;
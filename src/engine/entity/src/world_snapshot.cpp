@@ -0,0 +1,261 @@
+#include "world_snapshot.h"
+#include "world.h"
+#include "entity.h"
+#include "entity_factory.h"
+#include "component_reflector.h"
+#include "registry.h"
+#include "halley/maths/uuid.h"
+#include "halley/support/exception.h"
+
+using namespace Halley;
+
+void WorldSnapshot::Entry::serialize(Serializer& s) const
+{
+	s << id << data;
+}
+
+void WorldSnapshot::Entry::deserialize(Deserializer& s)
+{
+	s >> id >> data;
+}
+
+WorldSnapshot::WorldSnapshot(gsl::span<const gsl::byte> bytes)
+{
+	Deserializer s(bytes, SerializerOptions(SerializerOptions::maxVersion));
+	deserialize(s);
+}
+
+Bytes WorldSnapshot::toBytes() const
+{
+	return Serializer::toBytes(*this, SerializerOptions(SerializerOptions::maxVersion));
+}
+
+void WorldSnapshot::serialize(Serializer& s) const
+{
+	s << delta << entries;
+}
+
+void WorldSnapshot::deserialize(Deserializer& s)
+{
+	s >> delta >> entries;
+}
+
+bool WorldSnapshot::isDelta() const
+{
+	return delta;
+}
+
+size_t WorldSnapshot::getNumEntities() const
+{
+	return entries.size();
+}
+
+const Vector<WorldSnapshot::Entry>& WorldSnapshot::getEntries() const
+{
+	return entries;
+}
+
+WorldSnapshot WorldSnapshot::makeDelta(const WorldSnapshot& base) const
+{
+	if (delta || base.delta) {
+		throw Exception("Deltas can only be made between two full snapshots", HalleyExceptions::Entity);
+	}
+
+	HashMap<EntityId, const Bytes*> baseData;
+	for (auto& entry: base.entries) {
+		baseData[entry.id] = &entry.data;
+	}
+
+	// All entities are still listed, to keep their order and so that removals are implicit
+	WorldSnapshot result;
+	result.delta = true;
+	result.entries.reserve(entries.size());
+	for (auto& entry: entries) {
+		const auto iter = baseData.find(entry.id);
+		if (iter != baseData.end() && *iter->second == entry.data) {
+			result.entries.push_back(Entry{ entry.id, {} });
+		} else {
+			result.entries.push_back(entry);
+		}
+	}
+	return result;
+}
+
+WorldSnapshot WorldSnapshot::applyDelta(const WorldSnapshot& base) const
+{
+	if (!delta || base.delta) {
+		throw Exception("Deltas can only be applied to full snapshots", HalleyExceptions::Entity);
+	}
+
+	HashMap<EntityId, const Bytes*> baseData;
+	for (auto& entry: base.entries) {
+		baseData[entry.id] = &entry.data;
+	}
+
+	WorldSnapshot result;
+	result.entries.reserve(entries.size());
+	for (auto& entry: entries) {
+		if (entry.data.empty()) {
+			const auto iter = baseData.find(entry.id);
+			if (iter == baseData.end()) {
+				throw Exception("Delta snapshot doesn't match its base", HalleyExceptions::Entity);
+			}
+			result.entries.push_back(Entry{ entry.id, *iter->second });
+		} else {
+			result.entries.push_back(entry);
+		}
+	}
+	return result;
+}
+
+WorldSnapshot World::snapshot()
+{
+	auto context = makeSerializationContext();
+	const auto options = SerializerOptions(SerializerOptions::maxVersion);
+
+	// Parents are always stored before their children
+	Vector<Entity*> order;
+	order.reserve(entities.size() + entitiesPendingCreation.size());
+	for (auto* list: { &entities, &entitiesPendingCreation }) {
+		for (auto* e: *list) {
+			if (e->isAlive() && e->getParent() == nullptr) {
+				order.push_back(e);
+			}
+		}
+	}
+	for (size_t i = 0; i < order.size(); ++i) {
+		for (auto* child: order[i]->getChildren()) {
+			order.push_back(child);
+		}
+	}
+
+	context.entityContext->snapshot = true;
+	for (size_t i = 0; i < order.size(); ++i) {
+		context.entityContext->snapshotIndices[order[i]->getEntityId()] = i;
+	}
+
+	WorldSnapshot result;
+	result.entries.reserve(order.size());
+	Vector<std::pair<int, Component*>> components;
+	for (auto* e: order) {
+		auto entity = EntityRef(*e, *this);
+		components.assign(entity.begin(), entity.end());
+		auto data = Serializer::toBytes([&] (Serializer& s)
+		{
+			s << entity.getName() << entity.getUUID() << entity.isFromPrefab();
+			s << (e->getParent() ? e->getParent()->getEntityId() : EntityId());
+			s << static_cast<uint32_t>(components.size());
+			for (auto& [componentId, component]: components) {
+				s << componentId;
+				getComponentReflector(componentId).serialize(s, context, *component);
+			}
+		}, options);
+		result.entries.push_back(WorldSnapshot::Entry{ e->getEntityId(), std::move(data) });
+	}
+	return result;
+}
+
+WorldSnapshot World::snapshot(const WorldSnapshot& base)
+{
+	return snapshot().makeDelta(base);
+}
+
+void World::restore(const WorldSnapshot& snapshot)
+{
+	if (snapshot.isDelta()) {
+		throw Exception("Delta snapshots can only be restored together with their base", HalleyExceptions::Entity);
+	}
+
+	auto context = makeSerializationContext();
+	context.entityContext->snapshot = true;
+	const auto options = SerializerOptions(SerializerOptions::maxVersion);
+	WorldSnapshotState state;
+
+	const size_t n = snapshot.entries.size();
+	Vector<Deserializer> records;
+	Vector<EntityRef> restored;
+	HashMap<EntityId, size_t> restoredIndex;
+	records.reserve(n);
+	restored.reserve(n);
+
+	// Create or reuse every entity first, so references between them can be resolved
+	for (auto& entry: snapshot.entries) {
+		auto& s = records.emplace_back(entry.data, options);
+		s.setState(&state);
+
+		String name;
+		UUID uuid;
+		bool fromPrefab;
+		s >> name >> uuid >> fromPrefab;
+
+		// Ids are only meaningful in the world the snapshot came from, so make sure it's really the same entity
+		auto* existing = tryGetRawEntity(entry.id);
+		const bool reuse = existing && existing->isAlive() && existing->getUUID() == uuid && restoredIndex.find(entry.id) == restoredIndex.end();
+		auto entity = reuse ? EntityRef(*existing, *this) : createEntity(uuid, "", {}, fromPrefab);
+		entity.setName(std::move(name));
+		if (reuse) {
+			// Families need to pick up the restored component values
+			entity.setReloaded();
+		}
+
+		state.entityIds[entry.id] = entity.getEntityId();
+		context.entityContext->snapshotEntities.push_back(entity.getEntityId());
+		restoredIndex[entity.getEntityId()] = restored.size();
+		restored.push_back(entity);
+	}
+
+	// Restore hierarchy
+	for (size_t i = 0; i < n; ++i) {
+		EntityId parentId;
+		records[i] >> parentId;
+		const auto iter = restoredIndex.find(parentId);
+		if (iter != restoredIndex.end()) {
+			restored[i].setParent(restored[iter->second]);
+		} else {
+			restored[i].setParent();
+		}
+	}
+
+	// Destroy everything else; any restored entities have already been moved out of their hierarchies
+	Vector<EntityId> toDestroy;
+	for (auto* list: { &entities, &entitiesPendingCreation }) {
+		for (auto* e: *list) {
+			if (e->isAlive() && restoredIndex.find(e->getEntityId()) == restoredIndex.end()) {
+				toDestroy.push_back(e->getEntityId());
+			}
+		}
+	}
+	for (auto& id: toDestroy) {
+		doDestroyEntity(id);
+	}
+
+	// Restore components
+	std::vector<int> componentIds;
+	for (size_t i = 0; i < n; ++i) {
+		auto& s = records[i];
+		uint32_t nComponents;
+		s >> nComponents;
+
+		componentIds.clear();
+		for (uint32_t j = 0; j < nComponents; ++j) {
+			int componentId;
+			s >> componentId;
+			getComponentReflector(componentId).deserialize(s, context, restored[i]);
+			componentIds.push_back(componentId);
+		}
+		restored[i].keepOnlyComponentsWithIds(componentIds);
+	}
+}
+
+void World::restore(const WorldSnapshot& delta, const WorldSnapshot& base)
+{
+	restore(delta.applyDelta(base));
+}
+
+ConfigNodeSerializationContext World::makeSerializationContext()
+{
+	ConfigNodeSerializationContext context;
+	context.resources = &resources;
+	context.entityContext = std::make_shared<EntitySerializationContext>(*this);
+	return context;
+}
@@ -34,7 +34,10 @@ namespace Halley {
 		{}
 	};
 
-	class SerializerState {};
+	class SerializerState {
+	public:
+		virtual ~SerializerState() = default;
+	};
 
 	class ByteSerializationBase {
 	public:
@@ -44,10 +47,11 @@ namespace Halley {
 		
 		SerializerState* setState(SerializerState* state);
 		
+		// Returns null if there's no state, or if it's of a different type
 		template <typename T>
 		T* getState() const
 		{
-			return static_cast<T*>(state);
+			return dynamic_cast<T*>(state);
 		}
 
 		int getVersion() const { return version; }
@@ -8,11 +8,16 @@ namespace Halley {
 	public:
 		static Bytes compress(const Bytes& bytes);
 		static Bytes compress(gsl::span<const gsl::byte> bytes);
+		static Bytes compress(gsl::span<const gsl::byte> bytes, int level); // 1 is fastest, 9 is smallest, -1 is zlib's default
 		static Bytes decompress(const Bytes& bytes, size_t maxSize = std::numeric_limits<size_t>::max());
 		static Bytes decompress(gsl::span<const gsl::byte> bytes, size_t maxSize = std::numeric_limits<size_t>::max());
 		static std::shared_ptr<const char> decompressToSharedPtr(gsl::span<const gsl::byte> bytes, size_t& outSize, size_t maxSize = std::numeric_limits<size_t>::max());
 
-		static Bytes compressRaw(gsl::span<const gsl::byte> bytes, bool insertLength);
+		// For data produced by compress(), so the destination can be allocated up front and inflated straight into
+		static size_t getDecompressedSize(gsl::span<const gsl::byte> bytes);
+		static void decompressInto(gsl::span<const gsl::byte> bytes, gsl::span<gsl::byte> dst);
+
+		static Bytes compressRaw(gsl::span<const gsl::byte> bytes, bool insertLength, int level = -1);
 		static Bytes decompressRaw(gsl::span<const gsl::byte> bytes, size_t maxSize, size_t expectedSize = 0);
 	};
 }
@@ -1,6 +1,10 @@
 #pragma once
 #include <array>
+#include <atomic>
+#include <exception>
 #include <functional>
+#include <mutex>
+#include <vector>
 #include <halley/text/halleystring.h>
 #include "executor.h"
 #include "future.h"
@@ -30,6 +34,18 @@ namespace Halley
 			return execute(e, Task<typename std::result_of<F()>::type>(f));
 		}
 
+		template <typename T>
+		auto execute(ExecutionQueue& e, TaskPriority priority, Task<T> task) -> Future<T>
+		{
+			return task.enqueueOn(e, priority);
+		}
+
+		template <typename F>
+		auto execute(ExecutionQueue& e, TaskPriority priority, F f) -> Future<typename std::result_of<F()>::type>
+		{
+			return execute(e, priority, Task<typename std::result_of<F()>::type>(f));
+		}
+
 		template <typename T>
 		auto execute(Task<T> task) -> Future<T>
 		{
@@ -56,24 +72,46 @@ namespace Halley
 		void foreach(ExecutionQueue& e, T begin, T end, F f)
 		{
 			const size_t n = end - begin;
-			constexpr size_t maxThreads = 8;
-			size_t nThreads = std::max(size_t(1), std::min(maxThreads, e.threadCount()));
-			std::array<Future<void>, maxThreads> futures;
-
-			size_t prevEnd = 0;
-			for (size_t j = 0; j < nThreads; ++j) {
-				size_t curStart = prevEnd;
-				size_t curEnd = n * (j + 1) / nThreads;
-				prevEnd = curEnd;
+			const size_t nThreads = std::min(n, e.threadCount() + 1); // The calling thread also takes part
+			if (nThreads <= 1) {
+				for (auto i = begin; i != end; ++i) {
+					f(*i);
+				}
+				return;
+			}
 
-				futures[j] = execute([begin, f, curStart, curEnd]() {
-					for (auto i = begin + curStart; i < begin + curEnd; ++i) {
-						f(*i);
+			// Threads claim small chunks of the range as they go, so the ones that finish early take over the remaining work
+			// The tasks reference this stack frame, so errors are collected and rethrown once every task is done
+			const size_t chunkSize = std::max(size_t(1), n / (nThreads * 8));
+			std::atomic<size_t> next(0);
+			std::mutex errorMutex;
+			std::exception_ptr error;
+			auto run = [&] () {
+				try {
+					for (size_t curStart = next.fetch_add(chunkSize); curStart < n; curStart = next.fetch_add(chunkSize)) {
+						const size_t curEnd = std::min(curStart + chunkSize, n);
+						for (auto i = begin + curStart; i < begin + curEnd; ++i) {
+							f(*i);
+						}
 					}
-				});
+				} catch (...) {
+					std::unique_lock<std::mutex> lock(errorMutex);
+					error = std::current_exception();
+					next = n;
+				}
+			};
+
+			std::vector<Future<void>> futures;
+			futures.reserve(nThreads - 1);
+			for (size_t j = 1; j < nThreads; ++j) {
+				futures.push_back(execute(e, run));
 			}
+			run();
+			whenAll(futures.begin(), futures.end()).wait(e);
 
-			whenAll(futures.data(), futures.data() + nThreads).wait();
+			if (error) {
+				std::rethrow_exception(error);
+			}
 		}
 
 		template <typename T, typename F>
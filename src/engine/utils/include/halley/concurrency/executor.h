@@ -6,36 +6,139 @@
 #include <functional>
 #include <atomic>
 #include <vector>
+#include <array>
+#include <memory>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <chrono>
+#include <limits>
 #include "halley/text/halleystring.h"
 
 namespace Halley
 {
-	using TaskBase = std::function<void()>;
+	// Move-only void() callable
+	// Functors up to inlineSize bytes (such as the ones created by Task) are stored in place, so queuing a task doesn't need extra allocations
+	class TaskBase
+	{
+	public:
+		TaskBase() = default;
+
+		template <typename F, typename = std::enable_if_t<!std::is_same_v<std::decay_t<F>, TaskBase>>>
+		TaskBase(F&& f)
+		{
+			using T = std::decay_t<F>;
+			if constexpr (sizeof(T) <= inlineSize && alignof(T) <= alignof(std::max_align_t) && std::is_nothrow_move_constructible_v<T>) {
+				::new (storage.data()) T(std::forward<F>(f));
+				ops = &InlineOps<T>::ops;
+			} else {
+				::new (storage.data()) T*(new T(std::forward<F>(f)));
+				ops = &HeapOps<T>::ops;
+			}
+		}
+
+		TaskBase(TaskBase&& other) noexcept;
+		TaskBase& operator=(TaskBase&& other) noexcept;
+		TaskBase(const TaskBase& other) = delete;
+		TaskBase& operator=(const TaskBase& other) = delete;
+		~TaskBase();
+
+		void operator()();
+		explicit operator bool() const { return ops != nullptr; }
+
+	private:
+		constexpr static size_t inlineSize = 48;
+
+		struct Ops {
+			void (*invoke)(void*);
+			void (*move)(void* dst, void* src);
+			void (*destroy)(void*);
+		};
+
+		template <typename T>
+		struct InlineOps {
+			static void invoke(void* p) { (*static_cast<T*>(p))(); }
+			static void move(void* dst, void* src) { ::new (dst) T(std::move(*static_cast<T*>(src))); static_cast<T*>(src)->~T(); }
+			static void destroy(void* p) { static_cast<T*>(p)->~T(); }
+			constexpr static Ops ops = { &invoke, &move, &destroy };
+		};
+
+		template <typename T>
+		struct HeapOps {
+			static void invoke(void* p) { (**static_cast<T**>(p))(); }
+			static void move(void* dst, void* src) { ::new (dst) T*(*static_cast<T**>(src)); }
+			static void destroy(void* p) { delete *static_cast<T**>(p); }
+			constexpr static Ops ops = { &invoke, &move, &destroy };
+		};
+
+		alignas(std::max_align_t) std::array<char, inlineSize> storage;
+		const Ops* ops = nullptr;
+
+		void reset();
+	};
+
+	enum class TaskPriority {
+		Low,
+		Normal,
+		High
+	};
 
+	// Tasks queued from threads that don't belong to the queue go to a shared FIFO per priority, which are emptied from High to Low
+	// Normal tasks queued from the queue's own executors go to that executor's lock-free deque, which it runs newest first and idle executors steal from, oldest first
 	class ExecutionQueue
 	{
 	public:
 		ExecutionQueue();
-		void addToQueue(TaskBase task);
+		~ExecutionQueue();
+
+		void addToQueue(TaskBase task, TaskPriority priority = TaskPriority::Normal);
 
 		TaskBase getNext();
 		std::vector<TaskBase> getAll();
 
+		// Runs one pending task on the calling thread, if there are any. Returns whether a task was run
+		bool runOne();
+
+		// Runs pending tasks on the calling thread until there are none left, maxTasks have run or maxTime has passed
+		// At least one task is run if any are pending, so the queue always makes progress. Returns the number of tasks run
+		size_t runPending(std::chrono::microseconds maxTime, size_t maxTasks = std::numeric_limits<size_t>::max());
+
 		size_t threadCount() const;
 		void onAttached();
 		void onDetached();
 		void abort();
 
+		// Called by an executor from its own thread, so it gets a deque of its own
+		void attachWorkerThread();
+		void detachWorkerThread();
+
 		static ExecutionQueue& getDefault();
 
+		// The queue that the calling thread is an executor of, if any
+		static ExecutionQueue* getCurrent();
+
 	private:
-		std::deque<TaskBase> queue;
+		class Worker;
+		constexpr static size_t maxWorkers = 128;
+
+		std::array<std::deque<TaskBase*>, 3> queues; // Indexed by TaskPriority
 		std::mutex mutex;
 		std::condition_variable condition;
 
+		std::array<std::atomic<Worker*>, maxWorkers> workers;
+		std::vector<std::unique_ptr<Worker>> workerStorage;
+		std::atomic<size_t> nWorkers;
+
 		std::atomic<int> attachedCount;
-		std::atomic<bool> hasTasks;
+		std::atomic<int> pendingCount;
+		std::atomic<int> sleepingCount;
 		std::atomic<bool> aborted;
+
+		static thread_local ExecutionQueue* currentQueue;
+		static thread_local Worker* currentWorker;
+
+		TaskBase* tryPop();
+		void notifyPending();
 	};
 
 	class Executors
@@ -7,6 +7,7 @@
 #include <thread>
 #include <mutex>
 #include <condition_variable>
+#include <chrono>
 #include <halley/support/exception.h>
 
 namespace Halley
@@ -96,9 +97,22 @@ namespace Halley
 			return doGet<T>();
 		}
 
-		void wait()
+		// Blocks until the value is available. If helpQueue is set, runs its tasks in the meantime
+		void wait(ExecutionQueue* helpQueue = nullptr)
 		{
 			if (!available) {
+				// Run other tasks while waiting, so threads waiting on tasks queued behind them don't stall the queue
+				if (helpQueue) {
+					while (!available) {
+						if (!helpQueue->runOne()) {
+							std::unique_lock<std::mutex> lock(mutex);
+							if (!available) {
+								condition.wait_for(lock, std::chrono::microseconds(100));
+							}
+						}
+					}
+				}
+
 				std::unique_lock<std::mutex> lock(mutex);
 				while (!available) {
 					condition.wait(lock);
@@ -217,6 +231,15 @@ namespace Halley
 			return data->wait();
 		}
 
+		// Waits for the value, running tasks from helpQueue in the meantime
+		void wait(ExecutionQueue& helpQueue)
+		{
+			if (!data) {
+				throw Exception("Future has not been bound.", HalleyExceptions::Utils);
+			}
+			return data->wait(&helpQueue);
+		}
+
 		void cancel()
 		{
 			if (!data) {
@@ -466,11 +489,11 @@ namespace Halley
 			payload = std::move(f);
 		}
 
-		Future<T> enqueueOn(ExecutionQueue& e)
+		Future<T> enqueueOn(ExecutionQueue& e, TaskPriority priority = TaskPriority::Normal)
 		{
 			e.addToQueue([payload(std::move(payload)), promise(promise)]() mutable {
 				TaskHelper<T>::setPromise(promise, payload);
-			});
+			}, priority);
 			return getFuture();
 		}
 
@@ -498,7 +521,11 @@ namespace Halley
 
 		auto task = Task<R>();
 		data->addContinuation([task, f, executor](typename TaskHelper<T>::DataType v) mutable {
-			task.setPayload(MovableFunction<R>(f, std::move(v)));
+			if constexpr (std::is_void_v<T>) {
+				task.setPayload(MovableFunction<R>(std::function<R()>(f)));
+			} else {
+				task.setPayload(MovableFunction<R>(f, std::move(v)));
+			}
 			task.enqueueOn(executor.get());
 		});
 		return task.getFuture();
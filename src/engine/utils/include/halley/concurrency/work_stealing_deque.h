@@ -0,0 +1,108 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <cstdint>
+
+namespace Halley
+{
+	class TaskBase;
+
+	// Chase-Lev work-stealing deque, as described by Le, Pop, Cohen and Zappa Nardelli (2013)
+	// Only the owner thread can push and pop (from the bottom), any thread can steal (from the top)
+	class WorkStealingDeque {
+	public:
+		WorkStealingDeque()
+			: top(0)
+			, bottom(0)
+		{
+			buffers.push_back(std::make_unique<Buffer>(256));
+			buffer.store(buffers.back().get());
+		}
+
+		void push(TaskBase* task)
+		{
+			const int64_t b = bottom.load(std::memory_order_relaxed);
+			const int64_t t = top.load(std::memory_order_acquire);
+			Buffer* buf = buffer.load(std::memory_order_relaxed);
+			if (b - t > buf->capacity - 1) {
+				buf = grow(buf, b, t);
+			}
+			buf->put(b, task);
+			std::atomic_thread_fence(std::memory_order_release);
+			bottom.store(b + 1, std::memory_order_relaxed);
+		}
+
+		TaskBase* pop()
+		{
+			const int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+			Buffer* buf = buffer.load(std::memory_order_relaxed);
+			bottom.store(b, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			int64_t t = top.load(std::memory_order_relaxed);
+
+			if (t > b) {
+				// Empty
+				bottom.store(b + 1, std::memory_order_relaxed);
+				return nullptr;
+			}
+
+			TaskBase* task = buf->get(b);
+			if (t == b) {
+				// Last element, race against stealers for it
+				if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+					task = nullptr;
+				}
+				bottom.store(b + 1, std::memory_order_relaxed);
+			}
+			return task;
+		}
+
+		TaskBase* steal()
+		{
+			int64_t t = top.load(std::memory_order_acquire);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			const int64_t b = bottom.load(std::memory_order_acquire);
+
+			if (t < b) {
+				Buffer* buf = buffer.load(std::memory_order_acquire);
+				TaskBase* task = buf->get(t);
+				if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+					return nullptr;
+				}
+				return task;
+			}
+			return nullptr;
+		}
+
+	private:
+		struct Buffer {
+			const int64_t capacity;
+			std::unique_ptr<std::atomic<TaskBase*>[]> data;
+
+			explicit Buffer(int64_t capacity)
+				: capacity(capacity)
+				, data(new std::atomic<TaskBase*>[capacity])
+			{}
+
+			TaskBase* get(int64_t i) const { return data[i & (capacity - 1)].load(std::memory_order_relaxed); }
+			void put(int64_t i, TaskBase* task) { data[i & (capacity - 1)].store(task, std::memory_order_relaxed); }
+		};
+
+		std::atomic<int64_t> top;
+		std::atomic<int64_t> bottom;
+		std::atomic<Buffer*> buffer;
+		std::vector<std::unique_ptr<Buffer>> buffers; // Old buffers are kept alive, as stealers might still be reading from them
+
+		Buffer* grow(Buffer* old, int64_t b, int64_t t)
+		{
+			buffers.push_back(std::make_unique<Buffer>(old->capacity * 2));
+			Buffer* buf = buffers.back().get();
+			for (int64_t i = t; i < b; ++i) {
+				buf->put(i, old->get(i));
+			}
+			buffer.store(buf, std::memory_order_release);
+			return buf;
+		}
+	};
+}
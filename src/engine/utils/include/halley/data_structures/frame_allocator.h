@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+#include <gsl/gsl>
+#include "vector.h"
+
+namespace Halley {
+	// Linear arena for scratch memory that only lives until the next reset(), e.g. for the duration of a frame
+	// Allocating just bumps an offset, and nothing is freed individually; not thread safe
+	class FrameAllocator
+	{
+	public:
+		explicit FrameAllocator(size_t initialCapacity = 64 * 1024);
+
+		FrameAllocator(const FrameAllocator& other) = delete;
+		FrameAllocator(FrameAllocator&& other) noexcept = default;
+		FrameAllocator& operator=(const FrameAllocator& other) = delete;
+		FrameAllocator& operator=(FrameAllocator&& other) noexcept = default;
+
+		void* alloc(size_t size, size_t alignment = alignof(std::max_align_t));
+
+		// Elements are default initialized, so trivial types are left uninitialized
+		template <typename T>
+		gsl::span<T> alloc(size_t n)
+		{
+			static_assert(std::is_trivially_destructible_v<T>, "FrameAllocator never runs destructors");
+			T* result = static_cast<T*>(alloc(n * sizeof(T), alignof(T)));
+			std::uninitialized_default_construct_n(result, n);
+			return gsl::span<T>(result, n);
+		}
+
+		// Invalidates everything allocated so far
+		// If the last frame needed more than one block, they're merged into a single one big enough for all of it
+		void reset();
+
+		size_t getUsed() const; // In bytes, since the last reset
+		size_t getPeakUsed() const; // Highest getUsed() ever reached
+		size_t getCapacity() const;
+
+	private:
+		struct Block {
+			std::unique_ptr<char[]> data;
+			size_t size = 0;
+		};
+
+		Vector<Block> blocks;
+		size_t curBlock = 0;
+		size_t curOffset = 0;
+		size_t usedInPrevBlocks = 0;
+		size_t peakUsed = 0;
+		size_t initialCapacity;
+
+		void addBlock(size_t minSize);
+	};
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <memory>
+#include <gsl/gsl>
+
+namespace Halley
+{
+	class Path;
+
+	// A read-only view of a whole file, paged in lazily by the OS
+	// Only implemented on POSIX platforms; open() returns null elsewhere, or if the file can't be mapped
+	class MemoryMappedFile
+	{
+	public:
+		static std::shared_ptr<MemoryMappedFile> open(const Path& path);
+
+		MemoryMappedFile(const void* data, size_t size);
+		MemoryMappedFile(const MemoryMappedFile& other) = delete;
+		MemoryMappedFile& operator=(const MemoryMappedFile& other) = delete;
+		~MemoryMappedFile();
+
+		gsl::span<const gsl::byte> getSpan() const;
+		const char* getData() const;
+		size_t getSize() const;
+
+	private:
+		const void* data;
+		size_t size;
+	};
+}
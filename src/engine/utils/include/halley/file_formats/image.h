@@ -95,6 +95,7 @@ namespace Halley {
 		static std::unique_ptr<Image> loadResource(ResourceLoader& loader);
 		constexpr static AssetType getAssetType() { return AssetType::Image; }
 		void reload(Resource&& resource) override;
+		ResourceMemoryUsage getMemoryUsage() const override;
 
 		Image& operator=(const Image& o) = delete;
 		Image& operator=(Image&& o) = default;
@@ -19,6 +19,7 @@ namespace Halley
 		static std::unique_ptr<TextFile> loadResource(ResourceLoader& loader);
 		constexpr static AssetType getAssetType() { return AssetType::TextFile; }
 		void reload(Resource&& resource) override;
+		ResourceMemoryUsage getMemoryUsage() const override;
 
 	private:
 		String data;
@@ -11,6 +11,7 @@ namespace Halley {} // Get GitHub to realise this is C++ :3
 
 #include "data_structures/bin_pack.h"
 #include "data_structures/dynamic_grid.h"
+#include "data_structures/frame_allocator.h"
 #include "data_structures/hash_map.h"
 #include "data_structures/mapped_pool.h"
 #include "data_structures/maybe.h"
@@ -23,6 +24,7 @@ namespace Halley {} // Get GitHub to realise this is C++ :3
 #include "data_structures/vector.h"
 
 #include "file/directory_monitor.h"
+#include "file/memory_mapped_file.h"
 #include "file/path.h"
 
 #include "file_formats/binary_file.h"
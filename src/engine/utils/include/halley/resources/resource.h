@@ -87,6 +87,17 @@ namespace Halley
 	class ResourceObserver;
 	class Resources;
 
+	struct ResourceMemoryUsage
+	{
+		size_t ramUsage = 0;
+		size_t vramUsage = 0;
+
+		size_t getTotal() const { return ramUsage + vramUsage; }
+
+		ResourceMemoryUsage& operator+=(const ResourceMemoryUsage& other);
+		ResourceMemoryUsage& operator-=(const ResourceMemoryUsage& other);
+	};
+
 	class Resource
 	{
 	public:
@@ -103,6 +114,9 @@ namespace Halley
 		int getAssetVersion() const;
 		void reloadResource(Resource&& resource);
 
+		// Approximate memory held by this resource, for the memory budgets in Resources. Defaults to nothing
+		virtual ResourceMemoryUsage getMemoryUsage() const;
+
 	protected:
 		virtual void reload(Resource&& resource);
 
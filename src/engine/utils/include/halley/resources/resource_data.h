@@ -59,8 +59,10 @@ namespace Halley {
 	public:
 		ResourceDataStatic(String path);
 		ResourceDataStatic(const void* data, size_t size, String path, bool owning = true);
+		ResourceDataStatic(std::shared_ptr<const char> data, size_t size, String path); // data may alias whatever owns the memory, e.g. a MemoryMappedFile
 
 		void set(const void* data, size_t size, bool owning = true);
+		void set(std::shared_ptr<const char> data, size_t size);
 		bool isLoaded() const;
 
 		const void* getData() const;
@@ -104,6 +106,18 @@ namespace Halley {
 		High = 2
 	};
 
+	inline TaskPriority getTaskPriority(ResourceLoadPriority priority)
+	{
+		switch (priority) {
+		case ResourceLoadPriority::Low:
+			return TaskPriority::Low;
+		case ResourceLoadPriority::High:
+			return TaskPriority::High;
+		default:
+			return TaskPriority::Normal;
+		}
+	}
+
 	class HalleyAPI;
 	class Metadata;
 	class Resources;
@@ -120,7 +134,7 @@ namespace Halley {
 
 		std::unique_ptr<ResourceDataStatic> getStatic();
 		std::unique_ptr<ResourceDataStream> getStream();
-		Future<std::unique_ptr<ResourceDataStatic>> getAsync() const;
+		Future<std::unique_ptr<ResourceDataStatic>> getAsync(); // Read on the disk IO executors, in order of priority
 		Resources& getResources() const;
 
 	private:
@@ -128,6 +142,8 @@ namespace Halley {
 		ResourceLoader(IResourceLocator& locator, const String& name, AssetType type, ResourceLoadPriority priority, const HalleyAPI* api, Resources& resources);
 		~ResourceLoader();
 
+		static std::unique_ptr<ResourceDataStatic> readStatic(IResourceLocator& locator, const String& name, AssetType type, const Metadata& meta);
+
 		IResourceLocator& locator;
 		Resources& resources;
 		String name;
@@ -135,6 +151,7 @@ namespace Halley {
 		ResourceLoadPriority priority;
 		const HalleyAPI* api;
 		const Metadata* metadata;
+		std::unique_ptr<ResourceDataStatic> prefetched; // Read ahead by an asynchronous load, returned by the first getStatic or getAsync
 		bool loaded = false;
 	};
 
@@ -204,6 +204,18 @@ namespace Halley {
 		return static_cast<int>(tab64[uint64_t((value - (value >> 1)) * 0x07EDD5E59A4E28C2) >> 58]);
 	}
 
+	[[nodiscard]] inline int popCount(uint64_t value)
+	{
+#if defined(__GNUC__) || defined(__clang__)
+		return __builtin_popcountll(value);
+#else
+		value = value - ((value >> 1) & 0x5555555555555555ull);
+		value = (value & 0x3333333333333333ull) + ((value >> 2) & 0x3333333333333333ull);
+		value = (value + (value >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+		return static_cast<int>((value * 0x0101010101010101ull) >> 56);
+#endif
+	}
+
 	[[nodiscard]] constexpr inline int fastLog2Ceil (uint32_t value)
 	{
 		if (value == 0) {
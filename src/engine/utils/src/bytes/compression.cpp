@@ -1,5 +1,7 @@
 #include <cstdlib>
 #include <memory>
+#include <algorithm>
+#include <limits>
 #include "halley/bytes/compression.h"
 //#include "../../contrib/lodepng/lodepng.h"
 #include "../../../../contrib/zlib/zlib.h"
@@ -18,6 +20,19 @@ static void zlibFree(voidpf opaque, voidpf address)
 	free(address);
 }
 
+// avail_in and avail_out are only 32 bits wide, so larger buffers are handed to zlib in chunks
+// total_in and total_out can be 32 bits as well, so sizes are tracked here instead
+static void refill(Bytef*& next, uInt& avail, const gsl::byte*& src, size_t& remaining)
+{
+	if (avail == 0 && remaining > 0) {
+		const size_t chunk = std::min(remaining, size_t(std::numeric_limits<uInt>::max()));
+		next = reinterpret_cast<Bytef*>(const_cast<gsl::byte*>(src));
+		avail = uInt(chunk);
+		src += chunk;
+		remaining -= chunk;
+	}
+}
+
 Bytes Compression::compress(const Bytes& bytes)
 {
 	return compress(gsl::as_bytes(gsl::span<const Byte>(bytes)));
@@ -28,6 +43,11 @@ Bytes Compression::compress(gsl::span<const gsl::byte> bytes)
 	return compressRaw(bytes, true);
 }
 
+Bytes Compression::compress(gsl::span<const gsl::byte> bytes, int level)
+{
+	return compressRaw(bytes, true, level);
+}
+
 Bytes Compression::decompress(const Bytes& bytes, size_t maxSize)
 {
 	return decompress(gsl::as_bytes(gsl::span<const Byte>(bytes)), maxSize);
@@ -50,22 +70,80 @@ static void deleter(const char* data)
 
 std::shared_ptr<const char> Compression::decompressToSharedPtr(gsl::span<const gsl::byte> bytes, size_t& size, size_t maxSize)
 {
-	auto out = decompress(bytes, maxSize);
-	
-	size = out.size();
-	auto rawResult = new char[out.size()];
-	memcpy(rawResult, out.data(), out.size());
+	size = getDecompressedSize(bytes);
+	if (size > maxSize) {
+		throw Exception("File is too big to inflate: " + String::prettySize(size), HalleyExceptions::Compression);
+	}
+
+	auto rawResult = new char[size];
 	auto result = std::shared_ptr<const char>(rawResult, deleter);
+	decompressInto(bytes, gsl::as_writable_bytes(gsl::span<char>(rawResult, size)));
 	return result;
 }
 
-Bytes Compression::compressRaw(gsl::span<const gsl::byte> bytes, bool insertLength)
+size_t Compression::getDecompressedSize(gsl::span<const gsl::byte> bytes)
+{
+	Expects (bytes.size_bytes() >= 8);
+	uint64_t size;
+	memcpy(&size, bytes.data(), 8);
+	return size_t(size);
+}
+
+static void inflateInto(gsl::span<const gsl::byte> bytes, gsl::span<gsl::byte> dst)
+{
+	z_stream stream;
+	stream.zalloc = &zlibAlloc;
+	stream.zfree = &zlibFree;
+	stream.opaque = nullptr;
+	stream.avail_in = 0;
+	stream.next_in = nullptr;
+	int ret = inflateInit(&stream);
+	if (ret != Z_OK) {
+		throw Exception("Unable to initialise zlib", HalleyExceptions::Compression);
+	}
+
+	const gsl::byte* src = bytes.data();
+	size_t srcLeft = bytes.size_bytes();
+	const gsl::byte* out = dst.data();
+	size_t outLeft = dst.size_bytes();
+	Bytef noOutput; // zlib refuses a null next_out, even when there's nothing to write
+	stream.next_out = &noOutput;
+	stream.avail_out = 0;
+	int res;
+	do {
+		refill(stream.next_in, stream.avail_in, src, srcLeft);
+		refill(stream.next_out, stream.avail_out, out, outLeft);
+		res = inflate(&stream, Z_NO_FLUSH);
+	} while (res == Z_OK);
+	const size_t totalOut = size_t(dst.size_bytes()) - outLeft - stream.avail_out;
+	inflateEnd(&stream);
+
+	if (res != Z_STREAM_END) {
+		throw Exception("Unable to inflate stream.", HalleyExceptions::Compression);
+	}
+	if (totalOut != size_t(dst.size_bytes())) {
+		throw Exception("Unexpected outsize (" + toString(totalOut) + ") when inflating data, expected (" + toString(dst.size_bytes()) + ").", HalleyExceptions::Compression);
+	}
+}
+
+void Compression::decompressInto(gsl::span<const gsl::byte> bytes, gsl::span<gsl::byte> dst)
+{
+	if (getDecompressedSize(bytes) != size_t(dst.size_bytes())) {
+		throw Exception("Destination doesn't match the size of the compressed data.", HalleyExceptions::Compression);
+	}
+	inflateInto(bytes.subspan(8), dst);
+}
+
+Bytes Compression::compressRaw(gsl::span<const gsl::byte> bytes, bool insertLength, int level)
 {
 	Expects (sizeof(uint64_t) == 8);
 
 	const uint64_t inSize = bytes.size_bytes();
 	const size_t headerSize = insertLength ? 8 : 0;
-	Bytes result(size_t(inSize) + headerSize + 16); // Header size, plus 16 bytes for headroom, should be enough for any compression
+
+	// zlib's most conservative bound, for data that doesn't compress at all (deflateBound takes a uLong, which can be too narrow)
+	const size_t maxOutSize = size_t(inSize) + ((size_t(inSize) + 7) >> 3) + ((size_t(inSize) + 63) >> 6) + 11;
+	Bytes result(headerSize + maxOutSize);
 
 	if (insertLength) {
 		memcpy(result.data(), &inSize, 8);
@@ -75,25 +153,29 @@ Bytes Compression::compressRaw(gsl::span<const gsl::byte> bytes, bool insertLeng
 	stream.zalloc = &zlibAlloc;
 	stream.zfree = &zlibFree;
 	stream.opaque = nullptr;
-	int res = deflateInit(&stream, Z_DEFAULT_COMPRESSION);
+	int res = deflateInit(&stream, level);
 	if (res != Z_OK) {
 		throw Exception("Unable to initialize zlib compression", HalleyExceptions::Compression);
 	}
 
-	stream.avail_in = uInt(bytes.size_bytes());
-	stream.next_in = reinterpret_cast<unsigned char*>(const_cast<gsl::byte*>(bytes.data()));
-	stream.avail_out = uInt(result.size() - headerSize);
-	stream.next_out = result.data() + headerSize;
+	stream.avail_in = 0;
+	stream.avail_out = 0;
+	const gsl::byte* src = bytes.data();
+	size_t srcLeft = bytes.size_bytes();
+	const gsl::byte* out = reinterpret_cast<const gsl::byte*>(result.data() + headerSize);
+	size_t outLeft = maxOutSize;
 
 	do {
-		res = deflate(&stream, Z_FINISH);
+		refill(stream.next_in, stream.avail_in, src, srcLeft);
+		refill(stream.next_out, stream.avail_out, out, outLeft);
+		res = deflate(&stream, srcLeft == 0 ? Z_FINISH : Z_NO_FLUSH);
 		if (res == Z_STREAM_ERROR || res == Z_BUF_ERROR) {
 			deflateEnd(&stream);
 			throw Exception("Unable to compress data.", HalleyExceptions::Compression);
 		}
 	} while (res != Z_STREAM_END);
 
-	const size_t outSize = size_t(stream.total_out);
+	const size_t outSize = maxOutSize - outLeft - stream.avail_out;
 	deflateEnd(&stream);
 
 	result.resize(headerSize + outSize);
@@ -106,6 +188,12 @@ Bytes Compression::decompressRaw(gsl::span<const gsl::byte> bytes, size_t maxSiz
 	if (expectedSize > uint64_t(maxSize)) {
 		throw Exception("File is too big to inflate: " + String::prettySize(expectedSize), HalleyExceptions::Compression);
 	}
+
+	if (expectedSize > 0) {
+		Bytes result(expectedSize);
+		inflateInto(bytes, gsl::as_writable_bytes(gsl::span<Byte>(result)));
+		return result;
+	}
 	
 	z_stream stream;
 	stream.zalloc = &zlibAlloc;
@@ -117,54 +205,40 @@ Bytes Compression::decompressRaw(gsl::span<const gsl::byte> bytes, size_t maxSiz
 	if (ret != Z_OK) {
 		throw Exception("Unable to initialise zlib", HalleyExceptions::Compression);
 	}
-	stream.avail_in = uInt(bytes.size_bytes());
-	stream.next_in = reinterpret_cast<unsigned char*>(const_cast<gsl::byte*>(bytes.data()));
+	const gsl::byte* src = bytes.data();
+	size_t srcLeft = bytes.size_bytes();
 
-	if (expectedSize > 0) {
-		Bytes result(expectedSize);
-		stream.avail_out = uInt(result.size());
-		stream.next_out = result.data();
-		
-		const int res = inflate(&stream, Z_NO_FLUSH);
-		const size_t totalOut = size_t(stream.total_out);
-		inflateEnd(&stream);
-
-		if (res != Z_STREAM_END) {
-			throw Exception("Unable to inflate stream.", HalleyExceptions::Compression);
-		}
-		if (totalOut != expectedSize) {
-			throw Exception("Unexpected outsize (" + toString(result.size()) + ") when inflating data, expected (" + toString(expectedSize) + ").", HalleyExceptions::Compression);
-		}
+	constexpr size_t blockSize = 256 * 1024;
+	Bytes result(std::min(blockSize, maxSize));
 
-		return result;
-	} else {
-		constexpr size_t blockSize = 256 * 1024;
-		Bytes result(std::min(blockSize, maxSize));
-
-		int res = 0;
-		do {
-			// Expand if needed
-			if (result.size() - size_t(stream.total_out) < blockSize / 2) {
-				if (result.size() >= maxSize) {
-					inflateEnd(&stream);
-					throw Exception("Unable to inflate stream, maximum size has been exceeded.", HalleyExceptions::Compression);
-				}
-				auto newSize = std::min(result.size() + blockSize, maxSize);
-				result.resize(newSize);
+	int res = 0;
+	size_t totalOut = 0;
+	do {
+		// Expand if needed
+		if (result.size() - totalOut < blockSize / 2) {
+			if (result.size() >= maxSize) {
+				inflateEnd(&stream);
+				throw Exception("Unable to inflate stream, maximum size has been exceeded.", HalleyExceptions::Compression);
 			}
-			stream.avail_out = uInt(result.size()) - stream.total_out;
-			stream.next_out = result.data() + size_t(stream.total_out);
-			res = inflate(&stream, Z_NO_FLUSH);
-		} while (res == Z_OK);
+			auto newSize = std::min(result.size() + blockSize, maxSize);
+			result.resize(newSize);
+		}
+		refill(stream.next_in, stream.avail_in, src, srcLeft);
 
-		const size_t totalOut = size_t(stream.total_out);
-		inflateEnd(&stream);
+		// Never more than blockSize and a half at a time, so it always fits in avail_out
+		const size_t outSize = result.size() - totalOut;
+		stream.avail_out = uInt(outSize);
+		stream.next_out = result.data() + totalOut;
+		res = inflate(&stream, Z_NO_FLUSH);
+		totalOut += outSize - stream.avail_out;
+	} while (res == Z_OK);
 
-		if (res != Z_STREAM_END) {
-			throw Exception("Unable to inflate stream.", HalleyExceptions::Compression);
-		}
-		result.resize(totalOut);
+	inflateEnd(&stream);
 
-		return result;
+	if (res != Z_STREAM_END) {
+		throw Exception("Unable to inflate stream.", HalleyExceptions::Compression);
 	}
+	result.resize(totalOut);
+
+	return result;
 }
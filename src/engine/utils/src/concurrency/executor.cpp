@@ -1,59 +1,267 @@
 #include <halley/concurrency/concurrent.h>
 #include <halley/concurrency/executor.h>
+#include <halley/concurrency/work_stealing_deque.h>
 #include <halley/support/exception.h>
 #include "halley/text/string_converter.h"
 #include "halley/support/logger.h"
+#include <algorithm>
 
 using namespace Halley;
 
 Executors* Executors::instance = nullptr;
+thread_local ExecutionQueue* ExecutionQueue::currentQueue = nullptr;
+thread_local ExecutionQueue::Worker* ExecutionQueue::currentWorker = nullptr;
+
+TaskBase::TaskBase(TaskBase&& other) noexcept
+{
+	if (other.ops) {
+		other.ops->move(storage.data(), other.storage.data());
+		ops = other.ops;
+		other.ops = nullptr;
+	}
+}
+
+TaskBase& TaskBase::operator=(TaskBase&& other) noexcept
+{
+	if (this != &other) {
+		reset();
+		if (other.ops) {
+			other.ops->move(storage.data(), other.storage.data());
+			ops = other.ops;
+			other.ops = nullptr;
+		}
+	}
+	return *this;
+}
+
+TaskBase::~TaskBase()
+{
+	reset();
+}
+
+void TaskBase::operator()()
+{
+	if (!ops) {
+		throw Exception("Calling an empty task.", HalleyExceptions::Concurrency);
+	}
+	ops->invoke(storage.data());
+}
+
+void TaskBase::reset()
+{
+	if (ops) {
+		ops->destroy(storage.data());
+		ops = nullptr;
+	}
+}
+
+class ExecutionQueue::Worker {
+public:
+	WorkStealingDeque deque;
+	std::atomic<bool> inUse;
+
+	Worker()
+		: inUse(true)
+	{}
+};
 
 ExecutionQueue::ExecutionQueue()
-	: aborted(false)
+	: nWorkers(0)
+	, attachedCount(0)
+	, pendingCount(0)
+	, sleepingCount(0)
+	, aborted(false)
 {
-	hasTasks.store(false);
+	for (auto& w: workers) {
+		w.store(nullptr);
+	}
+}
+
+ExecutionQueue::~ExecutionQueue()
+{
+	for (auto& queue: queues) {
+		for (auto* task: queue) {
+			delete task;
+		}
+	}
+	for (auto& w: workerStorage) {
+		while (auto* task = w->deque.pop()) {
+			delete task;
+		}
+	}
 }
 
 TaskBase ExecutionQueue::getNext()
 {
-	std::unique_lock<std::mutex> lock(mutex);
-	while (queue.empty()) {
-		if (!aborted) {
-			condition.wait(lock);
+	while (true) {
+		if (aborted) {
+			return TaskBase([] () {});
 		}
+
+		if (auto* task = tryPop()) {
+			TaskBase value = std::move(*task);
+			delete task;
+			return value;
+		}
+
+		std::unique_lock<std::mutex> lock(mutex);
 		if (aborted) {
-			queue.clear();
 			return TaskBase([] () {});
 		}
+		++sleepingCount;
+		if (pendingCount.load() == 0) {
+			condition.wait(lock);
+		}
+		--sleepingCount;
 	}
-
-	TaskBase value = queue.front();
-	queue.pop_front();
-	return value;
 }
 
 std::vector<TaskBase> ExecutionQueue::getAll()
 {
-	std::unique_lock<std::mutex> lock(mutex);
-	hasTasks.store(false);
-	std::vector<TaskBase> tasks(queue.begin(), queue.end());
-	queue.clear();
+	std::vector<TaskBase> tasks;
+	while (auto* task = tryPop()) {
+		tasks.push_back(std::move(*task));
+		delete task;
+	}
 	return tasks;
 }
 
-void ExecutionQueue::addToQueue(TaskBase task)
+bool ExecutionQueue::runOne()
 {
 #if HAS_THREADS
-	std::unique_lock<std::mutex> lock(mutex);
-	queue.emplace_back(task);
-	hasTasks.store(true);
+	if (auto* task = tryPop()) {
+		std::unique_ptr<TaskBase> owned(task);
+		(*owned)();
+		return true;
+	}
+#endif
+	return false;
+}
+
+size_t ExecutionQueue::runPending(std::chrono::microseconds maxTime, size_t maxTasks)
+{
+	const auto deadline = std::chrono::steady_clock::now() + maxTime;
+	size_t n = 0;
+	while (n < maxTasks && runOne()) {
+		++n;
+		if (std::chrono::steady_clock::now() >= deadline) {
+			break;
+		}
+	}
+	return n;
+}
+
+TaskBase* ExecutionQueue::tryPop()
+{
+	if (pendingCount.load() == 0) {
+		return nullptr;
+	}
 
-	condition.notify_one();
+	// Our own tasks first, most recent first, as they're likely to still be in cache
+	if (currentQueue == this && currentWorker) {
+		if (auto* task = currentWorker->deque.pop()) {
+			--pendingCount;
+			return task;
+		}
+	}
+
+	// Then tasks from outside the queue, highest priority first
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		for (auto queue = queues.rbegin(); queue != queues.rend(); ++queue) {
+			if (!queue->empty()) {
+				auto* task = queue->front();
+				queue->pop_front();
+				--pendingCount;
+				return task;
+			}
+		}
+	}
+
+	// Finally, steal from the other executors, starting from a different one on each thread to spread contention
+	const size_t n = nWorkers.load(std::memory_order_acquire);
+	const size_t start = std::hash<std::thread::id>()(std::this_thread::get_id());
+	for (size_t i = 0; i < n; ++i) {
+		auto* worker = workers[(start + i) % n].load(std::memory_order_acquire);
+		if (worker && worker != currentWorker) {
+			if (auto* task = worker->deque.steal()) {
+				--pendingCount;
+				return task;
+			}
+		}
+	}
+
+	return nullptr;
+}
+
+void ExecutionQueue::addToQueue(TaskBase task, TaskPriority priority)
+{
+#if HAS_THREADS
+	auto* node = new TaskBase(std::move(task));
+	++pendingCount;
+	if (currentQueue == this && currentWorker && priority == TaskPriority::Normal) {
+		currentWorker->deque.push(node);
+	} else {
+		std::unique_lock<std::mutex> lock(mutex);
+		queues[int(priority)].push_back(node);
+	}
+	notifyPending();
 #else
 	task();
 #endif
 }
 
+void ExecutionQueue::notifyPending()
+{
+	// Sleeping executors only wait after checking pendingCount with sleepingCount raised, so this can't miss them
+	if (sleepingCount.load() > 0) {
+		std::unique_lock<std::mutex> lock(mutex);
+		condition.notify_one();
+	}
+}
+
+void ExecutionQueue::attachWorkerThread()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+
+	// Reuse the deque of an executor that has stopped, if possible, so any tasks left in it still get stolen
+	for (auto& w: workerStorage) {
+		bool expected = false;
+		if (w->inUse.compare_exchange_strong(expected, true)) {
+			currentQueue = this;
+			currentWorker = w.get();
+			return;
+		}
+	}
+
+	currentQueue = this;
+	if (workerStorage.size() < maxWorkers) {
+		auto& w = workerStorage.emplace_back(std::make_unique<Worker>());
+		workers[workerStorage.size() - 1].store(w.get(), std::memory_order_release);
+		nWorkers.store(workerStorage.size(), std::memory_order_release);
+		currentWorker = w.get();
+	} else {
+		// Too many executors, this one will only use the shared queue
+		currentWorker = nullptr;
+	}
+}
+
+void ExecutionQueue::detachWorkerThread()
+{
+	if (currentQueue == this) {
+		if (currentWorker) {
+			currentWorker->inUse = false;
+		}
+		currentQueue = nullptr;
+		currentWorker = nullptr;
+	}
+}
+
+ExecutionQueue* ExecutionQueue::getCurrent()
+{
+	return currentQueue;
+}
+
 Executors& Executors::get()
 {
 	if (!instance) {
@@ -69,7 +277,7 @@ void Executors::setInstance(Executors& e)
 
 size_t ExecutionQueue::threadCount() const
 {
-	return attachedCount.load();
+	return size_t(std::max(attachedCount.load(), 0));
 }
 
 void ExecutionQueue::onAttached()
@@ -129,6 +337,7 @@ bool Executor::runPending()
 void Executor::runForever()
 {
 #if HAS_THREADS
+	queue.attachWorkerThread();
 	try {
 		while (running)	{
 			auto next = queue.getNext();
@@ -142,6 +351,7 @@ void Executor::runForever()
 	} catch (...) {
 		Logger::logError("Executor aborting due to unknown exception.");
 	}
+	queue.detachWorkerThread();
 #endif
 }
 
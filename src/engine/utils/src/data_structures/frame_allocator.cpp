@@ -0,0 +1,76 @@
+#include "halley/data_structures/frame_allocator.h"
+#include <algorithm>
+#include <cstdint>
+
+using namespace Halley;
+
+FrameAllocator::FrameAllocator(size_t initialCapacity)
+	: initialCapacity(std::max(initialCapacity, size_t(64)))
+{
+}
+
+void* FrameAllocator::alloc(size_t size, size_t alignment)
+{
+	Expects(alignment > 0 && (alignment & (alignment - 1)) == 0);
+
+	while (true) {
+		if (curBlock < blocks.size()) {
+			auto& block = blocks[curBlock];
+			const auto base = reinterpret_cast<uintptr_t>(block.data.get());
+			const size_t offset = ((base + curOffset + alignment - 1) & ~uintptr_t(alignment - 1)) - base;
+			if (offset + size <= block.size) {
+				curOffset = offset + size;
+				peakUsed = std::max(peakUsed, getUsed());
+				return block.data.get() + offset;
+			}
+
+			// Doesn't fit, move on to the next block
+			usedInPrevBlocks += curOffset;
+			curOffset = 0;
+			++curBlock;
+		}
+
+		if (curBlock == blocks.size()) {
+			addBlock(size + alignment);
+		}
+	}
+}
+
+void FrameAllocator::reset()
+{
+	if (blocks.size() > 1) {
+		const size_t total = getCapacity();
+		blocks.clear();
+		addBlock(total);
+	}
+	curBlock = 0;
+	curOffset = 0;
+	usedInPrevBlocks = 0;
+}
+
+size_t FrameAllocator::getUsed() const
+{
+	return usedInPrevBlocks + curOffset;
+}
+
+size_t FrameAllocator::getPeakUsed() const
+{
+	return peakUsed;
+}
+
+size_t FrameAllocator::getCapacity() const
+{
+	size_t total = 0;
+	for (const auto& block: blocks) {
+		total += block.size;
+	}
+	return total;
+}
+
+void FrameAllocator::addBlock(size_t minSize)
+{
+	const size_t size = std::max(minSize, blocks.empty() ? initialCapacity : blocks.back().size * 2);
+	auto& block = blocks.emplace_back();
+	block.data = std::make_unique<char[]>(size);
+	block.size = size;
+}
@@ -0,0 +1,72 @@
+#include "halley/file/memory_mapped_file.h"
+#include "halley/file/path.h"
+
+using namespace Halley;
+
+#if defined(__linux__) || defined(__APPLE__) || defined(__FreeBSD__)
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+std::shared_ptr<MemoryMappedFile> MemoryMappedFile::open(const Path& path)
+{
+	const int fd = ::open(path.string().c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return {};
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+		::close(fd);
+		return {};
+	}
+
+	// The mapping stays valid after the descriptor is closed
+	const auto size = size_t(st.st_size);
+	void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (data == MAP_FAILED) {
+		return {};
+	}
+	return std::make_shared<MemoryMappedFile>(data, size);
+}
+
+MemoryMappedFile::~MemoryMappedFile()
+{
+	munmap(const_cast<void*>(data), size);
+}
+
+#else
+
+std::shared_ptr<MemoryMappedFile> MemoryMappedFile::open(const Path&)
+{
+	// Not implemented
+	return {};
+}
+
+MemoryMappedFile::~MemoryMappedFile() = default;
+
+#endif
+
+MemoryMappedFile::MemoryMappedFile(const void* data, size_t size)
+	: data(data)
+	, size(size)
+{
+}
+
+gsl::span<const gsl::byte> MemoryMappedFile::getSpan() const
+{
+	return gsl::span<const gsl::byte>(static_cast<const gsl::byte*>(data), size);
+}
+
+const char* MemoryMappedFile::getData() const
+{
+	return static_cast<const char*>(data);
+}
+
+size_t MemoryMappedFile::getSize() const
+{
+	return size;
+}
@@ -43,6 +43,14 @@ void BinaryFile::reload(Resource&& resource)
 	*this = std::move(dynamic_cast<BinaryFile&>(resource));
 }
 
+ResourceMemoryUsage BinaryFile::getMemoryUsage() const
+{
+	// Streamed files are read as they're used, so only the loaded bytes count
+	ResourceMemoryUsage usage;
+	usage.ramUsage = data.size();
+	return usage;
+}
+
 const Bytes& BinaryFile::getBytes() const
 {
 	Expects(!streaming);
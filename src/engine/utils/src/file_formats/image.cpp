@@ -403,6 +403,13 @@ void Image::reload(Resource&& resource)
 	*this = std::move(dynamic_cast<Image&>(resource));
 }
 
+ResourceMemoryUsage Image::getMemoryUsage() const
+{
+	ResourceMemoryUsage usage;
+	usage.ramUsage = getByteSize();
+	return usage;
+}
+
 void Image::serialize(Serializer& s) const
 {
 	s << w;
@@ -28,3 +28,10 @@ void TextFile::reload(Resource&& resource)
 {
 	*this = std::move(dynamic_cast<TextFile&>(resource));
 }
+
+ResourceMemoryUsage TextFile::getMemoryUsage() const
+{
+	ResourceMemoryUsage usage;
+	usage.ramUsage = data.size();
+	return usage;
+}
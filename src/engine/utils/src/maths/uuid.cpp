@@ -58,7 +58,7 @@ bool UUID::operator!=(const UUID& other) const
 
 bool UUID::operator<(const UUID& other) const
 {
-	return memcmp(bytes.data(), other.bytes.data(), size_t(bytes.size())) == -1;
+	return memcmp(bytes.data(), other.bytes.data(), size_t(bytes.size())) < 0;
 }
 
 String UUID::toString() const
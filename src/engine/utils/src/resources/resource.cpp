@@ -1,8 +1,23 @@
 #include "halley/resources/resource.h"
 #include "halley/support/exception.h"
+#include <algorithm>
 
 using namespace Halley;
 
+ResourceMemoryUsage& ResourceMemoryUsage::operator+=(const ResourceMemoryUsage& other)
+{
+	ramUsage += other.ramUsage;
+	vramUsage += other.vramUsage;
+	return *this;
+}
+
+ResourceMemoryUsage& ResourceMemoryUsage::operator-=(const ResourceMemoryUsage& other)
+{
+	ramUsage -= std::min(ramUsage, other.ramUsage);
+	vramUsage -= std::min(vramUsage, other.vramUsage);
+	return *this;
+}
+
 Resource::~Resource() = default;
 
 void Resource::setMeta(Metadata m)
@@ -51,6 +66,11 @@ void Resource::reloadResource(Resource&& resource)
 	reload(std::move(resource));
 }
 
+ResourceMemoryUsage Resource::getMemoryUsage() const
+{
+	return {};
+}
+
 void Resource::reload(Resource&& resource)
 {
 }
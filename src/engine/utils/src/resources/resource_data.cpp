@@ -33,6 +33,13 @@ ResourceDataStatic::ResourceDataStatic(const void* _data, size_t _size, String p
 	set(_data, _size, owning);
 }
 
+ResourceDataStatic::ResourceDataStatic(std::shared_ptr<const char> _data, size_t _size, String path)
+	: ResourceData(path)
+	, loaded(false)
+{
+	set(std::move(_data), _size);
+}
+
 static void deleter(const char* data)
 {
 	delete[] data;
@@ -49,6 +56,13 @@ void ResourceDataStatic::set(const void* _data, size_t _size, bool owning)
 	loaded = true;
 }
 
+void ResourceDataStatic::set(std::shared_ptr<const char> _data, size_t _size)
+{
+	data = std::move(_data);
+	size = _size;
+	loaded = true;
+}
+
 const void* ResourceDataStatic::getData() const
 {
 	if (!loaded) throw Exception("Resource data not yet loaded", HalleyExceptions::Resources);
@@ -141,15 +155,13 @@ ResourceLoader::ResourceLoader(IResourceLocator& locator, const String& name, As
 
 std::unique_ptr<ResourceDataStatic> ResourceLoader::getStatic()
 {
-	auto result = locator.getStatic(name, type);
+	if (prefetched) {
+		loaded = true;
+		return std::move(prefetched);
+	}
+
+	auto result = readStatic(locator, name, type, *metadata);
 	if (result) {
-		if (metadata->getString("asset_compression", "") == "deflate") {
-			try {
-				result->inflate();
-			} catch (Exception &e) {
-				throw Exception("Failed to load resource \"" + getName() + "\" due to inflate exception: " + e.what(), HalleyExceptions::Resources);
-			}
-		}
 		loaded = true;
 	}
 	return result;
@@ -164,20 +176,35 @@ std::unique_ptr<ResourceDataStream> ResourceLoader::getStream()
 	return result;
 }
 
-Future<std::unique_ptr<ResourceDataStatic>> ResourceLoader::getAsync() const
+Future<std::unique_ptr<ResourceDataStatic>> ResourceLoader::getAsync()
 {
+	if (prefetched) {
+		Promise<std::unique_ptr<ResourceDataStatic>> promise;
+		promise.setValue(std::move(prefetched));
+		return promise.getFuture();
+	}
+
 	std::reference_wrapper<IResourceLocator> loc = locator;
 	auto n = name;
 	auto t = type;
 	auto meta = getMeta();
-	return Concurrent::execute(Executors::getDiskIO(), [meta, loc, n, t] () -> std::unique_ptr<ResourceDataStatic>
+	return Concurrent::execute(Executors::getDiskIO(), getTaskPriority(priority), [meta, loc, n, t] () -> std::unique_ptr<ResourceDataStatic>
 	{
-		auto result = loc.get().getStatic(n, t);
-		if (meta.getString("asset_compression", "") == "deflate") {
+		return readStatic(loc.get(), n, t, meta);
+	});
+}
+
+std::unique_ptr<ResourceDataStatic> ResourceLoader::readStatic(IResourceLocator& locator, const String& name, AssetType type, const Metadata& meta)
+{
+	auto result = locator.getStatic(name, type);
+	if (result && meta.getString("asset_compression", "") == "deflate") {
+		try {
 			result->inflate();
+		} catch (Exception &e) {
+			throw Exception("Failed to load resource \"" + name + "\" due to inflate exception: " + e.what(), HalleyExceptions::Resources);
 		}
-		return result;
-	});
+	}
+	return result;
 }
 
 Resources& ResourceLoader::getResources() const
@@ -35,6 +35,7 @@ DX11Texture& DX11Texture::operator=(DX11Texture&& other) noexcept
 	samplerState = other.samplerState;
 	format = other.format;
 	size = other.size;
+	loadedMemoryUsage = other.loadedMemoryUsage;
 
 	other.texture = nullptr;
 	other.srv = nullptr;
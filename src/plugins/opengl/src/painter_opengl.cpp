@@ -8,6 +8,10 @@
 
 using namespace Halley;
 
+#if defined(WITH_OPENGL) || defined(WITH_OPENGL_ES3)
+	#define HAS_INSTANCING
+#endif
+
 PainterOpenGL::PainterOpenGL(Resources& resources)
 	: Painter(resources)
 {}
@@ -38,6 +42,9 @@ void PainterOpenGL::doStartRender()
 	vertexBuffer.init(GL_ARRAY_BUFFER);
 	elementBuffer.init(GL_ELEMENT_ARRAY_BUFFER);
 	stdQuadElementBuffer.init(GL_ELEMENT_ARRAY_BUFFER, GL_STATIC_DRAW);
+	quadVertPosBuffer.init(GL_ARRAY_BUFFER, GL_STATIC_DRAW);
+	listVertexBuffer.init(GL_ARRAY_BUFFER);
+	listElementBuffer.init(GL_ELEMENT_ARRAY_BUFFER);
 
 #ifdef WITH_OPENGL
 	if (vao == 0) {
@@ -143,14 +150,7 @@ void PainterOpenGL::setVertices(const MaterialDefinition& material, size_t numVe
 
 	// Load indices into VBO
 	if (standardQuadsOnly) {
-		if (stdQuadElementBuffer.getSize() < numIndices * sizeof(unsigned short)) {
-			size_t indicesToAllocate = nextPowerOf2(numIndices);
-			std::vector<unsigned short> tmp(indicesToAllocate);
-			generateQuadIndices(0, indicesToAllocate / 6, tmp.data());
-			stdQuadElementBuffer.setData(gsl::as_bytes(gsl::span<unsigned short>(tmp)));
-		} else {
-			stdQuadElementBuffer.bind();
-		}
+		setupStandardQuadIndices(numIndices);
 	} else {
 		elementBuffer.setData(gsl::as_bytes(gsl::span<unsigned short>(indices, numIndices)));
 	}
@@ -160,12 +160,101 @@ void PainterOpenGL::setVertices(const MaterialDefinition& material, size_t numVe
 	vertexBuffer.setData(gsl::as_bytes(gsl::span<char>(static_cast<char*>(vertexData), bytesSize)));
 
 	// Set attributes
-	setupVertexAttributes(material);
+	setupVertexAttributes(material, false, vertexBuffer);
+}
+
+void PainterOpenGL::setupStandardQuadIndices(size_t numIndices)
+{
+	if (stdQuadElementBuffer.getSize() < numIndices * sizeof(unsigned short)) {
+		size_t indicesToAllocate = nextPowerOf2(numIndices);
+		std::vector<unsigned short> tmp(indicesToAllocate);
+		generateQuadIndices(0, indicesToAllocate / 6, tmp.data());
+		stdQuadElementBuffer.setData(gsl::as_bytes(gsl::span<unsigned short>(tmp)));
+	} else {
+		stdQuadElementBuffer.bind();
+	}
+}
+
+bool PainterOpenGL::supportsInstancing() const
+{
+#ifdef HAS_INSTANCING
+	return true;
+#else
+	return false;
+#endif
 }
 
-void PainterOpenGL::setupVertexAttributes(const MaterialDefinition& material)
+void PainterOpenGL::setInstances(const MaterialDefinition& material, size_t numInstances, void* instanceData)
+{
+	Expects(numInstances > 0);
+	Expects(instanceData);
+
+	setupQuadVertPos();
+	setupStandardQuadIndices(6);
+
+	size_t bytesSize = numInstances * material.getVertexStride();
+	vertexBuffer.setData(gsl::as_bytes(gsl::span<char>(static_cast<char*>(instanceData), bytesSize)));
+
+	setupVertexAttributes(material, true, vertexBuffer);
+}
+
+void PainterOpenGL::setupQuadVertPos()
+{
+	// The corners of the quad, must match expandSpriteVertices in painter.cpp
+	if (quadVertPosBuffer.getSize() == 0) {
+		constexpr float vertPos[4][4] = { { 0, 0, 0, 0 }, { 1, 0, 1, 0 }, { 1, 1, 1, 1 }, { 0, 1, 0, 1 } };
+		quadVertPosBuffer.setData(gsl::as_bytes(gsl::span<const float>(&vertPos[0][0], 16)));
+	}
+}
+
+void PainterOpenGL::drawInstancedQuads(size_t numInstances)
+{
+#ifdef HAS_INSTANCING
+	glDrawElementsInstanced(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, nullptr, GLsizei(numInstances));
+	glCheckError();
+#endif
+}
+
+bool PainterOpenGL::supportsListUpload() const
+{
+	return true;
+}
+
+void PainterOpenGL::setListData(gsl::span<const char> vertexData, gsl::span<const IndexType> indices)
+{
+	Expects(!vertexData.empty());
+
+	listVertexBuffer.setData(gsl::as_bytes(vertexData));
+	if (!indices.empty()) {
+		listElementBuffer.setData(gsl::as_bytes(indices));
+	}
+}
+
+void PainterOpenGL::setListVertices(const MaterialDefinition& material, size_t vertexOffset, bool instanced)
+{
+	// The element buffer binding belongs to the VAO, so it's set again for every command, in case anything else drew in between
+	if (instanced) {
+		setupQuadVertPos();
+		setupStandardQuadIndices(6);
+	} else {
+		listElementBuffer.bind();
+	}
+	setupVertexAttributes(material, instanced, listVertexBuffer, vertexOffset);
+}
+
+void PainterOpenGL::drawListTriangles(size_t firstIndex, size_t numIndices)
+{
+	Expects(numIndices > 0);
+	Expects(numIndices % 3 == 0);
+
+	glDrawElements(GL_TRIANGLES, int(numIndices), GL_UNSIGNED_SHORT, reinterpret_cast<GLvoid*>(firstIndex * sizeof(IndexType)));
+	glCheckError();
+}
+
+void PainterOpenGL::setupVertexAttributes(const MaterialDefinition& material, bool instanced, GLBuffer& buffer, size_t baseOffset)
 {
 	// Set vertex attribute pointers in VBO
+	// When instanced, vertPos comes from the quad buffer and everything else advances once per instance
 	size_t vertexStride = material.getVertexStride();
 	for (auto& attribute : material.getAttributes()) {
 		int count = 0;
@@ -207,8 +296,17 @@ void PainterOpenGL::setupVertexAttributes(const MaterialDefinition& material)
 			break;
 		}
 		glEnableVertexAttribArray(attribute.location);
-		size_t offset = attribute.offset;
-		glVertexAttribPointer(attribute.location, count, type, GL_FALSE, GLsizei(vertexStride), reinterpret_cast<GLvoid*>(offset));
+		if (instanced && !attribute.instanced) {
+			quadVertPosBuffer.bind();
+			glVertexAttribPointer(attribute.location, count, type, GL_FALSE, GLsizei(4 * sizeof(float)), nullptr);
+		} else {
+			buffer.bind();
+			size_t offset = baseOffset + attribute.offset;
+			glVertexAttribPointer(attribute.location, count, type, GL_FALSE, GLsizei(vertexStride), reinterpret_cast<GLvoid*>(offset));
+		}
+#ifdef HAS_INSTANCING
+		glVertexAttribDivisor(attribute.location, instanced && attribute.instanced ? 1 : 0);
+#endif
 		glCheckError();
 	}
 
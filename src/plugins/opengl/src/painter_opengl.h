@@ -27,6 +27,13 @@ namespace Halley
 	protected:
 		void setVertices(const MaterialDefinition& material, size_t numVertices, void* vertexData, size_t numIndices, unsigned short* indices, bool standardQuadsOnly) override;
 		void drawTriangles(size_t numIndices) override;
+		bool supportsInstancing() const override;
+		void setInstances(const MaterialDefinition& material, size_t numInstances, void* instanceData) override;
+		void drawInstancedQuads(size_t numInstances) override;
+		bool supportsListUpload() const override;
+		void setListData(gsl::span<const char> vertexData, gsl::span<const IndexType> indices) override;
+		void setListVertices(const MaterialDefinition& material, size_t vertexOffset, bool instanced) override;
+		void drawListTriangles(size_t firstIndex, size_t numIndices) override;
 		void setViewPort(Rect4i rect) override;
 		void onUpdateProjection(Material& material) override;
 
@@ -37,8 +44,13 @@ namespace Halley
 		GLBuffer vertexBuffer;
 		GLBuffer elementBuffer;
 		GLBuffer stdQuadElementBuffer;
+		GLBuffer quadVertPosBuffer;
+		GLBuffer listVertexBuffer;
+		GLBuffer listElementBuffer;
 		std::unique_ptr<GLUtils> glUtils;
 
-		void setupVertexAttributes(const MaterialDefinition& material);
+		void setupVertexAttributes(const MaterialDefinition& material, bool instanced, GLBuffer& buffer, size_t baseOffset = 0);
+		void setupStandardQuadIndices(size_t numIndices);
+		void setupQuadVertPos();
 	};
 }
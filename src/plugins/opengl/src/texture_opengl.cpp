@@ -3,6 +3,7 @@
 #include "halley_gl.h"
 #include "texture_opengl.h"
 #include "halley/core/graphics/texture_descriptor.h"
+#include "halley/core/graphics/material/material.h"
 #include <gsl/gsl_assert>
 #include "video_opengl.h"
 #include "halley/support/logger.h"
@@ -33,6 +34,7 @@ TextureOpenGL& TextureOpenGL::operator=(TextureOpenGL&& other) noexcept
 
 	size = other.size;
 	textureId = other.textureId;
+	loadedMemoryUsage = other.loadedMemoryUsage;
 	texSize = other.texSize;
 
 	doneLoading();
@@ -44,6 +46,10 @@ void TextureOpenGL::doLoad(TextureDescriptor& d)
 {
 	GLUtils glUtils;
 	glUtils.bindTexture(textureId);
+	if (!parent.isLoaderThread()) {
+		// Replaces the texture bound by the last material, so it has to be bound again
+		Material::resetBindCache();
+	}
 	
 	if (texSize != d.size) {
 		create(d.size, d.format, d.useMipMap, d.useFiltering, d.addressMode, d.pixelData);
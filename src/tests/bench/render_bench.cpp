@@ -0,0 +1,398 @@
+#include <halley.hpp>
+#include <halley/core/graphics/render_command_list.h>
+#include <cstdio>
+#include "dummy_render_environment.h"
+
+// Headless benchmark of the render pipeline: synthetic scenes go through SpritePainter and Painter on the dummy video backend,
+// so it measures the CPU cost of rendering without needing a GPU
+// Usage: halley-bench-render [-n frames] [--no-instancing] [scene...]
+
+namespace Halley {
+	namespace {
+		// Counts the vertex and index data that would have been uploaded to the GPU
+		class BenchPainter final : public DummyPainter {
+		public:
+			size_t bytesUploaded = 0;
+
+			explicit BenchPainter(Resources& resources)
+				: DummyPainter(resources)
+			{}
+
+			void setVertices(const MaterialDefinition& material, size_t numVertices, void* vertexData, size_t numIndices, unsigned short* indices, bool standardQuadsOnly) override
+			{
+				bytesUploaded += numVertices * material.getVertexStride() + numIndices * sizeof(IndexType);
+				DummyPainter::setVertices(material, numVertices, vertexData, numIndices, indices, standardQuadsOnly);
+			}
+
+			void setInstances(const MaterialDefinition& material, size_t numInstances, void* instanceData) override
+			{
+				bytesUploaded += numInstances * material.getVertexStride();
+				DummyPainter::setInstances(material, numInstances, instanceData);
+			}
+
+			void setListData(gsl::span<const char> vertexData, gsl::span<const IndexType> indices) override
+			{
+				bytesUploaded += size_t(vertexData.size()) + size_t(indices.size()) * sizeof(IndexType);
+				DummyPainter::setListData(vertexData, indices);
+			}
+		};
+	}
+
+	class RenderBench {
+	public:
+		struct Scene {
+			String name;
+			std::function<void(Time)> update; // Optional
+			std::function<void(SpritePainter&)> populate; // Optional
+			std::function<void(Painter&)> paint; // Drawn directly into the painter, after the SpritePainter
+		};
+
+		RenderBench()
+		{
+			painter = std::make_unique<BenchPainter>(environment.getResources());
+			screenTarget = environment.getVideo().createScreenRenderTarget();
+			camera = std::make_unique<Camera>(Vector2f(1280, 720) * 0.5f);
+		}
+
+		Resources& getResources()
+		{
+			return environment.getResources();
+		}
+
+		void setInstancingEnabled(bool enabled)
+		{
+			painter->setInstancingEnabled(enabled);
+		}
+
+		void run(const Scene& scene, int frames)
+		{
+			Stopwatch updateTimer(false);
+			Stopwatch populateTimer(false);
+			Stopwatch paintTimer(false);
+			Stopwatch endTimer(false);
+			size_t drawCalls = 0;
+			size_t vertices = 0;
+			size_t mergedMaterialChanges = 0;
+			painter->bytesUploaded = 0;
+
+			// One extra warm-up frame, which isn't measured
+			for (int i = -1; i < frames; ++i) {
+				const bool measure = i >= 0;
+				painter->startRender();
+
+				if (scene.update) {
+					startTimer(updateTimer, measure);
+					scene.update(1.0 / 60.0);
+					updateTimer.pause();
+				}
+
+				startTimer(populateTimer, measure);
+				spritePainter.start();
+				if (scene.populate) {
+					scene.populate(spritePainter);
+				}
+				populateTimer.pause();
+
+				startTimer(paintTimer, measure);
+				RenderContext context(*painter, *camera, *screenTarget);
+				context.bind([&] (Painter& p)
+				{
+					spritePainter.draw(1, p);
+					if (scene.paint) {
+						scene.paint(p);
+					}
+				});
+				paintTimer.pause();
+
+				startTimer(endTimer, measure);
+				painter->endRender();
+				endTimer.pause();
+
+				if (measure) {
+					const auto& stats = painter->getPrevFrameStats();
+					drawCalls += stats.drawCalls;
+					vertices += stats.vertices;
+					mergedMaterialChanges += stats.mergedMaterialChanges;
+				} else {
+					painter->bytesUploaded = 0;
+				}
+			}
+
+			const auto perFrame = [&] (const Stopwatch& timer) { return double(timer.elapsedNanoseconds()) / (1000.0 * frames); };
+			const auto total = updateTimer.elapsedNanoseconds() + populateTimer.elapsedNanoseconds() + paintTimer.elapsedNanoseconds() + endTimer.elapsedNanoseconds();
+			printf("%-12s %10.1f %10.1f %10.1f %10.1f %10.1f %8zu %10zu %12zu %8zu\n", scene.name.c_str(),
+				perFrame(updateTimer), perFrame(populateTimer), perFrame(paintTimer), perFrame(endTimer), double(total) / (1000.0 * frames),
+				drawCalls / frames, vertices / frames, painter->bytesUploaded / frames, mergedMaterialChanges / frames);
+		}
+
+		static void printHeader()
+		{
+			printf("%-12s %10s %10s %10s %10s %10s %8s %10s %12s %8s\n", "scene", "update us", "populate", "paint", "end", "total", "draws", "vertices", "bytes", "merged");
+		}
+
+	private:
+		DummyRenderEnvironment environment;
+		std::unique_ptr<BenchPainter> painter;
+		std::unique_ptr<ScreenRenderTarget> screenTarget;
+		std::unique_ptr<Camera> camera;
+		SpritePainter spritePainter;
+
+		static void startTimer(Stopwatch& timer, bool measure)
+		{
+			if (measure) {
+				timer.start();
+			}
+		}
+
+	};
+}
+
+using namespace Halley;
+
+namespace {
+	constexpr int screenWidth = 1280;
+	constexpr int screenHeight = 720;
+
+	Vector2f randomPos(Random& rng)
+	{
+		return Vector2f(rng.getFloat(0.0f, float(screenWidth)), rng.getFloat(0.0f, float(screenHeight)));
+	}
+
+	Sprite makeSprite(Resources& resources, int image, Random& rng)
+	{
+		Sprite sprite;
+		sprite.setImage(resources.get<Texture>("test" + toString(image) + ".png"), resources.get<MaterialDefinition>("Halley/Sprite"));
+		sprite.setTexRect(Rect4f(0, 0, 1, 1));
+		sprite.setSize(Vector2f(32, 32));
+		sprite.setPivot(Vector2f(0.5f, 0.5f));
+		sprite.setPosition(randomPos(rng));
+		sprite.setRotation(Angle1f::fromRadians(rng.getFloat(0.0f, 6.28f)));
+		return sprite;
+	}
+
+	Vector<RenderBench::Scene> makeScenes(Resources& resources)
+	{
+		Vector<RenderBench::Scene> scenes;
+		auto rng = std::make_shared<Random>(1234);
+
+		// Lots of small sprites spread across a few textures and layers
+		{
+			auto sprites = std::make_shared<Vector<Sprite>>();
+			for (int i = 0; i < 20000; ++i) {
+				sprites->push_back(makeSprite(resources, i % 4, *rng));
+			}
+			scenes.push_back({ "sprites", {}, [=] (SpritePainter& sp)
+			{
+				for (size_t i = 0; i < sprites->size(); ++i) {
+					sp.add((*sprites)[i], 1, int(i / 4 % 8), float((*sprites)[i].getPosition().y));
+				}
+			}, {} });
+		}
+
+		// Nine-sliced panels, which each expand into nine quads
+		{
+			auto sprites = std::make_shared<Vector<Sprite>>();
+			for (int i = 0; i < 2000; ++i) {
+				auto sprite = makeSprite(resources, i % 2, *rng);
+				sprite.setRotation(Angle1f());
+				sprite.setSliced(Vector4s(8, 8, 8, 8));
+				sprite.setScale(Vector2f(rng->getFloat(1.0f, 4.0f), rng->getFloat(1.0f, 4.0f)));
+				sprites->push_back(sprite);
+			}
+			scenes.push_back({ "sliced", {}, [=] (SpritePainter& sp)
+			{
+				for (auto& sprite: *sprites) {
+					sp.add(sprite, 1, 0, 0);
+				}
+			}, {} });
+		}
+
+		// Text labels
+		{
+			auto font = resources.get<Font>("Test");
+			auto labels = std::make_shared<Vector<TextRenderer>>();
+			for (int i = 0; i < 1000; ++i) {
+				labels->push_back(TextRenderer(font, "Label " + toString(i) + ": the quick brown fox", 16).setPosition(randomPos(*rng)));
+			}
+			scenes.push_back({ "text", {}, [=] (SpritePainter& sp)
+			{
+				for (auto& label: *labels) {
+					sp.add(label, 1, 0, 0);
+				}
+			}, {} });
+		}
+
+		// Polylines and circles, drawn directly into the painter
+		{
+			auto lines = std::make_shared<Vector<Vector<Vector2f>>>();
+			for (int i = 0; i < 1000; ++i) {
+				auto& line = lines->emplace_back();
+				auto pos = randomPos(*rng);
+				for (int j = 0; j < 16; ++j) {
+					line.push_back(pos);
+					pos += Vector2f(rng->getFloat(-20.0f, 20.0f), rng->getFloat(-20.0f, 20.0f));
+				}
+			}
+			scenes.push_back({ "lines", {}, {}, [=] (Painter& painter)
+			{
+				for (size_t i = 0; i < lines->size(); ++i) {
+					painter.drawLine((*lines)[i], 2.0f, Colour4f(1, 1, 1, 1));
+					if (i % 4 == 0) {
+						painter.drawCircle((*lines)[i][0], 16.0f, 1.0f, Colour4f(1, 0, 0, 1));
+						painter.drawRect(Rect4f((*lines)[i][1], 8, 8), 1.0f, Colour4f(0, 1, 0, 1));
+					}
+				}
+			} });
+
+			// Same shapes, through the batched API
+			scenes.push_back({ "shapes", {}, {}, [=] (Painter& painter)
+			{
+				Vector<LineShape> lineShapes;
+				Vector<CircleShape> circles;
+				Vector<RectShape> rects;
+				for (size_t i = 0; i < lines->size(); ++i) {
+					lineShapes.push_back(LineShape{ (*lines)[i], 2.0f, Colour4f(1, 1, 1, 1) });
+					if (i % 4 == 0) {
+						circles.push_back(CircleShape{ (*lines)[i][0], Vector2f(16.0f, 16.0f), 1.0f, Colour4f(1, 0, 0, 1), std::nullopt });
+						rects.push_back(RectShape{ Rect4f((*lines)[i][1], 8, 8), 1.0f, Colour4f(0, 1, 0, 1) });
+					}
+				}
+				painter.drawLines(lineShapes);
+				painter.drawCircles(circles);
+				painter.drawRects(rects);
+			} });
+		}
+
+		// Particle emitters, simulated every frame
+		{
+			ConfigNode::MapType config;
+			config["spawnRate"] = 200.0f;
+			config["ttl"] = 2.0f;
+			config["speed"] = 50.0f;
+			config["directionScatter"] = 180.0f;
+			const auto configNode = ConfigNode(std::move(config));
+
+			auto emitters = std::make_shared<Vector<Particles>>();
+			for (int i = 0; i < 64; ++i) {
+				auto& particles = emitters->emplace_back(configNode, resources);
+				particles.setSeed(uint32_t(i));
+				particles.setPosition(randomPos(*rng));
+				particles.setSprites({ makeSprite(resources, i % 4, *rng) });
+			}
+			for (int i = 0; i < 120; ++i) {
+				for (auto& particles: *emitters) {
+					particles.update(1.0 / 60.0);
+				}
+			}
+			auto emitterPtrs = std::make_shared<Vector<Particles*>>();
+			for (auto& particles: *emitters) {
+				emitterPtrs->push_back(&particles);
+			}
+
+			scenes.push_back({ "particles", [=] (Time t)
+			{
+				Particles::update(*emitterPtrs, t);
+			}, [=] (SpritePainter& sp)
+			{
+				for (auto& particles: *emitters) {
+					sp.add(particles, 1, 0, 0);
+				}
+			}, {} });
+		}
+
+		// UI-like content: clipped panels, each with a sliced background, an icon and a label
+		{
+			struct Panel {
+				Sprite background;
+				Sprite icon;
+				TextRenderer label;
+				Rect4f clip;
+			};
+			auto font = resources.get<Font>("Test");
+			auto panels = std::make_shared<Vector<Panel>>();
+			for (int i = 0; i < 300; ++i) {
+				const auto pos = Vector2f(float((i % 20) * 64), float((i / 20) * 48));
+				auto& panel = panels->emplace_back();
+				panel.background = makeSprite(resources, 0, *rng);
+				panel.background.setRotation(Angle1f()).setPivot(Vector2f()).setPosition(pos).setSliced(Vector4s(4, 4, 4, 4)).setScale(Vector2f(2.0f, 1.5f));
+				panel.icon = makeSprite(resources, 1, *rng);
+				panel.icon.setRotation(Angle1f()).setPivot(Vector2f()).setPosition(pos + Vector2f(4, 4)).setScale(Vector2f(0.5f, 0.5f));
+				panel.label = TextRenderer(font, "Button " + toString(i), 12).setPosition(pos + Vector2f(24, 4));
+				panel.clip = Rect4f(pos, 64, 48);
+			}
+			scenes.push_back({ "ui", {}, [=] (SpritePainter& sp)
+			{
+				int layer = 0;
+				for (auto& panel: *panels) {
+					sp.add(panel.background, 1, layer, 0, panel.clip);
+					sp.add(panel.icon, 1, layer, 1, panel.clip);
+					sp.add(panel.label, 1, layer, 2, panel.clip);
+					++layer;
+				}
+			}, {} });
+		}
+
+		// A static layer, sorted and recorded once into a RenderCommandList, then replayed every frame
+		{
+			auto sprites = std::make_shared<Vector<Sprite>>();
+			for (int i = 0; i < 20000; ++i) {
+				sprites->push_back(makeSprite(resources, i % 4, *rng));
+			}
+			auto list = std::make_shared<RenderCommandList>();
+			scenes.push_back({ "recorded", {}, {}, [=] (Painter& painter)
+			{
+				if (!list->isRecorded()) {
+					SpritePainter layer;
+					layer.start();
+					for (auto& sprite: *sprites) {
+						layer.add(sprite, 1, 0, 0);
+					}
+					painter.startRecording(*list);
+					layer.draw(1, painter);
+					painter.stopRecording();
+				}
+				painter.draw(*list);
+			} });
+		}
+
+		return scenes;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	int frames = 100;
+	bool instancing = true;
+	Vector<String> filter;
+	for (int i = 1; i < argc; ++i) {
+		const auto arg = String(argv[i]);
+		if (arg == "-n" && i + 1 < argc) {
+			frames = std::max(1, String(argv[++i]).toInteger());
+		} else if (arg == "--no-instancing") {
+			instancing = false;
+		} else {
+			filter.push_back(arg);
+		}
+	}
+
+	HalleyStatics statics;
+	statics.resume(nullptr);
+
+	try {
+		RenderBench bench;
+		bench.setInstancingEnabled(instancing);
+		const auto scenes = makeScenes(bench.getResources());
+
+		printf("%d frames per scene, times are CPU microseconds per frame, counts are per frame\n", frames);
+		RenderBench::printHeader();
+		for (const auto& scene: scenes) {
+			if (filter.empty() || std::find(filter.begin(), filter.end(), scene.name) != filter.end()) {
+				bench.run(scene, frames);
+			}
+		}
+	} catch (const std::exception& e) {
+		fprintf(stderr, "%s\n", e.what());
+		return 1;
+	}
+	return 0;
+}
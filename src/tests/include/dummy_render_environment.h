@@ -0,0 +1,229 @@
+#pragma once
+
+#include <halley.hpp>
+#include <halley/core/resources/asset_pack.h>
+#include <halley/core/resources/standard_resources.h>
+#include <cstring>
+#include "dummy/dummy_system.h"
+#include "dummy/dummy_video.h"
+
+// Resources for headless tests and benchmarks of the render pipeline, on the dummy video backend
+// Materials and a font are served from an in-memory asset pack; textures are dummies, named test0.png to test3.png
+namespace Halley {
+	namespace RenderTest {
+		class MemoryDataReader final : public ResourceDataReader {
+		public:
+			explicit MemoryDataReader(gsl::span<const gsl::byte> data)
+				: data(data)
+			{}
+
+			size_t size() const override
+			{
+				return size_t(data.size());
+			}
+
+			int read(gsl::span<gsl::byte> dst) override
+			{
+				const size_t toRead = std::min(size_t(dst.size()), size() - pos);
+				memcpy(dst.data(), data.data() + pos, toRead);
+				pos += toRead;
+				return int(toRead);
+			}
+
+			void seek(int64_t offset, int whence) override
+			{
+				switch (whence) {
+				case SEEK_SET:
+					pos = size_t(offset);
+					break;
+				case SEEK_CUR:
+					pos = size_t(int64_t(pos) + offset);
+					break;
+				case SEEK_END:
+					pos = size_t(int64_t(size()) + offset);
+					break;
+				}
+			}
+
+			size_t tell() const override
+			{
+				return pos;
+			}
+
+			void close() override {}
+
+		private:
+			gsl::span<const gsl::byte> data;
+			size_t pos = 0;
+		};
+
+		class MemorySystemAPI final : public DummySystemAPI {
+		public:
+			Bytes pack;
+
+			std::unique_ptr<ResourceDataReader> getDataReader(String path, int64_t start, int64_t end) override
+			{
+				const auto span = gsl::as_bytes(gsl::span<const Byte>(pack));
+				const auto first = size_t(std::max(start, int64_t(0)));
+				const auto last = end < 0 ? size_t(span.size()) : size_t(end);
+				return std::make_unique<MemoryDataReader>(span.subspan(first, last - first));
+			}
+		};
+
+		inline ConfigNode makeAttribute(const String& name, const String& type, const String& semantic, const String& special = "")
+		{
+			ConfigNode::MapType result;
+			result["name"] = name;
+			result["type"] = type;
+			result["semantic"] = semantic;
+			if (!special.isEmpty()) {
+				result["special"] = special;
+			}
+			return result;
+		}
+
+		inline ConfigNode makeMaterialBase()
+		{
+			ConfigNode::MapType mvp;
+			mvp["u_mvp"] = "mat4";
+			ConfigNode::MapType block;
+			block["HalleyBlock"] = ConfigNode::SequenceType{ ConfigNode(std::move(mvp)) };
+
+			ConfigNode::MapType result;
+			result["name"] = "Halley/MaterialBase";
+			result["uniforms"] = ConfigNode::SequenceType{ ConfigNode(std::move(block)) };
+			return result;
+		}
+
+		// Mirrors shared_assets/material, which can't be imported without the tools
+		inline MaterialDefinition makeSpriteMaterial(const String& name)
+		{
+			ConfigNode::MapType sprite;
+			sprite["name"] = name;
+			sprite["instanced"] = true;
+			sprite["attributes"] = ConfigNode::SequenceType{
+				makeAttribute("vertPos", "vec4", "VERTPOS", "vertPos"),
+				makeAttribute("position", "vec2", "POSITION"),
+				makeAttribute("pivot", "vec2", "PIVOT"),
+				makeAttribute("size", "vec2", "SIZE"),
+				makeAttribute("scale", "vec2", "SCALE"),
+				makeAttribute("colour", "vec4", "COLOUR"),
+				makeAttribute("texCoord0", "vec4", "TEXCOORD0"),
+				makeAttribute("custom0", "vec4", "CUSTOM0"),
+				makeAttribute("custom1", "vec4", "CUSTOM1"),
+				makeAttribute("rotation", "float", "ROTATION"),
+				makeAttribute("textureRotation", "float", "TEXTUREROTATION")
+			};
+			ConfigNode::MapType tex;
+			tex["tex0"] = "sampler2D";
+			sprite["textures"] = ConfigNode::SequenceType{ ConfigNode(std::move(tex)) };
+
+			ConfigNode::MapType pass;
+			pass["blend"] = "AlphaPremultiplied";
+
+			MaterialDefinition result;
+			result.load(makeMaterialBase());
+			result.load(ConfigNode(std::move(sprite)));
+			result.addPass(MaterialPass(name, ConfigNode(std::move(pass))));
+			return result;
+		}
+
+		inline MaterialDefinition makeBaseMaterial()
+		{
+			MaterialDefinition result;
+			result.load(makeMaterialBase());
+			return result;
+		}
+
+		inline MaterialDefinition makeLineMaterial()
+		{
+			ConfigNode::MapType line;
+			line["name"] = "Halley/SolidLine";
+			line["attributes"] = ConfigNode::SequenceType{
+				makeAttribute("colour", "vec4", "COLOUR"),
+				makeAttribute("position", "vec2", "POSITION"),
+				makeAttribute("normal", "vec2", "NORMAL"),
+				makeAttribute("width", "vec2", "WIDTH")
+			};
+
+			ConfigNode::MapType pass;
+			pass["blend"] = "AlphaPremultiplied";
+
+			MaterialDefinition result;
+			result.load(makeMaterialBase());
+			result.load(ConfigNode(std::move(line)));
+			result.addPass(MaterialPass("Halley/SolidLine", ConfigNode(std::move(pass))));
+			return result;
+		}
+
+		inline Font makeFont()
+		{
+			Font font("Test", "test_font.png", 14, 18, 16, 1, Vector2i(256, 256));
+			for (int c = 32; c < 127; ++c) {
+				const int idx = c - 32;
+				const auto pos = Vector2f(float(idx % 16), float(idx / 16)) / 16.0f;
+				font.addGlyph(Font::Glyph(c, Rect4f(pos, pos + Vector2f(1, 1) / 16.0f), Vector2f(10, 16), Vector2f(1, 14), Vector2f(), Vector2f(11, 0)));
+			}
+			return font;
+		}
+
+		inline Bytes makePack()
+		{
+			AssetPack pack;
+			auto add = [&] (const String& name, AssetType type, const Bytes& bytes)
+			{
+				pack.addAsset(type, name, gsl::as_bytes(gsl::span<const Byte>(bytes)), Metadata());
+			};
+
+			add("Halley/MaterialBase", AssetType::MaterialDefinition, Serializer::toBytes(makeBaseMaterial()));
+			add("Halley/Sprite", AssetType::MaterialDefinition, Serializer::toBytes(makeSpriteMaterial("Halley/Sprite")));
+			add("Halley/SolidLine", AssetType::MaterialDefinition, Serializer::toBytes(makeLineMaterial()));
+			add("Test", AssetType::Font, Serializer::toBytes(makeFont()));
+
+			return pack.writeOut();
+		}
+	}
+
+	class DummyRenderEnvironment {
+	public:
+		DummyRenderEnvironment()
+		{
+			system = std::make_unique<RenderTest::MemorySystemAPI>();
+			video = std::make_unique<DummyVideoAPI>(*system);
+			video->setWindow(WindowDefinition(WindowType::Window, Vector2i(1280, 720), "Render test"));
+
+			api = std::make_unique<HalleyAPI>();
+			api->system = system.get();
+			api->video = video.get();
+
+			system->pack = RenderTest::makePack();
+			auto locator = std::make_unique<ResourceLocator>(*system);
+			locator->addPack(Path("test.dat"), "", true);
+			resources = std::make_unique<Resources>(std::move(locator), *api, Resources::Options());
+			StandardResources::initialize(*resources);
+
+			for (const auto& name: { "Halley/Sprite", "Halley/SolidLine" }) {
+				resources->of<ShaderFile>().setResource(0, String(name) + ":" + video->getShaderLanguage(), std::make_shared<ShaderFile>());
+			}
+			for (const auto& name: { "whitebox.png", "test_font.png", "test0.png", "test1.png", "test2.png", "test3.png" }) {
+				resources->of<Texture>().setResource(0, name, std::make_shared<DummyTexture>(Vector2i(256, 256)));
+			}
+		}
+
+		Resources& getResources()
+		{
+			return *resources;
+		}
+
+		VideoAPI& getVideo()
+		{
+			return *video;
+		}
+
+	private:
+		std::unique_ptr<RenderTest::MemorySystemAPI> system;
+		std::unique_ptr<DummyVideoAPI> video;
+		std::unique_ptr<HalleyAPI> api;
+		std::unique_ptr<Resources> resources;
+	};
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <halley.hpp>
+#include <halley/entity/component_reflector.h>
+#include <halley/entity/registry.h>
+
+// Components and a world for headless tests of the entity system
+// The components' reflectors are registered in test_world.cpp, which also provides the createSystem and getComponentReflector the engine expects
+namespace Halley {
+	namespace WorldTest {
+		// Indices after the engine's own components, which every world knows about
+		// Serialized in binary
+		class PositionComponent final : public Component {
+		public:
+			static constexpr int componentIndex{ 5 };
+			static const constexpr char* componentName{ "Position" };
+
+			float x = 0;
+
+			PositionComponent() = default;
+			explicit PositionComponent(float x) : x(x) {}
+
+			ConfigNode serialize(ConfigNodeSerializationContext& context) const { return ConfigNode(x); }
+			void deserialize(ConfigNodeSerializationContext& context, const ConfigNode& node) { x = node.asFloat(0); }
+			void serialize(Serializer& s) const { s << x; }
+			void deserialize(Deserializer& s) { s >> x; }
+		};
+
+		// Serialized in binary, with a reference to another entity
+		class OwnerComponent final : public Component {
+		public:
+			static constexpr int componentIndex{ 6 };
+			static const constexpr char* componentName{ "Owner" };
+
+			EntityId owner;
+
+			OwnerComponent() = default;
+			explicit OwnerComponent(EntityId owner) : owner(owner) {}
+
+			ConfigNode serialize(ConfigNodeSerializationContext& context) const { return ConfigNode(EntityId::toUUID(owner, context)); }
+			void deserialize(ConfigNodeSerializationContext& context, const ConfigNode& node) { owner = EntityId::fromUUID(node.asString(""), context); }
+			void serialize(Serializer& s) const { s << owner; }
+			void deserialize(Deserializer& s) { s >> owner; }
+		};
+
+		// Only serializable through ConfigNode, so its reference goes through the UUID path
+		class LinkComponent final : public Component {
+		public:
+			static constexpr int componentIndex{ 7 };
+			static const constexpr char* componentName{ "Link" };
+
+			EntityId target;
+
+			LinkComponent() = default;
+			explicit LinkComponent(EntityId target) : target(target) {}
+
+			ConfigNode serialize(ConfigNodeSerializationContext& context) const { return ConfigNode(EntityId::toUUID(target, context)); }
+			void deserialize(ConfigNodeSerializationContext& context, const ConfigNode& node) { target = EntityId::fromUUID(node.asString(""), context); }
+		};
+
+		class TestCore final : public CoreAPI {
+		public:
+			void quit(int exitCode) override {}
+			void setStage(StageID stage) override {}
+			void setStage(std::unique_ptr<Stage> stage) override {}
+			void initStage(Stage& stage) override {}
+			Stage& getCurrentStage() override { throw Exception("No stage", HalleyExceptions::Core); }
+			HalleyStatics& getStatics() override { throw Exception("No statics", HalleyExceptions::Core); }
+			const Environment& getEnvironment() override { throw Exception("No environment", HalleyExceptions::Core); }
+			int64_t getTime(CoreAPITimer timer, TimeLine tl, StopwatchRollingAveraging::Mode mode) const override { return 0; }
+			void setTimerPaused(CoreAPITimer timer, TimeLine tl, bool paused) override {}
+			bool isDevMode() override { return false; }
+		};
+	}
+
+	// Worlds never touch resources unless components load assets, which these don't
+	class TestWorldEnvironment {
+	public:
+		TestWorldEnvironment()
+		{
+			api.core = &core;
+			world = std::make_unique<World>(api, *reinterpret_cast<Resources*>(noResources.data()), false, CreateComponentFunction());
+		}
+
+		World& getWorld()
+		{
+			return *world;
+		}
+
+	private:
+		WorldTest::TestCore core;
+		HalleyAPI api;
+		alignas(std::max_align_t) std::array<char, sizeof(void*)> noResources;
+		std::unique_ptr<World> world;
+	};
+}
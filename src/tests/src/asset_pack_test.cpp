@@ -0,0 +1,168 @@
+#include <gtest/gtest.h>
+#include <halley.hpp>
+#include <halley/core/resources/asset_pack.h>
+#include <halley/core/resources/asset_database.h>
+#include <halley/bytes/compression.h>
+#include <cstring>
+
+using namespace Halley;
+
+namespace {
+	class BytesDataReader final : public ResourceDataReader {
+	public:
+		explicit BytesDataReader(Bytes bytes)
+			: bytes(std::move(bytes))
+		{}
+
+		size_t size() const override
+		{
+			return bytes.size();
+		}
+
+		int read(gsl::span<gsl::byte> dst) override
+		{
+			const size_t toRead = std::min(size_t(dst.size()), bytes.size() - std::min(pos, bytes.size()));
+			memcpy(dst.data(), bytes.data() + pos, toRead);
+			pos += toRead;
+			return int(toRead);
+		}
+
+		void seek(int64_t offset, int whence) override
+		{
+			switch (whence) {
+			case SEEK_SET:
+				pos = size_t(offset);
+				break;
+			case SEEK_CUR:
+				pos = size_t(int64_t(pos) + offset);
+				break;
+			case SEEK_END:
+				pos = size_t(int64_t(bytes.size()) + offset);
+				break;
+			}
+		}
+
+		size_t tell() const override
+		{
+			return pos;
+		}
+
+		void close() override {}
+
+	private:
+		Bytes bytes;
+		size_t pos = 0;
+	};
+
+	std::unique_ptr<ResourceDataReader> makeReader(const Bytes& bytes)
+	{
+		return std::make_unique<BytesDataReader>(bytes);
+	}
+
+	gsl::span<const gsl::byte> asBytes(const String& str)
+	{
+		return gsl::as_bytes(gsl::span<const char>(str.c_str(), str.size()));
+	}
+
+	String getString(AssetPack& pack, const String& name, AssetType type)
+	{
+		const auto data = pack.getData(name, type, false);
+		return static_cast<ResourceDataStatic&>(*data).getString();
+	}
+
+	// Some are long and repetitive enough to be stored compressed
+	String makeContents(int index)
+	{
+		return "data " + toString(index) + String(std::string(size_t(index % 3) * 100, 'x'));
+	}
+
+	Metadata makeMeta(int index)
+	{
+		Metadata meta;
+		meta.set("index", index);
+		return meta;
+	}
+
+	// Checks every asset added by addAssets(pack, first, n)
+	void checkAssets(AssetPack& pack, int first, int n)
+	{
+		for (int i = first; i < first + n; ++i) {
+			const auto type = i % 2 == 0 ? AssetType::BinaryFile : AssetType::Sprite;
+			EXPECT_EQ(getString(pack, "asset" + toString(i), type), makeContents(i));
+			EXPECT_EQ(pack.getMetaData("asset" + toString(i), type).getInt("index"), i);
+		}
+	}
+
+	void addAssets(AssetPack& pack, int first, int n)
+	{
+		for (int i = first; i < first + n; ++i) {
+			const auto type = i % 2 == 0 ? AssetType::BinaryFile : AssetType::Sprite;
+			const auto compression = i % 3 == 2 ? AssetPackCompression::Deflate : AssetPackCompression::None;
+			pack.addAsset(type, "asset" + toString(i), asBytes(makeContents(i)), makeMeta(i), compression);
+		}
+	}
+
+	// Version 1 packs were a 40-byte header, followed by the compressed asset database, then the data
+	Bytes makeVersion1Pack(int n)
+	{
+		AssetDatabase db;
+		Bytes data;
+		for (int i = 0; i < n; ++i) {
+			const auto type = i % 2 == 0 ? AssetType::BinaryFile : AssetType::Sprite;
+			const auto str = makeContents(i);
+			db.addAsset("asset" + toString(i), type, AssetDatabase::Entry(toString(data.size()) + ":" + toString(str.size()), makeMeta(i)));
+			data.insert(data.end(), reinterpret_cast<const Byte*>(str.c_str()), reinterpret_cast<const Byte*>(str.c_str()) + str.size());
+		}
+		const auto dbBytes = Compression::compress(Serializer::toBytes(db));
+
+		const uint64_t dbStart = AssetPackHeader::legacySize;
+		const uint64_t dataStart = dbStart + dbBytes.size();
+		Bytes result(size_t(dataStart) + data.size());
+		memset(result.data(), 0, result.size());
+		memcpy(result.data(), "HALLEYPK", 8);
+		memcpy(result.data() + 24, &dbStart, sizeof(dbStart));
+		memcpy(result.data() + 32, &dataStart, sizeof(dataStart));
+		memcpy(result.data() + dbStart, dbBytes.data(), dbBytes.size());
+		memcpy(result.data() + dataStart, data.data(), data.size());
+		return result;
+	}
+}
+
+TEST(HalleyAssetPack, Version2RoundTrip)
+{
+	AssetPack original;
+	addAssets(original, 0, 50);
+	const auto bytes = original.writeOut();
+
+	for (const bool preLoad: { false, true }) {
+		AssetPack pack(makeReader(bytes), "", preLoad);
+		EXPECT_EQ(pack.getVersion(), 2u);
+		EXPECT_EQ(pack.getAssets().size(), size_t(50));
+		checkAssets(pack, 0, 50);
+		EXPECT_THROW(pack.getData("asset1", AssetType::BinaryFile, false), Exception);
+
+		// Assets added after reading are found next to the ones from the file, and written out with them
+		addAssets(pack, 50, 10);
+		checkAssets(pack, 0, 60);
+		EXPECT_EQ(pack.getAssets().size(), size_t(60));
+
+		AssetPack reread(makeReader(pack.writeOut()));
+		checkAssets(reread, 0, 60);
+	}
+}
+
+TEST(HalleyAssetPack, Version1RoundTrip)
+{
+	AssetPack pack(makeReader(makeVersion1Pack(20)));
+	EXPECT_EQ(pack.getVersion(), 1u);
+	EXPECT_EQ(pack.getAssets().size(), size_t(20));
+	checkAssets(pack, 0, 20);
+
+	addAssets(pack, 20, 10);
+	checkAssets(pack, 0, 30);
+
+	// Written out in the current version
+	AssetPack reread(makeReader(pack.writeOut()));
+	EXPECT_EQ(reread.getVersion(), AssetPackHeader::currentVersion);
+	checkAssets(reread, 0, 30);
+}
@@ -0,0 +1,92 @@
+#include <gtest/gtest.h>
+#include <halley.hpp>
+#include <halley/bytes/compression.h>
+
+using namespace Halley;
+
+namespace {
+	gsl::span<const gsl::byte> asBytes(const Bytes& bytes)
+	{
+		return gsl::as_bytes(gsl::span<const Byte>(bytes));
+	}
+
+	Bytes makeRepetitive(size_t size)
+	{
+		Bytes result(size);
+		for (size_t i = 0; i < size; ++i) {
+			result[i] = Byte((i / 7) % 13);
+		}
+		return result;
+	}
+
+	// Doesn't compress, so the output is slightly bigger than the input
+	Bytes makeRandom(size_t size)
+	{
+		Random rng(1);
+		Bytes result(size);
+		rng.getBytes(gsl::as_writable_bytes(gsl::span<Byte>(result)));
+		return result;
+	}
+
+	void checkRoundTrip(const Bytes& original)
+	{
+		const auto compressed = Compression::compress(original);
+		EXPECT_EQ(Compression::getDecompressedSize(asBytes(compressed)), original.size());
+		EXPECT_EQ(Compression::decompress(compressed), original);
+
+		size_t size = 0;
+		const auto shared = Compression::decompressToSharedPtr(asBytes(compressed), size);
+		ASSERT_EQ(size, original.size());
+		EXPECT_TRUE(size == 0 || memcmp(shared.get(), original.data(), size) == 0);
+
+		Bytes into(original.size());
+		Compression::decompressInto(asBytes(compressed), gsl::as_writable_bytes(gsl::span<Byte>(into)));
+		EXPECT_EQ(into, original);
+
+		// Without the length, decompression grows the result as it goes
+		const auto raw = Compression::compressRaw(asBytes(original), false);
+		EXPECT_EQ(Compression::decompressRaw(asBytes(raw), std::numeric_limits<size_t>::max()), original);
+	}
+}
+
+TEST(HalleyCompression, RoundTrip)
+{
+	checkRoundTrip(Bytes());
+	checkRoundTrip(Bytes{ 1, 2, 3 });
+	checkRoundTrip(makeRepetitive(1000));
+	checkRoundTrip(makeRepetitive(3 * 1024 * 1024));
+	checkRoundTrip(makeRandom(1024 * 1024));
+}
+
+TEST(HalleyCompression, CompressesRepetitiveData)
+{
+	const auto original = makeRepetitive(1024 * 1024);
+	for (const int level: { 1, 9, -1 }) {
+		const auto compressed = Compression::compress(asBytes(original), level);
+		EXPECT_LT(compressed.size(), original.size() / 10);
+		EXPECT_EQ(Compression::decompress(compressed), original);
+	}
+}
+
+TEST(HalleyCompression, MaxSizeIsEnforced)
+{
+	const auto original = makeRepetitive(1024 * 1024);
+	const auto compressed = Compression::compress(original);
+	EXPECT_THROW(Compression::decompress(compressed, original.size() - 1), Exception);
+	size_t size = 0;
+	EXPECT_THROW(Compression::decompressToSharedPtr(asBytes(compressed), size, original.size() - 1), Exception);
+
+	const auto raw = Compression::compressRaw(asBytes(original), false);
+	EXPECT_THROW(Compression::decompressRaw(asBytes(raw), original.size() - 1), Exception);
+	EXPECT_EQ(Compression::decompressRaw(asBytes(raw), original.size()), original);
+}
+
+TEST(HalleyCompression, CorruptDataThrows)
+{
+	auto compressed = Compression::compress(makeRandom(1000));
+	compressed.resize(compressed.size() / 2);
+	EXPECT_THROW(Compression::decompress(compressed), Exception);
+
+	Bytes into(1000);
+	EXPECT_THROW(Compression::decompressInto(asBytes(compressed), gsl::as_writable_bytes(gsl::span<Byte>(into))), Exception);
+}
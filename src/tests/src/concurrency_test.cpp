@@ -0,0 +1,187 @@
+#include <gtest/gtest.h>
+#include <halley.hpp>
+#include <halley/concurrency/work_stealing_deque.h>
+#include <thread>
+
+using namespace Halley;
+
+namespace {
+	// The deque only stores pointers, so tests use addresses in this array as task identities
+	std::vector<TaskBase> makeTasks(size_t n)
+	{
+		std::vector<TaskBase> tasks;
+		tasks.reserve(n);
+		for (size_t i = 0; i < n; ++i) {
+			tasks.emplace_back([] () {});
+		}
+		return tasks;
+	}
+}
+
+TEST(HalleyWorkStealingDeque, PopIsLifoStealIsFifo)
+{
+	auto tasks = makeTasks(3);
+	WorkStealingDeque deque;
+	for (auto& t: tasks) {
+		deque.push(&t);
+	}
+
+	EXPECT_EQ(deque.steal(), &tasks[0]);
+	EXPECT_EQ(deque.pop(), &tasks[2]);
+	EXPECT_EQ(deque.pop(), &tasks[1]);
+	EXPECT_EQ(deque.pop(), nullptr);
+	EXPECT_EQ(deque.steal(), nullptr);
+}
+
+TEST(HalleyWorkStealingDeque, Grow)
+{
+	constexpr size_t n = 5000;
+	auto tasks = makeTasks(n);
+	WorkStealingDeque deque;
+
+	// Interleave with steals, so the live range wraps around the buffer as it grows
+	size_t stolen = 0;
+	for (size_t i = 0; i < n; ++i) {
+		deque.push(&tasks[i]);
+		if (i % 3 == 0) {
+			EXPECT_EQ(deque.steal(), &tasks[stolen]);
+			++stolen;
+		}
+	}
+	for (size_t i = n; i > stolen; --i) {
+		EXPECT_EQ(deque.pop(), &tasks[i - 1]);
+	}
+	EXPECT_EQ(deque.pop(), nullptr);
+}
+
+TEST(HalleyWorkStealingDeque, ConcurrentStealers)
+{
+	constexpr size_t n = 200000;
+	constexpr size_t nStealers = 4;
+	auto tasks = makeTasks(n);
+	std::vector<std::atomic<int>> taken(n);
+	for (auto& t: taken) {
+		t = 0;
+	}
+
+	WorkStealingDeque deque;
+	std::atomic<bool> done(false);
+	std::atomic<size_t> totalTaken(0);
+	const auto take = [&] (TaskBase* task)
+	{
+		++taken[size_t(task - tasks.data())];
+		++totalTaken;
+	};
+
+	std::vector<std::thread> stealers;
+	for (size_t i = 0; i < nStealers; ++i) {
+		stealers.emplace_back([&] ()
+		{
+			while (!done) {
+				if (auto* task = deque.steal()) {
+					take(task);
+				}
+			}
+		});
+	}
+
+	// The owner pushes in bursts and pops some back, racing the stealers for the last element
+	for (size_t i = 0; i < n; ++i) {
+		deque.push(&tasks[i]);
+		if (i % 7 == 0) {
+			for (int j = 0; j < 3; ++j) {
+				if (auto* task = deque.pop()) {
+					take(task);
+				}
+			}
+		}
+	}
+	while (auto* task = deque.pop()) {
+		take(task);
+	}
+	while (totalTaken < n) {
+		std::this_thread::yield();
+	}
+	done = true;
+	for (auto& t: stealers) {
+		t.join();
+	}
+
+	EXPECT_EQ(totalTaken.load(), n);
+	for (size_t i = 0; i < n; ++i) {
+		EXPECT_EQ(taken[i].load(), 1) << "Task " << i;
+	}
+}
+
+TEST(HalleyFuture, WaitBlocksWithoutHelping)
+{
+	ExecutionQueue queue;
+	bool ran = false;
+	queue.addToQueue(TaskBase([&] () { ran = true; }));
+
+	Promise<int> promise;
+	auto future = promise.getFuture();
+	std::thread setter([&] ()
+	{
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		promise.setValue(42);
+	});
+	EXPECT_EQ(future.get(), 42);
+	setter.join();
+
+	// The default wait doesn't touch any queue
+	EXPECT_FALSE(ran);
+	EXPECT_TRUE(queue.runOne());
+	EXPECT_TRUE(ran);
+}
+
+TEST(HalleyFuture, WaitHelpsWhenAsked)
+{
+	ExecutionQueue queue;
+	Promise<int> promise;
+	auto future = promise.getFuture();
+
+	// The only task that can fulfil the promise is in the queue, so waiting would deadlock without helping
+	queue.addToQueue(TaskBase([&] () { promise.setValue(7); }));
+	future.wait(queue);
+	EXPECT_EQ(future.get(), 7);
+}
+
+TEST(HalleyExecutionQueue, ExternalTasksRunByPriority)
+{
+	// Queued from a thread that isn't one of the queue's executors, so they all go to the shared FIFOs
+	ExecutionQueue queue;
+	std::vector<int> order;
+	const std::pair<int, TaskPriority> tasks[] = {
+		{ 0, TaskPriority::Low }, { 1, TaskPriority::Normal }, { 2, TaskPriority::High },
+		{ 3, TaskPriority::Normal }, { 4, TaskPriority::High }, { 5, TaskPriority::Low }
+	};
+	for (const auto& [id, priority]: tasks) {
+		queue.addToQueue(TaskBase([&order, id = id] () { order.push_back(id); }), priority);
+	}
+
+	while (queue.runOne()) {}
+	EXPECT_EQ(order, std::vector<int>({ 2, 4, 1, 3, 0, 5 }));
+}
+
+TEST(HalleyExecutionQueue, RunPendingIsCapped)
+{
+	ExecutionQueue queue;
+	int ran = 0;
+	for (int i = 0; i < 10; ++i) {
+		queue.addToQueue(TaskBase([&] () { ++ran; }));
+	}
+
+	EXPECT_EQ(queue.runPending(std::chrono::seconds(10), 3), size_t(3));
+	EXPECT_EQ(ran, 3);
+
+	// Out of time after the first one, but that one always runs
+	EXPECT_EQ(queue.runPending(std::chrono::microseconds(0)), size_t(1));
+	EXPECT_EQ(ran, 4);
+
+	// Tasks queued while running are picked up in the same call
+	queue.addToQueue(TaskBase([&] () { queue.addToQueue(TaskBase([&] () { ++ran; })); }));
+	EXPECT_EQ(queue.runPending(std::chrono::seconds(10)), size_t(8));
+	EXPECT_EQ(ran, 11);
+	EXPECT_EQ(queue.runPending(std::chrono::seconds(10)), size_t(0));
+}
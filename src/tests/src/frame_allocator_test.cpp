@@ -0,0 +1,68 @@
+#include <gtest/gtest.h>
+#include <halley.hpp>
+#include <halley/data_structures/frame_allocator.h>
+
+using namespace Halley;
+
+namespace {
+	bool isAligned(const void* p, size_t alignment)
+	{
+		return reinterpret_cast<uintptr_t>(p) % alignment == 0;
+	}
+}
+
+TEST(HalleyFrameAllocator, Alignment)
+{
+	FrameAllocator allocator(256);
+	for (size_t alignment = 1; alignment <= 256; alignment *= 2) {
+		// An odd-sized allocation first, so the offset is never aligned by accident
+		allocator.alloc(3, 1);
+		EXPECT_TRUE(isAligned(allocator.alloc(5, alignment), alignment)) << "Alignment " << alignment;
+	}
+
+	const auto doubles = allocator.alloc<double>(7);
+	EXPECT_TRUE(isAligned(doubles.data(), alignof(double)));
+	EXPECT_TRUE(isAligned(allocator.alloc(1), alignof(std::max_align_t)));
+}
+
+TEST(HalleyFrameAllocator, GrowsAndMergesOnReset)
+{
+	FrameAllocator allocator(128);
+	EXPECT_EQ(allocator.getCapacity(), size_t(0));
+
+	// More than the first block, so it has to add more
+	auto first = allocator.alloc<int>(10);
+	auto second = allocator.alloc<int>(1000);
+	for (int i = 0; i < 10; ++i) {
+		first[i] = i;
+	}
+	for (int i = 0; i < 1000; ++i) {
+		second[i] = -i;
+	}
+	for (int i = 0; i < 10; ++i) {
+		EXPECT_EQ(first[i], i);
+	}
+	EXPECT_EQ(second[999], -999);
+
+	const auto used = allocator.getUsed();
+	const auto capacity = allocator.getCapacity();
+	EXPECT_GE(used, 1010 * sizeof(int));
+	EXPECT_GE(capacity, used);
+	EXPECT_EQ(allocator.getPeakUsed(), used);
+
+	// The blocks are merged into one, with the same total capacity, so the same frame fits without growing
+	allocator.reset();
+	EXPECT_EQ(allocator.getUsed(), size_t(0));
+	EXPECT_EQ(allocator.getCapacity(), capacity);
+	EXPECT_EQ(allocator.getPeakUsed(), used);
+
+	const auto* a = allocator.alloc<int>(10).data();
+	const auto* b = allocator.alloc<int>(1000).data();
+	EXPECT_EQ(allocator.getCapacity(), capacity);
+	EXPECT_EQ(reinterpret_cast<const char*>(b) - reinterpret_cast<const char*>(a), ptrdiff_t(10 * sizeof(int)));
+
+	// A smaller frame leaves the peak alone
+	allocator.reset();
+	allocator.alloc(16);
+	EXPECT_EQ(allocator.getPeakUsed(), used);
+}
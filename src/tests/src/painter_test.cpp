@@ -0,0 +1,310 @@
+#include <gtest/gtest.h>
+#include <halley.hpp>
+#include <halley/core/graphics/render_command_list.h>
+#include "dummy_render_environment.h"
+
+using namespace Halley;
+
+namespace {
+	// Records what the backend is asked to upload and draw
+	class RecordingPainter final : public DummyPainter {
+	public:
+		struct Draw {
+			size_t vertexOffset; // Into the list's vertex data, when drawing from an uploaded list
+			size_t firstIndex;
+			size_t numIndices; // Zero for instanced draws
+			size_t numInstances;
+		};
+
+		size_t vertexUploads = 0;
+		size_t instanceUploads = 0;
+		size_t listUploads = 0;
+		size_t listIndices = 0;
+		size_t materialBinds = 0;
+		Vector<Draw> draws;
+		Vector<SpriteVertexAttrib> lastVertices; // Of the last setVertices, for sprite materials
+		bool cpuInstancing = false; // Use Painter's own expansion of instances, as backends without instancing do
+
+		explicit RecordingPainter(Resources& resources)
+			: DummyPainter(resources)
+		{}
+
+		void reset()
+		{
+			vertexUploads = instanceUploads = listUploads = listIndices = materialBinds = 0;
+			draws.clear();
+		}
+
+		void setMaterialPass(const Material&, int) override
+		{
+			++materialBinds;
+		}
+
+		void setVertices(const MaterialDefinition& material, size_t numVertices, void* vertexData, size_t, unsigned short*, bool) override
+		{
+			++vertexUploads;
+			vertexOffset = 0;
+			if (material.getVertexStride() == sizeof(SpriteVertexAttrib)) {
+				const auto* vertices = static_cast<const SpriteVertexAttrib*>(vertexData);
+				lastVertices.assign(vertices, vertices + numVertices);
+			}
+		}
+
+		void drawTriangles(size_t numIndices) override
+		{
+			draws.push_back(Draw{ vertexOffset, 0, numIndices, 0 });
+		}
+
+		void setInstances(const MaterialDefinition& material, size_t numInstances, void* instanceData) override
+		{
+			++instanceUploads;
+			vertexOffset = 0;
+			if (cpuInstancing) {
+				Painter::setInstances(material, numInstances, instanceData);
+			}
+		}
+
+		void drawInstancedQuads(size_t numInstances) override
+		{
+			if (cpuInstancing) {
+				Painter::drawInstancedQuads(numInstances);
+			} else {
+				draws.push_back(Draw{ vertexOffset, 0, 0, numInstances });
+			}
+		}
+
+		void setListData(gsl::span<const char>, gsl::span<const IndexType> indices) override
+		{
+			++listUploads;
+			listIndices = size_t(indices.size());
+		}
+
+		void setListVertices(const MaterialDefinition&, size_t offset, bool) override
+		{
+			vertexOffset = offset;
+		}
+
+		void drawListTriangles(size_t firstIndex, size_t numIndices) override
+		{
+			draws.push_back(Draw{ vertexOffset, firstIndex, numIndices, 0 });
+		}
+
+	private:
+		size_t vertexOffset = 0;
+	};
+
+	// Binds itself when loaded, as TextureOpenGL does
+	class BindingTexture final : public Texture {
+	public:
+		using Texture::Texture;
+
+		void doLoad(TextureDescriptor&) override
+		{
+			Material::resetBindCache();
+			doneLoading();
+		}
+	};
+
+	class PainterTest : public ::testing::Test {
+	protected:
+		DummyRenderEnvironment environment;
+		RecordingPainter painter{ environment.getResources() };
+		std::unique_ptr<RenderTarget> screenTarget = environment.getVideo().createScreenRenderTarget();
+		Camera camera{ Vector2f(640, 360) };
+
+		RenderContext makeContext()
+		{
+			return RenderContext(painter, camera, *screenTarget);
+		}
+
+		void render(const std::function<void(RenderContext&)>& f)
+		{
+			painter.startRender();
+			auto context = makeContext();
+			f(context);
+			painter.endRender();
+		}
+
+		Sprite makeSprite(int image, Vector2f pos)
+		{
+			Sprite sprite;
+			sprite.setImage(environment.getResources().get<Texture>("test" + toString(image) + ".png"), environment.getResources().get<MaterialDefinition>("Halley/Sprite"));
+			sprite.setTexRect(Rect4f(0, 0, 1, 1));
+			sprite.setSize(Vector2f(32, 32));
+			sprite.setPosition(pos);
+			return sprite;
+		}
+
+		// Sprites and lines alternate, so each group is its own command
+		void drawScene(Painter& p)
+		{
+			const Vector<Vector2f> line = { Vector2f(0, 0), Vector2f(100, 20), Vector2f(50, 80) };
+			for (int i = 0; i < 3; ++i) {
+				makeSprite(i, Vector2f(10, 10)).draw(p);
+				makeSprite(i, Vector2f(50, 10)).draw(p);
+				p.drawLine(line, 2.0f, Colour4f(1, 1, 1, 1));
+			}
+		}
+	};
+}
+
+TEST_F(PainterTest, ReplayUploadsListOnce)
+{
+	// The same scene drawn directly, to compare against
+	render([&] (RenderContext& rc) { rc.bind([&] (Painter& p) { drawScene(p); }); });
+	const auto directDraws = painter.draws;
+	EXPECT_EQ(painter.listUploads, size_t(0));
+	EXPECT_EQ(directDraws.size(), size_t(6));
+
+	RenderCommandList list;
+	render([&] (RenderContext& rc) { rc.record(list, [&] (Painter& p) { drawScene(p); }); });
+	EXPECT_EQ(list.getNumCommands(), size_t(6));
+
+	painter.reset();
+	render([&] (RenderContext& rc) { rc.replay(list, {}); });
+	EXPECT_EQ(painter.listUploads, size_t(1));
+	EXPECT_EQ(painter.vertexUploads, size_t(0));
+	EXPECT_EQ(painter.instanceUploads, size_t(0));
+	EXPECT_EQ(painter.listIndices, list.getNumIndices());
+
+	// Same draws as drawing directly, each from its own range of the list, in order
+	ASSERT_EQ(painter.draws.size(), directDraws.size());
+	size_t nextIndex = 0;
+	size_t lastVertexOffset = 0;
+	for (size_t i = 0; i < directDraws.size(); ++i) {
+		const auto& draw = painter.draws[i];
+		EXPECT_EQ(draw.numIndices, directDraws[i].numIndices);
+		EXPECT_EQ(draw.numInstances, directDraws[i].numInstances);
+		if (i > 0) {
+			EXPECT_GT(draw.vertexOffset, lastVertexOffset);
+		}
+		lastVertexOffset = draw.vertexOffset;
+		if (draw.numIndices > 0) {
+			EXPECT_GE(draw.firstIndex, nextIndex);
+			nextIndex = draw.firstIndex + draw.numIndices;
+		}
+	}
+	EXPECT_LE(nextIndex, list.getNumIndices());
+}
+
+TEST_F(PainterTest, ReplayExpandsInstancesWhenInstancingIsOff)
+{
+	RenderCommandList list;
+	render([&] (RenderContext& rc) { rc.record(list, [&] (Painter& p) { drawScene(p); }); });
+
+	painter.setInstancingEnabled(false);
+	painter.reset();
+	render([&] (RenderContext& rc) { rc.replay(list, {}); });
+
+	// The lines still draw from the uploaded list, while the sprites are expanded into quads and uploaded on their own
+	EXPECT_EQ(painter.listUploads, size_t(1));
+	EXPECT_EQ(painter.vertexUploads, size_t(3));
+	ASSERT_EQ(painter.draws.size(), size_t(6));
+	for (size_t i = 0; i < painter.draws.size(); ++i) {
+		EXPECT_EQ(painter.draws[i].numInstances, size_t(0));
+		EXPECT_EQ(painter.draws[i].numIndices, i % 2 == 0 ? size_t(12) : painter.draws[1].numIndices);
+	}
+}
+
+TEST_F(PainterTest, EveryBatchBindsItsMaterial)
+{
+	// Nothing changed the backend's bindings between the two batches, so the second one reuses the first's
+	const auto sprite = makeSprite(0, Vector2f(10, 10));
+	render([&] (RenderContext& rc) { rc.bind([&] (Painter& p)
+	{
+		sprite.draw(p);
+		p.flush();
+		sprite.draw(p);
+	}); });
+	EXPECT_EQ(painter.draws.size(), size_t(2));
+	EXPECT_EQ(painter.materialBinds, size_t(1));
+
+	// Loading a texture binds it directly on some backends, so the second batch binds its material again
+	painter.reset();
+	BindingTexture texture(Vector2i(4, 4));
+	render([&] (RenderContext& rc) { rc.bind([&] (Painter& p)
+	{
+		sprite.draw(p);
+		p.flush();
+		texture.load(TextureDescriptor(Vector2i(4, 4)));
+		sprite.draw(p);
+	}); });
+	EXPECT_EQ(painter.draws.size(), size_t(2));
+	EXPECT_EQ(painter.materialBinds, size_t(2));
+}
+
+TEST_F(PainterTest, InstancesFallBackToCpuQuads)
+{
+	const auto sprites = Vector<Sprite>{ makeSprite(0, Vector2f(10, 10)), makeSprite(0, Vector2f(50, 10)), makeSprite(0, Vector2f(90, 30)) };
+	auto drawSprites = [&] (Painter& p)
+	{
+		for (const auto& sprite: sprites) {
+			sprite.draw(p);
+		}
+	};
+
+	// Instancing is on, but the instances are packed into quads by the painter's default implementation
+	painter.cpuInstancing = true;
+	render([&] (RenderContext& rc) { rc.bind(drawSprites); });
+	EXPECT_EQ(painter.instanceUploads, size_t(1));
+	EXPECT_EQ(painter.vertexUploads, size_t(1));
+	ASSERT_EQ(painter.draws.size(), size_t(1));
+	EXPECT_EQ(painter.draws[0].numIndices, size_t(18));
+	EXPECT_EQ(painter.draws[0].numInstances, size_t(0));
+	const auto packed = painter.lastVertices;
+
+	// Each sprite becomes four vertices, with its own data and the corners in vertPos
+	const Vector4f corners[] = { Vector4f(0, 0, 0, 0), Vector4f(1, 0, 1, 0), Vector4f(1, 1, 1, 1), Vector4f(0, 1, 0, 1) };
+	ASSERT_EQ(packed.size(), size_t(12));
+	for (size_t i = 0; i < packed.size(); ++i) {
+		EXPECT_EQ(packed[i].pos, sprites[i / 4].getPosition());
+		EXPECT_EQ(packed[i].size, sprites[i / 4].getSize());
+		EXPECT_EQ(packed[i].vertPos, corners[i % 4]);
+	}
+
+	// Same as the quads drawSprites expands itself when instancing is off
+	painter.reset();
+	painter.setInstancingEnabled(false);
+	render([&] (RenderContext& rc) { rc.bind(drawSprites); });
+	EXPECT_EQ(painter.instanceUploads, size_t(0));
+	// The padding at the end of each vertex is never written, so it's left out
+	ASSERT_EQ(painter.lastVertices.size(), packed.size());
+	for (size_t i = 0; i < packed.size(); ++i) {
+		EXPECT_EQ(memcmp(&painter.lastVertices[i], &packed[i], offsetof(SpriteVertexAttrib, _padding)), 0) << "Vertex " << i;
+	}
+}
+
+TEST_F(PainterTest, ParticlesAreCulledAndSkipSpritesWithoutMaterial)
+{
+	ConfigNode::MapType config;
+	config["spawnRate"] = 100.0f;
+	config["ttl"] = 10.0f;
+	config["speed"] = 0.0f;
+	Particles particles(ConfigNode(std::move(config)), environment.getResources());
+	particles.setSeed(1);
+	particles.setSprites({ makeSprite(0, Vector2f()), Sprite() });
+	particles.update(0.5);
+	ASSERT_EQ(particles.getNumParticles(), size_t(50));
+
+	auto countInstances = [&] ()
+	{
+		size_t n = 0;
+		for (const auto& draw: painter.draws) {
+			n += draw.numInstances;
+		}
+		return n;
+	};
+
+	// The emitter sits at the corner of the camera's view, which its sprites overlap
+	painter.reset();
+	render([&] (RenderContext& rc) { rc.bind([&] (Painter& p) { particles.draw(p); }); });
+	const auto nDrawn = countInstances();
+	EXPECT_GT(nDrawn, size_t(0));
+	EXPECT_LT(nDrawn, size_t(50));
+	EXPECT_EQ(nDrawn, particles.getSprites().size());
+
+	// Out of view
+	painter.reset();
+	render([&] (RenderContext& rc) { rc.bind([&] (Painter& p) { particles.draw(p, Rect4f(1000, 1000, 100, 100)); }); });
+	EXPECT_EQ(countInstances(), size_t(0));
+}
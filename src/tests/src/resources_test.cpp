@@ -0,0 +1,192 @@
+#include <gtest/gtest.h>
+#include <halley.hpp>
+#include <halley/core/resources/resource_locator.h>
+#include "dummy_render_environment.h"
+
+using namespace Halley;
+
+namespace {
+	// Binary files b0 to b9, of assetSize bytes each, served from an in-memory pack
+	// The executors have no threads, so asynchronous loads only advance when the test runs their queues
+	class ResourcesTest : public ::testing::Test {
+	protected:
+		constexpr static size_t numAssets = 10;
+		constexpr static size_t assetSize = 1000;
+
+		RenderTest::MemorySystemAPI system;
+		HalleyAPI api;
+		std::unique_ptr<Resources> resources;
+
+		void SetUp() override
+		{
+			// Outlives the test, as other tests might use it
+			static Executors executors;
+			Executors::setInstance(executors);
+
+			AssetPack pack;
+			for (size_t i = 0; i < numAssets; ++i) {
+				const Bytes bytes(assetSize, Byte(i));
+				pack.addAsset(AssetType::BinaryFile, getName(i), gsl::as_bytes(gsl::span<const Byte>(bytes)), Metadata());
+			}
+			system.pack = pack.writeOut();
+			api.system = &system;
+
+			auto locator = std::make_unique<ResourceLocator>(system);
+			locator->addPack(Path("test.dat"), "", true);
+			resources = std::make_unique<Resources>(std::move(locator), api, Resources::Options());
+			resources->init<BinaryFile>();
+		}
+
+		void TearDown() override
+		{
+			// Nothing left queued that refers to these resources
+			runExecutors();
+		}
+
+		static String getName(size_t i)
+		{
+			return "b" + toString(i);
+		}
+
+		static bool hasContents(const std::shared_ptr<const BinaryFile>& file, size_t i)
+		{
+			const auto& bytes = file->getBytes();
+			return bytes.size() == assetSize && std::all_of(bytes.begin(), bytes.end(), [&] (Byte b) { return b == Byte(i); });
+		}
+
+		void runExecutors()
+		{
+			while (Executors::getDiskIO().runOne() || Executors::getMainThread().runOne() || Executors::getCPU().runOne()) {}
+		}
+	};
+}
+
+TEST_F(ResourcesTest, AsyncLoadsOfTheSameAssetAreShared)
+{
+	auto first = resources->getAsync<BinaryFile>(getName(0));
+	auto second = resources->getAsync<BinaryFile>(getName(0), ResourceLoadPriority::High);
+	auto missing = resources->getAsync<BinaryFile>("missing");
+
+	// One read for the asset, one for the missing one
+	EXPECT_TRUE(Executors::getDiskIO().runOne());
+	EXPECT_TRUE(Executors::getDiskIO().runOne());
+	EXPECT_FALSE(Executors::getDiskIO().runOne());
+	EXPECT_FALSE(first.isReady());
+
+	runExecutors();
+	ASSERT_TRUE(first.isReady());
+	ASSERT_TRUE(second.isReady());
+	EXPECT_TRUE(hasContents(first.get(), 0));
+	EXPECT_EQ(first.get(), second.get());
+	EXPECT_EQ(resources->get<BinaryFile>(getName(0)), first.get());
+
+	// Failed loads resolve to null
+	ASSERT_TRUE(missing.isReady());
+	EXPECT_FALSE(missing.get());
+
+	// Loaded assets are returned straight from the cache
+	auto cached = resources->getAsync<BinaryFile>(getName(0));
+	EXPECT_FALSE(Executors::getDiskIO().runOne());
+	runExecutors();
+	EXPECT_EQ(cached.get(), first.get());
+}
+
+TEST_F(ResourcesTest, SyncGetClaimsAsyncLoad)
+{
+	auto async = resources->getAsync<BinaryFile>(getName(1));
+
+	// Once read, the asset waits for the main thread to build it, but a synchronous get builds it right away
+	EXPECT_TRUE(Executors::getDiskIO().runOne());
+	const auto sync = resources->get<BinaryFile>(getName(1));
+	EXPECT_TRUE(hasContents(sync, 1));
+
+	// The main thread finds the load claimed, and doesn't build it again
+	runExecutors();
+	ASSERT_TRUE(async.isReady());
+	EXPECT_EQ(async.get(), sync);
+	EXPECT_EQ(resources->get<BinaryFile>(getName(1)), sync);
+	EXPECT_EQ(resources->getMemoryStats()[AssetType::BinaryFile].numResources, size_t(1));
+}
+
+TEST_F(ResourcesTest, BudgetEvictsLeastRecentlyUsed)
+{
+	resources->setMemoryBudget(AssetType::BinaryFile, 4 * assetSize);
+
+	// Only the cache holds on to them, and b0 is kept recently used
+	std::vector<std::weak_ptr<const BinaryFile>> loaded;
+	for (size_t i = 0; i < numAssets; ++i) {
+		loaded.push_back(resources->get<BinaryFile>(getName(i)));
+		resources->get<BinaryFile>(getName(0));
+	}
+
+	for (size_t i = 0; i < numAssets; ++i) {
+		EXPECT_EQ(loaded[i].expired(), i >= 1 && i <= 6) << getName(i);
+	}
+	const auto stats = resources->getMemoryStats()[AssetType::BinaryFile];
+	EXPECT_EQ(stats.numResources, size_t(4));
+	EXPECT_EQ(stats.numEvicted, size_t(6));
+	EXPECT_EQ(stats.memoryUsage.getTotal(), 4 * assetSize);
+
+	// Evicted assets load again when asked for
+	EXPECT_TRUE(hasContents(resources->get<BinaryFile>(getName(1)), 1));
+}
+
+TEST_F(ResourcesTest, HeldResourcesAreNotEvicted)
+{
+	const auto held = resources->get<BinaryFile>(getName(0));
+	resources->setMemoryBudget(AssetType::BinaryFile, 0);
+
+	// Still being returned while it was loaded, so it's only evicted the next time the budget is enforced
+	std::weak_ptr<const BinaryFile> released = resources->get<BinaryFile>(getName(1));
+	EXPECT_FALSE(released.expired());
+	resources->enforceMemoryBudgets();
+	EXPECT_TRUE(released.expired());
+
+	const auto stats = resources->getMemoryStats()[AssetType::BinaryFile];
+	EXPECT_EQ(stats.numResources, size_t(1));
+	EXPECT_EQ(stats.numEvictable, size_t(0));
+	EXPECT_EQ(stats.memoryUsage.getTotal(), assetSize);
+	EXPECT_EQ(resources->get<BinaryFile>(getName(0)), held);
+}
+
+TEST_F(ResourcesTest, GlobalBudgetSkipsResourcesWithoutMemory)
+{
+	// Empty, so evicting them wouldn't free anything, even though they're the least recently used
+	resources->init<TextFile>();
+	resources->of<TextFile>().setResourceLoader([] (const String&, ResourceLoadPriority) { return std::make_shared<TextFile>(); });
+	std::vector<std::weak_ptr<const TextFile>> empty;
+	for (size_t i = 0; i < 3; ++i) {
+		empty.push_back(resources->get<TextFile>("t" + toString(i)));
+	}
+
+	resources->setMemoryBudget(3 * assetSize);
+	std::vector<std::weak_ptr<const BinaryFile>> loaded;
+	for (size_t i = 0; i < numAssets; ++i) {
+		loaded.push_back(resources->get<BinaryFile>(getName(i)));
+	}
+
+	for (const auto& e: empty) {
+		EXPECT_FALSE(e.expired());
+	}
+	for (size_t i = 0; i < numAssets; ++i) {
+		EXPECT_EQ(loaded[i].expired(), i < numAssets - 3) << getName(i);
+	}
+	EXPECT_EQ(resources->getMemoryUsage().getTotal(), 3 * assetSize);
+	EXPECT_EQ(resources->getMemoryStats()[AssetType::TextFile].numEvictable, size_t(0));
+}
+
+TEST_F(ResourcesTest, LoadingTexturesAreMeasuredAgainWhenDone)
+{
+	// Stored before it's loaded, so it's estimated as RGBA until then
+	auto texture = std::make_shared<DummyTexture>(Vector2i(16, 16));
+	texture->startLoading();
+	resources->init<Texture>();
+	resources->of<Texture>().setResourceLoader([&] (const String&, ResourceLoadPriority) { return texture; });
+	EXPECT_EQ(resources->get<Texture>("texture"), texture);
+	EXPECT_EQ(resources->getMemoryStats()[AssetType::Texture].memoryUsage.vramUsage, size_t(16 * 16 * 4));
+
+	TextureDescriptor descriptor(Vector2i(16, 16));
+	descriptor.format = TextureFormat::Red;
+	texture->load(std::move(descriptor));
+	EXPECT_EQ(resources->getMemoryStats()[AssetType::Texture].memoryUsage.vramUsage, size_t(16 * 16));
+}
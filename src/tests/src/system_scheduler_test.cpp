@@ -0,0 +1,161 @@
+#include <gtest/gtest.h>
+#include <halley.hpp>
+#include <halley/entity/system_scheduler.h>
+#include "test_world.h"
+
+using namespace Halley;
+using namespace Halley::WorldTest;
+
+namespace {
+	class ReadPositionFamily : public FamilyBaseOf<ReadPositionFamily> {
+	public:
+		const PositionComponent& position;
+
+		using Type = FamilyType<const PositionComponent>;
+
+	protected:
+		ReadPositionFamily(const PositionComponent& position)
+			: position(position)
+		{}
+	};
+
+	class WritePositionFamily : public FamilyBaseOf<WritePositionFamily> {
+	public:
+		PositionComponent& position;
+
+		using Type = FamilyType<PositionComponent>;
+
+	protected:
+		WritePositionFamily(PositionComponent& position)
+			: position(position)
+		{}
+	};
+
+	class ReadOwnerFamily : public FamilyBaseOf<ReadOwnerFamily> {
+	public:
+		const OwnerComponent& owner;
+
+		using Type = FamilyType<const OwnerComponent>;
+
+	protected:
+		ReadOwnerFamily(const OwnerComponent& owner)
+			: owner(owner)
+		{}
+	};
+
+	class WriteOwnerFamily : public FamilyBaseOf<WriteOwnerFamily> {
+	public:
+		OwnerComponent& owner;
+
+		using Type = FamilyType<OwnerComponent>;
+
+	protected:
+		WriteOwnerFamily(OwnerComponent& owner)
+			: owner(owner)
+		{}
+	};
+
+	// Accesses one family, as declared by the generated code of a system that isn't exclusive
+	// Undeclared systems are exclusive, like generated ones that access the world, API or resources
+	template <typename F>
+	class AccessSystem final : public System {
+	public:
+		FamilyBinding<F> family;
+
+		AccessSystem(Vector<String>& log, bool declared, Vector<String> services = {})
+			: System({ &family }, {})
+			, log(log)
+		{
+			if (declared) {
+				declareAccess(false, std::move(services), {});
+			}
+		}
+
+	protected:
+		void updateBase(Time) override
+		{
+			log.push_back(getName());
+		}
+
+	private:
+		Vector<String>& log;
+	};
+
+	// The CPU executor has no threads, so every batch runs on the calling thread, in order
+	class SystemSchedulerTest : public ::testing::Test {
+	protected:
+		TestWorldEnvironment environment;
+		World& world = environment.getWorld();
+		SystemScheduler scheduler;
+		Vector<String> log;
+
+		void SetUp() override
+		{
+			// Outlives the test, as other tests might use it
+			static Executors executors;
+			Executors::setInstance(executors);
+		}
+
+		template <typename F>
+		void add(const String& name, bool declared = true, Vector<String> services = {})
+		{
+			world.addSystem(std::make_unique<AccessSystem<F>>(log, declared, std::move(services)), TimeLine::FixedUpdate).setName(name);
+		}
+
+		Vector<Vector<String>> run()
+		{
+			scheduler.update(world, world.getSystems(TimeLine::FixedUpdate), 0);
+
+			Vector<Vector<String>> result;
+			for (const auto& batch: scheduler.getBatches()) {
+				auto& names = result.emplace_back();
+				for (const auto* system: batch) {
+					names.push_back(system->getName());
+				}
+			}
+			return result;
+		}
+	};
+}
+
+TEST_F(SystemSchedulerTest, ConflictingAccessRunsInLaterBatches)
+{
+	add<WritePositionFamily>("writePos");
+	add<ReadOwnerFamily>("readOwner");
+	add<ReadPositionFamily>("readPos1");
+	add<ReadPositionFamily>("readPos2");
+	add<WriteOwnerFamily>("writeOwner");
+	add<WritePositionFamily>("writePos2");
+
+	// Readers of a component share a batch, after its last writer and before its next one
+	const auto batches = run();
+	EXPECT_EQ(batches, (Vector<Vector<String>>{
+		{ "writePos", "readOwner" },
+		{ "readPos1", "readPos2", "writeOwner" },
+		{ "writePos2" }
+	}));
+	EXPECT_EQ(log, (Vector<String>{ "writePos", "readOwner", "readPos1", "readPos2", "writeOwner", "writePos2" }));
+
+	// Batches are kept until the systems change
+	log.clear();
+	EXPECT_EQ(run(), batches);
+	EXPECT_EQ(log.size(), size_t(6));
+}
+
+TEST_F(SystemSchedulerTest, ExclusiveSystemsRunAlone)
+{
+	add<ReadPositionFamily>("before");
+	add<ReadPositionFamily>("undeclared", false);
+	add<ReadOwnerFamily>("after");
+	add<ReadOwnerFamily>("service1", true, { "Service" });
+	add<ReadOwnerFamily>("service2", true, { "Service" });
+	add<ReadPositionFamily>("otherService", true, { "OtherService" });
+
+	// Systems sharing a service conflict even if their components don't
+	EXPECT_EQ(run(), (Vector<Vector<String>>{
+		{ "before" },
+		{ "undeclared" },
+		{ "after", "service1", "otherService" },
+		{ "service2" }
+	}));
+}
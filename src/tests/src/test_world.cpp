@@ -0,0 +1,28 @@
+#include "test_world.h"
+
+using namespace Halley;
+using namespace Halley::WorldTest;
+
+namespace Halley {
+	std::unique_ptr<System> createSystem(String name)
+	{
+		return {};
+	}
+
+	ComponentReflector& getComponentReflector(int componentId)
+	{
+		static ComponentReflectorImpl<PositionComponent> position;
+		static ComponentReflectorImpl<OwnerComponent> owner;
+		static ComponentReflectorImpl<LinkComponent> link;
+		switch (componentId) {
+		case PositionComponent::componentIndex:
+			return position;
+		case OwnerComponent::componentIndex:
+			return owner;
+		case LinkComponent::componentIndex:
+			return link;
+		default:
+			throw Exception("Unknown component " + toString(componentId), HalleyExceptions::Entity);
+		}
+	}
+}
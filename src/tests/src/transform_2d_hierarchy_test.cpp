@@ -0,0 +1,88 @@
+#include <gtest/gtest.h>
+#include <halley.hpp>
+#include <halley/entity/components/transform_2d_component.h>
+#include <halley/entity/transform_2d_hierarchy.h>
+#include "test_world.h"
+
+using namespace Halley;
+
+namespace {
+	class Transform2DHierarchyTest : public ::testing::Test {
+	protected:
+		TestWorldEnvironment environment;
+		World& world = environment.getWorld();
+
+		EntityRef create(Vector2f position, std::optional<EntityRef> parent = {}, Angle1f rotation = {}, Vector2f scale = Vector2f(1, 1))
+		{
+			auto entity = world.createEntity("", parent);
+			entity.addComponent(Transform2DComponent(position, rotation, scale));
+			return entity;
+		}
+
+		void update()
+		{
+			world.spawnPending();
+			world.getTransformHierarchy()->update();
+		}
+
+		static void expectNear(Vector2f a, Vector2f b)
+		{
+			EXPECT_NEAR(a.x, b.x, 0.0001f);
+			EXPECT_NEAR(a.y, b.y, 0.0001f);
+		}
+	};
+}
+
+TEST_F(Transform2DHierarchyTest, ChildrenFollowTheirParents)
+{
+	auto root = create(Vector2f(10, 0), {}, Angle1f::fromDegrees(90), Vector2f(2, 2));
+	auto child = create(Vector2f(1, 0), root);
+	auto grandChild = create(Vector2f(0, 1), child);
+	auto other = create(Vector2f(5, 5));
+	update();
+
+	auto& rootTransform = root.getComponent<Transform2DComponent>();
+	const auto& childTransform = child.getComponent<Transform2DComponent>();
+	const auto& grandChildTransform = grandChild.getComponent<Transform2DComponent>();
+	expectNear(childTransform.getGlobalPosition(), Vector2f(10, 2));
+	expectNear(grandChildTransform.getGlobalPosition(), Vector2f(8, 2));
+	EXPECT_NEAR(grandChildTransform.getGlobalRotation().toDegrees(), 90.0f, 0.0001f);
+	expectNear(grandChildTransform.getGlobalScale(), Vector2f(2, 2));
+
+	// Only the moved subtree changes
+	const auto otherRevision = other.getComponent<Transform2DComponent>().getRevision();
+	const auto childRevision = childTransform.getRevision();
+	rootTransform.setLocalPosition(Vector2f(20, 0));
+	update();
+	expectNear(childTransform.getGlobalPosition(), Vector2f(20, 2));
+	expectNear(grandChildTransform.getGlobalPosition(), Vector2f(18, 2));
+	EXPECT_NE(childTransform.getRevision(), childRevision);
+	EXPECT_EQ(other.getComponent<Transform2DComponent>().getRevision(), otherRevision);
+
+	// Detached transforms are their own roots again
+	child.setParent();
+	update();
+	expectNear(childTransform.getGlobalPosition(), Vector2f(1, 0));
+	expectNear(grandChildTransform.getGlobalPosition(), Vector2f(1, 1));
+
+	world.destroyEntity(root);
+	update();
+	expectNear(grandChildTransform.getGlobalPosition(), Vector2f(1, 1));
+}
+
+TEST_F(Transform2DHierarchyTest, SpriteAABBIncludesTheSpritesTransform)
+{
+	auto entity = create(Vector2f(100, 100), {}, {}, Vector2f(2, 1));
+	update();
+
+	Sprite sprite;
+	sprite.setSize(Vector2f(10, 20)).setPivot(Vector2f(0.5f, 0.5f));
+	const auto& transform = entity.getComponent<Transform2DComponent>();
+	EXPECT_EQ(transform.getSpriteAABB(sprite), Rect4f(Vector2f(90, 90), Vector2f(110, 110)));
+
+	// The sprite's own scale and rotation apply first, around its pivot
+	sprite.setScale(Vector2f(1, 2)).setRotation(Angle1f::fromDegrees(90));
+	const auto aabb = transform.getSpriteAABB(sprite);
+	expectNear(aabb.getTopLeft(), Vector2f(60, 95));
+	expectNear(aabb.getBottomRight(), Vector2f(140, 105));
+}
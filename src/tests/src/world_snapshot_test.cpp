@@ -0,0 +1,83 @@
+#include <gtest/gtest.h>
+#include <halley.hpp>
+#include <halley/entity/world_snapshot.h>
+#include "test_world.h"
+
+using namespace Halley;
+using namespace Halley::WorldTest;
+
+namespace {
+	class SnapshotTest : public ::testing::Test {
+	protected:
+		TestWorldEnvironment environment;
+		World* world = &environment.getWorld();
+
+		// Every instance shares the same UUIDs, as prefab instances do
+		void createInstances(int n)
+		{
+			const auto rootUUID = UUID::generate();
+			const auto childUUID = UUID::generate();
+			for (int i = 0; i < n; ++i) {
+				auto root = world->createEntity(rootUUID, toString(i), {}, true);
+				auto child = world->createEntity(childUUID, "child", root, true);
+				root.addComponent(PositionComponent(float(i))).addComponent(LinkComponent(child.getEntityId()));
+				child.addComponent(OwnerComponent(root.getEntityId()));
+			}
+			world->spawnPending();
+		}
+
+		void checkInstances(int n)
+		{
+			auto roots = world->getTopLevelEntities();
+			ASSERT_EQ(roots.size(), size_t(n));
+			EXPECT_EQ(world->numEntities(), size_t(2 * n));
+			for (auto& root: roots) {
+				EXPECT_EQ(root.getComponent<PositionComponent>().x, float(root.getName().toInteger()));
+				ASSERT_EQ(root.getRawChildren().size(), size_t(1));
+				auto child = EntityRef(*root.getRawChildren()[0], *world);
+				EXPECT_EQ(root.getComponent<LinkComponent>().target, child.getEntityId());
+				EXPECT_EQ(child.getComponent<OwnerComponent>().owner, root.getEntityId());
+				EXPECT_FALSE(child.hasComponent<PositionComponent>());
+			}
+		}
+	};
+}
+
+TEST_F(SnapshotTest, RestoreUndoesChanges)
+{
+	createInstances(10);
+	checkInstances(10);
+	const auto snapshot = world->snapshot();
+	EXPECT_EQ(snapshot.getNumEntities(), size_t(20));
+
+	// Change a component, destroy a child, add a component and an entity
+	auto roots = world->getTopLevelEntities();
+	roots[0].getComponent<PositionComponent>().x = 100;
+	world->destroyEntity(roots[1].getRawChildren()[0]->getEntityId());
+	EntityRef(*roots[2].getRawChildren()[0], *world).addComponent(PositionComponent(5));
+	world->createEntity("extra").addComponent(PositionComponent(7));
+	world->spawnPending();
+
+	world->restore(WorldSnapshot(gsl::as_bytes(gsl::span<const Byte>(snapshot.toBytes()))));
+	world->spawnPending();
+	checkInstances(10);
+}
+
+TEST_F(SnapshotTest, DeltaOnlyStoresChanges)
+{
+	createInstances(10);
+	const auto base = world->snapshot();
+
+	world->getTopLevelEntities()[3].getComponent<PositionComponent>().x = 100;
+	const auto delta = world->snapshot(base);
+	EXPECT_TRUE(delta.isDelta());
+	EXPECT_EQ(std::count_if(delta.getEntries().begin(), delta.getEntries().end(), [] (const auto& e) { return !e.data.empty(); }), 1);
+
+	world->restore(delta, base);
+	world->spawnPending();
+	EXPECT_EQ(world->getTopLevelEntities()[3].getComponent<PositionComponent>().x, 100.0f);
+
+	world->restore(base);
+	world->spawnPending();
+	checkInstances(10);
+}
@@ -0,0 +1,152 @@
+#include <gtest/gtest.h>
+#include <halley.hpp>
+#include "test_world.h"
+
+using namespace Halley;
+using namespace Halley::WorldTest;
+
+namespace {
+	class PositionFamily : public FamilyBaseOf<PositionFamily> {
+	public:
+		PositionComponent& position;
+
+		using Type = FamilyType<PositionComponent>;
+
+	protected:
+		PositionFamily(PositionComponent& position)
+			: position(position)
+		{}
+	};
+
+	class OwnedPositionFamily : public FamilyBaseOf<OwnedPositionFamily> {
+	public:
+		PositionComponent& position;
+		const OwnerComponent& owner;
+
+		using Type = FamilyType<PositionComponent, const OwnerComponent>;
+
+	protected:
+		OwnedPositionFamily(PositionComponent& position, const OwnerComponent& owner)
+			: position(position)
+			, owner(owner)
+		{}
+	};
+
+	// Entities sharing a mask keep their components in the same archetype, and move whenever their mask changes
+	class WorldStorageTest : public ::testing::Test {
+	protected:
+		TestWorldEnvironment environment;
+		World& world = environment.getWorld();
+		Family* positions = nullptr;
+		Family* ownedPositions = nullptr;
+
+		void SetUp() override
+		{
+			world.setArchetypeStorageEnabled(true);
+			positions = &world.getFamily<PositionFamily>();
+			ownedPositions = &world.getFamily<OwnedPositionFamily>();
+		}
+
+		EntityId create(std::optional<float> position, bool owned)
+		{
+			auto entity = world.createEntity();
+			if (position) {
+				entity.addComponent(PositionComponent(*position));
+			}
+			if (owned) {
+				entity.addComponent(OwnerComponent(entity.getEntityId()));
+			}
+			return entity.getEntityId();
+		}
+
+		// Also checks that every member's family entry refers to the components the entity itself has
+		template <typename T>
+		std::set<EntityId> getMembers(const Family& family)
+		{
+			std::set<EntityId> result;
+			for (size_t i = 0; i < family.count(); ++i) {
+				const auto& elem = *static_cast<const T*>(family.getElement(i));
+				EntityRef entity = world.getEntity(elem.entityId);
+				EXPECT_EQ(&elem.position, &entity.getComponent<PositionComponent>());
+				EXPECT_EQ(family.getIndexOf(elem.entityId), std::optional<size_t>(i));
+				result.insert(elem.entityId);
+			}
+			return result;
+		}
+	};
+}
+
+TEST_F(WorldStorageTest, FamilyMembershipFollowsComponents)
+{
+	const auto a = create(1.0f, false);
+	const auto b = create(2.0f, true);
+	const auto c = create(std::nullopt, true);
+	const auto d = create(4.0f, true);
+	world.spawnPending();
+	EXPECT_EQ(getMembers<PositionFamily>(*positions), std::set<EntityId>({ a, b, d }));
+	EXPECT_EQ(getMembers<OwnedPositionFamily>(*ownedPositions), std::set<EntityId>({ b, d }));
+
+	// Each of these moves the entity to another archetype, or out of the world
+	world.getEntity(b).removeComponent<PositionComponent>();
+	world.getEntity(c).addComponent(PositionComponent(3.0f));
+	world.getEntity(a).addComponent(OwnerComponent(a));
+	world.destroyEntity(d);
+	world.spawnPending();
+	EXPECT_EQ(getMembers<PositionFamily>(*positions), std::set<EntityId>({ a, c }));
+	EXPECT_EQ(getMembers<OwnedPositionFamily>(*ownedPositions), std::set<EntityId>({ a, c }));
+	EXPECT_FALSE(positions->getIndexOf(b));
+	EXPECT_FALSE(ownedPositions->getIndexOf(d));
+	EXPECT_EQ(world.numEntities(), size_t(3));
+
+	// Components keep their values when they move
+	EXPECT_EQ(world.getEntity(a).getComponent<PositionComponent>().x, 1.0f);
+	EXPECT_EQ(world.getEntity(c).getComponent<PositionComponent>().x, 3.0f);
+	EXPECT_EQ(world.getEntity(a).getComponent<OwnerComponent>().owner, a);
+	EXPECT_FALSE(world.getEntity(b).hasComponent<PositionComponent>());
+	EXPECT_EQ(world.getEntity(b).getComponent<OwnerComponent>().owner, b);
+}
+
+TEST_F(WorldStorageTest, FamiliesAddedLaterFindExistingEntities)
+{
+	const auto a = create(1.0f, true);
+	const auto b = create(2.0f, false);
+	world.spawnPending();
+
+	// Existing entities join on the next update, once anything bound to the family is ready for them
+	auto& late = world.getFamily<OwnedPositionFamily>();
+	world.getEntity(b).addComponent(OwnerComponent(b));
+	world.spawnPending();
+	EXPECT_EQ(getMembers<OwnedPositionFamily>(late), std::set<EntityId>({ a, b }));
+
+	world.destroyEntity(a);
+	world.spawnPending();
+	EXPECT_EQ(getMembers<OwnedPositionFamily>(late), std::set<EntityId>({ b }));
+	EXPECT_EQ(getMembers<OwnedPositionFamily>(*ownedPositions), std::set<EntityId>({ b }));
+}
+
+TEST(WorldComponentLookup, FindsLiveComponents)
+{
+	for (const bool archetypes: { false, true }) {
+		TestWorldEnvironment environment;
+		auto& world = environment.getWorld();
+		world.setArchetypeStorageEnabled(archetypes);
+
+		auto entity = world.createEntity();
+		entity.addComponent(OwnerComponent()).addComponent(PositionComponent(1.0f));
+		EXPECT_EQ(entity.getComponent<PositionComponent>().x, 1.0f);
+		EXPECT_FALSE(entity.hasComponent<LinkComponent>());
+
+		// Adding a component the entity already has keeps the existing one
+		entity.addComponent(PositionComponent(2.0f));
+		world.spawnPending();
+		EXPECT_EQ(entity.getComponent<PositionComponent>().x, 1.0f);
+
+		entity.removeComponent<OwnerComponent>();
+		entity.addComponent(LinkComponent(entity.getEntityId()));
+		world.spawnPending();
+		EXPECT_FALSE(entity.tryGetComponent<OwnerComponent>());
+		EXPECT_EQ(entity.getComponent<PositionComponent>().x, 1.0f);
+		ASSERT_TRUE(entity.tryGetComponent<LinkComponent>());
+		EXPECT_EQ(entity.getComponent<LinkComponent>().target, entity.getEntityId());
+	}
+}
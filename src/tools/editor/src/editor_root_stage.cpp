@@ -15,7 +15,6 @@ using namespace Halley;
 
 EditorRootStage::EditorRootStage(HalleyEditor& editor, std::unique_ptr<Project> project)
 	: editor(editor)
-	, mainThreadExecutor(Executors::getMainThread())
 	, project(std::move(project))
 {
 }
@@ -41,8 +40,6 @@ void EditorRootStage::init()
 
 void EditorRootStage::onVariableUpdate(Time time)
 {
-	mainThreadExecutor.runPending();
-
 	if (!topLevelUI || !topLevelUI->isAlive()) {
 		unloadProject();
 		createLoadProjectUI();
@@ -22,7 +22,6 @@ namespace Halley {
 	private:
 		HalleyEditor& editor;
 		I18N i18n;
-		Executor mainThreadExecutor;
 
 		std::unique_ptr<Project> project;
 
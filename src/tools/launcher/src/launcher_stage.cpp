@@ -5,7 +5,6 @@
 using namespace Halley;
 
 LauncherStage::LauncherStage()
-	: mainThreadExecutor(Executors::getMainThread())
 {
 }
 
@@ -19,7 +18,6 @@ void LauncherStage::init()
 
 void LauncherStage::onVariableUpdate(Time time)
 {
-	mainThreadExecutor.runPending();
 	updateUI(time);
 }
 
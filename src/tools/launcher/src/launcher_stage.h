@@ -21,8 +21,6 @@ namespace Halley {
 		std::shared_ptr<UIWidget> topLevelUI;
 		std::shared_ptr<UIWidget> curUI;
 
-		Executor mainThreadExecutor;
-
 		Sprite background;
 		std::shared_ptr<LauncherSaveData> saveData;
 
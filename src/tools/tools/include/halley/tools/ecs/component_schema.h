@@ -24,6 +24,7 @@ namespace Halley
 		std::optional<String> customImplementation;
 		std::vector<String> componentDependencies;
 		bool generate = false;
+		bool binarySerialize = false; // Generates Serializer/Deserializer methods, used by world snapshots
 
 		bool operator<(const ComponentSchema& other) const;
 	};
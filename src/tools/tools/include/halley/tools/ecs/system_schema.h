@@ -83,6 +83,7 @@ namespace Halley
 		CodegenLanguage language = CodegenLanguage::CPlusPlus;
 		int smearing = 0;
 		bool generate = false;
+		bool constComponents = false; // Read-only family components are generated as const, which lets the scheduler run the system in parallel with other readers
 
 		std::unordered_set<String> includeFiles;
 
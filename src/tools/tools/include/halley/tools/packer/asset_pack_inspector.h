@@ -6,6 +6,8 @@
 #include "halley/core/resources/asset_database.h"
 
 namespace Halley {
+	struct AssetPackHeader;
+
     class AssetPackInspector {
     public:
 	    explicit AssetPackInspector(String name);
@@ -33,6 +35,7 @@ namespace Halley {
 
 		void parseTable(Deserializer s, const Bytes& packBytes);
 	    void parseTypedDB(Deserializer& s, const Bytes& packBytes);
+		void parseDirectory(const AssetPackHeader& header, const Bytes& packBytes);
 		void computeHash();
     };
 
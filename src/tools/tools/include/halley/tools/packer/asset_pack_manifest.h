@@ -2,25 +2,29 @@
 #include "halley/text/halleystring.h"
 #include "halley/data_structures/maybe.h"
 #include "halley/utils/utils.h"
+#include <map>
 
 namespace Halley {
 	class ConfigNode;
 	class ConfigFile;
+	enum class AssetType;
 
 	class AssetPackManifestEntry {
 	public:
 		AssetPackManifestEntry();
-		AssetPackManifestEntry(const ConfigNode& node);
+		AssetPackManifestEntry(const ConfigNode& node, std::map<String, String> compression = {});
 
 		const String& getName() const;
 		bool checkMatch(const String& asset) const;
 		bool isEncrypted() const;
 		const String& getEncryptionKey() const;
+		const String& getCompression(AssetType type) const; // One of "none", "deflate" or "deflateFast"
 
 	private:
 		String name;
 		String encryptionKey;
 		std::vector<String> matches;
+		std::map<String, String> compression; // By asset type name, or "default"
 	};
 
 	class AssetPackManifest {
@@ -18,6 +18,7 @@ namespace Halley {
 			String name;
 			String path;
 			Metadata metadata;
+			String compression;
 
 			bool operator<(const Entry& other) const;
 		};
@@ -25,7 +26,7 @@ namespace Halley {
 		AssetPackListing();
 		AssetPackListing(String name, String encryptionKey);
 		
-		void addFile(AssetType type, const String& name, const AssetDatabase::Entry& entry);
+		void addFile(AssetType type, const String& name, const AssetDatabase::Entry& entry, const String& compression);
 		const std::vector<Entry>& getEntries() const;
 		const String& getEncryptionKey() const;
 		
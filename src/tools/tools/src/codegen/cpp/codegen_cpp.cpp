@@ -211,6 +211,8 @@ Vector<String> CodegenCPP::generateComponentHeader(ComponentSchema component)
 	const String lineBreak = getPlatform() == GamePlatform::Windows ? "\r\n\t\t" : "\n\t\t";
 	String serializeBody = "Halley::ConfigNode node = Halley::ConfigNode::MapType();" + lineBreak;
 	String deserializeBody;
+	String serializeBytesBody;
+	String deserializeBytesBody;
 	bool first = true;
 	for (auto& member: component.members) {
 		if (!member.serializable) {
@@ -222,9 +224,13 @@ Vector<String> CodegenCPP::generateComponentHeader(ComponentSchema component)
 		} else {
 			serializeBody += lineBreak;
 			deserializeBody += lineBreak;
+			serializeBytesBody += lineBreak;
+			deserializeBytesBody += lineBreak;
 		}
 		serializeBody += "node[\"" + member.name + "\"] = Halley::ConfigNodeHelper<decltype(" + member.name + ")>::serialize(" + member.name + ", context);";
 		deserializeBody += "Halley::ConfigNodeHelper<decltype(" + member.name + ")>::deserialize(" + member.name + ", context, node[\"" + member.name + "\"]);";
+		serializeBytesBody += "s << " + member.name + ";";
+		deserializeBytesBody += "s >> " + member.name + ";";
 	}
 	serializeBody += lineBreak + "return node;";
 
@@ -260,6 +266,17 @@ Vector<String> CodegenCPP::generateComponentHeader(ComponentSchema component)
 		}, "deserialize"), deserializeBody)
 		.addBlankLine();
 
+	if (component.binarySerialize) {
+		gen.addMethodDefinition(MethodSchema(TypeSchema("void"), {
+				VariableSchema(TypeSchema("Halley::Serializer&"), "s")
+			}, "serialize", true), serializeBytesBody)
+			.addBlankLine()
+			.addMethodDefinition(MethodSchema(TypeSchema("void"), {
+				VariableSchema(TypeSchema("Halley::Deserializer&"), "s")
+			}, "deserialize"), deserializeBytesBody)
+			.addBlankLine();
+	}
+
 	gen.finish()
 		.writeTo(contents);
 
@@ -376,15 +393,18 @@ Vector<String> CodegenCPP::generateSystemHeader(SystemSchema& system, const Hash
 			return MemberSchema(TypeSchema(type, !comp.write), lowerFirst(comp.name));
 		});
 
+		Vector<String> familyComponents;
+		for (auto& comp: fam.components) {
+			const String constness = comp.write || !system.constComponents ? "" : "const ";
+			familyComponents.push_back(constness + (comp.optional ? "Halley::MaybeRef<" + comp.name + "Component>" : comp.name + "Component"));
+		}
+
 		sysClassGen
 			.addClass(CPPClassGenerator(upperFirst(fam.name) + "Family", "Halley::FamilyBaseOf<" + upperFirst(fam.name) + "Family>")
 				.setAccessLevel(MemberAccess::Public)
 				.addMembers(members)
 				.addBlankLine()
-				.addTypeDefinition("Type", "Halley::FamilyType<" + String::concatList(convert<ComponentReferenceSchema, String>(fam.components, [](auto& comp)
-				{
-					return comp.optional ? "Halley::MaybeRef<" + comp.name + "Component>" : comp.name + "Component";
-				}), ", ") + ">")
+				.addTypeDefinition("Type", "Halley::FamilyType<" + String::concatList(familyComponents, ", ") + ">")
 				.addBlankLine()
 				.setAccessLevel(MemberAccess::Protected)
 				.addConstructor(MemberSchema::toVariableSchema(members), false)
@@ -407,8 +427,10 @@ Vector<String> CodegenCPP::generateSystemHeader(SystemSchema& system, const Hash
 	// Entity messages
 	bool hasReceiveEntityMessage = false;
 	Vector<String> entityMsgsReceived;
+	Vector<String> entityMsgsSent;
 	for (auto& msg : system.messages) {
 		if (msg.send) {
+			entityMsgsSent.push_back(msg.name + "Message::messageIndex");
 			sysClassGen.addMethodDefinition(MethodSchema(TypeSchema("void"), { VariableSchema(TypeSchema("Halley::EntityId"), "entityId"), VariableSchema(TypeSchema(msg.name + "Message"), "msg") }, "sendMessage"), "sendMessageGeneric(entityId, std::move(msg));");
 		}
 		if (msg.receive) {
@@ -599,11 +621,17 @@ Vector<String> CodegenCPP::generateSystemHeader(SystemSchema& system, const Hash
 			}, "canHandleSystemMessage", true, false, true, true), canReceiveBody);
 	}
 
+	// Access declaration, used to schedule systems in parallel
+	const int exclusiveAccess = int(SystemAccess::API) | int(SystemAccess::World) | int(SystemAccess::Resources);
+	const bool exclusive = (int(system.access) & exclusiveAccess) != 0 || !system.systemMessages.empty();
+	const String servicesUsed = String::concatList(convert<ServiceSchema, String>(system.services, [](auto& service) { return "\"" + service.name + "\""; }), ", ");
+	const String declareAccess = String("declareAccess(") + (exclusive ? "true" : "false") + ", {" + servicesUsed + "}, {" + String::concatList(entityMsgsSent, ", ") + "});";
+
 	sysClassGen
 		.setAccessLevel(MemberAccess::Public)
 		.addCustomConstructor({}, {
 			VariableSchema(TypeSchema(""), "System", "{" + String::concatList(convert<FamilySchema, String>(system.families, [](auto& fam) { return "&" + fam.name + "Family"; }), ", ") + "}, {" + String::concatList(entityMsgsReceived, ", ") + "}")
-		}, { "static_assert(std::is_final_v<T>, \"System must be final.\");" })
+		}, { "static_assert(std::is_final_v<T>, \"System must be final.\");", declareAccess })
 		.finish()
 		.writeTo(contents);
 
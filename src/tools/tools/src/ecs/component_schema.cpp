@@ -52,6 +52,8 @@ ComponentSchema::ComponentSchema(YAML::Node node, bool generate)
 		customImplementation = node["customImplementation"].as<std::string>();
 	}
 
+	binarySerialize = node["binarySerialize"].as<bool>(false);
+
 	const auto deps = node["componentDependencies"];
 	if (deps.IsSequence()) {
 		for (auto n = deps.begin(); n != deps.end(); ++n) {
@@ -24,14 +24,19 @@ void AssetPackInspector::parse(const Bytes& bytes)
 	s >> headerSpan;
 	dataStartPos = header.dataStartPos;
 
-	Bytes tableData(header.dataStartPos - header.assetDbStartPos);
-	auto tableSpan = gsl::as_writable_bytes(gsl::span<Byte>(tableData.data(), tableData.size()));
-	s >> tableSpan;
-
-	rawTableSize = tableData.size();
-	auto rawTableData = Compression::decompress(tableData);
-	tableSize = rawTableData.size();
-	parseTable(Deserializer(rawTableData), bytes);
+	if (header.getVersion() >= 2) {
+		rawTableSize = tableSize = size_t(header.dataStartPos - header.assetDbStartPos);
+		parseDirectory(header, bytes);
+	} else {
+		Bytes tableData(header.dataStartPos - header.assetDbStartPos);
+		auto tableSpan = gsl::as_writable_bytes(gsl::span<Byte>(tableData.data(), tableData.size()));
+		memcpy(tableSpan.data(), bytes.data() + header.assetDbStartPos, tableSpan.size());
+
+		rawTableSize = tableData.size();
+		auto rawTableData = Compression::decompress(tableData);
+		tableSize = rawTableData.size();
+		parseTable(Deserializer(rawTableData), bytes);
+	}
 
 	// Generated sorted entries
 	sortedEntries.resize(entries.size());
@@ -80,6 +85,28 @@ void AssetPackInspector::parseTypedDB(Deserializer& s, const Bytes& packBytes)
 	}
 }
 
+void AssetPackInspector::parseDirectory(const AssetPackHeader& header, const Bytes& packBytes)
+{
+	const auto* directory = reinterpret_cast<const AssetPackDirectoryEntry*>(packBytes.data() + header.assetDbStartPos);
+	const auto* strings = reinterpret_cast<const char*>(packBytes.data() + header.stringTableStartPos);
+
+	entries.reserve(header.numEntries);
+	for (uint32_t i = 0; i < header.numEntries; ++i) {
+		AssetPackDirectoryEntry dirEntry;
+		memcpy(&dirEntry, directory + i, sizeof(dirEntry));
+
+		AssetDatabase::Entry entry;
+		entry.path = toString(dirEntry.pos) + ":" + toString(dirEntry.size);
+		if (dirEntry.compression != uint32_t(AssetPackCompression::None)) {
+			entry.path += ":" + toString(AssetPackCompression(dirEntry.compression));
+		}
+		entry.meta = Deserializer::fromBytes<Metadata>(gsl::as_bytes(gsl::span<const char>(strings + dirEntry.metadataOffset, dirEntry.metadataSize)));
+		auto hash = Hash::hash(gsl::as_bytes(gsl::span<const Byte>(packBytes.data() + dirEntry.pos + dataStartPos, size_t(dirEntry.size))));
+
+		entries.emplace_back(int(dirEntry.type), hash, String(strings + dirEntry.nameOffset, dirEntry.nameSize), std::move(entry));
+	}
+}
+
 void AssetPackInspector::computeHash()
 {
 	Hash::Hasher hasher;
@@ -111,7 +138,7 @@ void AssetPackInspector::printData() const
 		}
 
 		auto splitPath = entry.entry.path.split(':');
-		std::cout << "    [" << i << "] " << strCol << entry.key << stdCol << " [" << infoCol << toString(entry.hash, 16) << stdCol << "]: at " << infoCol << splitPath.at(0) << stdCol << ", " << infoCol << splitPath.at(1) << stdCol << " bytes, " << strCol << toString(entry.entry.meta) <<  stdCol << "\n";
+		std::cout << "    [" << i << "] " << strCol << entry.key << stdCol << " [" << infoCol << toString(entry.hash, 16) << stdCol << "]: at " << infoCol << splitPath.at(0) << stdCol << ", " << infoCol << splitPath.at(1) << stdCol << " bytes" << (splitPath.size() > 2 ? " (" + splitPath[2] + ")" : String()) << ", " << strCol << toString(entry.entry.meta) <<  stdCol << "\n";
 
 		++i;
 	}
@@ -3,13 +3,26 @@
 #include "halley/tools/packer/asset_packer.h"
 #include <yaml-cpp/yaml.h>
 #include "halley/tools/yaml/yaml_convert.h"
+#include "halley/resources/resource.h"
 using namespace Halley;
 
 AssetPackManifestEntry::AssetPackManifestEntry()
 {
 }
 
-AssetPackManifestEntry::AssetPackManifestEntry(const ConfigNode& node)
+namespace {
+	void readCompression(const ConfigNode& node, std::map<String, String>& compression)
+	{
+		if (node.hasKey("compression")) {
+			for (auto& [type, codec]: node["compression"].asMap()) {
+				compression[type] = codec.asString();
+			}
+		}
+	}
+}
+
+AssetPackManifestEntry::AssetPackManifestEntry(const ConfigNode& node, std::map<String, String> defaultCompression)
+	: compression(std::move(defaultCompression))
 {
 	name = node["name"].asString();
 	encryptionKey = node["encryptionKey"].asString("");
@@ -18,6 +31,7 @@ AssetPackManifestEntry::AssetPackManifestEntry(const ConfigNode& node)
 			matches.push_back(m.asString());
 		}
 	}
+	readCompression(node, compression);
 }
 
 const String& AssetPackManifestEntry::getName() const
@@ -45,6 +59,16 @@ const String& AssetPackManifestEntry::getEncryptionKey() const
 	return encryptionKey;
 }
 
+const String& AssetPackManifestEntry::getCompression(AssetType type) const
+{
+	static const String none = "none";
+	auto iter = compression.find(toString(type));
+	if (iter == compression.end()) {
+		iter = compression.find("default");
+	}
+	return iter != compression.end() ? iter->second : none;
+}
+
 AssetPackManifest::AssetPackManifest(const Bytes& data)
 {
 	load(YAMLConvert::parseConfig(data));
@@ -65,9 +89,13 @@ void AssetPackManifest::load(const ConfigFile& file)
 		}
 	}
 
+	// Compression set at the root applies to every pack, unless the pack overrides it
+	std::map<String, String> compression;
+	readCompression(root, compression);
+
 	if (root.hasKey("packs")) {
 		for (auto& p: root["packs"].asSequence()) {
-			packs.emplace_back(p);
+			packs.emplace_back(p, compression);
 		}
 	}
 }
@@ -26,9 +26,9 @@ AssetPackListing::AssetPackListing(String name, String encryptionKey)
 {
 }
 
-void AssetPackListing::addFile(AssetType type, const String& name, const AssetDatabase::Entry& entry)
+void AssetPackListing::addFile(AssetType type, const String& name, const AssetDatabase::Entry& entry, const String& compression)
 {
-	entries.push_back(Entry{ type, name, entry.path, entry.meta });
+	entries.push_back(Entry{ type, name, entry.path, entry.meta, compression });
 }
 
 const std::vector<AssetPackListing::Entry>& AssetPackListing::getEntries() const
@@ -92,9 +92,11 @@ std::map<String, AssetPackListing> AssetPacker::sortIntoPacks(const AssetPackMan
 			auto packEntry = manifest.getPack("~:" + assetName);
 			String packName;
 			String encryptionKey;
+			String compression = "none";
 			if (packEntry) {
 				packName = packEntry->get().getName();
 				encryptionKey = packEntry->get().getEncryptionKey();
+				compression = packEntry->get().getCompression(type);
 			}
 
 			// Retrieve pack
@@ -118,7 +120,7 @@ std::map<String, AssetPackListing> AssetPacker::sortIntoPacks(const AssetPackMan
 			}
 
 			// Add file to pack
-			iter->second.addFile(type, assetEntry.first, assetEntry.second);
+			iter->second.addFile(type, assetEntry.first, assetEntry.second, compression);
 		}
 	}
 
@@ -167,26 +169,30 @@ void AssetPacker::generatePacks(std::map<String, AssetPackListing> packs, const
 void AssetPacker::generatePack(const String& packId, const AssetPackListing& packListing, const Path& src, const Path& dst)
 {
 	AssetPack pack;
-	AssetDatabase& db = pack.getAssetDatabase();
-	Bytes& data = pack.getData();
 
 	for (auto& entry: packListing.getEntries()) {
 		//Logger::logDev("  [" + toString(entry.type) + "] " + entry.name);
 
 		// Read original file
 		auto fileData = FileSystem::readFile(src / entry.path);
-		const size_t pos = data.size();
-		const size_t size = fileData.size();
-		if (size == 0) {
+		if (fileData.empty()) {
 			throw Exception("Unable to pack: \"" + (src / entry.path) + "\". File not found or empty.", HalleyExceptions::Tools);
 		}
-		
-		// Read data into pack data
-		data.reserve(nextPowerOf2(pos + size));
-		data.resize(pos + size);
-		memcpy(data.data() + pos, fileData.data(), size);
 
-		db.addAsset(entry.name, entry.type, AssetDatabase::Entry(toString(pos) + ":" + toString(size), entry.metadata));
+		// Compress it, unless the importer already did
+		auto compression = AssetPackCompression::None;
+		int compressionLevel = -1;
+		if (entry.metadata.getString("asset_compression", "") != "deflate") {
+			if (entry.compression == "deflateFast") {
+				compression = AssetPackCompression::Deflate;
+				compressionLevel = 1;
+			} else {
+				compression = fromString<AssetPackCompression>(entry.compression);
+			}
+		}
+
+		// Read data into pack data, the directory is generated on writeOut
+		pack.addAsset(entry.type, entry.name, gsl::as_bytes(gsl::span<const Byte>(fileData)), entry.metadata, compression, compressionLevel);
 	}
 
 	if (!packListing.getEncryptionKey().isEmpty()) {
@@ -196,5 +202,5 @@ void AssetPacker::generatePack(const String& packId, const AssetPackListing& pac
 
 	// Write pack
 	FileSystem::writeFile(dst, pack.writeOut());
-	Logger::logInfo("- Packed " + toString(packListing.getEntries().size()) + " entries on \"" + packId + "\" (" + String::prettySize(data.size()) + ").");
+	Logger::logInfo("- Packed " + toString(packListing.getEntries().size()) + " entries on \"" + packId + "\" (" + String::prettySize(pack.getData().size()) + ").");
 }